@@ -1,9 +1,27 @@
 #include "AppEditorLogic.h"
 
+#include <UnigineConsole.h>
+#include <UnigineEngine.h>
+#include <UnigineFileSystem.h>
+#include <UnigineLog.h>
+#include <UnigineWorld.h>
+
+using namespace Unigine;
+using namespace Math;
+
+static ConsoleVariableInt pendulum_preview("pendulum_preview", "Animate a preview of the pendulum field in the editor", 1, 1, 0, 1);
+static ConsoleVariableFloat pendulum_preview_budget("pendulum_preview_budget", "Milliseconds per editor frame spent on the field preview", 1, 4.0f, 0.0f, 100.0f);
+static ConsoleVariableFloat pendulum_preview_duration("pendulum_preview_duration", "Length of the preview loop in seconds", 1, 10.0f, 0.1f, 600.0f);
+static ConsoleVariableInt pendulum_preview_instances("pendulum_preview_instances", "Maximum number of bobs drawn by the preview", 1, 16384, 0, 1 << 20);
+
 // Editor logic, it takes effect only when the UnigineEditor is loaded.
 // These methods are called right after corresponding editor script's (UnigineScript) methods.
 
 AppEditorLogic::AppEditorLogic()
+	: world_loaded(false)
+	, preview_size(0)
+	, preview_spacing(0.0f)
+	, preview_length(0.0f)
 {
 }
 
@@ -14,6 +32,12 @@ AppEditorLogic::~AppEditorLogic()
 int AppEditorLogic::init()
 {
 	// Write here code to be called on editor initialization.
+	Console::addCommand("pendulum_preview_length", "Sets the rod length of the previewed pendulums in a region: x0 y0 x1 y1 length",
+		MakeCallback(this, &AppEditorLogic::preview_length_command));
+	Console::addCommand("pendulum_preview_angle", "Sets the initial angle of the previewed pendulums in a region: x0 y0 x1 y1 angle",
+		MakeCallback(this, &AppEditorLogic::preview_angle_command));
+	Console::addCommand("pendulum_preview_restart", "Restarts the field preview loop",
+		MakeCallback(this, &AppEditorLogic::preview_restart_command));
 	return 1;
 }
 
@@ -24,6 +48,7 @@ int AppEditorLogic::init()
 int AppEditorLogic::update()
 {
 	// Write here code to be called before updating each render frame when editor is loaded.
+	update_preview();
 	return 1;
 }
 
@@ -41,23 +66,145 @@ int AppEditorLogic::render(const Unigine::EngineWindowViewportPtr &window)
 int AppEditorLogic::shutdown()
 {
 	// Write here code to be called on editor shutdown.
+	Console::removeCommand("pendulum_preview_length");
+	Console::removeCommand("pendulum_preview_angle");
+	Console::removeCommand("pendulum_preview_restart");
+	preview.shutdown();
 	return 1;
 }
 
 int AppEditorLogic::worldInit()
 {
 	// Write here code to be called on world initialization when editor is loaded.
+	world_loaded = true;
+	preview_size = 0;
 	return 1;
 }
 
 int AppEditorLogic::worldShutdown()
 {
 	// Write here code to be called on world shutdown when editor is loaded.
+	world_loaded = false;
+	preview.shutdown();
 	return 1;
 }
 
 int AppEditorLogic::worldSave()
 {
 	// Write here code to be called on world save when editor is loaded.
+	save_field();
 	return 1;
 }
+
+void AppEditorLogic::load_field()
+{
+	String path = FieldStorage::getWorldFile();
+	if (path.empty())
+		return;
+
+	PendulumField field;
+	if (!storage.load(path, field))
+		return;
+	Log::message("AppEditorLogic::load_field(): %d pendulums loaded from \"%s\" in %.2f ms (%.1f MB)\n", field.getNumPendulums(), path.get(),
+		storage.getTime(), storage.getFileSize() / 1048576.0);
+
+	// the authored field is kept until the lattice settings change
+	preview.init(field);
+	preview_size = Console::getInt("pendulum_field_size");
+	preview_spacing = Console::getFloat("pendulum_field_spacing");
+	preview_length = Console::getFloat("pendulum_field_length");
+}
+
+void AppEditorLogic::save_field()
+{
+	if (!preview.isInitialized())
+		return;
+
+	// the world keeps the GUID of the file, so it may be moved or renamed together with the world
+	String path = FieldStorage::getWorldFile();
+	if (path.empty())
+		path = String::extension(FileSystem::getAbsolutePath(World::getPath()), "pfield");
+
+	const PendulumField &field = preview.getInitialField();
+	if (!storage.save(path, field) || !FieldStorage::setWorldFile(path))
+	{
+		Log::error("AppEditorLogic::save_field(): can't save the field to \"%s\"\n", path.get());
+		return;
+	}
+	Log::message("AppEditorLogic::save_field(): %d pendulums saved to \"%s\" in %.2f ms, %d of %d chunks written (%.1f MB)\n",
+		field.getNumPendulums(), path.get(), storage.getTime(), storage.getNumWrittenChunks(), storage.getNumChunks(),
+		storage.getFileSize() / 1048576.0);
+}
+
+void AppEditorLogic::update_preview()
+{
+	if (!world_loaded || !pendulum_preview)
+	{
+		if (preview.isInitialized())
+			preview.shutdown();
+		preview_size = 0;
+		return;
+	}
+
+	// the field settings are owned by the world logic
+	int size = Console::getInt("pendulum_field_size");
+	float spacing = Console::getFloat("pendulum_field_spacing");
+	float length = Console::getFloat("pendulum_field_length");
+
+	preview.setBudget(pendulum_preview_budget);
+	preview.setDuration(pendulum_preview_duration);
+	preview.setMaxInstances(pendulum_preview_instances);
+	preview.setIntegrator(PendulumField::INTEGRATOR(Console::getInt("pendulum_field_integrator")));
+
+	// the authored field saved with the world comes first
+	if (!preview.isInitialized())
+		load_field();
+
+	// the lattice settings change the whole field, region edits are re-simulated incrementally
+	if (!preview.isInitialized() || size != preview_size || spacing != preview_spacing || length != preview_length)
+	{
+		preview.init(size, size, spacing, length);
+		preview_size = size;
+		preview_spacing = spacing;
+		preview_length = length;
+	}
+
+	preview.update(Engine::get()->getIFps());
+}
+
+bool AppEditorLogic::parse_region(int argc, char **argv, BoundBox &region, float &value)
+{
+	if (argc < 6)
+	{
+		Log::error("%s: x0 y0 x1 y1 value\n", argv[0]);
+		return false;
+	}
+	vec3 p0(String::atof(argv[1]), String::atof(argv[2]), -Consts::INF);
+	vec3 p1(String::atof(argv[3]), String::atof(argv[4]), Consts::INF);
+	region.set(min(p0, p1), max(p0, p1));
+	value = String::atof(argv[5]);
+	return true;
+}
+
+void AppEditorLogic::preview_length_command(int argc, char **argv)
+{
+	BoundBox region;
+	float value;
+	if (parse_region(argc, argv, region, value))
+		preview.setLength(region, value);
+}
+
+void AppEditorLogic::preview_angle_command(int argc, char **argv)
+{
+	BoundBox region;
+	float value;
+	if (parse_region(argc, argv, region, value))
+		preview.setAngle(region, value * Consts::DEG2RAD);
+}
+
+void AppEditorLogic::preview_restart_command(int argc, char **argv)
+{
+	UNIGINE_UNUSED(argc);
+	UNIGINE_UNUSED(argv);
+	preview.restart();
+}
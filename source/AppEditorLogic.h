@@ -3,6 +3,9 @@
 
 #include <UnigineLogic.h>
 
+#include "FieldPreview.h"
+#include "FieldStorage.h"
+
 class AppEditorLogic : public Unigine::EditorLogic
 {
 public:
@@ -19,6 +22,23 @@ public:
 	int worldInit() override;
 	int worldShutdown() override;
 	int worldSave() override;
+
+private:
+	void load_field();
+	void save_field();
+	void update_preview();
+	bool parse_region(int argc, char **argv, Unigine::Math::BoundBox &region, float &value);
+	void preview_length_command(int argc, char **argv);
+	void preview_angle_command(int argc, char **argv);
+	void preview_restart_command(int argc, char **argv);
+
+	FieldPreview preview;
+	FieldStorage storage;
+	bool world_loaded;
+	// field settings the preview was built with
+	int preview_size;
+	float preview_spacing;
+	float preview_length;
 };
 
 #endif // __APP_EDITOR_LOGIC_H__
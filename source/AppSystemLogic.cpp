@@ -1,12 +1,62 @@
 #include "AppSystemLogic.h"
+#include "FieldEnsemble.h"
+#include "FieldJobs.h"
 #include <UnigineComponentSystem.h>
+#include <UnigineConsole.h>
+#include <UnigineEngine.h>
+#include <UnigineLog.h>
+#include <UniginePhysics.h>
+#include <UnigineTimer.h>
+
+#include <stdio.h>
 
 using namespace Unigine;
 
+// number of consecutive frames close to the running average frame time after which startup is over
+static constexpr int STARTUP_STABLE_FRAMES = 60;
+
+static ConsoleVariableFloat pendulum_job_budget("pendulum_job_budget", "Milliseconds per frame spent in background field jobs", 1, 2.0f, 0.0f, 100.0f);
+// parameter sweeps run without a world, e.g. -video_app null -sound_app null -console_command "pendulum_sweep out.sweep && quit"
+static ConsoleVariableString pendulum_sweep_damping("pendulum_sweep_damping", "Damping values of the sweep: min max count", 1, "0.05 0.5 8");
+static ConsoleVariableString pendulum_sweep_frequency("pendulum_sweep_frequency", "Drive frequencies of the sweep in Hz: min max count", 1, "0.2 1.0 16");
+static ConsoleVariableString pendulum_sweep_coupling("pendulum_sweep_coupling", "Neighbour couplings of the sweep: min max count", 1, "0.0 4.0 8");
+static ConsoleVariableInt pendulum_sweep_size("pendulum_sweep_size", "Lattice size of every sweep variant", 1, 8, 1, 64);
+static ConsoleVariableFloat pendulum_sweep_amplitude("pendulum_sweep_amplitude", "Drive torque per unit of inertia of the sweep", 1, 1.0f, 0.0f, 100.0f);
+static ConsoleVariableFloat pendulum_sweep_duration("pendulum_sweep_duration", "Simulated seconds of every sweep variant", 1, 60.0f, 0.1f, 100000.0f);
+static ConsoleVariableFloat pendulum_sweep_transient("pendulum_sweep_transient", "Simulated seconds left out of the sweep averages", 1, 20.0f, 0.0f, 100000.0f);
+
+namespace
+{
+// "min max count" as count evenly spaced values, a single value as itself
+Vector<float> get_sweep_values(const char *range)
+{
+	Vector<float> ret;
+	float from = 0.0f;
+	float to = 0.0f;
+	int count = 1;
+	int num = sscanf(range, "%f %f %d", &from, &to, &count);
+	if (num < 1)
+		return ret;
+	if (num < 3 || count < 2)
+	{
+		ret.append(from);
+		return ret;
+	}
+	for (int i = 0; i < count; i++)
+		ret.append(Math::lerp(from, to, float(i) / (count - 1)));
+	return ret;
+}
+}
+
 // System logic, it exists during the application life cycle.
 // These methods are called right after corresponding system script's (UnigineScript) methods.
 
 AppSystemLogic::AppSystemLogic()
+	: start_time(0)
+	, stable_time(0)
+	, average_ifps(0.0f)
+	, num_stable_frames(0)
+	, startup_reported(false)
 {
 }
 
@@ -16,9 +66,14 @@ AppSystemLogic::~AppSystemLogic()
 
 int AppSystemLogic::init()
 {
+	start_time = Time::get();
+
 	// initialization for c++ component system
 	ComponentSystem::get()->initialize();
 
+	Console::addCommand("pendulum_sweep", "Runs the damping, drive frequency and coupling sweep of small fields and saves the results: [path]",
+		MakeCallback(this, &AppSystemLogic::sweep_command));
+
 	// Write here code to be called on engine initialization.
 	return 1;
 }
@@ -30,6 +85,10 @@ int AppSystemLogic::init()
 int AppSystemLogic::update()
 {
 	// Write here code to be called before updating each render frame.
+	update_startup_time();
+	// field jobs publish here, between the physics ticks of the world
+	FieldJobs::setBudget(pendulum_job_budget);
+	FieldJobs::update();
 	return 1;
 }
 
@@ -46,5 +105,55 @@ int AppSystemLogic::postUpdate()
 int AppSystemLogic::shutdown()
 {
 	// Write here code to be called on engine shutdown.
+	Console::removeCommand("pendulum_sweep");
 	return 1;
 }
+
+void AppSystemLogic::update_startup_time()
+{
+	if (startup_reported)
+		return;
+
+	// a frame is stable when its time stays within 25% of the running average
+	float ifps = Engine::get()->getIFps();
+	if (average_ifps > 0.0f && ifps < average_ifps * 1.25f)
+	{
+		if (num_stable_frames++ == 0)
+			stable_time = Time::get();
+	}
+	else
+		num_stable_frames = 0;
+	average_ifps = (average_ifps > 0.0f) ? Math::lerp(average_ifps, ifps, 0.1f) : ifps;
+
+	if (num_stable_frames < STARTUP_STABLE_FRAMES)
+		return;
+
+	Log::message("AppSystemLogic::update(): time to first stable frame %.2f ms (%.2f ms per frame)\n",
+		Time::microsecondsToMilliseconds(stable_time - start_time), average_ifps * 1000.0f);
+	startup_reported = true;
+}
+
+void AppSystemLogic::sweep_command(int argc, char **argv)
+{
+	const char *path = (argc > 1) ? argv[1] : "pendulum.sweep";
+
+	Vector<float> dampings = get_sweep_values(pendulum_sweep_damping.get());
+	Vector<float> frequencies = get_sweep_values(pendulum_sweep_frequency.get());
+	Vector<float> couplings = get_sweep_values(pendulum_sweep_coupling.get());
+	if (dampings.empty() || frequencies.empty() || couplings.empty())
+	{
+		Log::error("AppSystemLogic::sweep_command(): can't parse the sweep ranges\n");
+		return;
+	}
+
+	FieldEnsemble ensemble;
+	ensemble.setSize(pendulum_sweep_size);
+	ensemble.setAmplitude(pendulum_sweep_amplitude);
+	ensemble.createSweep(dampings, frequencies, couplings);
+	ensemble.run(pendulum_sweep_duration, pendulum_sweep_transient, Physics::getIFps());
+	if (!ensemble.save(path))
+		return;
+
+	Log::message("AppSystemLogic::sweep_command(): %d variants of %d pendulums in %.1f ms, saved to \"%s\"\n",
+		ensemble.getNumVariants(), ensemble.getSize() * ensemble.getSize(), ensemble.getTime(), path);
+}
@@ -15,6 +15,16 @@ public:
 	int postUpdate() override;
 
 	int shutdown() override;
+
+private:
+	void update_startup_time();
+	void sweep_command(int argc, char **argv);
+
+	long long start_time;
+	long long stable_time;
+	float average_ifps;
+	int num_stable_frames;
+	bool startup_reported;
 };
 
 #endif // __APP_SYSTEM_LOGIC_H__
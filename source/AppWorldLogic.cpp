@@ -1,9 +1,97 @@
 #include "AppWorldLogic.h"
+#include "DebugDraw.h"
+#include "FieldCache.h"
+#include "FieldRandom.h"
+#include "FieldSeriesReader.h"
+#include "JointChains.h"
+
+#include <UnigineConsole.h>
+#include <UnigineFileSystem.h>
+#include <UnigineGame.h>
+#include <UnigineInput.h>
+#include <UniginePhysics.h>
+#include <UnigineThread.h>
+#include <UnigineWindowManager.h>
+#include <UnigineWorld.h>
+
+#include <utility>
+
+using namespace Unigine;
+using namespace Math;
+
+static ConsoleVariableInt pendulum_field_size("pendulum_field_size", "Number of pendulums along each side of the field", 1, 128, 1, 4096);
+static ConsoleVariableFloat pendulum_field_spacing("pendulum_field_spacing", "Distance between neighbouring pivots", 1, 0.5f, 0.01f, 100.0f);
+static ConsoleVariableFloat pendulum_field_length("pendulum_field_length", "Rod length of the pendulums", 1, 2.0f, 0.01f, 100.0f);
+static ConsoleVariableInt pendulum_field_integrator("pendulum_field_integrator", "Field integrator (0 - semi-implicit Euler, 1 - adaptive Dormand-Prince, 2 - Forest-Ruth, 3 - Yoshida 6th order)", 1, 0, 0, PendulumField::NUM_INTEGRATORS - 1);
+static ConsoleVariableFloat pendulum_field_tolerance("pendulum_field_tolerance", "Error tolerance of the adaptive integrator", 1, 1e-4f, 1e-8f, 1e-1f);
+static ConsoleVariableFloat pendulum_sleep_energy("pendulum_sleep_energy", "Energy per unit mass below which a pendulum is at rest, 0 disables sleeping", 1, 1e-4f, 0.0f, 10.0f);
+static ConsoleVariableInt pendulum_sleep_ticks("pendulum_sleep_ticks", "Number of ticks at rest before a pendulum is put to sleep", 1, 30, 1, 10000);
+static ConsoleVariableInt pendulum_reorder_interval("pendulum_reorder_interval", "Ticks between merges of moved pendulums into the spatial storage order, 0 disables reordering", 1, 60, 0, 100000);
+static ConsoleVariableFloat pendulum_energy_report("pendulum_energy_report", "Interval in seconds between energy drift reports, 0 disables the monitor", 1, 0.0f, 0.0f, 3600.0f);
+static ConsoleVariableInt pendulum_field_numa("pendulum_field_numa", "Place field partitions on the NUMA nodes of their workers", 1, 1, 0, 1);
+static ConsoleVariableInt pendulum_field_huge_pages("pendulum_field_huge_pages", "Back the field arrays with transparent huge pages", 1, 0, 0, 1);
+static ConsoleVariableInt pendulum_task_graph("pendulum_task_graph", "Run the physics tick as a graph of chunk tasks instead of stage by stage", 1, 1, 0, 1);
+static ConsoleVariableInt pendulum_command_capacity("pendulum_command_capacity", "Number of field edits that can be queued between physics ticks", 1, 4096, 16, 1 << 20);
+static ConsoleVariableInt pendulum_brush_operation("pendulum_brush_operation", "Operation of the middle mouse brush (0 - impulse, 1 - damp, 2 - length)", 1, 0, 0, FieldBrush::NUM_OPERATIONS - 1);
+static ConsoleVariableFloat pendulum_brush_radius("pendulum_brush_radius", "Radius of the middle mouse brush", 1, 2.0f, 0.01f, 1000.0f);
+static ConsoleVariableFloat pendulum_brush_value("pendulum_brush_value", "Value of the brush operation: velocity, damped fraction or target length", 1, 0.5f, -100.0f, 100.0f);
+static ConsoleVariableFloat pendulum_brush_strength("pendulum_brush_strength", "Strength of the brush at its center", 1, 1.0f, 0.0f, 1.0f);
+static ConsoleVariableInt pendulum_field_cache("pendulum_field_cache", "Load the initialized field from the binary cache next to the world", 1, 1, 0, 1);
+static ConsoleVariableString pendulum_prewarm_meshes("pendulum_prewarm_meshes", "Semicolon separated meshes loaded before the field starts", 1, "");
+static ConsoleVariableInt pendulum_trail_length("pendulum_trail_length", "Number of history samples kept per bob trail", 1, 64, 2, 1024);
+static ConsoleVariableInt pendulum_trail_budget("pendulum_trail_budget", "Maximum number of trails drawn per frame", 1, 1024, 0, 65536);
+static ConsoleVariableString pendulum_trail_material("pendulum_trail_material", "Material of the trail ribbons", 1, "");
+static ConsoleVariableInt pendulum_debug_draw("pendulum_debug_draw", "Mask of enabled debug draw categories (velocity, bounds, chains)", 0, 0, 0, (1 << DebugDraw::NUM_CATEGORIES) - 1);
+static ConsoleVariableInt pendulum_debug_bounds_depth("pendulum_debug_bounds_depth", "Number of levels of the bob BVH drawn from the root by the bounds debug category", 1, 6, 1, 64);
+static ConsoleVariableInt pendulum_debug_budget("pendulum_debug_budget", "Maximum number of debug lines per frame", 1, 100000, 0, 10000000);
+static ConsoleVariableInt pendulum_field_paged("pendulum_field_paged", "Page an infinite field around the camera through a tileset file next to the world", 1, 0, 0, 1);
+static ConsoleVariableInt pendulum_page_radius("pendulum_page_radius", "Number of resident cells on each side of the camera cell in a paged field", 1, 4, 0, 64);
+static ConsoleVariableInt pendulum_page_size("pendulum_page_size", "Number of pendulums along each side of a cell in a paged field", 1, 32, 1, 1024);
+static ConsoleVariableFloat pendulum_rebase_distance("pendulum_rebase_distance", "Camera distance from the field origin that moves the origin to the camera, 0 disables rebasing", 1, 512.0f, 0.0f, 1e6f);
+static ConsoleVariableInt pendulum_spectrum("pendulum_spectrum", "Analyze the spectra of the lattice angles in the background", 1, 0, 0, 1);
+static ConsoleVariableInt pendulum_spectrum_window("pendulum_spectrum_window", "Number of ticks in the sliding window of the probe spectra, rounded down to a power of two", 1, 256, 16, 65536);
+static ConsoleVariableInt pendulum_spectrum_interval("pendulum_spectrum_interval", "Ticks between spectrum snapshots", 1, 15, 1, 10000);
+static ConsoleVariableInt pendulum_spectrum_capacity("pendulum_spectrum_capacity", "Number of spectra kept for readers", 1, 8, 1, 1024);
+static ConsoleVariableInt pendulum_sonify("pendulum_sonify", "Sound the field through binned voices placed over it", 1, 0, 0, 1);
+static ConsoleVariableInt pendulum_sonify_bins("pendulum_sonify_bins", "Number of voice bins along each side of the field", 1, 2, 1, 8);
+static ConsoleVariableInt pendulum_sonify_rate("pendulum_sonify_rate", "Sample rate of the sonified field", 1, 44100, 8000, 96000);
+static ConsoleVariableFloat pendulum_sonify_segment("pendulum_sonify_segment", "Length of the live segments in seconds, the latency of the sound", 1, 0.25f, 0.05f, 2.0f);
+static ConsoleVariableFloat pendulum_sonify_gain("pendulum_sonify_gain", "Gain of the mean bob speed of a voice", 1, 0.1f, 0.0f, 10.0f);
+static ConsoleVariableFloat pendulum_sonify_pitch("pendulum_sonify_pitch", "Scale from the natural frequency of a pendulum to its pitch", 1, 1250.0f, 1.0f, 100000.0f);
+static ConsoleVariableInt pendulum_chains("pendulum_chains", "Number of multi-link pendulums in a row next to the field", 1, 0, 0, 65536);
+static ConsoleVariableInt pendulum_chain_links("pendulum_chain_links", "Number of links of every multi-link pendulum", 1, 3, 1, PendulumChains::MAX_LINKS);
+static ConsoleVariableFloat pendulum_chain_length("pendulum_chain_length", "Length of a multi-link pendulum, split evenly between its links", 1, 2.0f, 0.01f, 100.0f);
+static ConsoleVariableInt pendulum_chain_substeps("pendulum_chain_substeps", "Runge-Kutta steps of the multi-link pendulums per physics tick", 1, 2, 1, 64);
+static ConsoleVariableInt pendulum_series("pendulum_series", "Record the field to a columnar series file next to the world", 1, 0, 0, 1);
+static ConsoleVariableInt pendulum_series_columns("pendulum_series_columns", "Mask of the recorded field arrays, bit 6 is the angle and bit 7 the angular velocity", 1,
+	(1 << PendulumField::ARRAY_THETA) | (1 << PendulumField::ARRAY_OMEGA), 1, (1 << PendulumField::NUM_ARRAYS) - 1);
+static ConsoleVariableInt pendulum_series_chunk("pendulum_series_chunk", "Ticks per chunk of the series, each of the three chunk buffers holds that many ticks of every column", 1, 32, 1, 4096);
+static ConsoleVariableInt pendulum_series_compress("pendulum_series_compress", "Compress the series blocks with lz4 when it pays", 1, 1, 0, 1);
+static ConsoleVariableInt pendulum_publish("pendulum_publish", "Publish the live field state to shared memory for external readers", 1, 0, 0, 1);
+static ConsoleVariableString pendulum_publish_name("pendulum_publish_name", "Shared memory name of the published field state", 1, "/pendulum_field");
+static ConsoleVariableInt pendulum_publish_columns("pendulum_publish_columns", "Mask of the published field arrays, bit 6 is the angle and bit 7 the angular velocity", 1,
+	(1 << PendulumField::ARRAY_THETA) | (1 << PendulumField::ARRAY_OMEGA), 1, (1 << PendulumField::NUM_ARRAYS) - 1);
+static ConsoleVariableInt pendulum_publish_frames("pendulum_publish_frames", "Frames of the published ring, a reader has that many publishes to copy a frame", 1, 8, 2, 1024);
+static ConsoleVariableInt pendulum_publish_interval("pendulum_publish_interval", "Physics ticks between published frames", 1, 1, 1, 1000);
+static ConsoleVariableString pendulum_prewarm_images("pendulum_prewarm_images", "Semicolon separated images loaded before the field starts", 1, "");
 
 // World logic, it takes effect only when the world is loaded.
 // These methods are called right after corresponding world script's (UnigineScript) methods.
 
 AppWorldLogic::AppWorldLogic()
+	: field_cached(false)
+	, field_stored(false)
+	, field_paged(false)
+	, selected_bob(-1)
+	, reorder_ticks(0)
+	, brush_dragging(false)
+	, energy_enabled(false)
+	, energy_report_time(0.0)
+	, num_jobs_published(0)
+	, num_lattices_published(0)
+	, spectrum_size_x(0)
+	, spectrum_size_y(0)
+	, spectrum_spacing(0.0f)
 {}
 
 AppWorldLogic::~AppWorldLogic()
@@ -12,6 +100,76 @@ AppWorldLogic::~AppWorldLogic()
 int AppWorldLogic::init()
 {
 	// Write here code to be called on world initialization: initialize resources for your world scene during the world start.
+	Timer timer;
+	timer.begin();
+
+	FieldMemory::setHugePages(pendulum_field_huge_pages != 0);
+	field.setNumaAware(pendulum_field_numa != 0);
+
+	// resources and the field are prewarmed behind the loading screen, the world starts only when all of them are resident
+	prepare_field_cache();
+	prewarm.addMeshes(pendulum_prewarm_meshes);
+	prewarm.addImages(pendulum_prewarm_images);
+	// loading an authored field is mostly reading, it goes to the file stream thread
+	field_storage_path = FieldStorage::getWorldFile();
+	field_pages_path = pendulum_field_paged ? String::format("%s.fieldpages", FileSystem::getAbsolutePath(World::getPath()).get()) : String();
+	PlayerPtr player = Game::getPlayer();
+	view_position = player ? player->getWorldPosition() : Vec3_zero;
+	prewarm.run(MakeCallback(this, &AppWorldLogic::init_field),
+		field_storage_path.empty() ? AsyncQueue::ASYNC_THREAD_BACKGROUND : AsyncQueue::ASYNC_THREAD_FILE_STREAM);
+	prewarm.wait();
+
+	if (field_stored)
+		Log::message("AppWorldLogic::init(): %d pendulums loaded from \"%s\" in %.2f ms (%.1f MB)\n", field.getNumPendulums(), field_storage_path.get(),
+			field_storage.getTime(), field_storage.getFileSize() / 1048576.0);
+	Log::message("AppWorldLogic::init(): %d pendulums initialized in %.2f ms (%s)\n", field.getNumPendulums(), timer.endMilliseconds(),
+		field_paged ? "paged" : (field_stored ? "authored" : (field_cached ? "cache hit" : (pendulum_field_cache ? "cache miss" : "cache disabled"))));
+
+	// storage follows the Morton order of the pivots so spatial neighbours share cache lines
+	if (pendulum_reorder_interval > 0)
+		field.reorder();
+	reorder_ticks = 0;
+	commands.init(pendulum_command_capacity);
+	bob_bvh.build(field);
+	trails.setMaterialPath(pendulum_trail_material);
+	trails.init(field, pendulum_trail_length, pendulum_trail_budget);
+	tick.init(field, bob_bvh, &trails);
+	DebugDraw::init(pendulum_debug_budget);
+	selected_bob = -1;
+	energy_enabled = false;
+	init_chains();
+	sonifier.init(pendulum_sonify_bins, pendulum_sonify_bins, pendulum_sonify_rate);
+	sonifier_path = String::format("%s.fieldvoice", FileSystem::getAbsolutePath(World::getPath()).get());
+	// only generated fields keep the lattice layout of the ids
+	spectrum_probes.clear();
+	if (!field_paged && !field_stored)
+		init_spectrum(pendulum_field_size, pendulum_field_size, pendulum_field_spacing);
+	Console::addCommand("pendulum_energy_max_step", "Prints the largest tick of every integrator that keeps the relative energy error within a budget: [budget] [duration]",
+		MakeCallback(this, &AppWorldLogic::energy_max_step_command));
+	Console::addCommand("pendulum_ray_benchmark", "Measures batched ray queries against the bob BVH of a lattice of its own: [rays] [size] [batches]",
+		MakeCallback(this, &AppWorldLogic::ray_benchmark_command));
+	Console::addCommand("pendulum_field_numa_benchmark", "Compares ticks of the default and the NUMA-aware field layouts: [ticks]",
+		MakeCallback(this, &AppWorldLogic::numa_benchmark_command));
+	Console::addCommand("pendulum_task_graph_benchmark", "Compares barrier idle time of the staged and the task graph ticks: [ticks]",
+		MakeCallback(this, &AppWorldLogic::task_graph_benchmark_command));
+	Console::addCommand("pendulum_origin_benchmark", "Measures bob precision and tick time of the field moved far from the world origin: [distance] [ticks]",
+		MakeCallback(this, &AppWorldLogic::origin_benchmark_command));
+	Console::addCommand("pendulum_reorder_benchmark", "Compares ticks of a shuffled and a Morton-ordered lattice through step, BVH refit and trails: [size] [ticks]",
+		MakeCallback(this, &AppWorldLogic::reorder_benchmark_command));
+	Console::addCommand("pendulum_field_rebuild", "Regenerates the field as a lattice in the background: [size] [spacing] [length]",
+		MakeCallback(this, &AppWorldLogic::field_rebuild_command));
+	Console::addCommand("pendulum_field_reseed", "Re-seeds the angles of the field in the background: [amplitude] [seed]",
+		MakeCallback(this, &AppWorldLogic::field_reseed_command));
+	Console::addCommand("pendulum_spectrum_probes", "Sets the pendulums whose angles are analyzed over time: [id...]",
+		MakeCallback(this, &AppWorldLogic::spectrum_probes_command));
+	Console::addCommand("pendulum_spectrum_report", "Prints the dominant wave vector and the probe frequencies of the newest lattice spectrum",
+		MakeCallback(this, &AppWorldLogic::spectrum_report_command));
+	Console::addCommand("pendulum_sonify_render", "Renders the sound of the field stepped ahead of time to a stereo WAV file: [path] [duration]",
+		MakeCallback(this, &AppWorldLogic::sonify_render_command));
+	Console::addCommand("pendulum_chain_benchmark", "Compares the reduced-coordinate chains with joint-based ones: [links] [chains] [duration]",
+		MakeCallback(this, &AppWorldLogic::chain_benchmark_command));
+	Console::addCommand("pendulum_series_benchmark", "Records a copy of the field to a series file and reads a slice back: [ticks] [compress]",
+		MakeCallback(this, &AppWorldLogic::series_benchmark_command));
 	return 1;
 }
 
@@ -22,6 +180,16 @@ int AppWorldLogic::init()
 int AppWorldLogic::update()
 {
 	// Write here code to be called before updating each render frame: specify all graphics-related functions you want to be called every frame while your application executes.
+	PlayerPtr player = Game::getPlayer();
+	if (player)
+		view_position = player->getWorldPosition();
+	update_jobs();
+	update_picking();
+	update_brush();
+	trails.update(Game::getPlayer(), bob_bvh);
+	update_debug_draw();
+	update_energy_report();
+	update_sonifier();
 	return 1;
 }
 
@@ -36,6 +204,57 @@ int AppWorldLogic::updatePhysics()
 	// Write here code to be called before updating each physics frame: control physics in your application and put non-rendering calculations.
 	// The engine calls updatePhysics() with the fixed rate (60 times per second by default) regardless of the FPS value.
 	// WARNING: do not create, delete or change transformations of nodes here, because rendering is already in progress.
+
+	// queued edits land between ticks, never while the workers are stepping
+	// brush strokes go first, they query the BVH that structural commands invalidate
+	brush.apply(field, bob_bvh);
+	commands.apply(field);
+	update_origin();
+	// cells paged in or out change the energy of the field, the monitor starts over
+	if (field_paged && pager.update(view_position, Physics::getIFps()))
+		energy_enabled = false;
+
+	// the physics tick stays fixed, the adaptive integrator sub-steps inside it per chunk
+	PendulumField::INTEGRATOR integrator = PendulumField::INTEGRATOR(pendulum_field_integrator.get());
+	bool energy_reset = (integrator != field.getIntegrator() || !energy_enabled);
+	field.setIntegrator(integrator);
+	field.setTolerance(pendulum_field_tolerance);
+	field.setSleepEnergy(pendulum_sleep_energy);
+	field.setSleepTicks(pendulum_sleep_ticks);
+
+	energy_enabled = (pendulum_energy_report > 0.0f);
+	if (energy_enabled && energy_reset)
+	{
+		energy.reset(field);
+		energy_report_time = 0.0;
+	}
+	if (pendulum_reorder_interval > 0 && ++reorder_ticks >= pendulum_reorder_interval)
+	{
+		field.updateOrder();
+		reorder_ticks = 0;
+	}
+	if (pendulum_task_graph)
+	{
+		tick.setEnergy(energy_enabled ? &energy : nullptr);
+		tick.run(Physics::getIFps());
+	}
+	else
+	{
+		field.step(Physics::getIFps());
+		if (energy_enabled)
+			energy.update(field, Physics::getIFps());
+		bob_bvh.update();
+		trails.record();
+	}
+	chains.setNumSubsteps(pendulum_chain_substeps);
+	chains.step(Physics::getIFps());
+	if (pendulum_spectrum)
+	{
+		spectrum.setInterval(pendulum_spectrum_interval);
+		spectrum.capture(field, Physics::getIFps());
+	}
+	update_series();
+	update_publisher();
 	return 1;
 }
 
@@ -46,6 +265,39 @@ int AppWorldLogic::updatePhysics()
 int AppWorldLogic::shutdown()
 {
 	// Write here code to be called on world shutdown: delete resources that were created during world script execution to avoid memory leaks.
+	Console::removeCommand("pendulum_energy_max_step");
+	Console::removeCommand("pendulum_ray_benchmark");
+	Console::removeCommand("pendulum_field_numa_benchmark");
+	Console::removeCommand("pendulum_task_graph_benchmark");
+	Console::removeCommand("pendulum_origin_benchmark");
+	Console::removeCommand("pendulum_reorder_benchmark");
+	Console::removeCommand("pendulum_field_rebuild");
+	Console::removeCommand("pendulum_field_reseed");
+	Console::removeCommand("pendulum_spectrum_probes");
+	Console::removeCommand("pendulum_spectrum_report");
+	Console::removeCommand("pendulum_sonify_render");
+	Console::removeCommand("pendulum_chain_benchmark");
+	Console::removeCommand("pendulum_series_benchmark");
+	FieldJobs::remove(&lattice_job);
+	FieldJobs::remove(&seed_job);
+	lattice_job.cancel();
+	seed_job.cancel();
+	spectrum.shutdown();
+	sonifier.shutdown();
+	series.close();
+	publisher.close();
+	chains.clear();
+	spectrum_size_x = 0;
+	spectrum_size_y = 0;
+	DebugDraw::shutdown();
+	tick.clear();
+	commands.shutdown();
+	trails.shutdown();
+	bob_bvh.clear();
+	pager.shutdown();
+	field_paged = false;
+	field.clear();
+	prewarm.clear();
 	return 1;
 }
 
@@ -62,3 +314,855 @@ int AppWorldLogic::restore(const Unigine::StreamPtr &stream)
 	UNIGINE_UNUSED(stream);
 	return 1;
 }
+
+void AppWorldLogic::prepare_field_cache()
+{
+	field_cache_path.clear();
+	if (!pendulum_field_cache)
+		return;
+
+	// the key covers everything the field is built from
+	struct
+	{
+		int size;
+		float spacing;
+		float length;
+		float gravity;
+		float damping;
+		float bob_radius;
+	} config = { pendulum_field_size, pendulum_field_spacing, pendulum_field_length, field.getGravity(), field.getDamping(), field.getBobRadius() };
+
+	String world_path = FileSystem::getAbsolutePath(World::getPath());
+	field_cache.beginKey();
+	field_cache.addKeyFile(world_path);
+	field_cache.addKeyData(&config, sizeof(config));
+	field_cache.endKey();
+
+	field_cache_path = String::format("%s.fieldcache", world_path.get());
+}
+
+void AppWorldLogic::init_field()
+{
+	// runs on an async thread during prewarm, a paged field takes precedence over the authored and the generated ones
+	field_paged = !field_pages_path.empty() && pager.init(field, field_pages_path, pendulum_page_radius, pendulum_page_size,
+		pendulum_field_spacing, pendulum_field_length, view_position);
+	if (field_paged)
+		return;
+
+	field_stored = !field_storage_path.empty() && field_storage.load(field_storage_path, field);
+	if (field_stored)
+		return;
+
+	field_cached = !field_cache_path.empty() && field_cache.load(field_cache_path, field);
+	if (field_cached)
+		return;
+
+	field.createLattice(pendulum_field_size, pendulum_field_size, pendulum_field_spacing, pendulum_field_length);
+	if (!field_cache_path.empty())
+		field_cache.save(field_cache_path, field);
+}
+
+void AppWorldLogic::update_picking()
+{
+	if (Console::isActive())
+		return;
+
+	// a right click pushes the selected pendulum, the impulse is applied on the next tick
+	if (Input::isMouseButtonDown(Input::MOUSE_BUTTON_RIGHT) && selected_bob != -1)
+		commands.impulse(selected_bob, 1.0f);
+
+	if (!Input::isMouseButtonDown(Input::MOUSE_BUTTON_LEFT))
+		return;
+
+	PlayerPtr player = Game::getPlayer();
+	EngineWindowViewportPtr window = WindowManager::getMainWindow();
+	if (!player || !window)
+		return;
+
+	// bob picking goes through the field BVH instead of World::getIntersection()
+	ivec2 mouse = Input::getMousePosition() - window->getClientPosition();
+	Vec3 p0, p1;
+	player->getDirectionFromMainWindow(p0, p1, mouse.x, mouse.y);
+	// the selection keeps the external id, slots change when the field is reordered
+	// the BVH is relative to the field origin
+	int slot = bob_bvh.getIntersection(vec3(p0 - field.getOrigin()), vec3(p1 - field.getOrigin()));
+	selected_bob = (slot != -1) ? field.getId(slot) : -1;
+	if (selected_bob != -1)
+		Log::message("AppWorldLogic::update_picking(): selected pendulum %d\n", selected_bob);
+}
+
+void AppWorldLogic::update_brush()
+{
+	PlayerPtr player = Game::getPlayer();
+	EngineWindowViewportPtr window = WindowManager::getMainWindow();
+	if (!Input::isMouseButtonPressed(Input::MOUSE_BUTTON_MIDDLE) || Console::isActive() || !player || !window)
+	{
+		brush_dragging = false;
+		return;
+	}
+
+	ivec2 mouse = Input::getMousePosition() - window->getClientPosition();
+	Vec3 p0, p1;
+	player->getDirectionFromMainWindow(p0, p1, mouse.x, mouse.y);
+	float fraction = 1.0f;
+	if (bob_bvh.getIntersection(vec3(p0 - field.getOrigin()), vec3(p1 - field.getOrigin()), &fraction) == -1)
+	{
+		brush_dragging = false;
+		return;
+	}
+
+	// a drag sweeps a capsule from the previous point so fast strokes leave no gaps
+	vec3 point = vec3(p0 - field.getOrigin()) + vec3(p1 - p0) * fraction;
+	FieldBrush::OPERATION operation = FieldBrush::OPERATION(pendulum_brush_operation.get());
+	if (brush_dragging)
+		brush.capsule(brush_point, point, pendulum_brush_radius, operation, pendulum_brush_value, pendulum_brush_strength);
+	else
+		brush.sphere(BoundSphere(point, pendulum_brush_radius), operation, pendulum_brush_value, pendulum_brush_strength);
+	brush_point = point;
+	brush_dragging = true;
+}
+
+void AppWorldLogic::update_debug_draw()
+{
+	for (int i = 0; i < DebugDraw::NUM_CATEGORIES; i++)
+		DebugDraw::setCategoryEnabled(DebugDraw::CATEGORY(i), (pendulum_debug_draw & (1 << i)) != 0);
+	DebugDraw::setBudget(pendulum_debug_budget);
+
+	if (DebugDraw::isCategoryEnabled(DebugDraw::CATEGORY_VELOCITY))
+	{
+		// bob velocities are emitted from the worker threads chunk by chunk
+		int num_chunks = field.getNumChunks();
+		AtomicInt32 next_chunk(0);
+		runSyncMultiThreadFunc([&](CPUShader *, int, int)
+		{
+			for (int chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++)
+			{
+				int begin, end;
+				field.getChunkRange(chunk, begin, end);
+				for (int i = begin; i < end; i++)
+				{
+					float s, c;
+					sincos(field.theta[i], s, c);
+					float speed = field.omega[i] * field.length[i];
+					vec3 velocity(field.direction_x[i] * c * speed, field.direction_y[i] * c * speed, s * speed);
+					DebugDraw::addVector(DebugDraw::CATEGORY_VELOCITY, field.getBob(i), velocity * 0.1f, vec4(0.2f, 1.0f, 0.2f, 1.0f));
+				}
+			}
+		});
+	}
+
+	if (DebugDraw::isCategoryEnabled(DebugDraw::CATEGORY_BOUNDS))
+	{
+		// deeper levels fade out, a full tree of a large field would spend the budget on its leaves
+		int num_levels = min(bob_bvh.getNumLevels(), pendulum_debug_bounds_depth.get());
+		for (int depth = 0; depth < num_levels; depth++)
+		{
+			float fade = 1.0f - 0.7f * depth / max(num_levels - 1, 1);
+			vec4 color(0.3f * fade, 0.6f * fade, 1.0f * fade, 1.0f);
+			for (int node : bob_bvh.getLevel(depth))
+			{
+				vec3 minimum, maximum;
+				bob_bvh.getNodeBounds(node, minimum, maximum);
+				DebugDraw::addBox(DebugDraw::CATEGORY_BOUNDS, minimum, maximum, color);
+			}
+		}
+	}
+
+	if (DebugDraw::isCategoryEnabled(DebugDraw::CATEGORY_CHAINS))
+	{
+		vec3 bobs[PendulumChains::MAX_LINKS];
+		for (int i = 0; i < chains.getNumChains(); i++)
+		{
+			chains.getBobs(i, bobs);
+			vec3 parent = chains.getAnchor(i);
+			for (int j = 0; j < chains.getNumLinks(); j++)
+			{
+				DebugDraw::addLine(DebugDraw::CATEGORY_CHAINS, parent, bobs[j], vec4(1.0f, 0.8f, 0.2f, 1.0f));
+				parent = bobs[j];
+			}
+		}
+	}
+
+	DebugDraw::setOrigin(field.getOrigin());
+	DebugDraw::flush(Game::getPlayer());
+}
+
+void AppWorldLogic::update_energy_report()
+{
+	if (!energy_enabled || energy.getTime() < energy_report_time + pendulum_energy_report)
+		return;
+
+	energy_report_time = energy.getTime();
+	Log::message("AppWorldLogic::update_energy_report(): %s, %.1f s simulated, energy %g, %g dissipated, drift %g\n",
+		PendulumField::getIntegratorName(field.getIntegrator()), energy.getTime(), energy.getEnergy(), energy.getDissipatedEnergy(), energy.getMaxDrift());
+}
+
+void AppWorldLogic::energy_max_step_command(int argc, char **argv)
+{
+	float budget = (argc > 1) ? String::atof(argv[1]) : 1e-3f;
+	float duration = (argc > 2) ? String::atof(argv[2]) : 60.0f;
+
+	Log::message("largest tick for %g relative energy error over %g s without damping:\n", budget, duration);
+	for (int i = 0; i < PendulumField::NUM_INTEGRATORS; i++)
+	{
+		PendulumField::INTEGRATOR integrator = PendulumField::INTEGRATOR(i);
+		float step = FieldEnergy::findMaxStep(field, integrator, budget, duration);
+		if (step > 0.0f)
+			Log::message("  %s: %g s\n", PendulumField::getIntegratorName(integrator), step);
+		else
+			Log::message("  %s: none\n", PendulumField::getIntegratorName(integrator));
+	}
+}
+
+void AppWorldLogic::ray_benchmark_command(int argc, char **argv)
+{
+	int num_rays = (argc > 1) ? max(String::atoi(argv[1]), 1) : 100000;
+	int size = (argc > 2) ? max(String::atoi(argv[2]), 1) : 1000;
+	int num_batches = (argc > 3) ? max(String::atoi(argv[3]), 1) : 10;
+	float ifps = Physics::getIFps();
+
+	// a lattice of its own, the target of 100k rays against 1M bobs is measured whatever the world holds
+	PendulumField lattice;
+	lattice.setBobRadius(field.getBobRadius());
+	lattice.createLattice(size, size, pendulum_field_spacing, pendulum_field_length);
+	lattice.step(ifps);
+	BobBVH lattice_bvh;
+	Timer timer;
+	timer.begin();
+	lattice_bvh.build(lattice);
+	double build_time = timer.endMilliseconds();
+
+	// picks from above: steep rays through the lattice at the points of a low-discrepancy sequence
+	float half_size = size * pendulum_field_spacing * 0.5f;
+	float length = pendulum_field_length;
+	Vector<vec3> p0(num_rays);
+	Vector<vec3> p1(num_rays);
+	Vector<int> hits(num_rays);
+	for (int i = 0; i < num_rays; i++)
+	{
+		double u = 0.5 + i * 0.7548776662466927;
+		double v = 0.5 + i * 0.5698402909980532;
+		float x = float(u - floor(u)) * 2.0f - 1.0f;
+		float y = float(v - floor(v)) * 2.0f - 1.0f;
+		p0[i] = vec3(x * half_size, y * half_size, length * 2.0f + 1.0f);
+		p1[i] = vec3(x * half_size + length * 0.3f, y * half_size - length * 0.2f, -1.0f);
+	}
+
+	lattice_bvh.getIntersections(p0.get(), p1.get(), num_rays, hits.get());
+	timer.begin();
+	for (int i = 0; i < num_batches; i++)
+		lattice_bvh.getIntersections(p0.get(), p1.get(), num_rays, hits.get());
+	double batch_time = timer.endMilliseconds() / num_batches;
+	int num_hits = 0;
+	for (int i = 0; i < num_rays; i++)
+		num_hits += (hits[i] != -1);
+
+	// the same rays one at a time on this thread
+	int num_single = min(num_rays, 10000);
+	timer.begin();
+	for (int i = 0; i < num_single; i++)
+		hits[i] = lattice_bvh.getIntersection(p0[i], p1[i]);
+	double single_time = timer.endMilliseconds() * num_rays / num_single;
+
+	Log::message("rays against %d bobs, %d nodes built in %.1f ms, %d hits of %d rays:\n", lattice.getNumPendulums(), lattice_bvh.getNumNodes(),
+		build_time, num_hits, num_rays);
+	Log::message("  batched: %.3f ms per batch, %.1f M rays per second on %d threads\n", batch_time, num_rays / max(batch_time, 1e-6) * 1e-3,
+		PoolCPUShaders::getNumThreads());
+	Log::message("  single thread: %.3f ms for the same rays, %.1f M rays per second\n", single_time, num_rays / max(single_time, 1e-6) * 1e-3);
+	Log::message("  batch %s the %.2f ms physics tick\n", (batch_time <= ifps * 1000.0f) ? "fits" : "exceeds", ifps * 1000.0f);
+}
+
+void AppWorldLogic::numa_benchmark_command(int argc, char **argv)
+{
+	int num_ticks = (argc > 1) ? max(String::atoi(argv[1]), 1) : 100;
+	float ifps = Physics::getIFps();
+
+	// copies of the field are written by the main thread, so the default layout ends up on its node
+	auto run = [&](bool numa_aware)
+	{
+		PendulumField copy = field;
+		copy.setNumaAware(numa_aware);
+		copy.step(ifps);
+
+		Timer timer;
+		timer.begin();
+		for (int i = 0; i < num_ticks; i++)
+			copy.step(ifps);
+		double time = timer.endMilliseconds() / num_ticks;
+		Log::message("  %s: %d partitions, %.3f ms per tick, %.1f M pendulums per second\n", numa_aware ? "numa" : "default",
+			copy.getNumPartitions(), time, copy.getNumActive() / max(time, 1e-6) * 1e-3);
+	};
+
+	Log::message("field layouts on %d NUMA nodes, huge pages %s, %d ticks of %d pendulums:\n", FieldMemory::getNumNodes(),
+		FieldMemory::isHugePages() ? "on" : "off", num_ticks, field.getNumPendulums());
+	run(false);
+	run(true);
+	if (FieldMemory::getNumNodes() == 1)
+		Log::message("  single node machine, both layouts are the same\n");
+}
+
+void AppWorldLogic::task_graph_benchmark_command(int argc, char **argv)
+{
+	int num_ticks = (argc > 1) ? max(String::atoi(argv[1]), 1) : 100;
+	float ifps = Physics::getIFps();
+
+	// both runs tick copies of the field from the same state, the trails are left out as they own a mesh node
+	auto run = [&](bool staged)
+	{
+		PendulumField copy = field;
+		BobBVH copy_bvh;
+		copy_bvh.build(copy);
+		FieldEnergy copy_energy;
+		copy_energy.reset(copy);
+		FieldTick copy_tick;
+		copy_tick.init(copy, copy_bvh);
+		copy_tick.setEnergy(&copy_energy);
+		copy_tick.run(ifps, staged);
+
+		double time = 0.0;
+		double idle = 0.0;
+		for (int i = 0; i < num_ticks; i++)
+		{
+			copy_tick.run(ifps, staged);
+			const FieldTaskGraph &graph = copy_tick.getGraph();
+			time += graph.getTime();
+			idle += graph.getIdleTime();
+		}
+		const FieldTaskGraph &graph = copy_tick.getGraph();
+		time /= num_ticks;
+		idle /= num_ticks;
+		Log::message("  %s: %.3f ms per tick, %.3f ms idle over %d workers (%.1f%%), %d steals\n", staged ? "staged" : "graph", time, idle,
+			graph.getNumWorkers(), idle / max(time * graph.getNumWorkers(), 1e-6) * 100.0, graph.getNumSteals());
+		return idle;
+	};
+
+	const FieldTaskGraph &graph = tick.getGraph();
+	Log::message("tick of %d pendulums, %d tasks and %d dependencies, %d ticks:\n", field.getNumPendulums(), graph.getNumTasks(),
+		graph.getNumDependencies(), num_ticks);
+	double staged_idle = run(true);
+	double graph_idle = run(false);
+	Log::message("  barrier idle time eliminated: %.3f ms per tick\n", staged_idle - graph_idle);
+}
+
+void AppWorldLogic::update_origin()
+{
+	// the float coordinates of the field follow the camera, so a field far from the world origin keeps its precision;
+	// everything that caches positions relative to the field origin moves with it
+	vec3 offset;
+	if (pendulum_rebase_distance <= 0.0f || !field.rebase(view_position, pendulum_rebase_distance, offset))
+		return;
+	bob_bvh.translate(offset);
+	trails.translate(offset);
+	chains.translate(offset);
+	brush_point += offset;
+}
+
+void AppWorldLogic::update_jobs()
+{
+	// AppSystemLogic::update() has advanced the jobs before the world, a published field starts a new energy baseline
+	int num_published = lattice_job.getNumPublished() + seed_job.getNumPublished();
+	if (num_published == num_jobs_published)
+		return;
+	if (lattice_job.getNumPublished() != num_lattices_published)
+	{
+		num_lattices_published = lattice_job.getNumPublished();
+		init_spectrum(lattice_job.getSizeX(), lattice_job.getSizeY(), lattice_job.getSpacing());
+	}
+	num_jobs_published = num_published;
+	energy_enabled = false;
+	if (selected_bob != -1 && !field.isValidId(selected_bob))
+		selected_bob = -1;
+}
+
+void AppWorldLogic::field_rebuild_command(int argc, char **argv)
+{
+	// the pages of a paged field own fixed ranges of ids
+	if (field_paged)
+	{
+		Log::warning("AppWorldLogic::field_rebuild_command(): a paged field can't be rebuilt\n");
+		return;
+	}
+
+	int size = (argc > 1) ? max(String::atoi(argv[1]), 1) : pendulum_field_size.get();
+	float spacing = (argc > 2) ? String::atof(argv[2]) : pendulum_field_spacing.get();
+	float length = (argc > 3) ? String::atof(argv[3]) : pendulum_field_length.get();
+
+	// a running rebuild is dropped, a queued re-seed restarts on the new layout once it is published
+	FieldJobs::remove(&lattice_job);
+	lattice_job.start(field, bob_bvh, size, size, spacing, length, pendulum_reorder_interval > 0);
+	FieldJobs::add(&lattice_job);
+	Log::message("AppWorldLogic::field_rebuild_command(): rebuilding %d pendulums in %.1f ms slices\n", size * size, FieldJobs::getBudget());
+}
+
+void AppWorldLogic::field_reseed_command(int argc, char **argv)
+{
+	float amplitude = (argc > 1) ? String::atof(argv[1]) : Consts::PI * 0.5f;
+	unsigned int seed = (argc > 2) ? (unsigned int)String::atoi(argv[2]) : (unsigned int)Time::get();
+
+	FieldJobs::remove(&seed_job);
+	seed_job.start(field, amplitude, seed);
+	FieldJobs::add(&seed_job);
+	Log::message("AppWorldLogic::field_reseed_command(): re-seeding %d pendulums with amplitude %.3f and seed %u\n", field.getNumPendulums(), amplitude, seed);
+}
+
+void AppWorldLogic::init_spectrum(int size_x, int size_y, float spacing)
+{
+	spectrum_size_x = size_x;
+	spectrum_size_y = size_y;
+	spectrum_spacing = spacing;
+
+	// the center of the lattice and a point halfway to its corner unless probes were chosen
+	Vector<int> probes;
+	for (int id : spectrum_probes)
+	{
+		if (id < size_x * size_y)
+			probes.append(id);
+	}
+	if (probes.empty())
+	{
+		probes.append((size_y / 2) * size_x + size_x / 2);
+		probes.append((size_y / 4) * size_x + size_x / 4);
+	}
+	spectrum.init(size_x, size_y, probes, pendulum_spectrum_window, pendulum_spectrum_capacity);
+}
+
+void AppWorldLogic::spectrum_probes_command(int argc, char **argv)
+{
+	if (spectrum_size_x == 0)
+	{
+		Log::warning("AppWorldLogic::spectrum_probes_command(): the field is not a generated lattice\n");
+		return;
+	}
+
+	spectrum_probes.clear();
+	for (int i = 1; i < argc; i++)
+		spectrum_probes.append(max(String::atoi(argv[i]), 0));
+	init_spectrum(spectrum_size_x, spectrum_size_y, spectrum_spacing);
+	Log::message("AppWorldLogic::spectrum_probes_command(): %d probes, the window starts over\n", spectrum_probes.empty() ? 2 : spectrum_probes.size());
+}
+
+void AppWorldLogic::spectrum_report_command(int argc, char **argv)
+{
+	UNIGINE_UNUSED(argc);
+	UNIGINE_UNUSED(argv);
+
+	FieldSpectrum::Spectrum result;
+	if (!spectrum.isInitialized() || !spectrum.getSpectrum(0, result))
+	{
+		Log::warning("AppWorldLogic::spectrum_report_command(): no spectrum yet, see pendulum_spectrum\n");
+		return;
+	}
+
+	// wave numbers are in cycles per meter, negative ky are the upper half of the rows
+	int num_x = result.size_x / 2 + 1;
+	int peak = 1;
+	for (int i = 1; i < result.spatial.size(); i++)
+	{
+		if (result.spatial[i] > result.spatial[peak])
+			peak = i;
+	}
+	int kx = peak % num_x;
+	int ky = peak / num_x;
+	if (ky >= result.size_y / 2 && result.size_y > 1)
+		ky -= result.size_y;
+	int row_peak = 1;
+	for (int k = 2; k < result.rows.size(); k++)
+	{
+		if (result.rows[k] > result.rows[row_peak])
+			row_peak = k;
+	}
+
+	Log::message("spectrum at %.2f s of a %dx%d region, analysis %.3f ms, %d of %d snapshots dropped:\n", result.time, result.size_x, result.size_y,
+		spectrum.getAnalysisTime(), spectrum.getNumDropped(), spectrum.getNumSpectra() + spectrum.getNumDropped());
+	Log::message("  dominant wave vector (%.4f, %.4f) cycles/m, power %g\n", kx / (result.size_x * spectrum_spacing),
+		ky / (result.size_y * spectrum_spacing), result.spatial[peak]);
+	Log::message("  dominant row wave number %.4f cycles/m, power %g\n", row_peak / (result.size_x * spectrum_spacing), result.rows[row_peak]);
+
+	// the small angle frequency of a free pendulum is the reference of the dispersion
+	int num_f = result.window / 2 + 1;
+	float step = 1.0f / (result.window * result.sample_step);
+	for (int i = 0; i < result.num_probes; i++)
+	{
+		const float *power = result.temporal.get() + i * num_f;
+		int id = spectrum.getProbe(i);
+		int bin = 1;
+		for (int k = 2; k < num_f; k++)
+		{
+			if (power[k] > power[bin])
+				bin = k;
+		}
+		if (!field.isValidId(id))
+		{
+			Log::message("  probe %d: removed\n", id);
+			continue;
+		}
+		if (power[bin] == 0.0f)
+		{
+			Log::message("  probe %d: window of %d ticks not filled yet\n", id, result.window);
+			continue;
+		}
+		float length = field.length[field.getSlot(id)];
+		Log::message("  probe %d: peak %.3f Hz +- %.3f, power %g, free pendulum %.3f Hz\n", id, bin * step, step * 0.5f, power[bin],
+			sqrt(field.getGravity() / length) / Consts::PI2);
+	}
+}
+
+void AppWorldLogic::update_sonifier()
+{
+	// the segments are rendered from the state of the field at the end of every frame
+	sonifier.setGain(pendulum_sonify_gain);
+	sonifier.setPitchScale(pendulum_sonify_pitch);
+	if (pendulum_sonify && !sonifier.isPlaying())
+		sonifier.start(sonifier_path, pendulum_sonify_segment);
+	else if (!pendulum_sonify && sonifier.isPlaying())
+		sonifier.stop();
+	sonifier.update(field, Game::getIFps());
+}
+
+void AppWorldLogic::sonify_render_command(int argc, char **argv)
+{
+	String path = (argc > 1) ? String(argv[1]) : String::format("%s.sonified.wav", FileSystem::getAbsolutePath(World::getPath()).get());
+	float duration = (argc > 2) ? max(String::atof(argv[2]), 0.1f) : 10.0f;
+
+	// the field itself keeps running, a copy is stepped at the physics rate
+	Timer timer;
+	timer.begin();
+	Vector<short> samples;
+	if (!sonifier.render(field, duration, Physics::getIFps(), samples))
+		return;
+	double time = timer.endMilliseconds();
+	if (!FieldSonifier::saveWav(path, samples.get(), samples.size() / 2, 2, sonifier.getSampleRate()))
+		return;
+	Log::message("AppWorldLogic::sonify_render_command(): %.1f s of %d pendulums in %d voices rendered to \"%s\" in %.1f ms\n", duration,
+		field.getNumPendulums(), sonifier.getNumVoices(), path.get(), time);
+}
+
+void AppWorldLogic::init_chains()
+{
+	chains.clear();
+	if (pendulum_chains == 0)
+		return;
+
+	// the row runs along the front edge of the lattice, every chain swings across it
+	int num = pendulum_chains;
+	int num_links = pendulum_chain_links;
+	float total = pendulum_chain_length;
+	float spacing = pendulum_field_spacing;
+	float y = -(pendulum_field_size * spacing * 0.5f + total);
+	chains.create(num, num_links, total / num_links, 1.0f);
+	chains.setGravity(field.getGravity());
+	for (int i = 0; i < num; i++)
+	{
+		chains.setAnchor(i, vec3((i - (num - 1) * 0.5f) * spacing, y, total), vec2(0.0f, 1.0f));
+		chains.theta[chains.getIndex(i, 0)] = 1.0f + 0.5f * i / num;
+	}
+}
+
+void AppWorldLogic::chain_benchmark_command(int argc, char **argv)
+{
+	int num_links = (argc > 1) ? clamp(String::atoi(argv[1]), 1, int(PendulumChains::MAX_LINKS)) : pendulum_chain_links.get();
+	int num_chains = (argc > 2) ? max(String::atoi(argv[2]), 1) : 1000;
+	float duration = (argc > 3) ? max(String::atof(argv[3]), 0.1f) : 1.0f;
+	float ifps = Physics::getIFps();
+	int num_ticks = max(int(duration / ifps + 0.5f), 1);
+	float l = pendulum_chain_length / num_links;
+
+	// every chain starts bent at its first two joints, the reference is the same chain with many more steps
+	auto create = [&](PendulumChains &ret, int num, int substeps)
+	{
+		ret.create(num, num_links, l, 1.0f);
+		ret.setGravity(field.getGravity());
+		ret.setNumSubsteps(substeps);
+		for (int i = 0; i < num; i++)
+		{
+			ret.setAnchor(i, vec3_zero, vec2(1.0f, 0.0f));
+			ret.theta[ret.getIndex(i, 0)] = 1.0f;
+			if (num_links > 1)
+				ret.theta[ret.getIndex(i, 1)] = 0.5f;
+		}
+	};
+	PendulumChains reference;
+	create(reference, 1, pendulum_chain_substeps * 32);
+	PendulumChains reduced;
+	create(reduced, num_chains, pendulum_chain_substeps);
+	JointChains joints;
+	joints.create(reduced);
+	joints.setNumIterations(Physics::getNumIterations());
+
+	double energy = reference.getEnergy(0);
+	double scale = max(Math::abs(energy), 1e-6);
+	double reduced_time = 0.0;
+	double joints_time = 0.0;
+	float reduced_error = 0.0f;
+	float joints_error = 0.0f;
+	double reduced_drift = 0.0;
+	double joints_drift = 0.0;
+	float joints_stretch = 0.0f;
+	vec3 bobs[PendulumChains::MAX_LINKS];
+	Timer timer;
+	for (int i = 0; i < num_ticks; i++)
+	{
+		reference.step(ifps);
+		timer.begin();
+		reduced.step(ifps);
+		reduced_time += timer.endMilliseconds();
+		timer.begin();
+		joints.step(ifps);
+		joints_time += timer.endMilliseconds();
+
+		// the free end of the first chain against the reference, in the swing plane
+		reference.getBobs(0, bobs);
+		vec2 end(bobs[num_links - 1].x, bobs[num_links - 1].z);
+		reduced.getBobs(0, bobs);
+		reduced_error = max(reduced_error, length(vec2(bobs[num_links - 1].x, bobs[num_links - 1].z) - end));
+		joints_error = max(joints_error, length(joints.getBob(0, num_links - 1) - end));
+		reduced_drift = max(reduced_drift, Math::abs(reduced.getEnergy(0) - energy) / scale);
+		joints_drift = max(joints_drift, Math::abs(joints.getEnergy(0) - energy) / scale);
+		joints_stretch = max(joints_stretch, joints.getStretch());
+	}
+
+	double num_steps = double(num_chains) * num_links * num_ticks;
+	Log::message("%d chains of %d links, %.2f s at %.0f Hz, errors of the free end against %d substeps:\n", num_chains, num_links, num_ticks * ifps,
+		1.0f / ifps, reference.getNumSubsteps());
+	Log::message("  reduced, %d substeps: %.3f ms per tick, %.1f M links per second, end error %.4f m, energy drift %.3f%%, stretch 0\n",
+		reduced.getNumSubsteps(), reduced_time / num_ticks, num_steps / (reduced_time * 1000.0), reduced_error, reduced_drift * 100.0);
+	Log::message("  joints, %d iterations: %.3f ms per tick, %.1f M links per second, end error %.4f m, energy drift %.3f%%, stretch %.2f%%\n",
+		joints.getNumIterations(), joints_time / num_ticks, num_steps / (joints_time * 1000.0), joints_error, joints_drift * 100.0,
+		joints_stretch * 100.0f);
+}
+
+void AppWorldLogic::update_series()
+{
+	// the pendulums recorded are the ones of the field when the recording starts
+	if (pendulum_series && !series.isOpened())
+	{
+		String path = String::format("%s.fieldseries", FileSystem::getAbsolutePath(World::getPath()).get());
+		if (series.open(path.get(), field, pendulum_series_columns, pendulum_series_chunk, pendulum_series_compress != 0))
+			Log::message("AppWorldLogic::update_series(): recording %d pendulums to \"%s\"\n", field.getNumIds(), path.get());
+		else
+			pendulum_series.set(0);
+	}
+	else if (!pendulum_series && series.isOpened())
+	{
+		series.close();
+		Log::message("AppWorldLogic::update_series(): %llu ticks recorded to \"%s\", %.1f MB\n", series.getNumTicks(), series.getPath(),
+			series.getFileSize() / 1048576.0);
+	}
+	series.capture(field, Physics::getIFps());
+}
+
+void AppWorldLogic::update_publisher()
+{
+	// the ring is recreated when the field outgrows it or the settings change, readers reopen it by name
+	bool reopen = pendulum_publish && publisher.isOpened() && (field.getNumIds() > publisher.getCapacity() || publisher.getColumns() != pendulum_publish_columns
+		|| publisher.getNumFrames() != pendulum_publish_frames || String::compare(publisher.getName(), pendulum_publish_name.get()) != 0);
+	if ((pendulum_publish && !publisher.isOpened()) || reopen)
+	{
+		if (publisher.open(pendulum_publish_name.get(), field, pendulum_publish_columns, pendulum_publish_frames))
+			Log::message("AppWorldLogic::update_publisher(): publishing %d pendulums to \"%s\", %.1f MB\n", field.getNumIds(),
+				publisher.getName(), publisher.getSize() / 1048576.0);
+		else
+			pendulum_publish.set(0);
+	}
+	else if (!pendulum_publish && publisher.isOpened())
+	{
+		Log::message("AppWorldLogic::update_publisher(): %lld frames published to \"%s\", last one took %.3f ms\n", publisher.getNumPublished(),
+			publisher.getName(), publisher.getPublishTime());
+		publisher.close();
+	}
+	publisher.setInterval(pendulum_publish_interval);
+	publisher.update(field, Physics::getIFps());
+}
+
+void AppWorldLogic::series_benchmark_command(int argc, char **argv)
+{
+	int num_ticks = (argc > 1) ? max(String::atoi(argv[1]), 1) : 600;
+	bool compress = (argc > 2) ? String::atoi(argv[2]) != 0 : pendulum_series_compress != 0;
+	String path = String::format("%s.benchmark.fieldseries", FileSystem::getAbsolutePath(World::getPath()).get());
+	float ifps = Physics::getIFps();
+
+	// the field itself keeps running, a copy is stepped at the physics rate
+	PendulumField copy = field;
+	FieldSeries recording;
+	if (!recording.open(path.get(), copy, pendulum_series_columns, pendulum_series_chunk, compress))
+		return;
+	double step_time = 0.0;
+	double capture_time = 0.0;
+	Timer timer;
+	Timer total;
+	total.begin();
+	for (int i = 0; i < num_ticks; i++)
+	{
+		timer.begin();
+		copy.step(ifps);
+		step_time += timer.endMilliseconds();
+		timer.begin();
+		recording.capture(copy, ifps);
+		capture_time += timer.endMilliseconds();
+	}
+	timer.begin();
+	bool closed = recording.close();
+	double close_time = timer.endMilliseconds();
+	double total_time = total.endMilliseconds();
+	if (!closed)
+		return;
+
+	// the last tick of the middle pendulum chunk is read back and compared with the field
+	FieldSeriesReader reader;
+	if (!reader.open(path.get()))
+		return;
+	int column = max(reader.findColumn(PendulumField::ARRAY_THETA), 0);
+	PendulumField::ARRAY array = reader.getColumnArray(column);
+	int begin = (reader.getNumPendulums() / 2) / FieldSeries::CHUNK_SIZE * FieldSeries::CHUNK_SIZE;
+	int end = min(begin + int(FieldSeries::CHUNK_SIZE), reader.getNumPendulums());
+	Vector<float> slice(end - begin);
+	timer.begin();
+	bool ret = reader.read(column, reader.getNumTicks() - 1, reader.getNumTicks(), begin, end, slice.get());
+	double read_time = timer.endMilliseconds();
+	int num_mismatches = 0;
+	const Vector<float> &values = copy.getArray(array);
+	for (int id = begin; id < end && ret; id++)
+		if (copy.isValidId(id) && slice[id - begin] != values[copy.getSlot(id)])
+			num_mismatches++;
+
+	double raw = recording.getRawSize() / 1048576.0;
+	Log::message("%d ticks of %d pendulums, %d columns, %d ticks per chunk, %s, kept in \"%s\":\n", num_ticks, reader.getNumPendulums(),
+		reader.getNumColumns(), reader.getTicksPerChunk(), compress ? "lz4" : "raw", path.get());
+	Log::message("  step %.3f ms, capture %.3f ms per tick, physics thread stalled %.1f ms, close %.1f ms\n", step_time / num_ticks,
+		capture_time / num_ticks, recording.getStallTime(), close_time);
+	Log::message("  %.1f MB raw, %.1f MB written (%.2fx), background %.1f MB/s, end to end %.1f MB/s\n", raw, recording.getFileSize() / 1048576.0,
+		raw * 1048576.0 / max(recording.getFileSize(), 1ULL), raw * 1000.0 / max(double(recording.getWriteTime()), 1e-3), raw * 1000.0 / total_time);
+	Log::message("  slice of %d pendulums read in %.3f ms, %d mismatches\n", end - begin, read_time, ret ? num_mismatches : end - begin);
+	reader.close();
+}
+
+void AppWorldLogic::origin_benchmark_command(int argc, char **argv)
+{
+	double distance = (argc > 1) ? String::atod(argv[1]) : 100000.0;
+	int num_ticks = (argc > 2) ? max(String::atoi(argv[2]), 1) : 100;
+	float ifps = Physics::getIFps();
+	Scalar step = Scalar(PendulumField::REBASE_STEP);
+
+	// bobs of the field moved by the distance are computed in float the way the tick does, either in world
+	// coordinates or relative to a rebased origin, and compared with the same bobs computed in double
+	auto measure = [&](double d, bool rebased, double &max_error, double &rms_error)
+	{
+		Vec3 center = field.getOrigin() + Vec3(Scalar(d), Scalar(d), Scalar(0.0));
+		Vec3 origin = rebased ? Vec3(Scalar(floorInt(center.x / step + Scalar(0.5))) * step, Scalar(floorInt(center.y / step + Scalar(0.5))) * step, Scalar(0.0)) : Vec3_zero;
+		max_error = 0.0;
+		rms_error = 0.0;
+		for (int i = 0; i < field.getNumPendulums(); i++)
+		{
+			double s = Math::sin(double(field.theta[i]));
+			double c = Math::cos(double(field.theta[i]));
+			dvec3 pivot = dvec3(center) + dvec3(field.getPivot(i));
+			dvec3 bob = pivot + dvec3(field.direction_x[i] * s * field.length[i], field.direction_y[i] * s * field.length[i], -c * field.length[i]);
+
+			float fs, fc;
+			Math::sincos(field.theta[i], fs, fc);
+			vec3 local = vec3(Vec3(pivot) - origin);
+			vec3 local_bob = vec3(local.x + field.direction_x[i] * fs * field.length[i], local.y + field.direction_y[i] * fs * field.length[i],
+				local.z - fc * field.length[i]);
+			double error = length(dvec3(origin) + dvec3(local_bob) - bob);
+			max_error = max(max_error, error);
+			rms_error += error * error;
+		}
+		rms_error = Math::sqrt(rms_error / max(field.getNumPendulums(), 1));
+	};
+
+	Log::message("bob position error of %d pendulums (world floats / rebased floats):\n", field.getNumPendulums());
+	for (double d : { 0.0, 1000.0, 10000.0, distance })
+	{
+		double max_world, rms_world, max_rebased, rms_rebased;
+		measure(d, false, max_world, rms_world);
+		measure(d, true, max_rebased, rms_rebased);
+		Log::message("  %10.0f m: max %.3e / %.3e m, rms %.3e / %.3e m\n", d, max_world, max_rebased, rms_world, rms_rebased);
+	}
+
+	// the tick reads float arrays only: a rebased field keeps small floats at any distance, moving the origin away
+	// from the field gives the floats of an unrebased one
+	auto run = [&](const Vec3 &position)
+	{
+		PendulumField copy = field;
+		vec3 offset;
+		copy.rebase(position, 0.0f, offset);
+		copy.step(ifps);
+		Timer timer;
+		timer.begin();
+		for (int i = 0; i < num_ticks; i++)
+		{
+			copy.step(ifps);
+			copy.updateBobs();
+		}
+		return timer.endMilliseconds() / num_ticks;
+	};
+	double near_time = run(field.getOrigin());
+	double far_time = run(field.getOrigin() - Vec3(Scalar(distance), Scalar(distance), Scalar(0.0)));
+	Log::message("tick with all bobs updated, %d ticks: %.3f ms rebased, %.3f ms with floats at %.0f m\n", num_ticks, near_time, far_time, distance);
+}
+
+void AppWorldLogic::reorder_benchmark_command(int argc, char **argv)
+{
+	int size = (argc > 1) ? max(String::atoi(argv[1]), 1) : 1000;
+	int num_ticks = (argc > 2) ? max(String::atoi(argv[2]), 1) : 100;
+	float ifps = Physics::getIFps();
+
+	// the lattice is added in a shuffled order, so neighbouring pendulums end up in unrelated cache lines
+	int num = size * size;
+	Vector<int> order(num);
+	for (int i = 0; i < num; i++)
+		order[i] = i;
+	for (int i = num - 1; i > 0; i--)
+		std::swap(order[i], order[min(int((get_random(i, 0x5eed) * 0.5f + 0.5f) * (i + 1)), i)]);
+	PendulumField shuffled;
+	shuffled.setBobRadius(field.getBobRadius());
+	shuffled.reserve(num);
+	for (int i = 0; i < num; i++)
+	{
+		vec3 pivot;
+		float angle;
+		PendulumField::getLatticePendulum(order[i], size, size, pendulum_field_spacing, pendulum_field_length, pivot, angle);
+		shuffled.addPendulum(pivot, vec2(1.0f, 0.0f), pendulum_field_length, angle);
+	}
+	vec3 offset;
+	shuffled.rebase(field.getOrigin(), 0.0f, offset);
+	PendulumField ordered = shuffled;
+	ordered.reorder();
+
+	// both copies tick from the same state with a BVH and trails of their own, the trails follow the camera
+	auto run = [&](PendulumField &copy, const char *name)
+	{
+		BobBVH copy_bvh;
+		copy_bvh.build(copy);
+		FieldTrails copy_trails;
+		copy_trails.init(copy, pendulum_trail_length, pendulum_trail_budget);
+		auto tick = [&]()
+		{
+			copy.step(ifps);
+			copy_bvh.update();
+			copy_trails.record();
+			copy_trails.update(Game::getPlayer(), copy_bvh);
+		};
+		tick();
+
+		bool counted = FieldMemory::beginCacheMisses();
+		Timer timer;
+		timer.begin();
+		for (int i = 0; i < num_ticks; i++)
+			tick();
+		double time = timer.endMilliseconds() / num_ticks;
+		long long misses = FieldMemory::endCacheMisses();
+		copy_trails.shutdown();
+
+		if (counted && misses >= 0)
+			Log::message("  %s: %.3f ms per tick, %.1f cache misses per pendulum and tick\n", name, time, double(misses) / num_ticks / max(num, 1));
+		else
+			Log::message("  %s: %.3f ms per tick\n", name, time);
+		return time;
+	};
+
+	Log::message("reorder of %d pendulums, %d ticks on %d threads:\n", num, num_ticks, PoolCPUShaders::getNumThreads());
+	double shuffled_time = run(shuffled, "shuffled");
+	double ordered_time = run(ordered, "morton");
+	Log::message("  morton order is %.2fx the speed of the shuffled layout\n", shuffled_time / max(ordered_time, 1e-6));
+}
@@ -4,6 +4,25 @@
 #include <UnigineLogic.h>
 #include <UnigineStreams.h>
 
+#include "BobBVH.h"
+#include "FieldBrush.h"
+#include "FieldCache.h"
+#include "FieldCommands.h"
+#include "FieldEnergy.h"
+#include "FieldLatticeJob.h"
+#include "FieldPager.h"
+#include "FieldPrewarm.h"
+#include "FieldPublisher.h"
+#include "FieldSeedJob.h"
+#include "FieldSeries.h"
+#include "FieldSonifier.h"
+#include "FieldSpectrum.h"
+#include "FieldStorage.h"
+#include "FieldTick.h"
+#include "FieldTrails.h"
+#include "PendulumChains.h"
+#include "PendulumField.h"
+
 class AppWorldLogic : public Unigine::WorldLogic
 {
 
@@ -21,6 +40,93 @@ public:
 
 	int save(const Unigine::StreamPtr &stream) override;
 	int restore(const Unigine::StreamPtr &stream) override;
+
+	// thread-safe entry point for edits of the field
+	FieldCommands &getFieldCommands() { return commands; }
+
+private:
+	void prepare_field_cache();
+	void init_field();
+	void update_picking();
+	void update_brush();
+	void update_debug_draw();
+	void update_energy_report();
+	void update_origin();
+	void update_jobs();
+	void init_spectrum(int size_x, int size_y, float spacing);
+	void update_sonifier();
+	void init_chains();
+	void update_series();
+	void update_publisher();
+	void energy_max_step_command(int argc, char **argv);
+	void ray_benchmark_command(int argc, char **argv);
+	void numa_benchmark_command(int argc, char **argv);
+	void task_graph_benchmark_command(int argc, char **argv);
+	void origin_benchmark_command(int argc, char **argv);
+	void reorder_benchmark_command(int argc, char **argv);
+	void field_rebuild_command(int argc, char **argv);
+	void field_reseed_command(int argc, char **argv);
+	void spectrum_probes_command(int argc, char **argv);
+	void spectrum_report_command(int argc, char **argv);
+	void sonify_render_command(int argc, char **argv);
+	void chain_benchmark_command(int argc, char **argv);
+	void series_benchmark_command(int argc, char **argv);
+
+	PendulumField field;
+	FieldCache field_cache;
+	Unigine::String field_cache_path;
+	bool field_cached;
+	// authored field saved by the editor next to the world
+	FieldStorage field_storage;
+	Unigine::String field_storage_path;
+	bool field_stored;
+	// infinite field paged around the view, cells outside of the window are kept in the file
+	FieldPager pager;
+	Unigine::String field_pages_path;
+	bool field_paged;
+	Unigine::Math::Vec3 view_position;
+	FieldPrewarm prewarm;
+	FieldCommands commands;
+
+	BobBVH bob_bvh;
+	FieldTrails trails;
+	int selected_bob;
+	int reorder_ticks;
+
+	FieldBrush brush;
+	bool brush_dragging;
+	Unigine::Math::vec3 brush_point;
+
+	FieldEnergy energy;
+	bool energy_enabled;
+	double energy_report_time;
+
+	FieldTick tick;
+
+	// rebuilds and re-seeds run in slices of the frame budget and swap their result in when done
+	FieldLatticeJob lattice_job;
+	FieldSeedJob seed_job;
+	int num_jobs_published;
+	int num_lattices_published;
+
+	// spectra of the lattice angles, analyzed in the background
+	FieldSpectrum spectrum;
+	Unigine::Vector<int> spectrum_probes;
+	int spectrum_size_x;
+	int spectrum_size_y;
+	float spectrum_spacing;
+
+	// a few binned voices sound the whole field
+	FieldSonifier sonifier;
+	Unigine::String sonifier_path;
+
+	// multi-link pendulums in a row next to the field
+	PendulumChains chains;
+
+	// columnar recording of the field, written in the background
+	FieldSeries series;
+	// live state for other processes through a shared-memory ring
+	FieldPublisher publisher;
 };
 
 #endif // __APP_WORLD_LOGIC_H__
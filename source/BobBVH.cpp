@@ -0,0 +1,823 @@
+#include "BobBVH.h"
+#include "PendulumField.h"
+
+#include <UnigineProfiler.h>
+#include <UnigineThread.h>
+#include <UnigineTimer.h>
+
+#include <algorithm>
+#include <limits.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+// number of leaves or queries taken by a worker at once
+constexpr int BATCH_SIZE = 64;
+// levels smaller than this are refitted on the calling thread
+constexpr int PARALLEL_LEVEL_SIZE = 4096;
+// nodes or bobs between clock checks of a sliced build
+constexpr int BUILD_SLICE_SIZE = 4096;
+
+float get_area(const vec3 &minimum, const vec3 &maximum)
+{
+	vec3 size = maximum - minimum;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+float get_box_distance2(const vec3 &point, const vec3 &minimum, const vec3 &maximum)
+{
+	vec3 d = max(max(minimum - point, point - maximum), vec3_zero);
+	return d.length2();
+}
+
+bool ray_box(const vec3 &point, const vec3 &idirection, const vec3 &minimum, const vec3 &maximum, float fraction)
+{
+	float tx0 = (minimum.x - point.x) * idirection.x;
+	float tx1 = (maximum.x - point.x) * idirection.x;
+	float ty0 = (minimum.y - point.y) * idirection.y;
+	float ty1 = (maximum.y - point.y) * idirection.y;
+	float tz0 = (minimum.z - point.z) * idirection.z;
+	float tz1 = (maximum.z - point.z) * idirection.z;
+	float t0 = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), 0.0f));
+	float t1 = min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), fraction));
+	return t0 <= t1;
+}
+
+bool ray_sphere(const vec3 &point, const vec3 &direction, const vec3 &center, float radius, float &fraction)
+{
+	vec3 m = point - center;
+	float a = dot(direction, direction);
+	float b = dot(m, direction);
+	float c = dot(m, m) - radius * radius;
+	if (c <= 0.0f)
+	{
+		fraction = 0.0f;
+		return true;
+	}
+	float d = b * b - a * c;
+	if (b > 0.0f || d < 0.0f || a < Consts::EPS)
+		return false;
+	fraction = (-b - sqrt(d)) / a;
+	return true;
+}
+
+float get_inverse(float v)
+{
+	return (abs(v) < Consts::EPS) ? 1e30f : 1.0f / v;
+}
+
+float get_median(float a, float b, float c)
+{
+	return max(min(a, b), min(max(a, b), c));
+}
+}
+
+BobBVH::BobBVH()
+	: field(nullptr)
+	, rebuild_threshold(1.6f)
+	, build_cost(0.0f)
+	, cost(0.0f)
+	, num_rebuilds(0)
+	, layout_version(0)
+{
+	sliced.stage = BUILD_DONE;
+}
+
+BobBVH::~BobBVH()
+{
+}
+
+void BobBVH::clear()
+{
+	field = nullptr;
+	nodes.clear();
+	indices.clear();
+	leaves.clear();
+	levels.clear();
+	subtrees.clear();
+	top_nodes.clear();
+	build_cost = 0.0f;
+	cost = 0.0f;
+}
+
+void BobBVH::build(const PendulumField &f)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	begin_build(f);
+	if (indices.empty())
+		return;
+
+	// the topology in one go, the bounds by the parallel refit
+	build_topology(LLONG_MAX);
+	refit();
+	build_cost = cost;
+	num_rebuilds++;
+	sliced.stage = BUILD_DONE;
+}
+
+void BobBVH::beginBuild(const PendulumField &f)
+{
+	begin_build(f);
+}
+
+bool BobBVH::updateBuild(long long end_time)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	if (sliced.stage == BUILD_INDICES || sliced.stage == BUILD_TOPOLOGY)
+	{
+		if (!build_topology(end_time))
+			return false;
+		sliced.stage = BUILD_LEAVES;
+		sliced.position = 0;
+	}
+
+	while (sliced.stage != BUILD_DONE)
+	{
+		if (Time::get() >= end_time)
+			return false;
+
+		int begin = sliced.position;
+		switch (sliced.stage)
+		{
+			case BUILD_LEAVES:
+			{
+				int end = min(begin + BUILD_SLICE_SIZE, leaves.size());
+				for (int i = begin; i < end; i++)
+					refit_leaf(nodes[leaves[i]]);
+				sliced.position = end;
+				if (end < leaves.size())
+					break;
+				sliced.stage = BUILD_LEVELS;
+				sliced.depth = levels.size() - 1;
+				sliced.position = 0;
+				break;
+			}
+			case BUILD_LEVELS:
+			{
+				if (sliced.depth < 0)
+				{
+					sliced.stage = BUILD_COST;
+					sliced.cost = 0.0f;
+					sliced.position = 0;
+					break;
+				}
+				const Vector<int> &level = levels[sliced.depth];
+				int end = min(begin + BUILD_SLICE_SIZE, level.size());
+				for (int i = begin; i < end; i++)
+					merge_children(nodes[level[i]]);
+				sliced.position = end;
+				if (end < level.size())
+					break;
+				sliced.depth--;
+				sliced.position = 0;
+				break;
+			}
+			case BUILD_COST:
+			{
+				int end = min(begin + BUILD_SLICE_SIZE, nodes.size());
+				sliced.cost += get_cost(begin, end);
+				sliced.position = end;
+				if (end < nodes.size())
+					break;
+				cost = build_cost = normalize_cost(sliced.cost);
+				num_rebuilds++;
+				sliced.stage = BUILD_DONE;
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	return true;
+}
+
+void BobBVH::translate(const vec3 &offset)
+{
+	for (Node &node : nodes)
+	{
+		node.minimum += offset;
+		node.maximum += offset;
+	}
+}
+
+void BobBVH::swap(BobBVH &other)
+{
+	using std::swap;
+
+	nodes.swap(other.nodes);
+	indices.swap(other.indices);
+	leaves.swap(other.leaves);
+	levels.swap(other.levels);
+	subtrees.swap(other.subtrees);
+	top_nodes.swap(other.top_nodes);
+	swap(build_cost, other.build_cost);
+	swap(cost, other.cost);
+
+	// the trees describe the pendulums their fields hold now, their topologies are new to the users of both
+	layout_version = field ? field->getLayoutVersion() : 0;
+	other.layout_version = other.field ? other.field->getLayoutVersion() : 0;
+	num_rebuilds++;
+	other.num_rebuilds++;
+	sliced.stage = other.sliced.stage = BUILD_DONE;
+}
+
+void BobBVH::begin_build(const PendulumField &f)
+{
+	field = &f;
+	layout_version = field->getLayoutVersion();
+	nodes.clear();
+	leaves.clear();
+	subtrees.clear();
+	top_nodes.clear();
+	for (Vector<int> &level : levels)
+		level.clear();
+
+	int num = field->getNumPendulums();
+	indices.resize(num);
+	sliced.stack.clear();
+	sliced.position = 0;
+	sliced.phase = SPLIT_BOUNDS;
+	if (num == 0)
+	{
+		build_cost = cost = 0.0f;
+		sliced.stage = BUILD_DONE;
+		return;
+	}
+
+	// median splits leave at least LEAF_SIZE / 2 bobs in a leaf, the node array never grows during the build
+	int max_leaves = num / (LEAF_SIZE / 2) + 1;
+	nodes.allocate(max_leaves * 2);
+	leaves.allocate(max_leaves);
+	nodes.append();
+	sliced.stack.append(BuildItem{ 0, 0, num, 0 });
+	sliced.stage = BUILD_INDICES;
+}
+
+bool BobBVH::build_topology(long long end_time)
+{
+	int num = indices.size();
+	if (sliced.stage == BUILD_INDICES)
+	{
+		while (sliced.position < num)
+		{
+			if (Time::get() >= end_time)
+				return false;
+			int end = min(sliced.position + BUILD_SLICE_SIZE * LEAF_SIZE, num);
+			for (int i = sliced.position; i < end; i++)
+				indices[i] = i;
+			sliced.position = end;
+		}
+		sliced.stage = BUILD_TOPOLOGY;
+		sliced.phase = SPLIT_BOUNDS;
+		sliced.position = sliced.stack.last().begin;
+	}
+
+	// the clock is checked every BUILD_SLICE_SIZE bobs, the state is consistent at every check
+	const float *bob[3] = { field->bob_x.get(), field->bob_y.get(), field->bob_z.get() };
+	int work = 0;
+	auto is_out_of_time = [&]()
+	{
+		return (++work % BUILD_SLICE_SIZE) == 0 && Time::get() >= end_time;
+	};
+
+	while (sliced.stack.size())
+	{
+		BuildItem item = sliced.stack.last();
+		if (item.end - item.begin <= LEAF_SIZE)
+		{
+			nodes[item.node].first = item.begin;
+			nodes[item.node].count = item.end - item.begin;
+			leaves.append(item.node);
+			sliced.stack.removeLast();
+			if (sliced.stack.size())
+				sliced.position = sliced.stack.last().begin;
+			continue;
+		}
+
+		// split at the median of the longest axis of the centroids
+		if (sliced.phase == SPLIT_BOUNDS)
+		{
+			if (sliced.position == item.begin)
+			{
+				sliced.minimum = vec3(Consts::INF);
+				sliced.maximum = vec3(-Consts::INF);
+			}
+			for (; sliced.position < item.end; sliced.position++)
+			{
+				if (is_out_of_time())
+					return false;
+				int index = indices[sliced.position];
+				vec3 p(bob[0][index], bob[1][index], bob[2][index]);
+				sliced.minimum = min(sliced.minimum, p);
+				sliced.maximum = max(sliced.maximum, p);
+			}
+			vec3 size = sliced.maximum - sliced.minimum;
+			sliced.axis = (size.x > size.y) ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+			sliced.low = item.begin;
+			sliced.high = item.end;
+			sliced.partitioning = false;
+			sliced.phase = SPLIT_SELECT;
+		}
+
+		// quickselect with three-way partitions, every element is a resumable step
+		int middle = (item.begin + item.end) / 2;
+		const float *coordinate = bob[sliced.axis];
+		while (true)
+		{
+			if (!sliced.partitioning)
+			{
+				if (sliced.high - sliced.low <= 1)
+					break;
+				sliced.pivot = get_median(coordinate[indices[sliced.low]], coordinate[indices[(sliced.low + sliced.high) / 2]],
+					coordinate[indices[sliced.high - 1]]);
+				sliced.less = sliced.low;
+				sliced.current = sliced.low;
+				sliced.greater = sliced.high;
+				sliced.partitioning = true;
+			}
+			while (sliced.current < sliced.greater)
+			{
+				if (is_out_of_time())
+					return false;
+				float c = coordinate[indices[sliced.current]];
+				if (c < sliced.pivot)
+					std::swap(indices[sliced.less++], indices[sliced.current++]);
+				else if (c > sliced.pivot)
+					std::swap(indices[sliced.current], indices[--sliced.greater]);
+				else
+					sliced.current++;
+			}
+			sliced.partitioning = false;
+			if (middle < sliced.less)
+				sliced.high = sliced.less;
+			else if (middle >= sliced.greater)
+				sliced.low = sliced.greater;
+			else
+				break;
+		}
+
+		int left = nodes.size();
+		nodes.append();
+		nodes.append();
+		nodes[item.node].first = left;
+		nodes[item.node].count = 0;
+
+		if (levels.size() <= item.depth)
+			levels.resize(item.depth + 1);
+		levels[item.depth].append(item.node);
+
+		// the left child is split first, nodes are numbered in depth-first order
+		sliced.stack.removeLast();
+		sliced.stack.append(BuildItem{ left + 1, middle, item.end, item.depth + 1 });
+		sliced.stack.append(BuildItem{ left, item.begin, middle, item.depth + 1 });
+		sliced.phase = SPLIT_BOUNDS;
+		sliced.position = item.begin;
+	}
+
+	split_subtrees(0, num);
+	std::reverse(top_nodes.begin(), top_nodes.end());
+	return true;
+}
+
+void BobBVH::refit_leaf(Node &node) const
+{
+	const float *bob_x = field->bob_x.get();
+	const float *bob_y = field->bob_y.get();
+	const float *bob_z = field->bob_z.get();
+
+	vec3 minimum(Consts::INF);
+	vec3 maximum(-Consts::INF);
+	for (int i = node.first; i < node.first + node.count; i++)
+	{
+		int index = indices[i];
+		vec3 p(bob_x[index], bob_y[index], bob_z[index]);
+		minimum = min(minimum, p);
+		maximum = max(maximum, p);
+	}
+	vec3 radius(field->getBobRadius());
+	node.minimum = minimum - radius;
+	node.maximum = maximum + radius;
+}
+
+void BobBVH::refit()
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	if (field == nullptr || nodes.empty())
+		return;
+
+	int num_leaves = leaves.size();
+	AtomicInt32 next_leaf(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		for (int begin = next_leaf.fetchAdd(BATCH_SIZE); begin < num_leaves; begin = next_leaf.fetchAdd(BATCH_SIZE))
+		{
+			int end = min(begin + BATCH_SIZE, num_leaves);
+			for (int i = begin; i < end; i++)
+				refit_leaf(nodes[leaves[i]]);
+		}
+	});
+
+	for (int depth = levels.size() - 1; depth >= 0; depth--)
+	{
+		const Vector<int> &level = levels[depth];
+		int num_nodes = level.size();
+		if (num_nodes < PARALLEL_LEVEL_SIZE)
+		{
+			for (int i = 0; i < num_nodes; i++)
+				merge_children(nodes[level[i]]);
+			continue;
+		}
+
+		AtomicInt32 next_node(0);
+		runSyncMultiThreadFunc([&](CPUShader *, int, int)
+		{
+			for (int begin = next_node.fetchAdd(BATCH_SIZE); begin < num_nodes; begin = next_node.fetchAdd(BATCH_SIZE))
+			{
+				int end = min(begin + BATCH_SIZE, num_nodes);
+				for (int i = begin; i < end; i++)
+					merge_children(nodes[level[i]]);
+			}
+		});
+	}
+
+	cost = get_cost();
+}
+
+void BobBVH::update()
+{
+	if (!updateLayout())
+		return;
+
+	refit();
+	if (cost > build_cost * rebuild_threshold)
+		build(*field);
+}
+
+bool BobBVH::updateLayout()
+{
+	if (field == nullptr)
+		return false;
+
+	if (nodes.empty() || indices.size() != field->getNumPendulums())
+	{
+		build(*field);
+		return false;
+	}
+
+	// a reordered field keeps the tree, only the indices are moved to the new slots
+	if (layout_version != field->getLayoutVersion())
+	{
+		const Vector<int> &order = field->getLastOrder();
+		if (layout_version + 1 != field->getLayoutVersion() || order.size() != indices.size())
+		{
+			build(*field);
+			return false;
+		}
+		remap.resize(order.size());
+		for (int i = 0; i < order.size(); i++)
+			remap[order[i]] = i;
+		for (int &index : indices)
+			index = remap[index];
+		layout_version = field->getLayoutVersion();
+	}
+	return true;
+}
+
+const int *BobBVH::getSubtreeBobs(int subtree, int &num) const
+{
+	// indices of a subtree are contiguous, from its leftmost to its rightmost leaf
+	int left = subtrees[subtree];
+	while (nodes[left].count == 0)
+		left = nodes[left].first;
+	int right = subtrees[subtree];
+	while (nodes[right].count == 0)
+		right = nodes[right].first + 1;
+	num = nodes[right].first + nodes[right].count - nodes[left].first;
+	return indices.get() + nodes[left].first;
+}
+
+void BobBVH::refitSubtree(int subtree)
+{
+	refit_subtree(subtrees[subtree]);
+}
+
+void BobBVH::refitTop()
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	if (field == nullptr || nodes.empty())
+		return;
+
+	for (int num : top_nodes)
+		merge_children(nodes[num]);
+
+	cost = get_cost();
+	if (cost > build_cost * rebuild_threshold)
+		build(*field);
+}
+
+void BobBVH::refit_subtree(int num)
+{
+	Node &node = nodes[num];
+	if (node.count)
+	{
+		refit_leaf(node);
+		return;
+	}
+	refit_subtree(node.first);
+	refit_subtree(node.first + 1);
+	merge_children(node);
+}
+
+void BobBVH::merge_children(Node &node)
+{
+	const Node &left = nodes[node.first];
+	const Node &right = nodes[node.first + 1];
+	node.minimum = min(left.minimum, right.minimum);
+	node.maximum = max(left.maximum, right.maximum);
+}
+
+void BobBVH::split_subtrees(int num, int size)
+{
+	const Node &node = nodes[num];
+	if (node.count || size <= SUBTREE_SIZE)
+	{
+		subtrees.append(num);
+		return;
+	}
+	// children first, so the nodes above the subtrees are listed bottom-up once reversed
+	top_nodes.append(num);
+	// sizes follow the median split of build_topology()
+	split_subtrees(node.first, size / 2);
+	split_subtrees(node.first + 1, size - size / 2);
+}
+
+float BobBVH::get_cost() const
+{
+	return normalize_cost(get_cost(0, nodes.size()));
+}
+
+float BobBVH::get_cost(int begin, int end) const
+{
+	float ret = 0.0f;
+	for (int i = begin; i < end; i++)
+	{
+		const Node &node = nodes[i];
+		ret += get_area(node.minimum, node.maximum) * (node.count ? node.count : 1);
+	}
+	return ret;
+}
+
+float BobBVH::normalize_cost(float node_cost) const
+{
+	// surface area heuristic normalized by the root area
+	const Node &root = nodes[0];
+	float root_area = get_area(root.minimum, root.maximum);
+	return (root_area < Consts::EPS) ? 0.0f : node_cost / root_area;
+}
+
+void BobBVH::getNodeBounds(int node, vec3 &minimum, vec3 &maximum) const
+{
+	minimum = nodes[node].minimum;
+	maximum = nodes[node].maximum;
+}
+
+float BobBVH::getQuality() const
+{
+	return (build_cost > Consts::EPS) ? cost / build_cost : 1.0f;
+}
+
+int BobBVH::getIntersection(const vec3 &p0, const vec3 &p1, float *fraction) const
+{
+	if (nodes.empty())
+		return -1;
+
+	const float *bob_x = field->bob_x.get();
+	const float *bob_y = field->bob_y.get();
+	const float *bob_z = field->bob_z.get();
+	float radius = field->getBobRadius();
+
+	vec3 direction = p1 - p0;
+	vec3 idirection(get_inverse(direction.x), get_inverse(direction.y), get_inverse(direction.z));
+
+	int ret = -1;
+	float best = 1.0f;
+
+	int stack[STACK_SIZE];
+	int depth = 0;
+	stack[depth++] = 0;
+	while (depth)
+	{
+		const Node &node = nodes[stack[--depth]];
+		if (!ray_box(p0, idirection, node.minimum, node.maximum, best))
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[depth++] = node.first;
+			stack[depth++] = node.first + 1;
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			int index = indices[i];
+			float t;
+			if (ray_sphere(p0, direction, vec3(bob_x[index], bob_y[index], bob_z[index]), radius, t) && t <= best)
+			{
+				best = t;
+				ret = index;
+			}
+		}
+	}
+
+	if (fraction)
+		*fraction = best;
+	return ret;
+}
+
+void BobBVH::getIntersections(const vec3 *p0, const vec3 *p1, int num_rays, int *ret) const
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	AtomicInt32 next_ray(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		for (int begin = next_ray.fetchAdd(BATCH_SIZE); begin < num_rays; begin = next_ray.fetchAdd(BATCH_SIZE))
+		{
+			int end = min(begin + BATCH_SIZE, num_rays);
+			for (int i = begin; i < end; i++)
+				ret[i] = getIntersection(p0[i], p1[i]);
+		}
+	});
+}
+
+template <typename Bound>
+void BobBVH::get_bobs(const Bound &bound, Vector<int> &ret) const
+{
+	ret.clear();
+	if (nodes.empty())
+		return;
+
+	const float *bob_x = field->bob_x.get();
+	const float *bob_y = field->bob_y.get();
+	const float *bob_z = field->bob_z.get();
+	float radius = field->getBobRadius();
+
+	int stack[STACK_SIZE];
+	int depth = 0;
+	stack[depth++] = 0;
+	while (depth)
+	{
+		const Node &node = nodes[stack[--depth]];
+		if (!bound.inside(node.minimum, node.maximum))
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[depth++] = node.first;
+			stack[depth++] = node.first + 1;
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			int index = indices[i];
+			if (bound.inside(vec3(bob_x[index], bob_y[index], bob_z[index]), radius))
+				ret.append(index);
+		}
+	}
+}
+
+void BobBVH::getBobs(const BoundSphere &bs, Vector<int> &ret) const
+{
+	get_bobs(bs, ret);
+}
+
+void BobBVH::getBobs(const BoundSphere *bs, int num_spheres, Vector<int> *ret) const
+{
+	AtomicInt32 next_sphere(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		for (int i = next_sphere++; i < num_spheres; i = next_sphere++)
+			get_bobs(bs[i], ret[i]);
+	});
+}
+
+void BobBVH::getBobs(const BoundFrustum &bf, Vector<int> &ret) const
+{
+	get_bobs(bf, ret);
+}
+
+void BobBVH::getBobs(const BoundFrustum *bf, int num_frustums, Vector<int> *ret) const
+{
+	AtomicInt32 next_frustum(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		for (int i = next_frustum++; i < num_frustums; i = next_frustum++)
+			get_bobs(bf[i], ret[i]);
+	});
+}
+
+void BobBVH::getBobs(const BoundBox &bb, Vector<int> &ret) const
+{
+	get_bobs(bb, ret);
+}
+
+void BobBVH::getBobs(const Capsule &capsule, Vector<int> &ret) const
+{
+	get_bobs(capsule, ret);
+}
+
+void BobBVH::getNearestBobs(const vec3 &point, int num, const BoundFrustum &bf, Vector<int> &ret) const
+{
+	ret.clear();
+	if (nodes.empty() || num <= 0)
+		return;
+
+	const float *bob_x = field->bob_x.get();
+	const float *bob_y = field->bob_y.get();
+	const float *bob_z = field->bob_z.get();
+	float radius = field->getBobRadius();
+
+	// best-first: nodes by the distance of their box, the bobs found so far in a heap with the farthest on top
+	struct Entry
+	{
+		float distance;
+		int index;
+	};
+	auto nearer = [](const Entry &e0, const Entry &e1) { return e0.distance > e1.distance; };
+	auto farther = [](const Entry &e0, const Entry &e1) { return e0.distance < e1.distance; };
+	Vector<Entry> queue;
+	Vector<Entry> found;
+	found.allocate(num);
+	queue.append(Entry{get_box_distance2(point, nodes[0].minimum, nodes[0].maximum), 0});
+	while (!queue.empty())
+	{
+		std::pop_heap(queue.begin(), queue.end(), nearer);
+		Entry entry = queue.last();
+		queue.removeLast();
+		// the nodes left are all farther than the farthest bob kept
+		if (found.size() == num && entry.distance >= found[0].distance)
+			break;
+
+		const Node &node = nodes[entry.index];
+		if (!bf.inside(node.minimum, node.maximum))
+			continue;
+
+		if (node.count == 0)
+		{
+			for (int child = node.first; child < node.first + 2; child++)
+			{
+				queue.append(Entry{get_box_distance2(point, nodes[child].minimum, nodes[child].maximum), child});
+				std::push_heap(queue.begin(), queue.end(), nearer);
+			}
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			int index = indices[i];
+			vec3 p(bob_x[index], bob_y[index], bob_z[index]);
+			if (!bf.inside(p, radius))
+				continue;
+			float distance = length2(p - point);
+			if (found.size() < num)
+			{
+				found.append(Entry{distance, index});
+				std::push_heap(found.begin(), found.end(), farther);
+			}
+			else if (distance < found[0].distance)
+			{
+				std::pop_heap(found.begin(), found.end(), farther);
+				found.last() = Entry{distance, index};
+				std::push_heap(found.begin(), found.end(), farther);
+			}
+		}
+	}
+
+	std::sort_heap(found.begin(), found.end(), farther);
+	ret.allocate(found.size());
+	for (const Entry &entry : found)
+		ret.appendFast(entry.index);
+}
+
+float BobBVH::Capsule::getDistance(const vec3 &point) const
+{
+	vec3 axis = p1 - p0;
+	float k = saturate(dot(point - p0, axis) / max(axis.length2(), Consts::EPS));
+	return (p0 + axis * k - point).length();
+}
+
+bool BobBVH::Capsule::inside(const vec3 &minimum, const vec3 &maximum) const
+{
+	vec3 capsule_min = min(p0, p1) - vec3(radius);
+	vec3 capsule_max = max(p0, p1) + vec3(radius);
+	return capsule_min.x <= maximum.x && capsule_max.x >= minimum.x && capsule_min.y <= maximum.y && capsule_max.y >= minimum.y
+		&& capsule_min.z <= maximum.z && capsule_max.z >= minimum.z;
+}
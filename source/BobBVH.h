@@ -0,0 +1,182 @@
+#ifndef __BOB_BVH_H__
+#define __BOB_BVH_H__
+
+#include <UnigineMathLib.h>
+#include <UnigineMathLibBounds.h>
+#include <UnigineVector.h>
+
+class PendulumField;
+
+// Bounding volume hierarchy over the bobs of a PendulumField.
+// The tree topology is built once and its bounds are refitted every tick; it is rebuilt only when
+// the refitted tree becomes too loose. All query results are pendulum slots of the field.
+class BobBVH
+{
+public:
+	// swept sphere between two points
+	struct Capsule
+	{
+		Capsule() {}
+		Capsule(const Unigine::Math::vec3 &p0_, const Unigine::Math::vec3 &p1_, float radius_) : p0(p0_), p1(p1_), radius(radius_) {}
+
+		float getDistance(const Unigine::Math::vec3 &point) const;
+		bool inside(const Unigine::Math::vec3 &point, float r) const { return getDistance(point) <= radius + r; }
+		// conservative, tests the box against the bounds of the capsule
+		bool inside(const Unigine::Math::vec3 &minimum, const Unigine::Math::vec3 &maximum) const;
+
+		Unigine::Math::vec3 p0;
+		Unigine::Math::vec3 p1;
+		float radius{0.0f};
+	};
+
+	BobBVH();
+	~BobBVH();
+
+	void clear();
+	void build(const PendulumField &field);
+	// build() in resumable slices for frame-budgeted jobs, updateBuild() returns true once the tree is ready;
+	// the field must not change in between
+	void beginBuild(const PendulumField &field);
+	bool updateBuild(long long end_time);
+	// exchanges the trees of two BVHs whose fields exchanged their pendulums with PendulumField::swap(),
+	// every tree stays bound to its own field
+	void swap(BobBVH &other);
+	// moves every node with the bobs after PendulumField::rebase(), the cost stays
+	void translate(const Unigine::Math::vec3 &offset);
+	// recomputes node bounds from the current bob positions keeping the topology
+	void refit();
+	// refits the tree and rebuilds it if the quality dropped below the threshold
+	void update();
+
+	// update() split for task schedulers: updateLayout() follows a resized or reordered field and returns false
+	// if the tree was rebuilt instead, then every subtree is refitted once the bobs under it are final, possibly
+	// concurrently, then refitTop() refits the nodes above the subtrees and rebuilds a loose tree
+	bool updateLayout();
+	int getNumSubtrees() const { return subtrees.size(); }
+	const int *getSubtreeBobs(int subtree, int &num) const;
+	void refitSubtree(int subtree);
+	void refitTop();
+
+	// rebuild is triggered when the refitted cost exceeds the cost after build by this factor
+	void setRebuildThreshold(float threshold) { rebuild_threshold = threshold; }
+	float getRebuildThreshold() const { return rebuild_threshold; }
+	// ratio of the current cost to the cost right after build, 1 for a freshly built tree
+	float getQuality() const;
+	int getNumNodes() const { return nodes.size(); }
+	// internal nodes grouped by depth, the root is the only node of level 0
+	int getNumLevels() const { return levels.size(); }
+	const Unigine::Vector<int> &getLevel(int depth) const { return levels[depth]; }
+	void getNodeBounds(int node, Unigine::Math::vec3 &minimum, Unigine::Math::vec3 &maximum) const;
+	int getNumRebuilds() const { return num_rebuilds; }
+
+	// closest bob hit by the segment p0-p1, returns -1 if there is none
+	int getIntersection(const Unigine::Math::vec3 &p0, const Unigine::Math::vec3 &p1, float *fraction = nullptr) const;
+	void getIntersections(const Unigine::Math::vec3 *p0, const Unigine::Math::vec3 *p1, int num_rays, int *ret) const;
+
+	void getBobs(const Unigine::Math::BoundSphere &bs, Unigine::Vector<int> &ret) const;
+	void getBobs(const Unigine::Math::BoundSphere *bs, int num_spheres, Unigine::Vector<int> *ret) const;
+	void getBobs(const Unigine::Math::BoundFrustum &bf, Unigine::Vector<int> &ret) const;
+	void getBobs(const Unigine::Math::BoundFrustum *bf, int num_frustums, Unigine::Vector<int> *ret) const;
+	void getBobs(const Unigine::Math::BoundBox &bb, Unigine::Vector<int> &ret) const;
+	void getBobs(const Capsule &capsule, Unigine::Vector<int> &ret) const;
+	// up to num bobs inside the frustum nearest to the point, nearest first; only the nodes closer than the
+	// farthest bob kept are visited, so the work follows num rather than the number of bobs in the frustum
+	void getNearestBobs(const Unigine::Math::vec3 &point, int num, const Unigine::Math::BoundFrustum &bf, Unigine::Vector<int> &ret) const;
+
+private:
+	enum
+	{
+		LEAF_SIZE = 8,
+		STACK_SIZE = 64,
+		// bobs under a subtree of the split refit, about a field chunk
+		SUBTREE_SIZE = 1024,
+	};
+
+	struct Node
+	{
+		Unigine::Math::vec3 minimum;
+		Unigine::Math::vec3 maximum;
+		int first; // first child for internal nodes, first index for leaves
+		int count; // number of indices for leaves, zero for internal nodes
+	};
+
+	// position of a build, the monolithic build goes through the same topology stages
+	enum BUILD_STAGE
+	{
+		BUILD_INDICES = 0,
+		BUILD_TOPOLOGY,
+		BUILD_LEAVES,
+		BUILD_LEVELS,
+		BUILD_COST,
+		BUILD_DONE,
+	};
+	enum SPLIT_PHASE
+	{
+		SPLIT_BOUNDS = 0,
+		SPLIT_SELECT,
+	};
+	// node waiting for its split
+	struct BuildItem
+	{
+		int node;
+		int begin;
+		int end;
+		int depth;
+	};
+	struct SlicedBuild
+	{
+		BUILD_STAGE stage;
+		int position;
+		int depth;
+		float cost;
+		Unigine::Vector<BuildItem> stack;
+		// split of the item on top of the stack: bounds of its bobs, then a quickselect of the median along the axis
+		SPLIT_PHASE phase;
+		Unigine::Math::vec3 minimum;
+		Unigine::Math::vec3 maximum;
+		int axis;
+		int low;
+		int high;
+		bool partitioning;
+		float pivot;
+		int less;
+		int current;
+		int greater;
+	};
+
+	void begin_build(const PendulumField &field);
+	bool build_topology(long long end_time);
+	void refit_leaf(Node &node) const;
+	void refit_subtree(int num);
+	void merge_children(Node &node);
+	void split_subtrees(int num, int size);
+	float get_cost() const;
+	float get_cost(int begin, int end) const;
+	float normalize_cost(float node_cost) const;
+
+	template <typename Bound>
+	void get_bobs(const Bound &bound, Unigine::Vector<int> &ret) const;
+
+	const PendulumField *field;
+
+	Unigine::Vector<Node> nodes;
+	Unigine::Vector<int> indices;
+	Unigine::Vector<int> leaves;
+	// internal nodes grouped by depth, refitted from the deepest level up
+	Unigine::Vector<Unigine::Vector<int>> levels;
+	// roots of the subtrees of the split refit and the internal nodes above them, children before parents
+	Unigine::Vector<int> subtrees;
+	Unigine::Vector<int> top_nodes;
+
+	float rebuild_threshold;
+	float build_cost;
+	float cost;
+	int num_rebuilds;
+
+	int layout_version;
+	Unigine::Vector<int> remap;
+
+	SlicedBuild sliced;
+};
+
+#endif // __BOB_BVH_H__
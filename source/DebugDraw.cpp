@@ -0,0 +1,341 @@
+#include "DebugDraw.h"
+
+#include <UnigineObjects.h>
+#include <UnigineProfiler.h>
+#include <UnigineThread.h>
+#include <UnigineWindowManager.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+// budget slots a thread takes from the shared counter at once
+constexpr int RESERVE_SIZE = 256;
+
+struct Line
+{
+	vec3 p0;
+	vec3 p1;
+	vec4 color;
+};
+
+struct ThreadBuffer
+{
+	Vector<Line> lines;
+	int num_reserved{0};
+};
+
+struct DebugDrawState
+{
+	Mutex mutex;
+	Vector<ThreadBuffer *> buffers;
+	// incremented on shutdown, thread buffers of an older generation are registered again
+	AtomicInt32 generation{0};
+
+	AtomicInt32 mask{(1 << DebugDraw::NUM_CATEGORIES) - 1};
+	AtomicInt32 num_reserved{0};
+	AtomicInt32 num_dropped{0};
+	int budget{0};
+	float line_width{1.5f};
+	String material_path;
+	Vec3 origin{Vec3_zero};
+
+	ObjectMeshDynamicPtr mesh;
+	Vector<ObjectMeshDynamic::Vertex> vertices;
+	int num_primitives{0};
+	int last_dropped{0};
+};
+
+DebugDrawState state;
+
+thread_local ThreadBuffer *thread_buffer = nullptr;
+thread_local int thread_generation = -1;
+
+ThreadBuffer *get_thread_buffer()
+{
+	int generation = state.generation;
+	if (thread_buffer && thread_generation == generation)
+		return thread_buffer;
+
+	thread_buffer = new ThreadBuffer();
+	thread_generation = generation;
+	ScopedLock lock(state.mutex);
+	state.buffers.append(thread_buffer);
+	return thread_buffer;
+}
+
+bool reserve(ThreadBuffer *buffer)
+{
+	if (buffer->num_reserved > 0)
+		return true;
+
+	int begin = state.num_reserved.fetchAdd(RESERVE_SIZE);
+	if (begin >= state.budget)
+	{
+		state.num_dropped++;
+		return false;
+	}
+	buffer->num_reserved = min(RESERVE_SIZE, state.budget - begin);
+	return true;
+}
+
+void clear_buffers()
+{
+	for (ThreadBuffer *buffer : state.buffers)
+	{
+		buffer->lines.clear();
+		buffer->num_reserved = 0;
+	}
+}
+
+void create_mesh()
+{
+	if (state.mesh)
+		state.mesh.deleteLater();
+	if (state.budget == 0)
+		return;
+
+	state.mesh = ObjectMeshDynamic::create(ObjectMeshDynamic::USAGE_DYNAMIC_VERTEX);
+	state.mesh->setName("debug_draw");
+	state.mesh->addSurface("lines");
+	state.mesh->setCastShadow(false, 0);
+	state.mesh->setCastWorldShadow(false, 0);
+	state.mesh->setIntersection(false, 0);
+	if (!state.material_path.empty())
+		state.mesh->setMaterialFilePath(state.material_path, 0);
+
+	// one quad per line, the index buffer covers the whole budget and never changes
+	Vector<int> indices;
+	indices.allocate(state.budget * 6);
+	for (int i = 0; i < state.budget; i++)
+	{
+		int v = i * 4;
+		indices.appendFast(v + 0);
+		indices.appendFast(v + 1);
+		indices.appendFast(v + 2);
+		indices.appendFast(v + 2);
+		indices.appendFast(v + 1);
+		indices.appendFast(v + 3);
+	}
+	state.mesh->setIndicesArray(indices.get(), indices.size());
+	state.mesh->flushIndices();
+	state.mesh->setEnabled(false);
+}
+}
+
+void DebugDraw::init(int budget)
+{
+	shutdown();
+	state.budget = max(budget, 0);
+	create_mesh();
+}
+
+void DebugDraw::shutdown()
+{
+	if (state.mesh)
+		state.mesh.deleteLater();
+	state.vertices.destroy();
+
+	ScopedLock lock(state.mutex);
+	for (ThreadBuffer *buffer : state.buffers)
+		delete buffer;
+	state.buffers.clear();
+	state.generation++;
+	state.num_reserved = 0;
+	state.num_dropped = 0;
+	state.num_primitives = 0;
+	state.last_dropped = 0;
+}
+
+void DebugDraw::setCategoryEnabled(CATEGORY category, bool enabled)
+{
+	if (enabled)
+		state.mask.fetchOr(1 << category);
+	else
+		state.mask.fetchAnd(~(1 << category));
+}
+
+bool DebugDraw::isCategoryEnabled(CATEGORY category)
+{
+	return (state.mask & (1 << category)) != 0;
+}
+
+void DebugDraw::setBudget(int budget)
+{
+	budget = max(budget, 0);
+	if (state.budget == budget)
+		return;
+	state.budget = budget;
+	create_mesh();
+}
+
+int DebugDraw::getBudget()
+{
+	return state.budget;
+}
+
+void DebugDraw::setLineWidth(float width)
+{
+	state.line_width = max(width, 0.0f);
+}
+
+float DebugDraw::getLineWidth()
+{
+	return state.line_width;
+}
+
+void DebugDraw::setOrigin(const Vec3 &origin)
+{
+	state.origin = origin;
+}
+
+const Vec3 &DebugDraw::getOrigin()
+{
+	return state.origin;
+}
+
+void DebugDraw::setMaterialPath(const char *path)
+{
+	state.material_path = path;
+	if (state.mesh && !state.material_path.empty())
+		state.mesh->setMaterialFilePath(state.material_path, 0);
+}
+
+void DebugDraw::addLine(CATEGORY category, const vec3 &p0, const vec3 &p1, const vec4 &color)
+{
+	if (!isCategoryEnabled(category) || state.budget == 0)
+		return;
+
+	ThreadBuffer *buffer = get_thread_buffer();
+	if (!reserve(buffer))
+		return;
+
+	Line &line = buffer->lines.append();
+	line.p0 = p0;
+	line.p1 = p1;
+	line.color = color;
+	buffer->num_reserved--;
+}
+
+void DebugDraw::addVector(CATEGORY category, const vec3 &position, const vec3 &direction, const vec4 &color)
+{
+	if (!isCategoryEnabled(category))
+		return;
+
+	float size = direction.length();
+	if (size < Consts::EPS)
+		return;
+
+	vec3 end = position + direction;
+	vec3 axis = (abs(direction.z) < size * 0.9f) ? vec3_up : vec3(1.0f, 0.0f, 0.0f);
+	vec3 side = normalize(cross(direction, axis)) * (size * 0.1f);
+	vec3 back = direction * -0.2f;
+	addLine(category, position, end, color);
+	addLine(category, end, end + back + side, color);
+	addLine(category, end, end + back - side, color);
+}
+
+void DebugDraw::addBox(CATEGORY category, const vec3 &minimum, const vec3 &maximum, const vec4 &color)
+{
+	if (!isCategoryEnabled(category))
+		return;
+
+	vec3 corners[8];
+	for (int i = 0; i < 8; i++)
+		corners[i] = vec3((i & 1) ? maximum.x : minimum.x, (i & 2) ? maximum.y : minimum.y, (i & 4) ? maximum.z : minimum.z);
+	// every edge joins two corners differing in a single axis bit
+	for (int i = 0; i < 8; i++)
+	{
+		for (int axis = 1; axis < 8; axis <<= 1)
+		{
+			if ((i & axis) == 0)
+				addLine(category, corners[i], corners[i | axis], color);
+		}
+	}
+}
+
+void DebugDraw::flush(const PlayerPtr &player)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	ScopedLock lock(state.mutex);
+
+	int num_lines = 0;
+	for (ThreadBuffer *buffer : state.buffers)
+		num_lines += buffer->lines.size();
+	num_lines = min(num_lines, state.budget);
+
+	state.num_primitives = num_lines;
+	state.last_dropped = state.num_dropped;
+	state.num_reserved = 0;
+	state.num_dropped = 0;
+
+	if (!state.mesh || num_lines == 0 || !player)
+	{
+		if (state.mesh)
+			state.mesh->setEnabled(false);
+		clear_buffers();
+		return;
+	}
+
+	ivec2 size = WindowManager::getMainWindow() ? WindowManager::getMainWindow()->getClientSize() : ivec2(1, 1);
+	vec3 camera = vec3(player->getWorldPosition() - state.origin);
+	// half width in world units at unit distance
+	float half_width = state.line_width * tan(player->getFov() * 0.5f * Consts::DEG2RAD) / max(size.y, 1);
+
+	state.vertices.resize(num_lines * 4);
+	ObjectMeshDynamic::Vertex *v = state.vertices.get();
+	BoundBox bound_box;
+	int num_written = 0;
+	for (ThreadBuffer *buffer : state.buffers)
+	{
+		for (const Line &line : buffer->lines)
+		{
+			if (num_written == num_lines)
+				break;
+
+			// camera-facing quad of constant screen-space width
+			vec3 center = (line.p0 + line.p1) * 0.5f;
+			vec3 side = cross(line.p1 - line.p0, center - camera);
+			float side_length = side.length();
+			side *= (side_length > Consts::EPS) ? half_width * (center - camera).length() / side_length : 0.0f;
+
+			v[0].xyz = line.p0 - side;
+			v[1].xyz = line.p0 + side;
+			v[2].xyz = line.p1 - side;
+			v[3].xyz = line.p1 + side;
+			for (int i = 0; i < 4; i++)
+			{
+				v[i].texcoord = vec4_zero;
+				v[i].tangent = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+				v[i].color = line.color;
+			}
+			v += 4;
+			num_written++;
+
+			bound_box.expand(line.p0);
+			bound_box.expand(line.p1);
+		}
+	}
+	clear_buffers();
+
+	state.mesh->setEnabled(true);
+	state.mesh->setWorldPosition(state.origin);
+	state.mesh->setVertexArray(state.vertices.get(), num_lines * 4);
+	state.mesh->setSurfaceBegin(0, 0);
+	state.mesh->setSurfaceEnd(num_lines * 6, 0);
+	state.mesh->setBoundBox(bound_box, 0);
+	state.mesh->setBoundBox(bound_box);
+	state.mesh->flushVertex();
+}
+
+int DebugDraw::getNumPrimitives()
+{
+	return state.num_primitives;
+}
+
+int DebugDraw::getNumDropped()
+{
+	return state.last_dropped;
+}
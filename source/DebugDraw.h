@@ -0,0 +1,48 @@
+#ifndef __DEBUG_DRAW_H__
+#define __DEBUG_DRAW_H__
+
+#include <UnigineMathLib.h>
+#include <UniginePlayers.h>
+
+// Batched debug drawing for the field stages.
+// Primitives are appended lock-free into per-thread buffers, so any worker thread may draw. Once per frame
+// flush() merges the buffers and submits them as a single dynamic mesh. Every category can be toggled and
+// the total number of primitives per frame is capped, primitives over the budget are dropped and counted.
+class DebugDraw
+{
+public:
+	enum CATEGORY
+	{
+		CATEGORY_VELOCITY = 0,
+		CATEGORY_BOUNDS,
+		CATEGORY_CHAINS,
+		NUM_CATEGORIES,
+	};
+
+	static void init(int budget);
+	static void shutdown();
+
+	static void setCategoryEnabled(CATEGORY category, bool enabled);
+	static bool isCategoryEnabled(CATEGORY category);
+	static void setBudget(int budget);
+	static int getBudget();
+	// line width in pixels
+	static void setLineWidth(float width);
+	static float getLineWidth();
+	static void setMaterialPath(const char *path);
+	// lines are given relative to the origin, usually the one of the field
+	static void setOrigin(const Unigine::Math::Vec3 &origin);
+	static const Unigine::Math::Vec3 &getOrigin();
+
+	static void addLine(CATEGORY category, const Unigine::Math::vec3 &p0, const Unigine::Math::vec3 &p1, const Unigine::Math::vec4 &color);
+	static void addVector(CATEGORY category, const Unigine::Math::vec3 &position, const Unigine::Math::vec3 &direction, const Unigine::Math::vec4 &color);
+	static void addBox(CATEGORY category, const Unigine::Math::vec3 &minimum, const Unigine::Math::vec3 &maximum, const Unigine::Math::vec4 &color);
+
+	// merges the thread buffers and uploads them, must be called on the main thread with no stage running
+	static void flush(const Unigine::PlayerPtr &player);
+
+	static int getNumPrimitives();
+	static int getNumDropped();
+};
+
+#endif // __DEBUG_DRAW_H__
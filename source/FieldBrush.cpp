@@ -0,0 +1,150 @@
+#include "FieldBrush.h"
+#include "PendulumField.h"
+
+#include <UnigineProfiler.h>
+
+#include <algorithm>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+// pendulums processed by a worker at once, smaller strokes run on the calling thread
+constexpr int BATCH_SIZE = 4096;
+// gathered arrays are processed in blocks that stay in the L1 cache
+constexpr int BLOCK_SIZE = 256;
+}
+
+FieldBrush::FieldBrush()
+	: num_affected(0)
+{
+}
+
+void FieldBrush::sphere(const BoundSphere &bs, OPERATION operation, float value, float strength)
+{
+	Stroke stroke = { SHAPE_SPHERE, operation, value, strength, bs.center, bs.center, bs.radius };
+	queue(stroke);
+}
+
+void FieldBrush::capsule(const vec3 &p0, const vec3 &p1, float radius, OPERATION operation, float value, float strength)
+{
+	Stroke stroke = { SHAPE_CAPSULE, operation, value, strength, p0, p1, radius };
+	queue(stroke);
+}
+
+void FieldBrush::box(const BoundBox &bb, OPERATION operation, float value, float strength)
+{
+	Stroke stroke = { SHAPE_BOX, operation, value, strength, bb.minimum, bb.maximum, 0.0f };
+	queue(stroke);
+}
+
+void FieldBrush::queue(const Stroke &stroke)
+{
+	ScopedLock lock(mutex);
+	strokes.append(stroke);
+}
+
+void FieldBrush::apply(PendulumField &field, const BobBVH &bvh)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	{
+		ScopedLock lock(mutex);
+		pending.swap(strokes);
+	}
+
+	num_affected = 0;
+	for (const Stroke &stroke : pending)
+		apply_stroke(field, bvh, stroke);
+	pending.clear();
+}
+
+void FieldBrush::apply_stroke(PendulumField &field, const BobBVH &bvh, const Stroke &stroke)
+{
+	switch (stroke.shape)
+	{
+		case SHAPE_SPHERE: bvh.getBobs(BoundSphere(stroke.p0, stroke.radius), indices); break;
+		case SHAPE_CAPSULE: bvh.getBobs(BobBVH::Capsule(stroke.p0, stroke.p1, stroke.radius), indices); break;
+		case SHAPE_BOX: bvh.getBobs(BoundBox(stroke.p0, stroke.p1), indices); break;
+	}
+	int num = indices.size();
+	if (num == 0)
+		return;
+	num_affected += num;
+
+	// slot order turns the gathers into forward walks through the arrays
+	std::sort(indices.begin(), indices.end());
+
+	if (num <= BATCH_SIZE)
+		apply_range(field, stroke, 0, num);
+	else
+	{
+		int num_batches = (num + BATCH_SIZE - 1) / BATCH_SIZE;
+		AtomicInt32 next_batch(0);
+		runSyncMultiThreadFunc([&](CPUShader *, int, int)
+		{
+			for (int batch = next_batch++; batch < num_batches; batch = next_batch++)
+				apply_range(field, stroke, batch * BATCH_SIZE, min((batch + 1) * BATCH_SIZE, num));
+		});
+	}
+
+	// waking writes shared chunk flags, it stays on the calling thread
+	for (int i = 0; i < num; i++)
+	{
+		if (field.isSleeping(indices[i]))
+			field.wake(indices[i]);
+	}
+}
+
+void FieldBrush::apply_range(PendulumField &field, const Stroke &stroke, int begin, int end)
+{
+	float weight[BLOCK_SIZE];
+	float l[BLOCK_SIZE];
+	float w[BLOCK_SIZE];
+
+	BobBVH::Capsule capsule(stroke.p0, stroke.p1, stroke.radius);
+	float iradius = 1.0f / max(stroke.radius, Consts::EPS);
+
+	for (int block = begin; block < end; block += BLOCK_SIZE)
+	{
+		const int *index = indices.get() + block;
+		int n = min(BLOCK_SIZE, end - block);
+
+		// gather and falloff, smooth towards the surface of spheres and capsules, flat inside boxes
+		for (int i = 0; i < n; i++)
+		{
+			l[i] = field.length[index[i]];
+			w[i] = field.omega[index[i]];
+			float k = (stroke.shape == SHAPE_BOX) ? 0.0f : saturate(capsule.getDistance(field.getBob(index[i])) * iradius);
+			weight[i] = (1.0f - k * k) * stroke.strength;
+		}
+
+		// branch-free operation over the block
+		switch (stroke.operation)
+		{
+			case OPERATION_IMPULSE:
+				for (int i = 0; i < n; i++)
+					w[i] += stroke.value * weight[i] / l[i];
+				break;
+			case OPERATION_DAMP:
+				for (int i = 0; i < n; i++)
+					w[i] *= 1.0f - saturate(stroke.value * weight[i]);
+				break;
+			case OPERATION_LENGTH:
+				for (int i = 0; i < n; i++)
+					l[i] = max(lerp(l[i], stroke.value, saturate(weight[i])), Consts::EPS);
+				break;
+			default:
+				break;
+		}
+
+		// scatter
+		for (int i = 0; i < n; i++)
+		{
+			field.length[index[i]] = l[i];
+			field.omega[index[i]] = w[i];
+		}
+		field.updateBobs(index, n);
+	}
+}
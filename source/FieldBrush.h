@@ -0,0 +1,74 @@
+#ifndef __FIELD_BRUSH_H__
+#define __FIELD_BRUSH_H__
+
+#include "BobBVH.h"
+
+#include <UnigineMathLibBounds.h>
+#include <UnigineThread.h>
+#include <UnigineVector.h>
+
+class PendulumField;
+
+// Area edits of a PendulumField.
+// A stroke is a world-space shape and an operation. Strokes can be queued at any rate from any thread and are
+// applied between ticks: the pendulums under a stroke are found through the bob BVH, sorted into slot order and
+// processed in one pass over gathered arrays, split between the workers for large strokes.
+class FieldBrush
+{
+public:
+	enum SHAPE
+	{
+		SHAPE_SPHERE = 0,
+		SHAPE_CAPSULE,
+		SHAPE_BOX,
+	};
+
+	enum OPERATION
+	{
+		// adds value m/s of tangential bob velocity
+		OPERATION_IMPULSE = 0,
+		// removes the value fraction of the angular velocity
+		OPERATION_DAMP,
+		// moves the rod length towards value by the strength fraction
+		OPERATION_LENGTH,
+		NUM_OPERATIONS,
+	};
+
+	struct Stroke
+	{
+		SHAPE shape;
+		OPERATION operation;
+		float value;
+		float strength;
+		// sphere and capsule use p0, p1 and radius, box uses minimum and maximum
+		Unigine::Math::vec3 p0;
+		Unigine::Math::vec3 p1;
+		float radius;
+	};
+
+	FieldBrush();
+
+	void sphere(const Unigine::Math::BoundSphere &bs, OPERATION operation, float value, float strength = 1.0f);
+	void capsule(const Unigine::Math::vec3 &p0, const Unigine::Math::vec3 &p1, float radius, OPERATION operation, float value, float strength = 1.0f);
+	void box(const Unigine::Math::BoundBox &bb, OPERATION operation, float value, float strength = 1.0f);
+	void queue(const Stroke &stroke);
+
+	// applies the queued strokes, must not be called while the field is stepping
+	void apply(PendulumField &field, const BobBVH &bvh);
+
+	// pendulums touched by the last apply()
+	int getNumAffected() const { return num_affected; }
+
+private:
+	void apply_stroke(PendulumField &field, const BobBVH &bvh, const Stroke &stroke);
+	void apply_range(PendulumField &field, const Stroke &stroke, int begin, int end);
+
+	Unigine::Mutex mutex;
+	Unigine::Vector<Stroke> strokes;
+	Unigine::Vector<Stroke> pending;
+
+	Unigine::Vector<int> indices;
+	int num_affected;
+};
+
+#endif // __FIELD_BRUSH_H__
@@ -0,0 +1,165 @@
+#include "FieldCache.h"
+#include "MappedFile.h"
+#include "PendulumField.h"
+
+#include <UnigineLog.h>
+#include <UnigineStreams.h>
+
+#include <string.h>
+
+using namespace Unigine;
+
+namespace
+{
+constexpr unsigned int CACHE_MAGIC = ('P' << 0) | ('F' << 8) | ('C' << 16) | ('H' << 24);
+constexpr unsigned int CACHE_VERSION = 1;
+// arrays start at cache line boundaries so the mapping can be read with aligned loads
+constexpr size_t CACHE_ALIGNMENT = 64;
+
+struct CacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int key[5];
+	int num_pendulums;
+	float gravity;
+	float damping;
+	float bob_radius;
+	unsigned int reserved;
+	unsigned long long offsets[PendulumField::NUM_ARRAYS];
+};
+
+size_t align(size_t offset)
+{
+	return (offset + CACHE_ALIGNMENT - 1) & ~(CACHE_ALIGNMENT - 1);
+}
+}
+
+FieldCache::FieldCache()
+{
+	beginKey();
+	endKey();
+}
+
+FieldCache::~FieldCache()
+{
+}
+
+void FieldCache::beginKey()
+{
+	sha1.begin();
+	unsigned int version = CACHE_VERSION;
+	sha1.update(&version, sizeof(version));
+}
+
+bool FieldCache::addKeyFile(const char *path)
+{
+	FilePtr file = File::create(path, "rb", false);
+	if (!file || !file->isOpened())
+		return false;
+
+	unsigned char buffer[64 * 1024];
+	size_t size;
+	while ((size = file->read(buffer, sizeof(buffer))) > 0)
+		sha1.update(buffer, size);
+	file->close();
+	return true;
+}
+
+void FieldCache::addKeyData(const void *data, size_t size)
+{
+	sha1.update(data, size);
+}
+
+void FieldCache::endKey()
+{
+	sha1.end(key, false);
+}
+
+bool FieldCache::load(const char *path, PendulumField &field) const
+{
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+
+	if (file.getSize() < sizeof(CacheHeader))
+		return false;
+
+	const CacheHeader &header = *reinterpret_cast<const CacheHeader *>(file.getData());
+	if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || memcmp(header.key, key, sizeof(key)) != 0)
+		return false;
+
+	if (header.num_pendulums < 0)
+		return false;
+	size_t array_size = sizeof(float) * header.num_pendulums;
+	for (int i = 0; i < PendulumField::NUM_ARRAYS; i++)
+	{
+		if (header.offsets[i] % CACHE_ALIGNMENT || header.offsets[i] + array_size > file.getSize())
+		{
+			Log::warning("FieldCache::load(): \"%s\" is truncated\n", path);
+			return false;
+		}
+	}
+
+	field.clear();
+	field.resize(header.num_pendulums);
+	for (int i = 0; i < PendulumField::NUM_ARRAYS; i++)
+	{
+		Vector<float> &array = field.getArray(PendulumField::ARRAY(i));
+		memcpy(array.get(), file.getData() + header.offsets[i], array_size);
+	}
+	field.setGravity(header.gravity);
+	field.setDamping(header.damping);
+	field.setBobRadius(header.bob_radius);
+	return true;
+}
+
+bool FieldCache::save(const char *path, const PendulumField &field) const
+{
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	memcpy(header.key, key, sizeof(key));
+	header.num_pendulums = field.getNumPendulums();
+	header.gravity = field.getGravity();
+	header.damping = field.getDamping();
+	header.bob_radius = field.getBobRadius();
+
+	size_t array_size = sizeof(float) * header.num_pendulums;
+	size_t offset = align(sizeof(CacheHeader));
+	for (int i = 0; i < PendulumField::NUM_ARRAYS; i++)
+	{
+		header.offsets[i] = offset;
+		offset = align(offset + array_size);
+	}
+
+	FilePtr file = File::create(path, "wb", false);
+	if (!file || !file->isOpened())
+	{
+		Log::error("FieldCache::save(): can't create \"%s\" file\n", path);
+		return false;
+	}
+
+	static const unsigned char padding[CACHE_ALIGNMENT] = {};
+	size_t position = 0;
+	auto write = [&](const void *data, size_t size)
+	{
+		if (file->write(data, size) != size)
+			return false;
+		position += size;
+		return true;
+	};
+
+	bool ret = write(&header, sizeof(header));
+	for (int i = 0; i < PendulumField::NUM_ARRAYS && ret; i++)
+	{
+		ret = write(padding, header.offsets[i] - position);
+		ret = ret && write(field.getArray(PendulumField::ARRAY(i)).get(), array_size);
+	}
+	file->close();
+
+	if (!ret)
+		Log::error("FieldCache::save(): can't write \"%s\" file\n", path);
+	return ret;
+}
@@ -0,0 +1,31 @@
+#ifndef __FIELD_CACHE_H__
+#define __FIELD_CACHE_H__
+
+#include <UnigineChecksum.h>
+
+class PendulumField;
+
+// Binary cache of a fully initialized PendulumField.
+// The cache is keyed by a SHA1 of everything the field is built from (the world file and the field settings),
+// a stale or foreign cache file is rejected on load. Loading maps the file and copies every array in one go,
+// there is no parsing and no per-pendulum work.
+class FieldCache
+{
+public:
+	FieldCache();
+	~FieldCache();
+
+	void beginKey();
+	bool addKeyFile(const char *path);
+	void addKeyData(const void *data, size_t size);
+	void endKey();
+
+	bool load(const char *path, PendulumField &field) const;
+	bool save(const char *path, const PendulumField &field) const;
+
+private:
+	Unigine::SHA1 sha1;
+	unsigned int key[5];
+};
+
+#endif // __FIELD_CACHE_H__
@@ -0,0 +1,289 @@
+#include "FieldCommands.h"
+#include "PendulumField.h"
+
+#include <UnigineProfiler.h>
+#include <UnigineTimer.h>
+
+#include <algorithm>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+// positions wrap around, the arithmetic is unsigned
+int advance(int pos, int num)
+{
+	return int(unsigned(pos) + unsigned(num));
+}
+
+int distance(int from, int to)
+{
+	return int(unsigned(to) - unsigned(from));
+}
+}
+
+FieldCommands::FieldCommands()
+	: mask(0)
+	, enqueue_pos(0)
+	, dequeue_pos(0)
+	, num_dropped(0)
+	, num_applied(0)
+	, num_coalesced(0)
+	, average_latency(0.0f)
+	, max_latency(0.0f)
+{
+}
+
+FieldCommands::~FieldCommands()
+{
+	shutdown();
+}
+
+void FieldCommands::init(int capacity)
+{
+	shutdown();
+
+	int size = 1;
+	while (size < capacity)
+		size <<= 1;
+	cells.resize(size);
+	for (int i = 0; i < size; i++)
+		cells[i].sequence = i;
+	mask = size - 1;
+	enqueue_pos = 0;
+	dequeue_pos = 0;
+	num_dropped = 0;
+	batch.allocate(size);
+}
+
+void FieldCommands::shutdown()
+{
+	cells.destroy();
+	batch.destroy();
+	order.destroy();
+	slots.destroy();
+	mask = 0;
+	num_applied = 0;
+	num_coalesced = 0;
+	average_latency = 0.0f;
+	max_latency = 0.0f;
+}
+
+int FieldCommands::getDepth() const
+{
+	return max(distance(dequeue_pos, enqueue_pos), 0);
+}
+
+bool FieldCommands::push(const Command &command)
+{
+	if (cells.empty())
+		return false;
+
+	// a cell is free for the position when its sequence equals the position
+	int pos = enqueue_pos;
+	Cell *cell = nullptr;
+	for (;;)
+	{
+		cell = &cells[pos & mask];
+		int diff = distance(pos, cell->sequence);
+		if (diff == 0)
+		{
+			if (enqueue_pos.compareAndSwap(pos, advance(pos, 1)))
+				break;
+			pos = enqueue_pos;
+		}
+		else if (diff < 0)
+		{
+			num_dropped++;
+			return false;
+		}
+		else
+			pos = enqueue_pos;
+	}
+
+	cell->command = command;
+	cell->command.time = Time::get();
+	// publishes the command to the consumer
+	cell->sequence = advance(pos, 1);
+	return true;
+}
+
+bool FieldCommands::impulse(int id, float velocity)
+{
+	Command command = { TYPE_IMPULSE, id, { velocity } };
+	return push(command);
+}
+
+bool FieldCommands::setState(int id, float angle, float velocity)
+{
+	Command command = { TYPE_SET_STATE, id, { angle, velocity } };
+	return push(command);
+}
+
+bool FieldCommands::setPivot(int id, const vec3 &pivot)
+{
+	Command command = { TYPE_SET_PIVOT, id, { pivot.x, pivot.y, pivot.z } };
+	return push(command);
+}
+
+bool FieldCommands::wake(int id)
+{
+	Command command = { TYPE_WAKE, id };
+	return push(command);
+}
+
+bool FieldCommands::add(const vec3 &pivot, const vec2 &direction, float length, float angle, float velocity)
+{
+	Command command = { TYPE_ADD, -1, { pivot.x, pivot.y, pivot.z, direction.x, direction.y, length, angle, velocity } };
+	return push(command);
+}
+
+bool FieldCommands::remove(int id)
+{
+	Command command = { TYPE_REMOVE, id };
+	return push(command);
+}
+
+bool FieldCommands::setGravity(float gravity)
+{
+	Command command = { TYPE_SET_GRAVITY, -1, { gravity } };
+	return push(command);
+}
+
+bool FieldCommands::setDamping(float damping)
+{
+	Command command = { TYPE_SET_DAMPING, -1, { damping } };
+	return push(command);
+}
+
+void FieldCommands::apply(PendulumField &field)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	num_applied = 0;
+	num_coalesced = 0;
+	average_latency = 0.0f;
+	max_latency = 0.0f;
+	if (cells.empty())
+		return;
+
+	// drains the published commands, at most one ring of them so producers can't stall the tick
+	batch.clear();
+	long long time = Time::get();
+	double latency = 0.0;
+	while (batch.size() < cells.size())
+	{
+		Cell &cell = cells[dequeue_pos & mask];
+		if (cell.sequence != advance(dequeue_pos, 1))
+			break;
+		batch.append(cell.command);
+		const Command &command = batch.last();
+		cell.sequence = advance(dequeue_pos, cells.size());
+		dequeue_pos = advance(dequeue_pos, 1);
+
+		float ms = float(time - command.time) * 1e-3f;
+		latency += ms;
+		max_latency = max(max_latency, ms);
+	}
+	num_applied = batch.size();
+	if (num_applied)
+		average_latency = float(latency / num_applied);
+
+	Profiler::setValue("Field commands depth", "", num_applied + getDepth(), cells.size(), nullptr);
+	Profiler::setValue("Field commands latency", "ms", max_latency, 100.0f, nullptr);
+	if (num_applied == 0)
+		return;
+
+	// a structural or field-wide command ends a segment, the segments are applied in queue order so every command
+	// sees the pendulums and parameters left by the commands queued before it
+	int begin = 0;
+	for (int i = 0; i < batch.size(); i++)
+	{
+		const Command &command = batch[i];
+		if (command.type <= TYPE_WAKE)
+			continue;
+		apply_pendulums(field, begin, i);
+		begin = i + 1;
+
+		const float *data = command.data;
+		switch (command.type)
+		{
+			case TYPE_REMOVE: field.removePendulum(command.id); break;
+			case TYPE_ADD: field.addPendulum(vec3(data[0], data[1], data[2]), vec2(data[3], data[4]), data[5], data[6], data[7]); break;
+			case TYPE_SET_GRAVITY: field.setGravity(data[0]); break;
+			case TYPE_SET_DAMPING: field.setDamping(data[0]); break;
+			default: break;
+		}
+	}
+	apply_pendulums(field, begin, batch.size());
+}
+
+void FieldCommands::apply_pendulums(PendulumField &field, int begin, int end)
+{
+	if (begin == end)
+		return;
+
+	// commands of single pendulums in slot order, the sort is stable so every pendulum keeps its command order
+	order.clear();
+	slots.resize(end - begin);
+	for (int i = begin; i < end; i++)
+	{
+		const Command &command = batch[i];
+		slots[i - begin] = -1;
+		if (!field.isValidId(command.id))
+			continue;
+		slots[i - begin] = field.getSlot(command.id);
+		order.append(i - begin);
+	}
+	std::stable_sort(order.begin(), order.end(), [this](int i0, int i1) { return slots[i0] < slots[i1]; });
+
+	for (int i = 0; i < order.size();)
+	{
+		int slot = slots[order[i]];
+		int id = field.getId(slot);
+
+		// the commands of a pendulum are merged into a single write
+		float theta = field.theta[slot];
+		float omega = field.omega[slot];
+		vec3 pivot;
+		bool state_changed = false;
+		bool pivot_changed = false;
+		bool woken = false;
+		int j = i;
+		for (; j < order.size() && slots[order[j]] == slot; j++)
+		{
+			const Command &command = batch[begin + order[j]];
+			switch (command.type)
+			{
+				case TYPE_IMPULSE:
+					omega += command.data[0] / field.length[slot];
+					state_changed = true;
+					break;
+				case TYPE_SET_STATE:
+					theta = command.data[0];
+					omega = command.data[1];
+					state_changed = true;
+					break;
+				case TYPE_SET_PIVOT:
+					pivot = vec3(command.data[0], command.data[1], command.data[2]);
+					pivot_changed = true;
+					break;
+				default:
+					woken = true;
+					break;
+			}
+		}
+		num_coalesced += j - i - 1;
+		i = j;
+
+		field.theta[slot] = theta;
+		field.omega[slot] = omega;
+		if (state_changed || woken)
+			field.wake(slot);
+		if (pivot_changed)
+			field.setPivot(id, pivot);
+		else if (state_changed)
+			field.updateBobs(slot, slot + 1);
+	}
+}
@@ -0,0 +1,100 @@
+#ifndef __FIELD_COMMANDS_H__
+#define __FIELD_COMMANDS_H__
+
+#include <UnigineMathLib.h>
+#include <UnigineThread.h>
+#include <UnigineVector.h>
+
+class PendulumField;
+
+// Edits of a PendulumField from any thread.
+// Producers push commands into a bounded lock-free multi-producer single-consumer ring and never wait: a push
+// into a full ring fails and is counted as dropped. The physics tick drains the ring before stepping and applies
+// it in queue order: adds, removes and field-wide commands split the batch into segments, and within a segment the
+// commands are sorted by slot, so the commands of a chunk are applied together and the commands of a pendulum are
+// merged into a single write. Pendulums are addressed by their external ids.
+class FieldCommands
+{
+public:
+	FieldCommands();
+	~FieldCommands();
+
+	// capacity is rounded up to a power of two
+	void init(int capacity);
+	void shutdown();
+
+	// producers, return false if the queue is full
+	bool impulse(int id, float velocity);
+	bool setState(int id, float angle, float velocity);
+	bool setPivot(int id, const Unigine::Math::vec3 &pivot);
+	bool wake(int id);
+	// the pendulum gets the id PendulumField::getNumIds() has when the command is applied, ids are never reused so
+	// the adds of a producer that is the only one adding get consecutive ids in their queue order
+	bool add(const Unigine::Math::vec3 &pivot, const Unigine::Math::vec2 &direction, float length, float angle, float velocity = 0.0f);
+	bool remove(int id);
+	bool setGravity(float gravity);
+	bool setDamping(float damping);
+
+	// consumer, applies the commands queued before the call
+	void apply(PendulumField &field);
+
+	int getCapacity() const { return cells.size(); }
+	int getDepth() const;
+	// statistics of the last apply()
+	int getNumApplied() const { return num_applied; }
+	int getNumCoalesced() const { return num_coalesced; }
+	float getAverageLatency() const { return average_latency; }
+	float getMaxLatency() const { return max_latency; }
+	// commands dropped on full queue since init()
+	int getNumDropped() const { return num_dropped; }
+
+private:
+	enum TYPE
+	{
+		TYPE_IMPULSE = 0,
+		TYPE_SET_STATE,
+		TYPE_SET_PIVOT,
+		TYPE_WAKE,
+		TYPE_ADD,
+		TYPE_REMOVE,
+		TYPE_SET_GRAVITY,
+		TYPE_SET_DAMPING,
+	};
+
+	struct Command
+	{
+		int type;
+		int id;
+		float data[8];
+		long long time;
+	};
+
+	struct Cell
+	{
+		Unigine::AtomicInt32 sequence;
+		Command command;
+	};
+
+	bool push(const Command &command);
+	// merges and applies the per-pendulum commands batch[begin, end)
+	void apply_pendulums(PendulumField &field, int begin, int end);
+
+	Unigine::Vector<Cell> cells;
+	int mask;
+	Unigine::AtomicInt32 enqueue_pos;
+	// owned by the consumer
+	int dequeue_pos;
+	Unigine::AtomicInt32 num_dropped;
+
+	// drained commands, sorted into the apply order
+	Unigine::Vector<Command> batch;
+	Unigine::Vector<int> order;
+	Unigine::Vector<int> slots;
+
+	int num_applied;
+	int num_coalesced;
+	float average_latency;
+	float max_latency;
+};
+
+#endif // __FIELD_COMMANDS_H__
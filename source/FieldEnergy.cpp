@@ -0,0 +1,115 @@
+#include "FieldEnergy.h"
+
+#include <UnigineProfiler.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+constexpr float MIN_STEP = 1e-4f;
+constexpr float MAX_STEP = 0.25f;
+constexpr int NUM_BISECTIONS = 10;
+
+double get_relative_drift(double energy, double initial_energy)
+{
+	return abs(energy - initial_energy) / max(abs(initial_energy), 1e-12);
+}
+
+// the sample fits into a single chunk, so every tick is a single job; the error is bounded for the symplectic
+// integrators, so the largest one over the run is compared with the budget as is
+bool check_step(const PendulumField &sample, float step, float duration, double max_drift)
+{
+	PendulumField field = sample;
+	double initial_energy = field.getEnergy(0, field.getNumPendulums());
+	int num_steps = max(ftoi(duration / step), 1);
+	for (int i = 0; i < num_steps; i++)
+	{
+		field.step(step);
+		if (get_relative_drift(field.getEnergy(0, field.getNumPendulums()), initial_energy) > max_drift)
+			return false;
+	}
+	return true;
+}
+}
+
+FieldEnergy::FieldEnergy()
+	: initial_energy(0.0)
+	, energy(0.0)
+	, kinetic_energy(0.0)
+	, dissipated_energy(0.0)
+	, time(0.0)
+	, max_drift(0.0)
+{
+}
+
+void FieldEnergy::reset(const PendulumField &field)
+{
+	initial_energy = field.getEnergy(&kinetic_energy);
+	energy = initial_energy;
+	dissipated_energy = 0.0;
+	time = 0.0;
+	max_drift = 0.0;
+}
+
+void FieldEnergy::update(const PendulumField &field, float ifps)
+{
+	double kinetic = 0.0;
+	double total = field.getEnergy(&kinetic);
+	update(total, kinetic, field.getDamping(), ifps);
+}
+
+void FieldEnergy::update(double field_energy, double field_kinetic_energy, float damping, float ifps)
+{
+	// the damping power is twice the kinetic energy times the damping, integrated by the trapezoidal rule
+	dissipated_energy += double(damping) * (kinetic_energy + field_kinetic_energy) * ifps;
+	energy = field_energy;
+	kinetic_energy = field_kinetic_energy;
+	time += ifps;
+	max_drift = max(max_drift, get_relative_drift(energy + dissipated_energy, initial_energy));
+}
+
+float FieldEnergy::findMaxStep(const PendulumField &field, PendulumField::INTEGRATOR integrator, float drift_budget, float duration, int num_samples)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	int num = field.getNumPendulums();
+	if (num == 0 || drift_budget <= 0.0f || duration <= 0.0f)
+		return 0.0f;
+
+	// evenly strided sample of the field with its parameters, undamped so the dissipation is not taken for drift
+	PendulumField sample;
+	sample.setGravity(field.getGravity());
+	sample.setDamping(0.0f);
+	sample.setTolerance(field.getTolerance());
+	sample.setSleepEnergy(0.0f);
+	sample.setIntegrator(integrator);
+	num_samples = clamp(num_samples, 1, min(num, int(PendulumField::CHUNK_SIZE)));
+	for (int i = 0; i < num_samples; i++)
+	{
+		int index = int(i * (long long)num / num_samples);
+		sample.addPendulum(field.getPivot(index), vec2(field.direction_x[index], field.direction_y[index]), field.length[index],
+			field.theta[index], field.omega[index]);
+	}
+
+	double max_drift = drift_budget;
+	if (check_step(sample, MAX_STEP, duration, max_drift))
+		return MAX_STEP;
+
+	// bisection in log space, the drift grows with a power of the step
+	float good = MIN_STEP;
+	float bad = MAX_STEP;
+	for (int i = 0; i < NUM_BISECTIONS; i++)
+	{
+		float step = sqrt(good * bad);
+		if (check_step(sample, step, duration, max_drift))
+			good = step;
+		else
+			bad = step;
+	}
+
+	// the smallest step is checked last, it is the most expensive run
+	if (good == MIN_STEP && !check_step(sample, MIN_STEP, duration, max_drift))
+		return 0.0f;
+	return good;
+}
@@ -0,0 +1,42 @@
+#ifndef __FIELD_ENERGY_H__
+#define __FIELD_ENERGY_H__
+
+#include "PendulumField.h"
+
+// Energy drift monitor of the field.
+// The total energy is sampled after every tick and compared against the energy at reset. The energy the damping
+// dissipated is added back, integrated from the kinetic energy, so only the error of the integrator remains. The
+// drift is the largest relative deviation seen so far; it is not extrapolated, the symplectic integrators keep it
+// bounded and a short run would otherwise overestimate them.
+class FieldEnergy
+{
+public:
+	FieldEnergy();
+
+	void reset(const PendulumField &field);
+	void update(const PendulumField &field, float ifps);
+	// samples energies summed by the caller
+	void update(double field_energy, double kinetic_energy, float damping, float ifps);
+
+	double getInitialEnergy() const { return initial_energy; }
+	double getEnergy() const { return energy; }
+	// energy taken by the damping since reset
+	double getDissipatedEnergy() const { return dissipated_energy; }
+	double getTime() const { return time; }
+	// largest relative deviation of the energy plus the dissipated energy from the initial energy
+	double getMaxDrift() const { return max_drift; }
+
+	// largest tick at which the integrator keeps the drift within the budget over duration simulated seconds,
+	// measured by bisection on num_samples pendulums of the field without damping, 0 if none does
+	static float findMaxStep(const PendulumField &field, PendulumField::INTEGRATOR integrator, float drift_budget, float duration = 60.0f, int num_samples = 64);
+
+private:
+	double initial_energy;
+	double energy;
+	double kinetic_energy;
+	double dissipated_energy;
+	double time;
+	double max_drift;
+};
+
+#endif // __FIELD_ENERGY_H__
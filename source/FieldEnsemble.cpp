@@ -0,0 +1,430 @@
+#include "FieldEnsemble.h"
+#include "FieldLanes.h"
+#include "FieldRandom.h"
+
+#include <UnigineLog.h>
+#include <UnigineProfiler.h>
+#include <UnigineStreams.h>
+#include <UnigineThread.h>
+#include <UnigineTimer.h>
+
+#include <string.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+constexpr unsigned int ENSEMBLE_MAGIC = ('P' << 0) | ('S' << 8) | ('W' << 16) | ('P' << 24);
+constexpr unsigned int ENSEMBLE_VERSION = 1;
+constexpr int COLUMN_NAME_SIZE = 24;
+// arrays of a block in the scratch: state and shadow state, then the Runge-Kutta stages
+constexpr int NUM_BLOCK_ARRAYS = 9;
+// angle offset of every pendulum of the shadow copy
+constexpr float PERTURBATION = 1e-4f;
+// ticks between renormalizations of the shadow copies
+constexpr int RENORMALIZE_TICKS = 8;
+// ticks between samples of the averages
+constexpr int SAMPLE_TICKS = 4;
+
+struct EnsembleHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	int num_variants;
+	int num_columns;
+	int size;
+	float length;
+	float gravity;
+	float amplitude;
+	unsigned int reserved;
+};
+
+struct EnsembleColumn
+{
+	char name[COLUMN_NAME_SIZE];
+	// offset of the column from the start of the file
+	unsigned long long offset;
+};
+}
+
+struct FieldEnsemble::Accumulator
+{
+	double energy[BLOCK_SIZE];
+	double energy_squared[BLOCK_SIZE];
+	double order[BLOCK_SIZE];
+	double stretch[BLOCK_SIZE];
+	int num_samples;
+	double stretch_time;
+};
+
+FieldEnsemble::FieldEnsemble()
+	: size(8)
+	, length(1.0f)
+	, gravity(9.81f)
+	, amplitude(1.0f)
+	, initial_angle(0.5f)
+	, seed(0)
+	, num_variants(0)
+	, time(0.0f)
+{
+}
+
+void FieldEnsemble::createSweep(const Vector<float> &damping_values, const Vector<float> &frequency_values, const Vector<float> &coupling_values)
+{
+	clear();
+	for (float coupling : coupling_values)
+		for (float frequency : frequency_values)
+			for (float damping : damping_values)
+				addVariant(damping, frequency, coupling);
+}
+
+void FieldEnsemble::addVariant(float damping, float frequency, float coupling)
+{
+	dampings.append(damping);
+	frequencies.append(frequency);
+	couplings.append(coupling);
+	num_variants++;
+}
+
+void FieldEnsemble::clear()
+{
+	num_variants = 0;
+	dampings.clear();
+	frequencies.clear();
+	couplings.clear();
+	for (Vector<float> &column : columns)
+		column.clear();
+}
+
+void FieldEnsemble::run(float duration, float transient, float ifps)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	if (num_variants == 0 || ifps <= 0.0f)
+		return;
+
+	long long begin_time = Time::get();
+
+	int num_ticks = max(int(duration / ifps + 0.5f), 1);
+	int num_transient = clamp(int(transient / ifps + 0.5f), 0, num_ticks - 1);
+	int num_blocks = (num_variants + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	int block_size = size * size * BLOCK_SIZE * NUM_BLOCK_ARRAYS;
+	int num_slots = PoolCPUShaders::getNumThreads() + 1;
+	scratch.resize(num_slots * block_size);
+	for (Vector<float> &column : columns)
+		column.resize(num_variants);
+
+	// blocks are independent, every worker integrates whole blocks from start to end
+	AtomicInt32 next_block(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int thread_num, int)
+	{
+		float *thread_scratch = scratch.get() + (thread_num % num_slots) * block_size;
+		for (int block = next_block++; block < num_blocks; block = next_block++)
+		{
+			Accumulator accumulator;
+			run_block(block, num_ticks, num_transient, ifps, thread_scratch, accumulator);
+
+			int begin = block * BLOCK_SIZE;
+			int end = min(begin + BLOCK_SIZE, num_variants);
+			double samples_inv = 1.0 / max(accumulator.num_samples, 1);
+			for (int i = begin; i < end; i++)
+			{
+				int j = i - begin;
+				double energy = accumulator.energy[j] * samples_inv;
+				double variance = max(accumulator.energy_squared[j] * samples_inv - energy * energy, 0.0);
+				columns[COLUMN_DAMPING][i] = dampings[i];
+				columns[COLUMN_FREQUENCY][i] = frequencies[i];
+				columns[COLUMN_COUPLING][i] = couplings[i];
+				columns[COLUMN_ENERGY][i] = float(energy);
+				columns[COLUMN_ENERGY_DEVIATION][i] = float(::sqrt(variance));
+				columns[COLUMN_ORDER][i] = float(accumulator.order[j] * samples_inv);
+				columns[COLUMN_LYAPUNOV][i] = (accumulator.stretch_time > 0.0) ? float(accumulator.stretch[j] / accumulator.stretch_time) : 0.0f;
+			}
+		}
+	});
+
+	time = Time::microsecondsToMilliseconds(Time::get() - begin_time);
+}
+
+void FieldEnsemble::run_block(int block, int num_ticks, int num_transient, float ifps, float *block_scratch, Accumulator &accumulator)
+{
+	int num_cells = size * size;
+	int num = num_cells * BLOCK_SIZE;
+	float *theta = block_scratch;
+	float *omega = theta + num;
+	float *shadow_theta = omega + num;
+	float *shadow_omega = shadow_theta + num;
+	float *stages = shadow_omega + num;
+
+	// damping, angular drive frequency and coupling of the lanes, padding lanes are left at rest
+	float params[3 * BLOCK_SIZE];
+	for (int j = 0; j < BLOCK_SIZE; j++)
+	{
+		int variant = block * BLOCK_SIZE + j;
+		bool used = variant < num_variants;
+		params[j] = used ? dampings[variant] : 0.0f;
+		params[BLOCK_SIZE + j] = used ? frequencies[variant] * Consts::PI2 : 0.0f;
+		params[2 * BLOCK_SIZE + j] = used ? couplings[variant] : 0.0f;
+	}
+
+	// every variant starts from the same angles, the shadow copies are displaced by a fixed distance
+	for (int cell = 0; cell < num_cells; cell++)
+	{
+		float angle = initial_angle * get_random(cell, seed);
+		float offset = (get_random(cell, seed ^ 0x5bd1e995u) < 0.0f) ? -PERTURBATION : PERTURBATION;
+		for (int j = 0; j < BLOCK_SIZE; j++)
+		{
+			int k = cell * BLOCK_SIZE + j;
+			bool used = block * BLOCK_SIZE + j < num_variants;
+			theta[k] = used ? angle : 0.0f;
+			shadow_theta[k] = theta[k] + offset;
+		}
+	}
+	memset(omega, 0, sizeof(float) * num);
+	memset(shadow_omega, 0, sizeof(float) * num);
+
+	memset(&accumulator, 0, sizeof(accumulator));
+	double distance = PERTURBATION * ::sqrt(double(num_cells));
+	double squared[BLOCK_SIZE];
+
+	for (int tick = 0; tick < num_ticks; tick++)
+	{
+		double t = double(tick) * ifps;
+		step_block(theta, omega, params, t, ifps, stages);
+		step_block(shadow_theta, shadow_omega, params, t, ifps, stages);
+
+		bool measured = tick >= num_transient;
+		if ((tick + 1) % RENORMALIZE_TICKS == 0)
+		{
+			// Benettin: the log of the growth of the separation, then the separation is scaled back
+			memset(squared, 0, sizeof(squared));
+			for (int k = 0; k < num; k++)
+			{
+				float dt = shadow_theta[k] - theta[k];
+				float dw = shadow_omega[k] - omega[k];
+				squared[k % BLOCK_SIZE] += dt * dt + dw * dw;
+			}
+			float scale[BLOCK_SIZE];
+			for (int j = 0; j < BLOCK_SIZE; j++)
+			{
+				double d = ::sqrt(squared[j]);
+				if (d < 1e-30)
+				{
+					scale[j] = 1.0f;
+					continue;
+				}
+				if (measured)
+					accumulator.stretch[j] += ::log(d / distance);
+				scale[j] = float(distance / d);
+			}
+			if (measured)
+				accumulator.stretch_time += RENORMALIZE_TICKS * double(ifps);
+			for (int k = 0; k < num; k++)
+			{
+				float s = scale[k % BLOCK_SIZE];
+				shadow_theta[k] = theta[k] + (shadow_theta[k] - theta[k]) * s;
+				shadow_omega[k] = omega[k] + (shadow_omega[k] - omega[k]) * s;
+			}
+		}
+
+		if (measured && (tick - num_transient) % SAMPLE_TICKS == 0)
+			measure(theta, omega, params, accumulator);
+	}
+}
+
+void FieldEnsemble::step_block(float *theta, float *omega, const float *params, double t, float ifps, float *stages) const
+{
+	int num = size * size * BLOCK_SIZE;
+	float *stage_theta = stages;
+	float *stage_omega = stage_theta + num;
+	float *sum_theta = stage_omega + num;
+	float *sum_omega = sum_theta + num;
+	float *accel = sum_omega + num;
+
+	// classic Runge-Kutta, the sums collect the weighted stage derivatives
+	static const float offsets[4] = { 0.0f, 0.5f, 0.5f, 1.0f };
+	static const float weights[4] = { 1.0f, 2.0f, 2.0f, 1.0f };
+	for (int stage = 0; stage < 4; stage++)
+	{
+		const float *src_theta = (stage == 0) ? theta : stage_theta;
+		const float *src_omega = (stage == 0) ? omega : stage_omega;
+		evaluate(src_theta, src_omega, params, t + offsets[stage] * ifps, accel);
+
+		float w = weights[stage];
+		float h = (stage < 3) ? offsets[stage + 1] * ifps : 0.0f;
+		for (int k = 0; k < num; k++)
+		{
+			float rate = src_omega[k];
+			sum_theta[k] = (stage == 0) ? rate : sum_theta[k] + w * rate;
+			sum_omega[k] = (stage == 0) ? accel[k] : sum_omega[k] + w * accel[k];
+			stage_theta[k] = theta[k] + h * rate;
+			stage_omega[k] = omega[k] + h * accel[k];
+		}
+	}
+
+	float h = ifps / 6.0f;
+	for (int k = 0; k < num; k++)
+	{
+		theta[k] += h * sum_theta[k];
+		omega[k] += h * sum_omega[k];
+	}
+}
+
+void FieldEnsemble::evaluate(const float *theta, const float *omega, const float *params, double t, float *accel) const
+{
+	const float *damping = params;
+	const float *frequency = params + BLOCK_SIZE;
+	const float *coupling = params + 2 * BLOCK_SIZE;
+
+	float drive[BLOCK_SIZE];
+	for (int j = 0; j < BLOCK_SIZE; j++)
+		drive[j] = amplitude * float(::cos(frequency[j] * t));
+
+	FieldLanes g(gravity / length);
+	FieldLanes four(4.0f);
+	int row = size * BLOCK_SIZE;
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			int k = (y * size + x) * BLOCK_SIZE;
+			const float *th = theta + k;
+			const float *om = omega + k;
+			float *a = accel + k;
+			// a missing neighbour at the border points at the pendulum itself and adds nothing
+			const float *left = (x > 0) ? th - BLOCK_SIZE : th;
+			const float *right = (x < size - 1) ? th + BLOCK_SIZE : th;
+			const float *down = (y > 0) ? th - row : th;
+			const float *up = (y < size - 1) ? th + row : th;
+			for (int j = 0; j < BLOCK_SIZE; j += FieldLanes::NUM)
+			{
+				FieldLanes angle = FieldLanes::load(th + j);
+				FieldLanes sin_angle, cos_angle;
+				sincos_lanes(angle, sin_angle, cos_angle);
+				FieldLanes spring = FieldLanes::load(left + j) + FieldLanes::load(right + j) + FieldLanes::load(down + j) + FieldLanes::load(up + j) - four * angle;
+				FieldLanes acceleration = FieldLanes::load(drive + j) - g * sin_angle - FieldLanes::load(damping + j) * FieldLanes::load(om + j)
+					+ FieldLanes::load(coupling + j) * spring;
+				acceleration.store(a + j);
+			}
+		}
+	}
+}
+
+void FieldEnsemble::measure(const float *theta, const float *omega, const float *params, Accumulator &accumulator) const
+{
+	const float *coupling = params + 2 * BLOCK_SIZE;
+
+	double energy[BLOCK_SIZE];
+	double sum_cos[BLOCK_SIZE];
+	double sum_sin[BLOCK_SIZE];
+	memset(energy, 0, sizeof(energy));
+	memset(sum_cos, 0, sizeof(sum_cos));
+	memset(sum_sin, 0, sizeof(sum_sin));
+
+	// energies per unit inertia, the springs are counted once through the right and upper neighbours
+	float g = gravity / length;
+	int row = size * BLOCK_SIZE;
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			int k = (y * size + x) * BLOCK_SIZE;
+			const float *th = theta + k;
+			const float *om = omega + k;
+			const float *right = (x < size - 1) ? th + BLOCK_SIZE : th;
+			const float *up = (y < size - 1) ? th + row : th;
+			float sin_angle[BLOCK_SIZE];
+			float cos_angle[BLOCK_SIZE];
+			for (int j = 0; j < BLOCK_SIZE; j += FieldLanes::NUM)
+			{
+				FieldLanes s, c;
+				sincos_lanes(FieldLanes::load(th + j), s, c);
+				s.store(sin_angle + j);
+				c.store(cos_angle + j);
+			}
+			for (int j = 0; j < BLOCK_SIZE; j++)
+			{
+				float dx = right[j] - th[j];
+				float dy = up[j] - th[j];
+				energy[j] += 0.5f * om[j] * om[j] + g * (1.0f - cos_angle[j]) + 0.5f * coupling[j] * (dx * dx + dy * dy);
+				sum_cos[j] += cos_angle[j];
+				sum_sin[j] += sin_angle[j];
+			}
+		}
+	}
+
+	// energy per pendulum and unit mass, the Kuramoto order parameter of the angles
+	double num_inv = 1.0 / (size * size);
+	double inertia = double(length) * length;
+	for (int j = 0; j < BLOCK_SIZE; j++)
+	{
+		double e = energy[j] * inertia * num_inv;
+		accumulator.energy[j] += e;
+		accumulator.energy_squared[j] += e * e;
+		accumulator.order[j] += ::sqrt(sum_cos[j] * sum_cos[j] + sum_sin[j] * sum_sin[j]) * num_inv;
+	}
+	accumulator.num_samples++;
+}
+
+const char *FieldEnsemble::getColumnName(COLUMN column)
+{
+	static const char *names[NUM_COLUMNS] = {
+		"damping",
+		"frequency",
+		"coupling",
+		"energy",
+		"energy_deviation",
+		"order",
+		"lyapunov",
+	};
+	return (column >= 0 && column < NUM_COLUMNS) ? names[column] : "";
+}
+
+bool FieldEnsemble::save(const char *path) const
+{
+	if (columns[0].size() != num_variants)
+	{
+		Log::error("FieldEnsemble::save(): the ensemble has not been run\n");
+		return false;
+	}
+
+	FilePtr file = File::create(path, "wb", false);
+	if (!file || !file->isOpened())
+	{
+		Log::error("FieldEnsemble::save(): can't open \"%s\" file\n", path);
+		return false;
+	}
+
+	EnsembleHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ENSEMBLE_MAGIC;
+	header.version = ENSEMBLE_VERSION;
+	header.num_variants = num_variants;
+	header.num_columns = NUM_COLUMNS;
+	header.size = size;
+	header.length = length;
+	header.gravity = gravity;
+	header.amplitude = amplitude;
+
+	// columns follow the table back to back
+	EnsembleColumn table[NUM_COLUMNS];
+	memset(table, 0, sizeof(table));
+	unsigned long long offset = sizeof(header) + sizeof(table);
+	for (int i = 0; i < NUM_COLUMNS; i++)
+	{
+		strncpy(table[i].name, getColumnName(COLUMN(i)), COLUMN_NAME_SIZE - 1);
+		table[i].offset = offset;
+		offset += sizeof(float) * num_variants;
+	}
+
+	bool ret = file->write(&header, sizeof(header)) == sizeof(header);
+	ret = ret && file->write(table, sizeof(table)) == sizeof(table);
+	for (int i = 0; i < NUM_COLUMNS && ret; i++)
+		ret = file->write(columns[i].get(), sizeof(float) * num_variants) == sizeof(float) * num_variants;
+	file->close();
+
+	if (!ret)
+		Log::error("FieldEnsemble::save(): can't write \"%s\" file\n", path);
+	return ret;
+}
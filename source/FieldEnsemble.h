@@ -0,0 +1,93 @@
+#ifndef __FIELD_ENSEMBLE_H__
+#define __FIELD_ENSEMBLE_H__
+
+#include <UnigineMathLib.h>
+#include <UnigineVector.h>
+
+// Batch of many small independent fields for parameter sweeps, stepped without a world.
+// Every variant is a square lattice of pendulums with angle springs between neighbours, viscous damping and a
+// sinusoidal drive torque shared by all its pendulums; variants differ in damping, drive frequency and coupling.
+// Variants are packed in blocks of BLOCK_SIZE: the state of a block is stored pendulum by pendulum with the
+// variants of a pendulum contiguous, so the inner loops run across variants. Blocks never interact and every worker
+// integrates whole blocks over the full duration, without a barrier per tick. A shadow copy of every variant,
+// displaced by a tiny perturbation, is stepped along and renormalized periodically to estimate the largest
+// Lyapunov exponent. Results are one row per variant, saved column by column.
+class FieldEnsemble
+{
+public:
+	enum
+	{
+		BLOCK_SIZE = 16,
+	};
+
+	enum COLUMN
+	{
+		COLUMN_DAMPING = 0,
+		COLUMN_FREQUENCY,
+		COLUMN_COUPLING,
+		// time averages after the transient, the energy is per pendulum and unit mass
+		COLUMN_ENERGY,
+		COLUMN_ENERGY_DEVIATION,
+		COLUMN_ORDER,
+		COLUMN_LYAPUNOV,
+		NUM_COLUMNS,
+	};
+
+	FieldEnsemble();
+
+	// every variant is a size by size lattice of pendulums of the given length
+	void setSize(int s) { size = Unigine::Math::clamp(s, 1, 64); }
+	int getSize() const { return size; }
+	void setLength(float l) { length = Unigine::Math::max(l, 0.01f); }
+	float getLength() const { return length; }
+	void setGravity(float g) { gravity = g; }
+	float getGravity() const { return gravity; }
+	// drive torque per unit of inertia, the same for all variants
+	void setAmplitude(float a) { amplitude = a; }
+	float getAmplitude() const { return amplitude; }
+	// initial angles are random in [-angle, angle], the same for all variants
+	void setInitialAngle(float angle, unsigned int s) { initial_angle = angle; seed = s; }
+
+	// variants on the grid of the given values, damping varies fastest
+	void createSweep(const Unigine::Vector<float> &dampings, const Unigine::Vector<float> &frequencies, const Unigine::Vector<float> &couplings);
+	void addVariant(float damping, float frequency, float coupling);
+	void clear();
+	int getNumVariants() const { return num_variants; }
+
+	// steps all variants from their initial state, the averages skip the transient
+	void run(float duration, float transient, float ifps);
+	float getTime() const { return time; }
+
+	float getResult(int variant, COLUMN column) const { return columns[column][variant]; }
+	static const char *getColumnName(COLUMN column);
+	// header, column table and one float column per result
+	bool save(const char *path) const;
+
+private:
+	struct Accumulator;
+
+	void run_block(int block, int num_ticks, int num_transient, float ifps, float *scratch, Accumulator &accumulator);
+	void step_block(float *theta, float *omega, const float *params, double t, float ifps, float *scratch) const;
+	void evaluate(const float *theta, const float *omega, const float *params, double t, float *accel) const;
+	void measure(const float *theta, const float *omega, const float *params, Accumulator &accumulator) const;
+
+	int size;
+	float length;
+	float gravity;
+	float amplitude;
+	float initial_angle;
+	unsigned int seed;
+
+	int num_variants;
+	float time;
+
+	// damping, frequency and coupling per variant, padded to whole blocks
+	Unigine::Vector<float> dampings;
+	Unigine::Vector<float> frequencies;
+	Unigine::Vector<float> couplings;
+	Unigine::Vector<float> columns[NUM_COLUMNS];
+	// per-thread state and Runge-Kutta stages of one block
+	Unigine::Vector<float> scratch;
+};
+
+#endif // __FIELD_ENSEMBLE_H__
@@ -0,0 +1,128 @@
+#include "FieldFFT.h"
+
+#include <UnigineLog.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+void get_reversal(int n, Vector<int> &ret)
+{
+	int bits = 0;
+	while ((1 << bits) < n)
+		bits++;
+	ret.resize(n);
+	for (int i = 0; i < n; i++)
+	{
+		int r = 0;
+		for (int b = 0; b < bits; b++)
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		ret[i] = r;
+	}
+}
+
+vec2 complex_mul(const vec2 &a, const vec2 &b)
+{
+	return vec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+}
+
+FieldFFT::FieldFFT()
+	: size(0)
+{
+}
+
+void FieldFFT::init(int n)
+{
+	if (!isPowerOfTwo(n) || n < 2)
+	{
+		Log::error("FieldFFT::init(): size %d is not a power of two\n", n);
+		n = max(getFloorPowerOfTwo(n), 2);
+	}
+	if (n == size)
+		return;
+
+	size = n;
+	// twiddles are computed in double, single precision recurrences drift over large sizes
+	twiddles.resize(size / 2);
+	for (int k = 0; k < size / 2; k++)
+	{
+		double angle = -2.0 * Consts::PI * k / size;
+		twiddles[k] = vec2(float(Math::cos(angle)), float(Math::sin(angle)));
+	}
+	get_reversal(size, reversed);
+	get_reversal(size / 2, half_reversed);
+	packed.resize(size / 2);
+}
+
+int FieldFFT::getFloorPowerOfTwo(int n)
+{
+	if (n < 1)
+		return 0;
+	int ret = 1;
+	while (ret <= n / 2)
+		ret *= 2;
+	return ret;
+}
+
+void FieldFFT::transform_complex(vec2 *data, int n, const int *reversal, int stride, bool inverse) const
+{
+	for (int i = 0; i < n; i++)
+	{
+		int r = reversal[i];
+		if (i < r)
+		{
+			vec2 temp = data[i];
+			data[i] = data[r];
+			data[r] = temp;
+		}
+	}
+
+	// iterative butterflies, the twiddles of a stage are every (n / len * stride)-th entry of the table
+	for (int len = 2; len <= n; len *= 2)
+	{
+		int half = len / 2;
+		int step = n / len * stride;
+		for (int i = 0; i < n; i += len)
+		{
+			for (int j = 0; j < half; j++)
+			{
+				vec2 w = twiddles[j * step];
+				if (inverse)
+					w.y = -w.y;
+				vec2 a = data[i + j];
+				vec2 b = complex_mul(data[i + j + half], w);
+				data[i + j] = a + b;
+				data[i + j + half] = a - b;
+			}
+		}
+	}
+}
+
+void FieldFFT::transform(vec2 *data, bool inverse) const
+{
+	transform_complex(data, size, reversed.get(), 1, inverse);
+}
+
+void FieldFFT::transformReal(const float *in, vec2 *out)
+{
+	// even samples go to the real parts and odd ones to the imaginary parts of a half-size transform
+	int half = size / 2;
+	for (int i = 0; i < half; i++)
+		packed[i] = vec2(in[i * 2], in[i * 2 + 1]);
+	transform_complex(packed.get(), half, half_reversed.get(), 2, false);
+
+	// the spectra of both halves are separated by symmetry and merged with one more butterfly
+	for (int k = 0; k <= half; k++)
+	{
+		vec2 z = packed[k % half];
+		const vec2 &c = packed[(half - k) % half];
+		vec2 zc = vec2(c.x, -c.y);
+		vec2 even = (z + zc) * 0.5f;
+		vec2 d = (z - zc) * 0.5f;
+		vec2 odd = vec2(d.y, -d.x);
+		vec2 w = (k < half) ? twiddles[k] : vec2(-1.0f, 0.0f);
+		out[k] = even + complex_mul(w, odd);
+	}
+}
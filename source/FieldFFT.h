@@ -0,0 +1,41 @@
+#ifndef __FIELD_FFT_H__
+#define __FIELD_FFT_H__
+
+#include <UnigineMathLib.h>
+#include <UnigineVector.h>
+
+// Radix-2 fast Fourier transform of a fixed power-of-two size.
+// Complex values are vec2 pairs of the real and the imaginary part. The plan keeps the twiddle factors and the
+// bit reversal of its size, so transforms of the same size allocate nothing. A real transform of size n packs the
+// input into a complex transform of size n / 2 and returns the n / 2 + 1 non-negative frequencies.
+class FieldFFT
+{
+public:
+	FieldFFT();
+
+	// n must be a power of two, at least 2
+	void init(int n);
+	int getSize() const { return size; }
+
+	// in place, unnormalized in both directions
+	void transform(Unigine::Math::vec2 *data, bool inverse = false) const;
+	// out receives getSize() / 2 + 1 values, in and out must not overlap; uses a scratch buffer of the plan
+	void transformReal(const float *in, Unigine::Math::vec2 *out);
+
+	static bool isPowerOfTwo(int n) { return n > 0 && (n & (n - 1)) == 0; }
+	// the largest power of two not above n, 0 for n < 1
+	static int getFloorPowerOfTwo(int n);
+
+private:
+	void transform_complex(Unigine::Math::vec2 *data, int n, const int *reversal, int stride, bool inverse) const;
+
+	int size;
+	// e^(-2 pi i k / size) for k below size / 2
+	Unigine::Vector<Unigine::Math::vec2> twiddles;
+	// bit reversal of the half-size transform used by transformReal()
+	Unigine::Vector<int> half_reversed;
+	Unigine::Vector<int> reversed;
+	Unigine::Vector<Unigine::Math::vec2> packed;
+};
+
+#endif // __FIELD_FFT_H__
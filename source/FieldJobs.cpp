@@ -0,0 +1,111 @@
+#include "FieldJobs.h"
+
+#include <UnigineLog.h>
+#include <UnigineProfiler.h>
+#include <UnigineTimer.h>
+#include <UnigineVector.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+struct FieldJobsState
+{
+	Vector<FieldJob *> jobs;
+	float budget{2.0f};
+	float time{0.0f};
+	float max_time{0.0f};
+	// job started by the current queue head, reported when done
+	long long start_time{0};
+	int num_frames{0};
+};
+
+FieldJobsState state;
+}
+
+void FieldJobs::add(FieldJob *job)
+{
+	if (job == nullptr || isQueued(job))
+		return;
+	state.jobs.append(job);
+}
+
+void FieldJobs::remove(FieldJob *job)
+{
+	int index = state.jobs.findIndex(job);
+	if (index == -1)
+		return;
+	// the head keeps its timing only if it stays the head
+	if (index == 0)
+		state.num_frames = 0;
+	state.jobs.remove(index);
+}
+
+bool FieldJobs::isQueued(const FieldJob *job)
+{
+	for (const FieldJob *j : state.jobs)
+	{
+		if (j == job)
+			return true;
+	}
+	return false;
+}
+
+int FieldJobs::getNumJobs()
+{
+	return state.jobs.size();
+}
+
+void FieldJobs::setBudget(float budget)
+{
+	state.budget = max(budget, 0.0f);
+}
+
+float FieldJobs::getBudget()
+{
+	return state.budget;
+}
+
+void FieldJobs::update()
+{
+	state.time = 0.0f;
+	if (state.jobs.empty())
+	{
+		state.max_time = 0.0f;
+		return;
+	}
+
+	UNIGINE_PROFILER_FUNCTION;
+
+	long long begin = Time::get();
+	long long end_time = begin + (long long)(state.budget * 1000.0f);
+	// every frame advances the head at least once, so a zero budget still makes progress
+	do
+	{
+		FieldJob *job = state.jobs[0];
+		if (state.num_frames++ == 0)
+			state.start_time = begin;
+		if (!job->update(end_time))
+			break;
+
+		Log::message("FieldJobs::update(): %s done in %.2f ms over %d frames\n", job->getName(),
+			Time::microsecondsToMilliseconds(Time::get() - state.start_time), state.num_frames);
+		state.jobs.remove(0);
+		state.num_frames = 0;
+	} while (state.jobs.size() && Time::get() < end_time);
+
+	state.time = Time::microsecondsToMilliseconds(Time::get() - begin);
+	state.max_time = max(state.max_time, state.time);
+	Profiler::setValue("Field jobs", "ms", state.time, state.budget, nullptr);
+}
+
+float FieldJobs::getTime()
+{
+	return state.time;
+}
+
+float FieldJobs::getMaxTime()
+{
+	return state.max_time;
+}
@@ -0,0 +1,43 @@
+#ifndef __FIELD_JOBS_H__
+#define __FIELD_JOBS_H__
+
+// Long field operation split into resumable slices.
+// A job is a state machine that does small units of work until the end time and keeps its position between
+// calls. It builds its result on the side and publishes it in its last slice, so the world never sees a half-done
+// field. Jobs are owned by their creators and must be removed from FieldJobs before they are destroyed.
+class FieldJob
+{
+public:
+	virtual ~FieldJob() {}
+
+	virtual const char *getName() const = 0;
+	// advances the job until it is done or Time::get() reaches end_time, returns true once it is done
+	virtual bool update(long long end_time) = 0;
+	// fraction of the work done
+	virtual float getProgress() const = 0;
+};
+
+// Cooperative scheduler of the field jobs.
+// AppSystemLogic::update() advances the queued jobs in order until the frame budget is spent, a finished job is
+// removed from the queue. The budget bounds the time of a frame spent in jobs, not the duration of a job.
+class FieldJobs
+{
+public:
+	// adding a queued job again does nothing
+	static void add(FieldJob *job);
+	static void remove(FieldJob *job);
+	static bool isQueued(const FieldJob *job);
+	static int getNumJobs();
+
+	// milliseconds per frame
+	static void setBudget(float budget);
+	static float getBudget();
+
+	static void update();
+
+	// time spent in the jobs by the last update and the longest one since the queue was last empty, in milliseconds
+	static float getTime();
+	static float getMaxTime();
+};
+
+#endif // __FIELD_JOBS_H__
@@ -0,0 +1,116 @@
+#ifndef __FIELD_LANES_H__
+#define __FIELD_LANES_H__
+
+#include <UnigineMathLib.h>
+
+// Four floats processed together, the SIMD kernels of the field are written once for all lanes.
+// Without SSE the lanes are plain arrays and the same code runs one lane at a time.
+#ifdef USE_SSE
+struct FieldLanes
+{
+	enum
+	{
+		NUM = 4,
+	};
+
+	FieldLanes() = default;
+	FieldLanes(__m128 x)
+		: v(x)
+	{}
+	explicit FieldLanes(float x)
+		: v(_mm_set1_ps(x))
+	{}
+	static FieldLanes load(const float *src) { return _mm_loadu_ps(src); }
+	void store(float *dest) const { _mm_storeu_ps(dest, v); }
+
+	__m128 v;
+};
+UNIGINE_INLINE FieldLanes operator+(const FieldLanes &a, const FieldLanes &b) { return _mm_add_ps(a.v, b.v); }
+UNIGINE_INLINE FieldLanes operator-(const FieldLanes &a, const FieldLanes &b) { return _mm_sub_ps(a.v, b.v); }
+UNIGINE_INLINE FieldLanes operator*(const FieldLanes &a, const FieldLanes &b) { return _mm_mul_ps(a.v, b.v); }
+UNIGINE_INLINE FieldLanes operator/(const FieldLanes &a, const FieldLanes &b) { return _mm_div_ps(a.v, b.v); }
+
+// Cephes sine and cosine: reduction to an octant by pi / 4 in three parts and two minimax polynomials
+UNIGINE_INLINE void sincos_lanes(const FieldLanes &angle, FieldLanes &sin_ret, FieldLanes &cos_ret)
+{
+	const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(int(0x80000000)));
+	__m128 x = _mm_andnot_ps(sign_mask, angle.v);
+	__m128 sign_sin = _mm_and_ps(angle.v, sign_mask);
+
+	__m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+	octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	__m128 y = _mm_cvtepi32_ps(octant);
+	__m128 swap_sin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29));
+	__m128 sign_cos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+	__m128 poly_mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_setzero_si128()));
+	sign_sin = _mm_xor_ps(sign_sin, swap_sin);
+
+	x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-0.78515625f)));
+	x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-2.4187564849853515625e-4f)));
+	x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-3.77489497744594108e-8f)));
+	__m128 z = _mm_mul_ps(x, x);
+
+	__m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z), _mm_set1_ps(-1.388731625493765e-3f));
+	c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(4.166664568298827e-2f));
+	c = _mm_mul_ps(_mm_mul_ps(c, z), z);
+	c = _mm_add_ps(_mm_sub_ps(c, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+	__m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z), _mm_set1_ps(8.3321608736e-3f));
+	s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(-1.6666654611e-1f));
+	s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+
+	__m128 sin_value = _mm_or_ps(_mm_and_ps(poly_mask, s), _mm_andnot_ps(poly_mask, c));
+	__m128 cos_value = _mm_or_ps(_mm_and_ps(poly_mask, c), _mm_andnot_ps(poly_mask, s));
+	sin_ret = _mm_xor_ps(sin_value, sign_sin);
+	cos_ret = _mm_xor_ps(cos_value, sign_cos);
+}
+#else
+struct FieldLanes
+{
+	enum
+	{
+		NUM = 4,
+	};
+
+	FieldLanes() = default;
+	explicit FieldLanes(float x)
+	{
+		for (float &lane : v)
+			lane = x;
+	}
+	static FieldLanes load(const float *src)
+	{
+		FieldLanes ret;
+		for (int i = 0; i < NUM; i++)
+			ret.v[i] = src[i];
+		return ret;
+	}
+	void store(float *dest) const
+	{
+		for (int i = 0; i < NUM; i++)
+			dest[i] = v[i];
+	}
+
+	float v[NUM];
+};
+#define FIELD_LANES_OPERATOR(OP) \
+	UNIGINE_INLINE FieldLanes operator OP(const FieldLanes &a, const FieldLanes &b) \
+	{ \
+		FieldLanes ret; \
+		for (int i = 0; i < FieldLanes::NUM; i++) \
+			ret.v[i] = a.v[i] OP b.v[i]; \
+		return ret; \
+	}
+FIELD_LANES_OPERATOR(+)
+FIELD_LANES_OPERATOR(-)
+FIELD_LANES_OPERATOR(*)
+FIELD_LANES_OPERATOR(/)
+#undef FIELD_LANES_OPERATOR
+
+UNIGINE_INLINE void sincos_lanes(const FieldLanes &angle, FieldLanes &sin_ret, FieldLanes &cos_ret)
+{
+	for (int i = 0; i < FieldLanes::NUM; i++)
+		Unigine::Math::sincos(angle.v[i], sin_ret.v[i], cos_ret.v[i]);
+}
+#endif
+
+#endif // __FIELD_LANES_H__
@@ -0,0 +1,159 @@
+#include "FieldLatticeJob.h"
+
+#include <UnigineAsyncQueue.h>
+#include <UnigineProfiler.h>
+#include <UnigineTimer.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+// pendulums generated between clock checks
+constexpr int GENERATE_SLICE_SIZE = 4096;
+}
+
+FieldLatticeJob::FieldLatticeJob()
+	: field(nullptr)
+	, bvh(nullptr)
+	, size_x(0)
+	, size_y(0)
+	, spacing(0.0f)
+	, length(0.0f)
+	, ordered(false)
+	, stage(STAGE_DONE)
+	, position(0)
+	, num_published(0)
+	, releasing(0)
+{
+}
+
+FieldLatticeJob::~FieldLatticeJob()
+{
+	wait_release();
+}
+
+void FieldLatticeJob::start(PendulumField &f, BobBVH &b, int sx, int sy, float s, float l, bool o)
+{
+	cancel();
+
+	field = &f;
+	bvh = &b;
+	size_x = max(sx, 0);
+	size_y = max(sy, 0);
+	spacing = s;
+	length = max(l, Consts::EPS);
+	ordered = o;
+
+	back.clear();
+	back.setGravity(field->getGravity());
+	back.setDamping(field->getDamping());
+	back.setBobRadius(field->getBobRadius());
+	back.setNumaAware(field->isNumaAware());
+	back.reserve(size_x * size_y);
+	stage = STAGE_GENERATE;
+	position = 0;
+}
+
+void FieldLatticeJob::cancel()
+{
+	wait_release();
+	stage = STAGE_DONE;
+	back.clear();
+	back_bvh.clear();
+}
+
+float FieldLatticeJob::getProgress() const
+{
+	// generation and the sort take most of the time, the BVH the rest
+	switch (stage)
+	{
+		case STAGE_GENERATE: return 0.4f * position / max(size_x * size_y, 1);
+		case STAGE_REORDER: return 0.4f;
+		case STAGE_BVH: return 0.7f;
+		case STAGE_PUBLISH: return 0.99f;
+		default: return 1.0f;
+	}
+}
+
+bool FieldLatticeJob::update(long long end_time)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	while (stage != STAGE_DONE)
+	{
+		switch (stage)
+		{
+			case STAGE_GENERATE:
+			{
+				int num = size_x * size_y;
+				while (position < num)
+				{
+					if (Time::get() >= end_time)
+						return false;
+					int end = min(position + GENERATE_SLICE_SIZE, num);
+					for (; position < end; position++)
+					{
+						vec3 pivot;
+						float angle;
+						PendulumField::getLatticePendulum(position, size_x, size_y, spacing, length, pivot, angle);
+						back.addPendulum(pivot, vec2(1.0f, 0.0f), length, angle);
+					}
+				}
+				if (ordered)
+				{
+					back.beginReorder();
+					stage = STAGE_REORDER;
+					break;
+				}
+				back_bvh.beginBuild(back);
+				stage = STAGE_BVH;
+				break;
+			}
+			case STAGE_REORDER:
+				if (!back.updateReorder(end_time))
+					return false;
+				back_bvh.beginBuild(back);
+				stage = STAGE_BVH;
+				break;
+			case STAGE_BVH:
+				if (!back_bvh.updateBuild(end_time))
+					return false;
+				stage = STAGE_PUBLISH;
+				break;
+			case STAGE_PUBLISH:
+			{
+				// jobs run on the main thread between ticks, the tick never sees a half-swapped field
+				field->swap(back);
+				bvh->swap(back_bvh);
+				num_published++;
+				stage = STAGE_DONE;
+
+				releasing = 1;
+				AsyncQueue::runAsync(AsyncQueue::ASYNC_THREAD_BACKGROUND, MakeCallback(this, &FieldLatticeJob::release));
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	return true;
+}
+
+void FieldLatticeJob::release()
+{
+	// unmapping the arrays of a large field takes longer than a slice, the empty field and tree take their place
+	{
+		PendulumField retired;
+		back.swap(retired);
+		BobBVH retired_bvh;
+		back_bvh.swap(retired_bvh);
+	}
+	releasing = 0;
+}
+
+void FieldLatticeJob::wait_release()
+{
+	while (releasing)
+		Thread::switchThread();
+}
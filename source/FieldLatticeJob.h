@@ -0,0 +1,66 @@
+#ifndef __FIELD_LATTICE_JOB_H__
+#define __FIELD_LATTICE_JOB_H__
+
+#include "BobBVH.h"
+#include "FieldJobs.h"
+#include "PendulumField.h"
+
+#include <UnigineThread.h>
+
+// Regenerates a field as a new lattice without stalling frames.
+// The lattice is generated into a back field, sorted along the storage curve and covered by a new bob BVH, all in
+// slices. The last slice swaps the back field and its tree with the live ones, so the world switches to the new
+// field between two ticks. The replaced field is freed on the background thread.
+class FieldLatticeJob : public FieldJob
+{
+public:
+	FieldLatticeJob();
+	~FieldLatticeJob() override;
+
+	// the result replaces the pendulums of the field and the tree of the BVH, the parameters of the field stay
+	void start(PendulumField &field, BobBVH &bvh, int size_x, int size_y, float spacing, float length, bool ordered);
+	// drops the unpublished result, the job must not be queued
+	void cancel();
+	bool isRunning() const { return stage != STAGE_DONE; }
+	// incremented by every publish
+	int getNumPublished() const { return num_published; }
+	// lattice of the last start
+	int getSizeX() const { return size_x; }
+	int getSizeY() const { return size_y; }
+	float getSpacing() const { return spacing; }
+
+	const char *getName() const override { return "FieldLatticeJob"; }
+	bool update(long long end_time) override;
+	float getProgress() const override;
+
+private:
+	enum STAGE
+	{
+		STAGE_GENERATE = 0,
+		STAGE_REORDER,
+		STAGE_BVH,
+		STAGE_PUBLISH,
+		STAGE_DONE,
+	};
+
+	void release();
+	void wait_release();
+
+	PendulumField *field;
+	BobBVH *bvh;
+	int size_x;
+	int size_y;
+	float spacing;
+	float length;
+	bool ordered;
+
+	STAGE stage;
+	int position;
+	int num_published;
+
+	PendulumField back;
+	BobBVH back_bvh;
+	Unigine::AtomicInt32 releasing;
+};
+
+#endif // __FIELD_LATTICE_JOB_H__
@@ -0,0 +1,195 @@
+#include "FieldMemory.h"
+
+#include <UnigineMathLib.h>
+#include <UnigineThread.h>
+
+#ifdef __linux__
+	#include <dirent.h>
+	#include <linux/perf_event.h>
+	#include <stdlib.h>
+	#include <string.h>
+	#include <sys/ioctl.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+using namespace Unigine;
+
+namespace
+{
+constexpr size_t PAGE_SIZE = 4 * 1024;
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// mbind() policy and flags, libnuma is not required
+constexpr int MPOL_PREFERRED = 1;
+constexpr unsigned int MPOL_MF_MOVE = 1 << 1;
+
+AtomicInt32 huge_pages(0);
+AtomicInt32 num_nodes(0);
+
+// one counter per thread, workers started before beginCacheMisses() are not covered by inherited counters
+int miss_counters[FieldMemory::MAX_COUNTED_THREADS];
+int num_miss_counters = 0;
+
+int detect_nodes()
+{
+	#ifdef __linux__
+		DIR *dir = opendir("/sys/devices/system/node");
+		if (dir == nullptr)
+			return 1;
+		int num = 0;
+		while (dirent *entry = readdir(dir))
+		{
+			if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+				num++;
+		}
+		closedir(dir);
+		return Math::clamp(num, 1, int(FieldMemory::MAX_NODES));
+	#else
+		return 1;
+	#endif
+}
+
+// whole pages inside the range
+bool get_pages(void *ptr, size_t size, size_t &begin, size_t &end)
+{
+	size_t page_size = FieldMemory::getPageSize();
+	begin = (size_t(ptr) + page_size - 1) & ~(page_size - 1);
+	end = (size_t(ptr) + size) & ~(page_size - 1);
+	return begin < end;
+}
+}
+
+void FieldMemory::setHugePages(bool enabled)
+{
+	huge_pages = enabled ? 1 : 0;
+}
+
+bool FieldMemory::isHugePages()
+{
+	return huge_pages != 0;
+}
+
+size_t FieldMemory::getPageSize()
+{
+	return isHugePages() ? HUGE_PAGE_SIZE : PAGE_SIZE;
+}
+
+int FieldMemory::getNumNodes()
+{
+	if (num_nodes == 0)
+		num_nodes = detect_nodes();
+	return num_nodes;
+}
+
+int FieldMemory::getCurrentNode()
+{
+	#ifdef __linux__
+		if (getNumNodes() == 1)
+			return 0;
+		unsigned int cpu = 0;
+		unsigned int node = 0;
+		if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+			return 0;
+		return int(node) % getNumNodes();
+	#else
+		return 0;
+	#endif
+}
+
+bool FieldMemory::bind(void *ptr, size_t size, int node)
+{
+	#ifdef __linux__
+		size_t begin, end;
+		if (getNumNodes() == 1 || node < 0 || node >= MAX_NODES || !get_pages(ptr, size, begin, end))
+			return false;
+		unsigned long mask = 1ul << node;
+		return syscall(SYS_mbind, begin, end - begin, MPOL_PREFERRED, &mask, sizeof(mask) * 8, MPOL_MF_MOVE) == 0;
+	#else
+		UNIGINE_UNUSED(ptr);
+		UNIGINE_UNUSED(size);
+		UNIGINE_UNUSED(node);
+		return false;
+	#endif
+}
+
+bool FieldMemory::beginCacheMisses()
+{
+	endCacheMisses();
+	#ifdef __linux__
+		DIR *dir = opendir("/proc/self/task");
+		if (dir == nullptr)
+			return false;
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		bool ret = true;
+		while (dirent *entry = readdir(dir))
+		{
+			if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+				continue;
+			int fd = int(syscall(SYS_perf_event_open, &attr, atoi(entry->d_name), -1, -1, 0));
+			if (fd == -1 || num_miss_counters == MAX_COUNTED_THREADS)
+			{
+				if (fd != -1)
+					close(fd);
+				ret = false;
+				break;
+			}
+			miss_counters[num_miss_counters++] = fd;
+		}
+		closedir(dir);
+		if (!ret || num_miss_counters == 0)
+		{
+			endCacheMisses();
+			return false;
+		}
+		for (int i = 0; i < num_miss_counters; i++)
+		{
+			ioctl(miss_counters[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(miss_counters[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+long long FieldMemory::endCacheMisses()
+{
+	if (num_miss_counters == 0)
+		return -1;
+	long long ret = 0;
+	#ifdef __linux__
+		for (int i = 0; i < num_miss_counters && ret != -1; i++)
+		{
+			long long value = 0;
+			ioctl(miss_counters[i], PERF_EVENT_IOC_DISABLE, 0);
+			ret = (read(miss_counters[i], &value, sizeof(value)) == sizeof(value)) ? ret + value : -1;
+		}
+		for (int i = 0; i < num_miss_counters; i++)
+			close(miss_counters[i]);
+	#endif
+	num_miss_counters = 0;
+	return ret;
+}
+
+bool FieldMemory::advise(void *ptr, size_t size)
+{
+	#if defined(__linux__) && defined(MADV_HUGEPAGE)
+		size_t begin, end;
+		if (!isHugePages() || !get_pages(ptr, size, begin, end))
+			return false;
+		return madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE) == 0;
+	#else
+		UNIGINE_UNUSED(ptr);
+		UNIGINE_UNUSED(size);
+		return false;
+	#endif
+}
@@ -0,0 +1,38 @@
+#ifndef __FIELD_MEMORY_H__
+#define __FIELD_MEMORY_H__
+
+#include <stddef.h>
+
+// NUMA placement and huge page hints for the field arrays.
+// The arrays stay regular engine allocations; only the whole pages inside a range are moved or advised, so the
+// boundary pages are left where they are. Platforms without NUMA support report a single node and ignore the calls.
+class FieldMemory
+{
+public:
+	enum
+	{
+		MAX_NODES = 16,
+		// threads of the process followed by the cache miss counters
+		MAX_COUNTED_THREADS = 256,
+	};
+
+	// transparent huge pages for ranges advised afterwards
+	static void setHugePages(bool enabled);
+	static bool isHugePages();
+	static size_t getPageSize();
+
+	static int getNumNodes();
+	// node of the CPU the calling thread runs on
+	static int getCurrentNode();
+
+	// moves the pages of the range to the node and keeps them there, returns false if not supported
+	static bool bind(void *ptr, size_t size, int node);
+	static bool advise(void *ptr, size_t size);
+
+	// hardware cache misses of all threads of the process between the calls, for benchmarks on the main thread;
+	// beginCacheMisses() returns false and endCacheMisses() -1 where perf events are missing or restricted
+	static bool beginCacheMisses();
+	static long long endCacheMisses();
+};
+
+#endif // __FIELD_MEMORY_H__
@@ -0,0 +1,25 @@
+#ifndef __FIELD_NAN_H__
+#define __FIELD_NAN_H__
+
+#include <UnigineBase.h>
+
+#include <string.h>
+
+// Quiet NaN marking missing values in the exported and published columns, and the test for it.
+// Both work on the bits: fast math neither produces a NaN from arithmetic reliably nor keeps floating-point NaN checks.
+UNIGINE_INLINE float get_nan()
+{
+	const unsigned int bits = 0x7fc00000;
+	float ret;
+	memcpy(&ret, &bits, sizeof(ret));
+	return ret;
+}
+
+UNIGINE_INLINE bool is_finite(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x7f800000) != 0x7f800000;
+}
+
+#endif // __FIELD_NAN_H__
@@ -0,0 +1,364 @@
+#include "FieldPager.h"
+
+#include <UnigineLog.h>
+#include <UnigineProfiler.h>
+#include <UnigineTimer.h>
+
+#include <string.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+constexpr int PAGE_MAGIC = ('P' << 24) | ('G' << 16) | ('E' << 8) | '1';
+// tileset files address tiles with non-negative coordinates
+constexpr int CELL_BIAS = 1 << 20;
+
+struct PageHeader
+{
+	int magic;
+	int num;
+	// field time the page was frozen at
+	double time;
+};
+
+int wrap(int value, int size)
+{
+	int result = value % size;
+	return (result < 0) ? result + size : result;
+}
+
+// Carlson's symmetric form, both elliptic integrals of the first kind reduce to it
+double carlson_rf(double x, double y, double z)
+{
+	double mu = (x + y + z) / 3.0;
+	for (int i = 0; i < 64; i++)
+	{
+		double dx = 1.0 - x / mu;
+		double dy = 1.0 - y / mu;
+		double dz = 1.0 - z / mu;
+		if (max(max(abs(dx), abs(dy)), abs(dz)) < 1e-3)
+			break;
+		double sx = dsqrt(x);
+		double sy = dsqrt(y);
+		double sz = dsqrt(z);
+		double l = sx * (sy + sz) + sy * sz;
+		x = (x + l) * 0.25;
+		y = (y + l) * 0.25;
+		z = (z + l) * 0.25;
+		mu = (x + y + z) / 3.0;
+	}
+	double dx = 1.0 - x / mu;
+	double dy = 1.0 - y / mu;
+	double dz = -(dx + dy);
+	double e2 = dx * dy - dz * dz;
+	double e3 = dx * dy * dz;
+	return (1.0 - e2 / 10.0 + e3 / 14.0 + e2 * e2 / 24.0 - 3.0 * e2 * e3 / 44.0) / dsqrt(mu);
+}
+
+// complete and incomplete integrals of the first kind with the parameter m = k^2
+double elliptic_k(double m)
+{
+	return carlson_rf(0.0, 1.0 - m, 1.0);
+}
+
+double elliptic_f(double phi, double m)
+{
+	double s = sin(phi);
+	double c = cos(phi);
+	return s * carlson_rf(c * c, 1.0 - m * s * s, 1.0);
+}
+
+// Jacobi sn and cn by the descending Landen transformation
+void jacobi_sn_cn(double u, double m, double &sn, double &cn)
+{
+	constexpr int MAX_STEPS = 16;
+	double a[MAX_STEPS + 1];
+	double c[MAX_STEPS + 1];
+	a[0] = 1.0;
+	c[0] = dsqrt(m);
+	double b = dsqrt(1.0 - m);
+	int n = 0;
+	while (n < MAX_STEPS && abs(c[n]) > 1e-15)
+	{
+		a[n + 1] = (a[n] + b) * 0.5;
+		c[n + 1] = (a[n] - b) * 0.5;
+		b = dsqrt(a[n] * b);
+		n++;
+	}
+	double phi = double(1 << n) * a[n] * u;
+	for (int i = n; i > 0; i--)
+		phi = (asin(clamp(c[i] * sin(phi) / a[i], -1.0, 1.0)) + phi) * 0.5;
+	sn = sin(phi);
+	cn = cos(phi);
+}
+}
+
+FieldPager::FieldPager()
+	: field(nullptr)
+	, radius(0)
+	, size(0)
+	, resolution(0)
+	, spacing(0.0f)
+	, length(0.0f)
+	, time(0.0)
+	, num_thawed(0)
+	, num_generated(0)
+	, page_time(0.0f)
+{
+}
+
+FieldPager::~FieldPager()
+{
+	shutdown();
+}
+
+bool FieldPager::init(PendulumField &f, const char *path, int r, int res, float s, float l, const Vec3 &position)
+{
+	shutdown();
+
+	radius = max(r, 0);
+	size = radius * 2 + 1;
+	resolution = max(res, 1);
+	spacing = max(s, Consts::EPS);
+	length = max(l, Consts::EPS);
+	if (!open(path))
+		return false;
+
+	// pages are added in order, so the pendulums of a page have consecutive ids
+	field = &f;
+	field->clear();
+	// generated pivots are relative to an origin next to the view from the start
+	vec3 offset;
+	field->rebase(position, 0.0f, offset);
+	int num = getNumPagePendulums();
+	field->reserve(size * size * num);
+	for (int i = 0; i < size * size * num; i++)
+		field->addPendulum(vec3_zero, vec2(1.0f, 0.0f), length, 0.0f);
+
+	page_cells.resize(size * size);
+	center = getCell(position);
+	for (int i = 0; i < page_cells.size(); i++)
+		thaw(i, get_page_cell(i, center));
+
+	Log::message("FieldPager::init(): %d x %d cells of %d pendulums paged through \"%s\" at %.1f s\n", size, size, num, path, time);
+	return true;
+}
+
+void FieldPager::shutdown()
+{
+	if (field == nullptr)
+		return;
+
+	for (int i = 0; i < page_cells.size(); i++)
+		freeze(i);
+	file->setDoubleAttribute("time", time);
+	file->flushHeader();
+	file->close();
+	file.clear();
+
+	field = nullptr;
+	page_cells.clear();
+	buffer.destroy();
+}
+
+bool FieldPager::open(const char *path)
+{
+	int tile_size = int(sizeof(PageHeader)) + getNumPagePendulums() * 2 * int(sizeof(float));
+	buffer.resize(tile_size);
+
+	// a file of another lattice is started over, its tiles would not match the generated pivots
+	file = TilesetFile::create();
+	if (file->load(path) && file->getTileSize() == tile_size && file->getIntAttribute("resolution") == resolution &&
+		file->getFloatAttribute("spacing") == spacing && file->getFloatAttribute("length") == length)
+	{
+		time = file->getDoubleAttribute("time");
+		return true;
+	}
+
+	file->close();
+	if (!file->createFile(path, tile_size))
+	{
+		Log::error("FieldPager::open(): can't create \"%s\"\n", path);
+		file.clear();
+		return false;
+	}
+	file->setIntAttribute("resolution", resolution, 10, 0);
+	file->setFloatAttribute("spacing", spacing, 0);
+	file->setFloatAttribute("length", length, 0);
+	file->flushAttributes();
+	time = 0.0;
+	return true;
+}
+
+ivec2 FieldPager::getCell(const Vec3 &position) const
+{
+	Scalar cell_size = Scalar(getCellSize());
+	return ivec2(floorInt(position.x / cell_size), floorInt(position.y / cell_size));
+}
+
+ivec2 FieldPager::get_page_cell(int page, const ivec2 &c) const
+{
+	// the window cell whose coordinates are congruent with the page
+	int x = c.x - radius;
+	int y = c.y - radius;
+	return ivec2(x + wrap(page % size - x, size), y + wrap(page / size - y, size));
+}
+
+bool FieldPager::update(const Vec3 &position, float ifps)
+{
+	bool moved = false;
+	ivec2 cell = getCell(position);
+	if (field != nullptr && cell != center)
+	{
+		UNIGINE_PROFILER_FUNCTION;
+		long long begin = Time::get();
+		num_thawed = 0;
+		num_generated = 0;
+
+		// a step to a neighbouring cell replaces one row or column of pages, a jump replaces all of them
+		for (int i = 0; i < page_cells.size(); i++)
+		{
+			ivec2 page_cell = get_page_cell(i, cell);
+			if (page_cell == page_cells[i])
+				continue;
+			freeze(i);
+			thaw(i, page_cell);
+			moved = true;
+		}
+		center = cell;
+		page_time = Time::microsecondsToMilliseconds(Time::get() - begin);
+	}
+
+	// the tick that follows brings the resident pages to this time
+	time += ifps;
+	return moved;
+}
+
+void FieldPager::freeze(int page)
+{
+	int num = getNumPagePendulums();
+	PageHeader header = { PAGE_MAGIC, num, time };
+	memcpy(buffer.get(), &header, sizeof(header));
+	float *theta = reinterpret_cast<float *>(buffer.get() + sizeof(header));
+	float *omega = theta + num;
+	for (int i = 0; i < num; i++)
+	{
+		int slot = field->getSlot(page * num + i);
+		theta[i] = field->theta[slot];
+		omega[i] = field->omega[slot];
+	}
+
+	const ivec2 &cell = page_cells[page];
+	if (!file->setTile(cell.x + CELL_BIAS, cell.y + CELL_BIAS, buffer.get()))
+		Log::warning("FieldPager::freeze(): can't write cell %d %d\n", cell.x, cell.y);
+}
+
+void FieldPager::thaw(int page, const ivec2 &cell)
+{
+	int num = getNumPagePendulums();
+	PageHeader header = {};
+	bool stored = file->hasTile(cell.x + CELL_BIAS, cell.y + CELL_BIAS) && file->getTile(cell.x + CELL_BIAS, cell.y + CELL_BIAS, buffer.get());
+	if (stored)
+	{
+		memcpy(&header, buffer.get(), sizeof(header));
+		stored = (header.magic == PAGE_MAGIC && header.num == num);
+	}
+	const float *theta = reinterpret_cast<const float *>(buffer.get() + sizeof(header));
+	const float *omega = theta + num;
+
+	// cells never visited start from the lattice wave at time zero, so all cells share one history
+	double frozen_time = stored ? header.time : 0.0;
+	float gravity = field->getGravity();
+	float damping = field->getDamping();
+	for (int i = 0; i < num; i++)
+	{
+		int x = cell.x * resolution + i % resolution;
+		int y = cell.y * resolution + i / resolution;
+		int slot = field->getSlot(page * num + i);
+		float t = stored ? theta[i] : PendulumField::getLatticeAngle(x, y);
+		float w = stored ? omega[i] : 0.0f;
+		fastForward(t, w, length, gravity, damping, time - frozen_time);
+		field->theta[slot] = t;
+		field->omega[slot] = w;
+		// cells far from the world origin are placed in double precision relative to the field origin
+		Vec3 pivot = Vec3((x + Scalar(0.5)) * spacing, (y + Scalar(0.5)) * spacing, Scalar(length));
+		field->setPivot(page * num + i, vec3(pivot - field->getOrigin()));
+		field->wake(slot);
+	}
+
+	page_cells[page] = cell;
+	num_thawed += stored ? 1 : 0;
+	num_generated += stored ? 0 : 1;
+}
+
+void FieldPager::fastForward(float &theta, float &omega, float l, float gravity, float damping, double dt)
+{
+	if (dt <= 0.0)
+		return;
+
+	// the orbit parameter m = k^2 is the energy relative to the top of the swing, it is 1 at the separatrix
+	double w0 = dsqrt(double(gravity) / max(l, Consts::EPS));
+	double half = sin(theta * 0.5);
+	double v = omega / (2.0 * w0);
+	double m = half * half + v * v;
+	double decay = exp(-double(damping) * dt);
+	double t = theta;
+	double sign = (omega < 0.0f) ? -1.0 : 1.0;
+
+	if (m >= 1.0)
+	{
+		// a rotating pendulum turns with the mean speed of its orbit until damping drops it below the top,
+		// the kinetic part above the mean height of the orbit decays twice as fast as a swing
+		double rotate_time = (damping > 0.0f) ? log((m - 0.5) / 0.5) / (2.0 * damping) : dt;
+		double rotate_end = min(rotate_time, dt);
+		double m_end = 0.5 + (m - 0.5) * exp(-2.0 * damping * rotate_end);
+		double m_mean = max(dsqrt(m * m_end), 1.0 + 1e-9);
+		double speed = Consts::PI * w0 * dsqrt(m_mean) / elliptic_k(1.0 / m_mean);
+		t += sign * speed * rotate_end;
+		if (rotate_time >= dt)
+		{
+			double s = sin(t * 0.5);
+			theta = float(t);
+			omega = float(sign * 2.0 * w0 * dsqrt(max(m_end - s * s, 0.0)));
+			return;
+		}
+		// the pendulum swings back from the nearest top
+		t = Consts::PI * (2.0 * ::floor(t / (2.0 * Consts::PI)) + 1.0);
+		dt -= rotate_end;
+		decay = exp(-double(damping) * dt);
+		m = 1.0;
+		v = 0.0;
+	}
+
+	double m_end = m * decay;
+	double center = 2.0 * Consts::PI * ::floor(t / (2.0 * Consts::PI) + 0.5);
+	half = sin((t - center) * 0.5);
+	if (m_end < 1e-14)
+	{
+		theta = float(center);
+		omega = 0.0f;
+		return;
+	}
+
+	// position on the orbit as the argument u of theta = 2 asin(k sn(u)), omega = 2 k w0 cn(u)
+	m = min(m, 1.0 - 1e-12);
+	m_end = min(m_end, 1.0 - 1e-12);
+	double k = dsqrt(m);
+	double k_begin = elliptic_k(m);
+	double k_end = elliptic_k(m_end);
+	double u = elliptic_f(asin(clamp(half / k, -1.0, 1.0)), m);
+	if (v < 0.0)
+		u = 2.0 * k_begin - u;
+
+	// the period stretches as the amplitude decays, the phase advances with the mean of both ends
+	double phase = u / (4.0 * k_begin) + w0 * dt * 0.125 * (1.0 / k_begin + 1.0 / k_end);
+	phase = frac(phase);
+
+	double sn, cn;
+	jacobi_sn_cn(phase * 4.0 * k_end, m_end, sn, cn);
+	k = dsqrt(m_end);
+	theta = float(center + 2.0 * asin(clamp(k * sn, -1.0, 1.0)));
+	omega = float(2.0 * k * w0 * cn);
+}
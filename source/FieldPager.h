@@ -0,0 +1,75 @@
+#ifndef __FIELD_PAGER_H__
+#define __FIELD_PAGER_H__
+
+#include "PendulumField.h"
+
+#include <UnigineMathLib.h>
+#include <UnigineTilesetFile.h>
+#include <UnigineVector.h>
+
+// Infinite lattice field paged through a tileset file.
+// The plane is split into square cells of resolution x resolution pendulums. Only the window of cells around the
+// view position lives in the field: a cell maps to the page (cell mod window size), so the field has a fixed
+// number of pendulums and ids no matter how far the view travels. A page leaving the window is frozen into the
+// tile of its cell together with the time, a cell entering it is thawed from its tile or generated, and fast-forwarded
+// in closed form over the time it spent frozen.
+class FieldPager
+{
+public:
+	FieldPager();
+	~FieldPager();
+
+	// fills the empty field with the window around the position, cells outside of it are kept in the file at path
+	bool init(PendulumField &field, const char *path, int radius, int resolution, float spacing, float length,
+		const Unigine::Math::Vec3 &position);
+	// freezes the resident cells and closes the file
+	void shutdown();
+	bool isInitialized() const { return field != nullptr; }
+
+	// moves the window to the cell of the position and advances the time by the tick that follows,
+	// returns true if any page was replaced
+	bool update(const Unigine::Math::Vec3 &position, float ifps);
+
+	int getRadius() const { return radius; }
+	int getResolution() const { return resolution; }
+	float getCellSize() const { return resolution * spacing; }
+	int getNumPages() const { return page_cells.size(); }
+	int getNumPagePendulums() const { return resolution * resolution; }
+	Unigine::Math::ivec2 getCell(const Unigine::Math::Vec3 &position) const;
+	const Unigine::Math::ivec2 &getCenter() const { return center; }
+	double getTime() const { return time; }
+
+	// statistics of the last update that moved the window, the time is in milliseconds
+	int getNumThawed() const { return num_thawed; }
+	int getNumGenerated() const { return num_generated; }
+	float getPageTime() const { return page_time; }
+
+	// advances a damped pendulum by the time without integrating: the undamped orbit is followed with the Jacobi
+	// elliptic functions while its energy decays as exp(-damping * time), which holds for light damping
+	static void fastForward(float &theta, float &omega, float length, float gravity, float damping, double time);
+
+private:
+	Unigine::Math::ivec2 get_page_cell(int page, const Unigine::Math::ivec2 &center) const;
+	bool open(const char *path);
+	void freeze(int page);
+	void thaw(int page, const Unigine::Math::ivec2 &cell);
+
+	PendulumField *field;
+	Unigine::TilesetFilePtr file;
+	int radius;
+	int size;
+	int resolution;
+	float spacing;
+	float length;
+
+	Unigine::Math::ivec2 center;
+	Unigine::Vector<Unigine::Math::ivec2> page_cells;
+	Unigine::Vector<unsigned char> buffer;
+	double time;
+
+	int num_thawed;
+	int num_generated;
+	float page_time;
+};
+
+#endif // __FIELD_PAGER_H__
@@ -0,0 +1,294 @@
+#include "FieldPreview.h"
+
+#include <UnigineMesh.h>
+#include <UniginePhysics.h>
+#include <UnigineProfiler.h>
+#include <UnigineTimer.h>
+
+#include <string.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+// editor time the preview may run ahead of the simulation before it slows down
+constexpr int MAX_LAG_TICKS = 4;
+}
+
+FieldPreview::FieldPreview()
+	: budget(4.0f)
+	, duration(10.0f)
+	, max_instances(16384)
+	, tick(1.0f / 60.0f)
+	, time(0.0)
+	, num_ticks(0)
+	, instance_stride(0)
+	, num_instances(0)
+{
+}
+
+FieldPreview::~FieldPreview()
+{
+	shutdown();
+}
+
+void FieldPreview::init(int size_x, int size_y, float spacing, float length)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	shutdown();
+	initial.createLattice(size_x, size_y, spacing, length);
+	init_field();
+}
+
+void FieldPreview::init(const PendulumField &source)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	shutdown();
+	int num = source.getNumPendulums();
+	initial.resize(num);
+	for (int i = 0; i < PendulumField::NUM_ARRAYS; i++)
+		memcpy(initial.getArray(PendulumField::ARRAY(i)).get(), source.getArray(PendulumField::ARRAY(i)).get(), sizeof(float) * num);
+	initial.setGravity(source.getGravity());
+	initial.setDamping(source.getDamping());
+	initial.setBobRadius(source.getBobRadius());
+	init_field();
+}
+
+void FieldPreview::init_field()
+{
+	int num = initial.getNumPendulums();
+	field.resize(num);
+	for (int i = 0; i < PendulumField::NUM_ARRAYS; i++)
+		memcpy(field.getArray(PendulumField::ARRAY(i)).get(), initial.getArray(PendulumField::ARRAY(i)).get(), sizeof(float) * num);
+	field.setGravity(initial.getGravity());
+	field.setDamping(initial.getDamping());
+	field.setBobRadius(initial.getBobRadius());
+	// sleeping pendulums would not replay the same way after a reset
+	field.setSleepEnergy(0.0f);
+
+	int num_chunks = field.getNumChunks();
+	chunk_ticks.resize(num_chunks);
+	chunk_stale.resize(num_chunks);
+	memset(chunk_stale.get(), 0, num_chunks);
+	restart();
+
+	create_cluster();
+}
+
+void FieldPreview::shutdown()
+{
+	if (cluster)
+		cluster.deleteLater();
+	initial.clear();
+	field.clear();
+	chunk_ticks.destroy();
+	chunk_stale.destroy();
+	stale_chunks.destroy();
+	fresh_chunks.destroy();
+	slots.destroy();
+	transforms.destroy();
+	instance_stride = 0;
+	num_instances = 0;
+	time = 0.0;
+	num_ticks = 0;
+}
+
+void FieldPreview::setMaxInstances(int num)
+{
+	num = max(num, 0);
+	if (max_instances == num)
+		return;
+	max_instances = num;
+	if (isInitialized())
+		create_cluster();
+}
+
+void FieldPreview::restart()
+{
+	for (int chunk : stale_chunks)
+		chunk_stale[chunk] = 0;
+	stale_chunks.clear();
+
+	int num = field.getNumPendulums();
+	memcpy(field.theta.get(), initial.theta.get(), sizeof(float) * num);
+	memcpy(field.omega.get(), initial.omega.get(), sizeof(float) * num);
+	field.updateBobs();
+
+	time = 0.0;
+	num_ticks = 0;
+	update_stale_chunks();
+}
+
+int FieldPreview::mark_region(const BoundBox &region, Vector<int> &result)
+{
+	result.clear();
+	int num = field.getNumPendulums();
+	for (int i = 0; i < num; i++)
+	{
+		if (region.inside(field.getPivot(i)))
+			result.append(i);
+	}
+	return result.size();
+}
+
+void FieldPreview::setLength(const BoundBox &region, float length)
+{
+	if (mark_region(region, slots) == 0)
+		return;
+
+	length = max(length, Consts::EPS);
+	for (int slot : slots)
+	{
+		initial.length[slot] = length;
+		field.length[slot] = length;
+	}
+
+	reset_slots();
+}
+
+void FieldPreview::setAngle(const BoundBox &region, float angle)
+{
+	if (mark_region(region, slots) == 0)
+		return;
+
+	for (int slot : slots)
+	{
+		initial.theta[slot] = angle;
+		initial.omega[slot] = 0.0f;
+	}
+
+	reset_slots();
+}
+
+void FieldPreview::reset_slots()
+{
+	// slots are sorted, every chunk under the region is reset once
+	int last_chunk = -1;
+	for (int slot : slots)
+	{
+		int chunk = slot / PendulumField::CHUNK_SIZE;
+		if (chunk != last_chunk)
+			reset_chunk(chunk);
+		last_chunk = chunk;
+	}
+	update_stale_chunks();
+}
+
+void FieldPreview::reset_chunk(int chunk)
+{
+	int begin, end;
+	field.getChunkRange(chunk, begin, end);
+	size_t size = sizeof(float) * (end - begin);
+	memcpy(field.theta.get() + begin, initial.theta.get() + begin, size);
+	memcpy(field.omega.get() + begin, initial.omega.get() + begin, size);
+	field.updateBobs(begin, end);
+
+	chunk_ticks[chunk] = 0;
+	if (!chunk_stale[chunk])
+	{
+		chunk_stale[chunk] = 1;
+		stale_chunks.append(chunk);
+	}
+}
+
+void FieldPreview::update_stale_chunks()
+{
+	for (int i = stale_chunks.size() - 1; i >= 0; i--)
+	{
+		int chunk = stale_chunks[i];
+		if (chunk_ticks[chunk] < num_ticks)
+			continue;
+		chunk_stale[chunk] = 0;
+		stale_chunks.removeFast(i);
+	}
+
+	fresh_chunks.clear();
+	int num_chunks = field.getNumChunks();
+	for (int i = 0; i < num_chunks; i++)
+	{
+		if (!chunk_stale[i])
+			fresh_chunks.append(i);
+	}
+}
+
+void FieldPreview::update(float ifps)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	if (!isInitialized())
+		return;
+
+	tick = Physics::getIFps();
+	long long end_time = Time::get() + (long long)(budget * 1000.0f);
+
+	if (num_ticks * tick >= duration)
+		restart();
+
+	// the preview slows down when the budget is not enough instead of accumulating debt
+	time = min(time + ifps, (num_ticks + MAX_LAG_TICKS) * double(tick));
+	int target_ticks = int(time / tick);
+
+	// the edited chunks catch up first so the region rejoins the rest of the field as soon as possible
+	while (stale_chunks.size() && Time::get() < end_time)
+	{
+		field.step(tick, stale_chunks.get(), stale_chunks.size());
+		for (int chunk : stale_chunks)
+			chunk_ticks[chunk]++;
+		update_stale_chunks();
+	}
+
+	while (num_ticks < target_ticks && Time::get() < end_time)
+	{
+		if (stale_chunks.empty())
+			field.step(tick);
+		else
+			field.step(tick, fresh_chunks.get(), fresh_chunks.size());
+		num_ticks++;
+	}
+
+	update_instances();
+
+	Profiler::setValue("Preview stale chunks", "", stale_chunks.size(), field.getNumChunks(), nullptr);
+}
+
+void FieldPreview::create_cluster()
+{
+	if (cluster)
+		cluster.deleteLater();
+
+	int num = field.getNumPendulums();
+	instance_stride = (max_instances > 0) ? (num + max_instances - 1) / max_instances : 0;
+	num_instances = (instance_stride > 0) ? (num + instance_stride - 1) / instance_stride : 0;
+	if (num_instances == 0)
+		return;
+
+	MeshPtr mesh = Mesh::create();
+	mesh->addSphereSurface("bob", field.getBobRadius(), 6, 8);
+
+	cluster = ObjectMeshCluster::create();
+	cluster->setName("pendulum_preview");
+	cluster->setMeshProceduralMode(ObjectMeshStatic::PROCEDURAL_MODE_DYNAMIC);
+	cluster->applyMoveMeshProceduralForce(mesh);
+	// editor-only node
+	cluster->setSaveToWorldEnabled(false);
+	cluster->setShowInEditorEnabled(false);
+	cluster->setCastShadow(false, 0);
+	cluster->setIntersection(false, 0);
+
+	transforms.resize(num_instances);
+	for (int i = 0; i < num_instances; i++)
+		transforms[i] = translate(Vec3(field.getBob(i * instance_stride)));
+	cluster->createMeshes(transforms);
+}
+
+void FieldPreview::update_instances()
+{
+	if (!cluster || num_instances == 0)
+		return;
+
+	for (int i = 0; i < num_instances; i++)
+		cluster->setMeshTransform(i, translate(field.getBob(i * instance_stride)));
+}
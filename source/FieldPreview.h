@@ -0,0 +1,89 @@
+#ifndef __FIELD_PREVIEW_H__
+#define __FIELD_PREVIEW_H__
+
+#include "PendulumField.h"
+
+#include <UnigineMathLibBounds.h>
+#include <UnigineObjects.h>
+#include <UnigineVector.h>
+
+// Editor-time preview of a pendulum field.
+// The preview plays a loop of the field from its initial state, simulating as many ticks per frame as the budget
+// allows and slowing down instead of falling behind. Pendulums are uncoupled, so an edit only resets the chunks
+// under the edited region to the initial state; they are re-simulated up to the current tick while the rest of the
+// field keeps playing. Bobs are drawn as instances of a single ObjectMeshCluster that is not saved with the world.
+class FieldPreview
+{
+public:
+	FieldPreview();
+	~FieldPreview();
+
+	void init(int size_x, int size_y, float spacing, float length);
+	// starts the loop from a copy of the given field
+	void init(const PendulumField &source);
+	void shutdown();
+	bool isInitialized() const { return field.getNumPendulums() > 0; }
+
+	// milliseconds of simulation per frame
+	void setBudget(float b) { budget = Unigine::Math::max(b, 0.0f); }
+	float getBudget() const { return budget; }
+	// length of the loop in seconds
+	void setDuration(float d) { duration = Unigine::Math::max(d, 0.1f); }
+	float getDuration() const { return duration; }
+	// bobs over the limit are skipped with a uniform stride
+	void setMaxInstances(int num);
+	int getMaxInstances() const { return max_instances; }
+
+	void setIntegrator(PendulumField::INTEGRATOR integrator) { field.setIntegrator(integrator); }
+	void setDamping(float damping) { field.setDamping(damping); }
+
+	// edits of the pendulums whose pivots are inside the region, the region is re-simulated from the loop start
+	void setLength(const Unigine::Math::BoundBox &region, float length);
+	void setAngle(const Unigine::Math::BoundBox &region, float angle);
+	// starts the loop again
+	void restart();
+
+	// advances the preview by ifps seconds of editor time and updates the instances
+	void update(float ifps);
+
+	const PendulumField &getField() const { return field; }
+	// state at the loop start with all edits applied, this is what gets saved
+	const PendulumField &getInitialField() const { return initial; }
+	float getTime() const { return num_ticks * tick; }
+	// chunks still catching up after an edit
+	int getNumStaleChunks() const { return stale_chunks.size(); }
+
+private:
+	void init_field();
+	int mark_region(const Unigine::Math::BoundBox &region, Unigine::Vector<int> &slots);
+	void reset_slots();
+	void reset_chunk(int chunk);
+	// drops the stale chunks that caught up and lists the others
+	void update_stale_chunks();
+	void create_cluster();
+	void update_instances();
+
+	PendulumField initial;
+	PendulumField field;
+
+	float budget;
+	float duration;
+	int max_instances;
+
+	float tick;
+	double time;
+	int num_ticks;
+	// ticks simulated by the stale chunks, the fresh ones are at num_ticks
+	Unigine::Vector<int> chunk_ticks;
+	Unigine::Vector<unsigned char> chunk_stale;
+	Unigine::Vector<int> stale_chunks;
+	Unigine::Vector<int> fresh_chunks;
+	Unigine::Vector<int> slots;
+
+	Unigine::ObjectMeshClusterPtr cluster;
+	Unigine::Vector<Unigine::Math::Mat4> transforms;
+	int instance_stride;
+	int num_instances;
+};
+
+#endif // __FIELD_PREVIEW_H__
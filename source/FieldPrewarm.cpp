@@ -0,0 +1,141 @@
+#include "FieldPrewarm.h"
+
+#include <UnigineAsyncQueue.h>
+#include <UnigineLoadingScreen.h>
+#include <UnigineLog.h>
+#include <UnigineProfiler.h>
+
+using namespace Unigine;
+
+FieldPrewarm::FieldPrewarm()
+	: field_job(nullptr)
+	, field_done(true)
+{
+}
+
+FieldPrewarm::~FieldPrewarm()
+{
+	// the background job references this object
+	field_done.waitValue(true);
+	clear();
+}
+
+void FieldPrewarm::clear()
+{
+	for (MeshResource &resource : meshes)
+	{
+		if (!resource.mesh && resource.id != -1)
+			AsyncQueue::removeMesh(resource.id);
+	}
+	for (ImageResource &resource : images)
+	{
+		if (!resource.image && resource.id != -1)
+			AsyncQueue::removeImage(resource.id);
+	}
+	meshes.clear();
+	images.clear();
+}
+
+void FieldPrewarm::addMeshes(const char *paths)
+{
+	StringArray<> tokens = String::split(paths, ";");
+	for (int i = 0; i < tokens.size(); i++)
+	{
+		MeshResource &resource = meshes.append();
+		resource.path = tokens[i];
+		resource.id = AsyncQueue::loadMesh(tokens[i]);
+		if (resource.id == -1)
+			Log::warning("FieldPrewarm::addMeshes(): can't queue \"%s\" mesh\n", tokens[i]);
+	}
+}
+
+void FieldPrewarm::addImages(const char *paths)
+{
+	StringArray<> tokens = String::split(paths, ";");
+	for (int i = 0; i < tokens.size(); i++)
+	{
+		ImageResource &resource = images.append();
+		resource.path = tokens[i];
+		resource.id = AsyncQueue::loadImage(tokens[i]);
+		if (resource.id == -1)
+			Log::warning("FieldPrewarm::addImages(): can't queue \"%s\" image\n", tokens[i]);
+	}
+}
+
+void FieldPrewarm::run(CallbackBase *job, AsyncQueue::ASYNC_THREAD thread)
+{
+	field_done.waitValue(true);
+	field_job = job;
+	if (field_job == nullptr)
+		return;
+
+	field_done = false;
+	AsyncQueue::runAsync(thread, MakeCallback(this, &FieldPrewarm::run_field_job), AsyncQueue::ASYNC_PRIORITY_CRITICAL);
+}
+
+void FieldPrewarm::run_field_job()
+{
+	field_job->run();
+	delete field_job;
+	field_job = nullptr;
+	field_done = true;
+}
+
+void FieldPrewarm::update_resources()
+{
+	for (MeshResource &resource : meshes)
+	{
+		if (!resource.mesh && resource.id != -1 && AsyncQueue::checkMesh(resource.id))
+			resource.mesh = AsyncQueue::takeMesh(resource.id);
+	}
+	for (ImageResource &resource : images)
+	{
+		if (!resource.image && resource.id != -1 && AsyncQueue::checkImage(resource.id))
+			resource.image = AsyncQueue::takeImage(resource.id);
+	}
+}
+
+bool FieldPrewarm::isDone() const
+{
+	if (!field_done)
+		return false;
+	for (const MeshResource &resource : meshes)
+	{
+		if (!resource.mesh && resource.id != -1)
+			return false;
+	}
+	for (const ImageResource &resource : images)
+	{
+		if (!resource.image && resource.id != -1)
+			return false;
+	}
+	return true;
+}
+
+int FieldPrewarm::getProgress() const
+{
+	int num_done = field_done ? 1 : 0;
+	for (const MeshResource &resource : meshes)
+		num_done += (resource.mesh || resource.id == -1) ? 1 : 0;
+	for (const ImageResource &resource : images)
+		num_done += (resource.image || resource.id == -1) ? 1 : 0;
+	return num_done * 100 / (meshes.size() + images.size() + 1);
+}
+
+void FieldPrewarm::wait()
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	bool enabled = LoadingScreen::isEnabled();
+	LoadingScreen::setEnabled(true);
+
+	update_resources();
+	while (!isDone())
+	{
+		LoadingScreen::render(getProgress(), field_done ? "Loading field resources" : "Initializing field");
+		update_resources();
+	}
+	LoadingScreen::render(100, "");
+
+	LoadingScreen::setEnabled(enabled);
+}
@@ -0,0 +1,64 @@
+#ifndef __FIELD_PREWARM_H__
+#define __FIELD_PREWARM_H__
+
+#include <UnigineAsyncQueue.h>
+#include <UnigineCallback.h>
+#include <UnigineImage.h>
+#include <UnigineMesh.h>
+#include <UnigineThread.h>
+#include <UnigineVector.h>
+
+// Startup prewarm of the field resources.
+// Meshes and images are queued on the engine async queue and the field initialization job runs on the
+// background thread, or on the file stream thread when it mostly reads; the loading screen is rendered with the combined progress until everything is resident.
+class FieldPrewarm
+{
+public:
+	FieldPrewarm();
+	~FieldPrewarm();
+
+	void clear();
+
+	// semicolon separated lists are accepted
+	void addMeshes(const char *paths);
+	void addImages(const char *paths);
+
+	// takes ownership of the callback, it is run on the given async thread
+	void run(Unigine::CallbackBase *field_job, Unigine::AsyncQueue::ASYNC_THREAD thread = Unigine::AsyncQueue::ASYNC_THREAD_BACKGROUND);
+	// renders the loading screen until all resources are loaded and the field job is done
+	void wait();
+
+	bool isDone() const;
+	int getProgress() const;
+
+	int getNumMeshes() const { return meshes.size(); }
+	const Unigine::MeshPtr &getMesh(int num) const { return meshes[num].mesh; }
+	int getNumImages() const { return images.size(); }
+	const Unigine::ImagePtr &getImage(int num) const { return images[num].image; }
+
+private:
+	struct MeshResource
+	{
+		Unigine::String path;
+		int id;
+		Unigine::MeshPtr mesh;
+	};
+
+	struct ImageResource
+	{
+		Unigine::String path;
+		int id;
+		Unigine::ImagePtr image;
+	};
+
+	void run_field_job();
+	void update_resources();
+
+	Unigine::Vector<MeshResource> meshes;
+	Unigine::Vector<ImageResource> images;
+
+	Unigine::CallbackBase *field_job;
+	Unigine::AtomicBool field_done;
+};
+
+#endif // __FIELD_PREWARM_H__
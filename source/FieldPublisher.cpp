@@ -0,0 +1,250 @@
+#include "FieldPublisher.h"
+#include "FieldNan.h"
+
+#include <UnigineLog.h>
+#include <UnigineProfiler.h>
+#include <UnigineThread.h>
+#include <UnigineTimer.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <time.h>
+	#include <unistd.h>
+#endif
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+size_t align(size_t size)
+{
+	return (size + FIELD_STATE_ALIGNMENT - 1) & ~size_t(FIELD_STATE_ALIGNMENT - 1);
+}
+
+// monotonic clock in nanoseconds, the same clock the readers compare publish times with
+long long get_clock()
+{
+	#ifdef _WIN32
+		LARGE_INTEGER counter, frequency;
+		QueryPerformanceCounter(&counter);
+		QueryPerformanceFrequency(&frequency);
+		return (long long)(counter.QuadPart / frequency.QuadPart) * 1000000000LL
+			+ (long long)(counter.QuadPart % frequency.QuadPart) * 1000000000LL / frequency.QuadPart;
+	#else
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	#endif
+}
+}
+
+FieldPublisher::FieldPublisher()
+	: header(nullptr)
+	, frames(nullptr)
+	, size(0)
+	#ifdef _WIN32
+		, mapping(nullptr)
+	#else
+		, fd(-1)
+	#endif
+	, columns(0)
+	, num_frames(0)
+	, capacity(0)
+	, interval(1)
+	, ticks(0)
+	, num_ticks(0)
+	, time(0.0)
+	, publish_time(0.0f)
+{
+}
+
+FieldPublisher::~FieldPublisher()
+{
+	close();
+}
+
+bool FieldPublisher::open(const char *n, const PendulumField &field, int mask, int frames_count)
+{
+	close();
+
+	arrays.clear();
+	for (int i = 0; i < PendulumField::NUM_ARRAYS && arrays.size() < FIELD_STATE_MAX_COLUMNS; i++)
+		if (mask & (1 << i))
+			arrays.append(i);
+	if (arrays.empty() || field.getNumIds() == 0)
+	{
+		Log::error("FieldPublisher::open(): nothing to publish\n");
+		return false;
+	}
+
+	// room for the pendulums spawned up to the end of the current chunk
+	capacity = (field.getNumIds() + PendulumField::CHUNK_SIZE - 1) / PendulumField::CHUNK_SIZE * PendulumField::CHUNK_SIZE;
+	columns = mask;
+	num_frames = max(frames_count, 2);
+	size_t column_size = align(sizeof(float) * capacity);
+	size_t frame_size = align(sizeof(FieldStateFrame)) + column_size * arrays.size();
+	size_t header_size = align(sizeof(FieldStateHeader));
+	size_t total_size = header_size + frame_size * num_frames;
+
+	void *ptr = nullptr;
+	#ifdef _WIN32
+		String object = String::format("Local\\%s", (n[0] == '/') ? n + 1 : n);
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD((unsigned long long)total_size >> 32),
+			DWORD(total_size & 0xffffffff), object.get());
+		// a name still held by the readers of a previous ring would hand back the old memory
+		if (mapping != nullptr && GetLastError() != ERROR_ALREADY_EXISTS)
+			ptr = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, total_size);
+	#else
+		// a name left behind by a crashed run is replaced, its readers keep the old memory
+		shm_unlink(n);
+		fd = shm_open(n, O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd != -1 && ftruncate(fd, off_t(total_size)) == 0)
+		{
+			ptr = mmap(nullptr, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (ptr == MAP_FAILED)
+				ptr = nullptr;
+		}
+	#endif
+	name = n;
+	size = total_size;
+	if (ptr == nullptr)
+	{
+		Log::error("FieldPublisher::open(): can't create \"%s\" shared memory of %.1f MB\n", n, total_size / 1048576.0);
+		close();
+		return false;
+	}
+
+	// fresh memory is zeroed, the magic goes last so readers never see a half set header
+	header = static_cast<FieldStateHeader *>(ptr);
+	frames = static_cast<unsigned char *>(ptr) + header_size;
+	header->version = FIELD_STATE_VERSION;
+	header->header_size = unsigned(header_size);
+	header->frame_size = unsigned(frame_size);
+	header->num_frames = num_frames;
+	header->capacity = capacity;
+	header->num_columns = arrays.size();
+	for (int i = 0; i < arrays.size(); i++)
+		header->columns[i] = arrays[i];
+	#ifdef _WIN32
+		header->writer_pid = GetCurrentProcessId();
+	#else
+		header->writer_pid = unsigned(getpid());
+	#endif
+	AtomicSet(reinterpret_cast<volatile int *>(&header->magic), int(FIELD_STATE_MAGIC));
+
+	ticks = 0;
+	num_ticks = 0;
+	time = 0.0;
+	publish_time = 0.0f;
+	return true;
+}
+
+void FieldPublisher::close()
+{
+	void *ptr = header;
+	if (header)
+	{
+		// readers that still map the memory notice the publisher is gone
+		AtomicSet(reinterpret_cast<volatile int *>(&header->magic), 0);
+	}
+	#ifdef _WIN32
+		if (ptr)
+			UnmapViewOfFile(ptr);
+		if (mapping)
+			CloseHandle(mapping);
+		mapping = nullptr;
+	#else
+		if (ptr)
+			munmap(ptr, size);
+		if (fd != -1)
+		{
+			::close(fd);
+			shm_unlink(name.get());
+		}
+		fd = -1;
+	#endif
+	header = nullptr;
+	frames = nullptr;
+	size = 0;
+	columns = 0;
+	num_frames = 0;
+	capacity = 0;
+}
+
+long long FieldPublisher::getNumPublished() const
+{
+	return header ? AtomicGet(&header->num_published) : 0;
+}
+
+void FieldPublisher::update(const PendulumField &field, float ifps)
+{
+	if (!header)
+		return;
+
+	time += ifps;
+	header->tick_step = ifps;
+	num_ticks++;
+	if (++ticks < interval)
+		return;
+	ticks = 0;
+
+	UNIGINE_PROFILER_FUNCTION;
+	long long begin = Time::get();
+	publish(field);
+	publish_time = Time::microsecondsToMilliseconds(Time::get() - begin);
+}
+
+void FieldPublisher::publish(const PendulumField &field)
+{
+	long long index = header->num_published;
+	FieldStateFrame *frame = reinterpret_cast<FieldStateFrame *>(frames + size_t(index % header->num_frames) * header->frame_size);
+	float *data = reinterpret_cast<float *>(reinterpret_cast<unsigned char *>(frame) + align(sizeof(FieldStateFrame)));
+	size_t column_size = align(sizeof(float) * capacity) / sizeof(float);
+
+	// the odd sequence goes out before any data, the increment is a full barrier
+	AtomicInc(&frame->sequence);
+
+	int num_ids = min(field.getNumIds(), capacity);
+	int num_chunks = (capacity + PendulumField::CHUNK_SIZE - 1) / PendulumField::CHUNK_SIZE;
+	int num_columns = arrays.size();
+	AtomicInt32 next_chunk(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		float nan = get_nan();
+		int slots[PendulumField::CHUNK_SIZE];
+		for (int chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++)
+		{
+			int begin = chunk * PendulumField::CHUNK_SIZE;
+			int width = min(capacity - begin, int(PendulumField::CHUNK_SIZE));
+			for (int i = 0; i < width; i++)
+				slots[i] = (begin + i < num_ids && field.isValidId(begin + i)) ? field.getSlot(begin + i) : -1;
+			for (int column = 0; column < num_columns; column++)
+			{
+				const float *src = field.getArray(PendulumField::ARRAY(arrays[column])).get();
+				float *dest = data + column * column_size + begin;
+				for (int i = 0; i < width; i++)
+					dest[i] = (slots[i] >= 0) ? src[slots[i]] : nan;
+			}
+		}
+	});
+
+	frame->num_pendulums = num_ids;
+	frame->frame = (unsigned long long)index;
+	frame->tick = num_ticks;
+	frame->time = time;
+	frame->publish_time = get_clock();
+	const Vec3 &origin = field.getOrigin();
+	for (int axis = 0; axis < 3; axis++)
+		frame->origin[axis] = double(origin[axis]);
+
+	// the even sequence releases the frame, the count announces it
+	AtomicSet(&frame->sequence, frame->sequence + 1);
+	AtomicSet(&header->num_published, index + 1);
+}
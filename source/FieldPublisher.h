@@ -0,0 +1,68 @@
+#ifndef __FIELD_PUBLISHER_H__
+#define __FIELD_PUBLISHER_H__
+
+#include "FieldStateLayout.h"
+#include "PendulumField.h"
+
+#include <UnigineString.h>
+#include <UnigineVector.h>
+
+// Publisher of the live field state to other processes on the machine through named shared memory.
+// Every publish gathers the chosen arrays by external id into the next frame of a ring, guarded by a sequence
+// lock: the simulation never waits for readers, and a reader that raced a write retries or takes an older frame.
+// The layout is described by FieldStateLayout.h, utils/field_state has the C reader.
+class FieldPublisher
+{
+public:
+	FieldPublisher();
+	~FieldPublisher();
+
+	FieldPublisher(const FieldPublisher &) = delete;
+	FieldPublisher &operator=(const FieldPublisher &) = delete;
+
+	// name is a shared memory name such as "/pendulum_field", an existing one is replaced; columns is a mask of
+	// PendulumField::ARRAY and the ids are the ones the field has handed out so far
+	bool open(const char *name, const PendulumField &field, int columns, int num_frames);
+	// removes the name, readers keep their mapping until they close it
+	void close();
+	bool isOpened() const { return header != nullptr; }
+	const char *getName() const { return name.get(); }
+	size_t getSize() const { return size; }
+	int getCapacity() const { return capacity; }
+	int getColumns() const { return columns; }
+	int getNumFrames() const { return num_frames; }
+
+	// samples the field after a tick on the physics thread, every interval ticks a frame is published
+	void setInterval(int ticks) { interval = Unigine::Math::max(ticks, 1); }
+	int getInterval() const { return interval; }
+	void update(const PendulumField &field, float ifps);
+
+	long long getNumPublished() const;
+	// duration of the last publish in milliseconds
+	float getPublishTime() const { return publish_time; }
+
+private:
+	void publish(const PendulumField &field);
+
+	Unigine::String name;
+	FieldStateHeader *header;
+	unsigned char *frames;
+	size_t size;
+	#ifdef _WIN32
+		void *mapping;
+	#else
+		int fd;
+	#endif
+
+	Unigine::Vector<int> arrays;
+	int columns;
+	int num_frames;
+	int capacity;
+	int interval;
+	int ticks;
+	unsigned long long num_ticks;
+	double time;
+	float publish_time;
+};
+
+#endif // __FIELD_PUBLISHER_H__
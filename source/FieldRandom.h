@@ -0,0 +1,19 @@
+#ifndef __FIELD_RANDOM_H__
+#define __FIELD_RANDOM_H__
+
+#include <UnigineBase.h>
+
+// Stateless random value of a pendulum, the same id and seed give the same value on every thread and run.
+// Uniform in [-1, 1].
+UNIGINE_INLINE float get_random(unsigned int id, unsigned int seed)
+{
+	unsigned int h = id * 0x9e3779b9u ^ seed;
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h * (2.0f / 4294967295.0f) - 1.0f;
+}
+
+#endif // __FIELD_RANDOM_H__
@@ -0,0 +1,106 @@
+#include "FieldSeedJob.h"
+#include "FieldRandom.h"
+
+#include <UnigineProfiler.h>
+#include <UnigineTimer.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+// pendulums seeded between clock checks
+constexpr int SEED_SLICE_SIZE = 8192;
+}
+
+FieldSeedJob::FieldSeedJob()
+	: field(nullptr)
+	, amplitude(0.0f)
+	, seed(0)
+	, layout_version(-1)
+	, origin(Vec3_zero)
+	, position(0)
+	, num_published(0)
+{
+}
+
+void FieldSeedJob::start(PendulumField &f, float a, unsigned int s)
+{
+	field = &f;
+	amplitude = a;
+	seed = s;
+	restart();
+}
+
+void FieldSeedJob::cancel()
+{
+	field = nullptr;
+	theta.destroy();
+	omega.destroy();
+	bob_x.destroy();
+	bob_y.destroy();
+	bob_z.destroy();
+}
+
+void FieldSeedJob::restart()
+{
+	int num = field->getNumPendulums();
+	layout_version = field->getLayoutVersion();
+	origin = field->getOrigin();
+	position = 0;
+	theta.resize(num);
+	omega.resize(num);
+	bob_x.resize(num);
+	bob_y.resize(num);
+	bob_z.resize(num);
+}
+
+float FieldSeedJob::getProgress() const
+{
+	return (field && theta.size()) ? float(position) / theta.size() : 1.0f;
+}
+
+bool FieldSeedJob::update(long long end_time)
+{
+	if (field == nullptr)
+		return true;
+
+	UNIGINE_PROFILER_FUNCTION;
+
+	// a rebuild or a reorder moved the slots under the written values, a rebase moved the pivots
+	if (field->getLayoutVersion() != layout_version || field->getNumPendulums() != theta.size() || field->getOrigin() != origin)
+		restart();
+
+	int num = theta.size();
+	while (position < num)
+	{
+		if (Time::get() >= end_time)
+			return false;
+		int end = min(position + SEED_SLICE_SIZE, num);
+		// same as PendulumField::updateBobs(), pivots edited meanwhile are corrected by the next step
+		for (int i = position; i < end; i++)
+		{
+			float t = amplitude * get_random(field->getId(i), seed);
+			float l = field->length[i];
+			float s, c;
+			sincos(t, s, c);
+			theta[i] = t;
+			omega[i] = 0.0f;
+			bob_x[i] = field->pivot_x[i] + field->direction_x[i] * s * l;
+			bob_y[i] = field->pivot_y[i] + field->direction_y[i] * s * l;
+			bob_z[i] = field->pivot_z[i] - c * l;
+		}
+		position = end;
+	}
+
+	// jobs run on the main thread between ticks, the old arrays stay as the spare ones of the next run
+	field->theta.swap(theta);
+	field->omega.swap(omega);
+	field->bob_x.swap(bob_x);
+	field->bob_y.swap(bob_y);
+	field->bob_z.swap(bob_z);
+	field->wakeAll();
+	num_published++;
+	field = nullptr;
+	return true;
+}
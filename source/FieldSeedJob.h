@@ -0,0 +1,49 @@
+#ifndef __FIELD_SEED_JOB_H__
+#define __FIELD_SEED_JOB_H__
+
+#include "FieldJobs.h"
+#include "PendulumField.h"
+
+#include <UnigineMathLib.h>
+#include <UnigineVector.h>
+
+// Re-seeds the initial angles of a field without stalling frames.
+// New angles, zero velocities and the matching bob positions are written into spare arrays in slices, the last
+// slice swaps them with the arrays of the field and wakes every pendulum. The angle of a pendulum depends on its id
+// and the seed only, so the result does not depend on the storage order. A layout change or a rebase of the field restarts it.
+class FieldSeedJob : public FieldJob
+{
+public:
+	FieldSeedJob();
+
+	// angles are uniform in [-amplitude, amplitude] radians
+	void start(PendulumField &field, float amplitude, unsigned int seed);
+	void cancel();
+	bool isRunning() const { return field != nullptr; }
+	// incremented by every publish
+	int getNumPublished() const { return num_published; }
+
+	const char *getName() const override { return "FieldSeedJob"; }
+	bool update(long long end_time) override;
+	float getProgress() const override;
+
+private:
+	void restart();
+
+	PendulumField *field;
+	float amplitude;
+	unsigned int seed;
+
+	int layout_version;
+	Unigine::Math::Vec3 origin;
+	int position;
+	int num_published;
+
+	Unigine::Vector<float> theta;
+	Unigine::Vector<float> omega;
+	Unigine::Vector<float> bob_x;
+	Unigine::Vector<float> bob_y;
+	Unigine::Vector<float> bob_z;
+};
+
+#endif // __FIELD_SEED_JOB_H__
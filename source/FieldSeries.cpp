@@ -0,0 +1,350 @@
+#include "FieldSeries.h"
+#include "FieldNan.h"
+
+#include <UnigineAsyncQueue.h>
+#include <UnigineCompress.h>
+#include <UnigineLog.h>
+#include <UnigineProfiler.h>
+#include <UnigineThread.h>
+#include <UnigineTimer.h>
+
+#include <string.h>
+
+using namespace Unigine;
+using namespace Math;
+
+FieldSeries::FieldSeries()
+	: opened(false)
+	, num_pendulums(0)
+	, num_chunks(0)
+	, ticks_per_chunk(0)
+	, compress(false)
+	, buffer_ticks(0)
+	, num_ticks(0)
+	, time(0.0)
+	, tick_step(0.0f)
+	, stall_time(0.0f)
+	, num_filled(0)
+	, num_written(0)
+	, writing(0)
+	, file_size(0)
+	, raw_size(0)
+	, write_time(0.0f)
+	, failed(0)
+{
+}
+
+FieldSeries::~FieldSeries()
+{
+	close();
+}
+
+bool FieldSeries::open(const char *name, const PendulumField &field, int columns, int ticks, bool compressed)
+{
+	close();
+
+	arrays.clear();
+	for (int i = 0; i < PendulumField::NUM_ARRAYS; i++)
+		if (columns & (1 << i))
+			arrays.append(i);
+	if (arrays.empty() || field.getNumIds() == 0)
+	{
+		Log::error("FieldSeries::open(): nothing to record\n");
+		return false;
+	}
+
+	file = File::create(name, "wb", false);
+	if (!file || !file->isOpened())
+	{
+		Log::error("FieldSeries::open(): can't open \"%s\" file\n", name);
+		return false;
+	}
+
+	path = name;
+	num_pendulums = field.getNumIds();
+	num_chunks = (num_pendulums + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	ticks_per_chunk = max(ticks, 1);
+	compress = compressed;
+	slots.resize(num_chunks * CHUNK_SIZE);
+	for (Buffer &buffer : buffers)
+	{
+		buffer.data.resize(arrays.size() * num_chunks * ticks_per_chunk * CHUNK_SIZE);
+		buffer.num_ticks = 0;
+	}
+	buffer_ticks = 0;
+	num_ticks = 0;
+	time = 0.0;
+	tick_step = 0.0f;
+	stall_time = 0.0f;
+	num_filled = 0;
+	num_written = 0;
+	writing = 0;
+	time_chunks.clear();
+	blocks.clear();
+	raw_size = 0;
+	write_time = 0.0f;
+	failed = 0;
+
+	// the header is rewritten with the index offset on close, until then readers reject the file
+	Header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MAGIC;
+	header.version = VERSION;
+	Vector<Column> table(arrays.size());
+	memset(table.get(), 0, sizeof(Column) * table.size());
+	for (int i = 0; i < arrays.size(); i++)
+	{
+		table[i].array = arrays[i];
+		strncpy(table[i].name, getColumnName(PendulumField::ARRAY(arrays[i])), sizeof(table[i].name) - 1);
+	}
+	size_t table_size = sizeof(Column) * table.size();
+	if (file->write(&header, sizeof(header)) != sizeof(header) || file->write(table.get(), table_size) != table_size)
+	{
+		Log::error("FieldSeries::open(): can't write \"%s\" file\n", name);
+		file->close();
+		file = nullptr;
+		return false;
+	}
+	file_size = sizeof(header) + table_size;
+	opened = true;
+	return true;
+}
+
+bool FieldSeries::close()
+{
+	if (!opened)
+		return true;
+
+	if (buffer_ticks > 0)
+		submit();
+	wait();
+
+	// the index goes after the last block, the header that points at it goes last
+	static const unsigned char padding[BLOCK_ALIGNMENT] = {};
+	unsigned long long index_offset = (file_size + BLOCK_ALIGNMENT - 1) & ~(unsigned long long)(BLOCK_ALIGNMENT - 1);
+	size_t time_chunks_size = sizeof(TimeChunk) * time_chunks.size();
+	size_t blocks_size = sizeof(Block) * blocks.size();
+	size_t padding_size = size_t(index_offset - file_size);
+	bool ret = !AtomicGet(&failed);
+	ret = ret && file->write(padding, padding_size) == padding_size;
+	ret = ret && file->write(time_chunks.get(), time_chunks_size) == time_chunks_size;
+	ret = ret && file->write(blocks.get(), blocks_size) == blocks_size;
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.num_pendulums = num_pendulums;
+	header.pendulums_per_chunk = CHUNK_SIZE;
+	header.ticks_per_chunk = ticks_per_chunk;
+	header.num_columns = arrays.size();
+	header.num_time_chunks = time_chunks.size();
+	header.tick_step = tick_step;
+	header.num_ticks = num_ticks;
+	header.index_offset = index_offset;
+	header.start_time = time_chunks.empty() ? 0.0 : time_chunks[0].start_time;
+	ret = ret && file->seekSet(0) && file->write(&header, sizeof(header)) == sizeof(header);
+	file->close();
+	file = nullptr;
+	opened = false;
+
+	file_size = index_offset + time_chunks_size + blocks_size;
+	for (Buffer &buffer : buffers)
+		buffer.data.clear();
+	if (!ret)
+		Log::error("FieldSeries::close(): can't write \"%s\" file\n", path.get());
+	return ret;
+}
+
+void FieldSeries::capture(const PendulumField &field, float ifps)
+{
+	if (!opened)
+		return;
+
+	UNIGINE_PROFILER_FUNCTION;
+
+	// the buffer is reused once the background has written it
+	if (buffer_ticks == 0 && num_filled - AtomicGet(&num_written) >= NUM_BUFFERS)
+	{
+		long long begin = Time::get();
+		while (num_filled - AtomicGet(&num_written) >= NUM_BUFFERS)
+			Thread::switchThread();
+		stall_time += Time::microsecondsToMilliseconds(Time::get() - begin);
+	}
+
+	time += ifps;
+	tick_step = ifps;
+	Buffer &buffer = buffers[num_filled % NUM_BUFFERS];
+	if (buffer_ticks == 0)
+	{
+		buffer.first_tick = num_ticks;
+		buffer.start_time = time;
+		buffer.origin = dvec3(field.getOrigin());
+	}
+
+	// positions of a field rebased during the chunk are moved back to the origin the chunk started with
+	float shifts[PendulumField::NUM_ARRAYS] = {};
+	dvec3 shift = dvec3(field.getOrigin()) - buffer.origin;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		shifts[PendulumField::ARRAY_PIVOT_X + axis] = float(shift[axis]);
+		shifts[PendulumField::ARRAY_BOB_X + axis] = float(shift[axis]);
+	}
+
+	// pendulums are gathered by id, a chunk of ids at a time on the workers
+	int num_ids = min(field.getNumIds(), num_pendulums);
+	int num_columns = arrays.size();
+	AtomicInt32 next_chunk(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		float nan = get_nan();
+		for (int chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++)
+		{
+			int begin = chunk * CHUNK_SIZE;
+			int width = get_chunk_width(chunk);
+			int *s = slots.get() + begin;
+			for (int i = 0; i < width; i++)
+				s[i] = (begin + i < num_ids && field.isValidId(begin + i)) ? field.getSlot(begin + i) : -1;
+			for (int column = 0; column < num_columns; column++)
+			{
+				const float *src = field.getArray(PendulumField::ARRAY(arrays[column])).get();
+				float *dest = buffer.data.get() + get_block_offset(column, chunk) + size_t(buffer_ticks) * width;
+				float offset = shifts[arrays[column]];
+				for (int i = 0; i < width; i++)
+					dest[i] = (s[i] >= 0) ? src[s[i]] + offset : nan;
+			}
+		}
+	});
+
+	num_ticks++;
+	if (++buffer_ticks == ticks_per_chunk)
+		submit();
+}
+
+const char *FieldSeries::getColumnName(PendulumField::ARRAY array)
+{
+	static const char *names[PendulumField::NUM_ARRAYS] = {
+		"pivot_x",
+		"pivot_y",
+		"pivot_z",
+		"direction_x",
+		"direction_y",
+		"length",
+		"theta",
+		"omega",
+		"bob_x",
+		"bob_y",
+		"bob_z",
+	};
+	return (array >= 0 && array < PendulumField::NUM_ARRAYS) ? names[array] : "";
+}
+
+void FieldSeries::submit()
+{
+	buffers[num_filled % NUM_BUFFERS].num_ticks = buffer_ticks;
+	buffer_ticks = 0;
+	AtomicSet(&num_filled, num_filled + 1);
+	if (AtomicCAS(&writing, 0, 1))
+		AsyncQueue::runAsync(AsyncQueue::ASYNC_THREAD_BACKGROUND, MakeCallback(this, &FieldSeries::write_buffers));
+}
+
+void FieldSeries::wait()
+{
+	while (AtomicGet(&num_written) < AtomicGet(&num_filled) || AtomicGet(&writing))
+		Thread::switchThread();
+}
+
+void FieldSeries::write_buffers()
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	for (;;)
+	{
+		while (AtomicGet(&num_written) < AtomicGet(&num_filled))
+		{
+			long long begin = Time::get();
+			const Buffer &buffer = buffers[num_written % NUM_BUFFERS];
+			if (!AtomicGet(&failed) && !write_buffer(buffer))
+				AtomicSet(&failed, 1);
+			write_time += Time::microsecondsToMilliseconds(Time::get() - begin);
+			AtomicInc(&num_written);
+		}
+		AtomicSet(&writing, 0);
+		// a buffer submitted between the last check and the release of the flag found the writer still running
+		if (AtomicGet(&num_written) == AtomicGet(&num_filled) || !AtomicCAS(&writing, 0, 1))
+			break;
+	}
+}
+
+bool FieldSeries::write_buffer(const Buffer &buffer)
+{
+	TimeChunk &time_chunk = time_chunks.append();
+	memset(&time_chunk, 0, sizeof(time_chunk));
+	time_chunk.first_tick = buffer.first_tick;
+	time_chunk.num_ticks = buffer.num_ticks;
+	time_chunk.start_time = buffer.start_time;
+	for (int axis = 0; axis < 3; axis++)
+		time_chunk.origin[axis] = buffer.origin[axis];
+
+	for (int chunk = 0; chunk < num_chunks; chunk++)
+	{
+		int num = buffer.num_ticks * get_chunk_width(chunk);
+		for (int column = 0; column < arrays.size(); column++)
+		{
+			Block &block = blocks.append();
+			if (!write_block(buffer.data.get() + get_block_offset(column, chunk), num, block))
+				return false;
+		}
+	}
+	return true;
+}
+
+bool FieldSeries::write_block(const float *data, int num, Block &block)
+{
+	float min_value = Consts::INF;
+	float max_value = -Consts::INF;
+	double sum = 0.0;
+	int count = 0;
+	for (int i = 0; i < num; i++)
+	{
+		float value = data[i];
+		if (!is_finite(value))
+			continue;
+		min_value = min(min_value, value);
+		max_value = max(max_value, value);
+		sum += value;
+		count++;
+	}
+
+	size_t size = sizeof(float) * num;
+	const void *src = data;
+	block.codec = CODEC_RAW;
+	block.raw_size = unsigned(size);
+	block.min = (count > 0) ? min_value : get_nan();
+	block.max = (count > 0) ? max_value : get_nan();
+	block.mean = (count > 0) ? float(sum / count) : get_nan();
+
+	// lz4 only pays when it saves an eighth, incompressible blocks stay raw and can be viewed in place
+	if (compress)
+	{
+		packed.resize(int(Compress::lz4Size(size)));
+		size_t packed_size = packed.size();
+		if (Compress::lz4Compress(packed.get(), packed_size, data, size, false) && packed_size < size - size / 8)
+		{
+			block.codec = CODEC_LZ4;
+			src = packed.get();
+			size = packed_size;
+		}
+	}
+
+	static const unsigned char padding[BLOCK_ALIGNMENT] = {};
+	unsigned long long offset = (file_size + BLOCK_ALIGNMENT - 1) & ~(unsigned long long)(BLOCK_ALIGNMENT - 1);
+	size_t padding_size = size_t(offset - file_size);
+	if (file->write(padding, padding_size) != padding_size || file->write(src, size) != size)
+		return false;
+	block.offset = offset;
+	block.size = unsigned(size);
+	file_size = offset + size;
+	raw_size += block.raw_size;
+	return true;
+}
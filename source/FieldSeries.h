@@ -0,0 +1,161 @@
+#ifndef __FIELD_SERIES_H__
+#define __FIELD_SERIES_H__
+
+#include "PendulumField.h"
+
+#include <UnigineStreams.h>
+#include <UnigineString.h>
+#include <UnigineVector.h>
+
+// Columnar time series of the per-pendulum arrays of a field, recorded tick by tick.
+// Time is cut into chunks of ticks_per_chunk ticks and the pendulums, addressed by their external ids, into chunks
+// of CHUNK_SIZE ids. Every column of a time and pendulum chunk is one block of ticks by pendulums floats with its
+// minimum, maximum and mean; removed pendulums read as NaN. Pivots and bobs are relative to the field origin
+// stored with their time chunk, the world position is that origin plus the value. Blocks are aligned to
+// BLOCK_ALIGNMENT and stored raw or as lz4 when that saves enough, so a reader maps the file, skips blocks by their
+// statistics and views raw ones without a copy. The index of the blocks follows the last one and is written when
+// the recording is closed.
+// The physics thread only gathers the arrays into one of NUM_BUFFERS chunk buffers, full buffers are compressed and
+// written by a background thread; a capture waits only when all buffers are still being written.
+class FieldSeries
+{
+public:
+	enum
+	{
+		MAGIC = ('P' << 0) | ('S' << 8) | ('E' << 16) | ('R' << 24),
+		VERSION = 2,
+		CHUNK_SIZE = PendulumField::CHUNK_SIZE,
+		BLOCK_ALIGNMENT = 64,
+		NUM_BUFFERS = 3,
+	};
+
+	enum CODEC
+	{
+		CODEC_RAW = 0,
+		CODEC_LZ4,
+	};
+
+	// file layout: Header, num_columns Column, blocks, then at index_offset num_time_chunks TimeChunk followed by
+	// the Block entries of every time chunk, pendulum chunk and column in this order
+	struct Header
+	{
+		unsigned int magic;
+		unsigned int version;
+		int num_pendulums;
+		int pendulums_per_chunk;
+		int ticks_per_chunk;
+		int num_columns;
+		int num_time_chunks;
+		float tick_step;
+		unsigned long long num_ticks;
+		// zero while the recording is open
+		unsigned long long index_offset;
+		double start_time;
+		unsigned int reserved[2];
+	};
+
+	struct Column
+	{
+		// PendulumField::ARRAY of the column
+		int array;
+		char name[28];
+	};
+
+	struct TimeChunk
+	{
+		unsigned long long first_tick;
+		int num_ticks;
+		int reserved;
+		double start_time;
+		// PendulumField::getOrigin() at the first tick, later ticks of a rebased field are shifted back to it
+		double origin[3];
+	};
+
+	struct Block
+	{
+		unsigned long long offset;
+		unsigned int size;
+		unsigned int raw_size;
+		unsigned int codec;
+		// over the pendulums present in the block, NaN if there is none
+		float min;
+		float max;
+		float mean;
+	};
+
+	FieldSeries();
+	~FieldSeries();
+
+	// records the pendulums with the ids the field has handed out so far, columns is a mask of PendulumField::ARRAY
+	bool open(const char *path, const PendulumField &field, int columns, int ticks_per_chunk, bool compress);
+	// writes the chunk in progress and the index, waits for the background writes
+	bool close();
+	bool isOpened() const { return opened; }
+	const char *getPath() const { return path.get(); }
+
+	// samples the field after a tick on the physics thread
+	void capture(const PendulumField &field, float ifps);
+
+	static const char *getColumnName(PendulumField::ARRAY array);
+
+	// statistics since open(), the sizes are final after close()
+	unsigned long long getNumTicks() const { return num_ticks; }
+	unsigned long long getRawSize() const { return raw_size; }
+	unsigned long long getFileSize() const { return file_size; }
+	// time the background spent packing and writing blocks, and the physics thread waiting for a free buffer
+	float getWriteTime() const { return write_time; }
+	float getStallTime() const { return stall_time; }
+
+private:
+	struct Buffer
+	{
+		// column by column and pendulum chunk by pendulum chunk, the rows of a block are as wide as its chunk
+		Unigine::Vector<float> data;
+		unsigned long long first_tick;
+		double start_time;
+		Unigine::Math::dvec3 origin;
+		int num_ticks;
+	};
+
+	void submit();
+	void wait();
+	void write_buffers();
+	bool write_buffer(const Buffer &buffer);
+	bool write_block(const float *data, int num, Block &block);
+	size_t get_block_offset(int column, int chunk) const { return size_t(column * num_chunks + chunk) * ticks_per_chunk * CHUNK_SIZE; }
+	int get_chunk_width(int chunk) const { return Unigine::Math::min(num_pendulums - chunk * CHUNK_SIZE, int(CHUNK_SIZE)); }
+
+	Unigine::String path;
+	Unigine::FilePtr file;
+	bool opened;
+	int num_pendulums;
+	int num_chunks;
+	int ticks_per_chunk;
+	bool compress;
+	Unigine::Vector<int> arrays;
+
+	// physics thread state
+	Unigine::Vector<int> slots;
+	int buffer_ticks;
+	unsigned long long num_ticks;
+	double time;
+	float tick_step;
+	float stall_time;
+
+	// buffers are filled in turn, the background writes the filled ones in order
+	Buffer buffers[NUM_BUFFERS];
+	volatile int num_filled;
+	volatile int num_written;
+	volatile int writing;
+
+	// background state
+	Unigine::Vector<TimeChunk> time_chunks;
+	Unigine::Vector<Block> blocks;
+	Unigine::Vector<unsigned char> packed;
+	unsigned long long file_size;
+	unsigned long long raw_size;
+	float write_time;
+	volatile int failed;
+};
+
+#endif // __FIELD_SERIES_H__
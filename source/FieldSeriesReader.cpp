@@ -0,0 +1,153 @@
+#include "FieldSeriesReader.h"
+
+#include <UnigineCompress.h>
+#include <UnigineLog.h>
+
+#include <string.h>
+
+using namespace Unigine;
+using namespace Math;
+
+FieldSeriesReader::FieldSeriesReader()
+	: header(nullptr)
+	, columns(nullptr)
+	, time_chunks(nullptr)
+	, blocks(nullptr)
+	, num_pendulum_chunks(0)
+{
+}
+
+bool FieldSeriesReader::open(const char *path)
+{
+	close();
+	if (!file.open(path))
+	{
+		Log::error("FieldSeriesReader::open(): can't open \"%s\" file\n", path);
+		return false;
+	}
+
+	const unsigned char *data = file.getData();
+	size_t size = file.getSize();
+	const FieldSeries::Header *h = reinterpret_cast<const FieldSeries::Header *>(data);
+	if (size < sizeof(FieldSeries::Header) || h->magic != FieldSeries::MAGIC || h->version != FieldSeries::VERSION)
+	{
+		Log::error("FieldSeriesReader::open(): \"%s\" is not a series file of version %d\n", path, int(FieldSeries::VERSION));
+		file.close();
+		return false;
+	}
+	if (h->index_offset == 0)
+	{
+		Log::error("FieldSeriesReader::open(): the recording of \"%s\" was not closed\n", path);
+		file.close();
+		return false;
+	}
+
+	int num_chunks = (h->num_pendulums + h->pendulums_per_chunk - 1) / max(h->pendulums_per_chunk, 1);
+	unsigned long long num_blocks = (unsigned long long)h->num_time_chunks * num_chunks * h->num_columns;
+	unsigned long long index_end = h->index_offset + sizeof(FieldSeries::TimeChunk) * h->num_time_chunks + sizeof(FieldSeries::Block) * num_blocks;
+	if (h->num_columns <= 0 || h->pendulums_per_chunk <= 0 || index_end > size
+		|| sizeof(FieldSeries::Header) + sizeof(FieldSeries::Column) * h->num_columns > size)
+	{
+		Log::error("FieldSeriesReader::open(): \"%s\" is truncated\n", path);
+		file.close();
+		return false;
+	}
+
+	header = h;
+	columns = reinterpret_cast<const FieldSeries::Column *>(data + sizeof(FieldSeries::Header));
+	time_chunks = reinterpret_cast<const FieldSeries::TimeChunk *>(data + h->index_offset);
+	blocks = reinterpret_cast<const FieldSeries::Block *>(time_chunks + h->num_time_chunks);
+	num_pendulum_chunks = num_chunks;
+	return true;
+}
+
+void FieldSeriesReader::close()
+{
+	file.close();
+	header = nullptr;
+	columns = nullptr;
+	time_chunks = nullptr;
+	blocks = nullptr;
+	num_pendulum_chunks = 0;
+}
+
+int FieldSeriesReader::findColumn(PendulumField::ARRAY array) const
+{
+	for (int i = 0; i < header->num_columns; i++)
+		if (columns[i].array == array)
+			return i;
+	return -1;
+}
+
+dvec3 FieldSeriesReader::getOrigin(int time_chunk) const
+{
+	const double *origin = time_chunks[time_chunk].origin;
+	return dvec3(origin[0], origin[1], origin[2]);
+}
+
+const FieldSeries::Block &FieldSeriesReader::getBlock(int time_chunk, int pendulum_chunk, int column) const
+{
+	return blocks[(size_t(time_chunk) * num_pendulum_chunks + pendulum_chunk) * header->num_columns + column];
+}
+
+const float *FieldSeriesReader::getBlockData(int time_chunk, int pendulum_chunk, int column, Vector<float> &buffer) const
+{
+	const FieldSeries::Block &block = getBlock(time_chunk, pendulum_chunk, column);
+	if (block.offset + block.size > file.getSize() || block.offset % sizeof(float) != 0)
+		return nullptr;
+
+	const unsigned char *src = file.getData() + block.offset;
+	if (block.codec == FieldSeries::CODEC_RAW)
+		return (block.size == block.raw_size) ? reinterpret_cast<const float *>(src) : nullptr;
+	if (block.codec != FieldSeries::CODEC_LZ4)
+		return nullptr;
+
+	buffer.resize(int(block.raw_size / sizeof(float)));
+	if (!Compress::lz4Decompress(buffer.get(), block.raw_size, src, block.size))
+		return nullptr;
+	return buffer.get();
+}
+
+bool FieldSeriesReader::read(int column, long long tick_begin, long long tick_end, int pendulum_begin, int pendulum_end, float *dest) const
+{
+	if (!isOpened() || column < 0 || column >= header->num_columns || tick_begin < 0 || tick_end > getNumTicks() || tick_begin > tick_end
+		|| pendulum_begin < 0 || pendulum_end > header->num_pendulums || pendulum_begin > pendulum_end)
+	{
+		Log::error("FieldSeriesReader::read(): bad slice\n");
+		return false;
+	}
+
+	int ticks_per_chunk = header->ticks_per_chunk;
+	int pendulums_per_chunk = header->pendulums_per_chunk;
+	int width = pendulum_end - pendulum_begin;
+	// time chunks are full except for the last one, so the chunk of a tick follows from its index
+	for (int time_chunk = int(tick_begin / ticks_per_chunk); time_chunk < header->num_time_chunks; time_chunk++)
+	{
+		const FieldSeries::TimeChunk &chunk = time_chunks[time_chunk];
+		long long first = max((long long)chunk.first_tick, tick_begin);
+		long long last = min((long long)chunk.first_tick + chunk.num_ticks, tick_end);
+		if (first >= last)
+			break;
+
+		for (int pendulum_chunk = pendulum_begin / pendulums_per_chunk; pendulum_chunk * pendulums_per_chunk < pendulum_end; pendulum_chunk++)
+		{
+			int chunk_begin = pendulum_chunk * pendulums_per_chunk;
+			int chunk_width = min(header->num_pendulums - chunk_begin, pendulums_per_chunk);
+			int from = max(pendulum_begin, chunk_begin);
+			int to = min(pendulum_end, chunk_begin + chunk_width);
+
+			const float *src = getBlockData(time_chunk, pendulum_chunk, column, scratch);
+			if (!src)
+			{
+				Log::error("FieldSeriesReader::read(): block %d of time chunk %d is corrupted\n", pendulum_chunk, time_chunk);
+				return false;
+			}
+			for (long long tick = first; tick < last; tick++)
+			{
+				const float *row = src + (tick - chunk.first_tick) * chunk_width + (from - chunk_begin);
+				memcpy(dest + (tick - tick_begin) * width + (from - pendulum_begin), row, sizeof(float) * (to - from));
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,61 @@
+#ifndef __FIELD_SERIES_READER_H__
+#define __FIELD_SERIES_READER_H__
+
+#include "FieldSeries.h"
+#include "MappedFile.h"
+
+#include <UnigineVector.h>
+
+// Reference reader of the series files written by FieldSeries.
+// The file is mapped and only the blocks a slice overlaps are touched: raw blocks are returned in place, lz4 ones
+// are decompressed into the scratch of the caller. Block statistics let a query skip blocks without reading them.
+class FieldSeriesReader
+{
+public:
+	FieldSeriesReader();
+
+	// fails for files of another version and for recordings that were not closed
+	bool open(const char *path);
+	void close();
+	bool isOpened() const { return header != nullptr; }
+
+	int getNumPendulums() const { return header->num_pendulums; }
+	long long getNumTicks() const { return (long long)header->num_ticks; }
+	int getTicksPerChunk() const { return header->ticks_per_chunk; }
+	int getPendulumsPerChunk() const { return header->pendulums_per_chunk; }
+	int getNumTimeChunks() const { return header->num_time_chunks; }
+	int getNumPendulumChunks() const { return num_pendulum_chunks; }
+	float getTickStep() const { return header->tick_step; }
+	double getStartTime() const { return header->start_time; }
+
+	int getNumColumns() const { return header->num_columns; }
+	const char *getColumnName(int column) const { return columns[column].name; }
+	PendulumField::ARRAY getColumnArray(int column) const { return PendulumField::ARRAY(columns[column].array); }
+	// index of the column recording the array, -1 if it was not recorded
+	int findColumn(PendulumField::ARRAY array) const;
+
+	const FieldSeries::TimeChunk &getTimeChunk(int time_chunk) const { return time_chunks[time_chunk]; }
+	// field origin the pivots and bobs of a time chunk are relative to
+	Unigine::Math::dvec3 getOrigin(int time_chunk) const;
+	// time chunk holding the tick
+	int getTimeChunkIndex(long long tick) const { return int(tick / header->ticks_per_chunk); }
+	const FieldSeries::Block &getBlock(int time_chunk, int pendulum_chunk, int column) const;
+	// ticks by pendulums floats of a block, the rows are as wide as the pendulum chunk; nullptr on a corrupted block
+	const float *getBlockData(int time_chunk, int pendulum_chunk, int column, Unigine::Vector<float> &buffer) const;
+
+	// copies ticks [tick_begin, tick_end) of pendulums [pendulum_begin, pendulum_end) into rows of
+	// pendulum_end - pendulum_begin floats
+	bool read(int column, long long tick_begin, long long tick_end, int pendulum_begin, int pendulum_end, float *dest) const;
+
+private:
+	MappedFile file;
+	const FieldSeries::Header *header;
+	const FieldSeries::Column *columns;
+	const FieldSeries::TimeChunk *time_chunks;
+	const FieldSeries::Block *blocks;
+	int num_pendulum_chunks;
+	// decompressed blocks of read()
+	mutable Unigine::Vector<float> scratch;
+};
+
+#endif // __FIELD_SERIES_READER_H__
@@ -0,0 +1,478 @@
+#include "FieldSonifier.h"
+
+#include <UnigineAsyncQueue.h>
+#include <UnigineProfiler.h>
+#include <UnigineStreams.h>
+#include <UnigineThread.h>
+#include <UnigineTimer.h>
+
+#include <string.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+// frames synthesized between renormalizations of the phasors
+constexpr int BLOCK_SIZE = 256;
+// segments rotate through three files, so the render never writes the one being played
+constexpr int NUM_SEGMENT_FILES = 3;
+// linear fades at the ends of a live segment hide the restart of the source
+constexpr int SEGMENT_FADE = 64;
+
+#pragma pack(push, 1)
+struct WavHeader
+{
+	char riff[4];
+	unsigned int riff_size;
+	char wave[4];
+	char fmt[4];
+	unsigned int fmt_size;
+	unsigned short format;
+	unsigned short num_channels;
+	unsigned int sample_rate;
+	unsigned int byte_rate;
+	unsigned short block_align;
+	unsigned short bits_per_sample;
+	char data[4];
+	unsigned int data_size;
+};
+#pragma pack(pop)
+
+// soft limiter, linear for quiet fields and bounded for loud ones
+short to_pcm(float value)
+{
+	float limited = value / Math::sqrt(1.0f + value * value);
+	return short(floorInt(limited * 32767.0f + 0.5f));
+}
+}
+
+FieldSonifier::FieldSonifier()
+	: bins_x(0)
+	, bins_y(0)
+	, sample_rate(0)
+	, pitch_scale(1250.0f)
+	, min_frequency(110.0f)
+	, gain(0.1f)
+	, segment(0.25f)
+	, segment_time(0.0f)
+	, rendering(0)
+	, num_rendered(0)
+	, num_played(0)
+	, render_time(0.0f)
+	, num_late(0)
+{
+}
+
+FieldSonifier::~FieldSonifier()
+{
+	shutdown();
+}
+
+void FieldSonifier::init(int x, int y, int rate)
+{
+	shutdown();
+
+	bins_x = max(x, 1);
+	bins_y = max(y, 1);
+	sample_rate = max(rate, 8000);
+	counts.resize(getNumVoices());
+	positions.resize(getNumVoices());
+	setMinFrequency(min_frequency);
+}
+
+void FieldSonifier::shutdown()
+{
+	stop();
+	sample_rate = 0;
+}
+
+void FieldSonifier::setMinFrequency(float frequency)
+{
+	min_frequency = max(frequency, 1.0f);
+	if (!isInitialized())
+		return;
+
+	// PARTIALS_PER_OCTAVE steps per octave, partials above the Nyquist frequency stay silent
+	rotation_re.resize(NUM_PARTIALS);
+	rotation_im.resize(NUM_PARTIALS);
+	for (int i = 0; i < NUM_PARTIALS; i++)
+	{
+		double frequency = min_frequency * ::pow(2.0, double(i) / PARTIALS_PER_OCTAVE);
+		double angle = (frequency < sample_rate * 0.5) ? 2.0 * Consts::PI_D * frequency / sample_rate : 0.0;
+		rotation_re[i] = float(::cos(angle));
+		rotation_im[i] = float(::sin(angle));
+	}
+}
+
+void FieldSonifier::start(const char *path, float length)
+{
+	stop();
+	if (!isInitialized())
+	{
+		Log::error("FieldSonifier::start(): the sonifier is not initialized\n");
+		return;
+	}
+
+	segment_path = path;
+	segment = max(length, 0.05f);
+	segment_time = 0.0f;
+	pending.clear();
+	pending_times.clear();
+	last.resize(getNumVoices() * NUM_PARTIALS);
+	memset(last.get(), 0, sizeof(float) * last.size());
+	init_oscillators(live);
+	num_rendered = 0;
+	num_played = 0;
+	num_late = 0;
+}
+
+void FieldSonifier::stop()
+{
+	while (AtomicGet(&rendering))
+		Thread::switchThread();
+	for (SoundSourcePtr &source : sources)
+		source.deleteLater();
+	sources.clear();
+	segment_path.clear();
+}
+
+void FieldSonifier::update(const PendulumField &field, float ifps)
+{
+	if (!isPlaying())
+		return;
+
+	UNIGINE_PROFILER_FUNCTION;
+
+	int num = getNumVoices() * NUM_PARTIALS;
+	int offset = pending.size();
+	pending.resize(offset + num);
+	capture(field, pending.get() + offset, positions.get());
+	segment_time += ifps;
+	pending_times.append(segment_time);
+
+	// a finished segment replaces the one playing, the sources follow the centers of their bins
+	int rendered_count = AtomicGet(&num_rendered);
+	if (rendered_count != num_played)
+	{
+		num_played = rendered_count;
+		for (int i = 0; i < getNumVoices(); i++)
+		{
+			String name = String::format("%s%d_%d.wav", segment_path.get(), i, (num_played - 1) % NUM_SEGMENT_FILES);
+			if (sources.size() <= i)
+			{
+				SoundSourcePtr source = SoundSource::create(name, 1);
+				source->setName(String::format("pendulum_voice_%d", i));
+				source->setLoop(0);
+				sources.append(source);
+			}
+			else
+			{
+				sources[i]->stop();
+				sources[i]->setSampleName(name);
+			}
+			sources[i]->setWorldPosition(positions[i]);
+			sources[i]->play();
+		}
+	}
+
+	if (segment_time < segment)
+		return;
+	// a late render stretches the next segment over the captures it missed
+	if (!AtomicCAS(&rendering, 0, 1))
+	{
+		num_late++;
+		return;
+	}
+	rendered.swap(pending);
+	rendered_times.swap(pending_times);
+	pending.clear();
+	pending_times.clear();
+	segment_time = 0.0f;
+	AsyncQueue::runAsync(AsyncQueue::ASYNC_THREAD_BACKGROUND, MakeCallback(this, &FieldSonifier::render_segment));
+}
+
+void FieldSonifier::render_segment()
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	long long begin = Time::get();
+	int num = getNumVoices() * NUM_PARTIALS;
+	int num_frames = max(int(segment * sample_rate), 1);
+	int num_captures = rendered_times.size();
+	float total = rendered_times.last();
+	int index = AtomicGet(&num_rendered) % NUM_SEGMENT_FILES;
+
+	mono.resize(num_frames);
+	pcm.resize(num_frames);
+	for (int i = 0; i < getNumVoices(); i++)
+	{
+		memset(mono.get(), 0, sizeof(float) * num_frames);
+		const float *from = last.get() + i * NUM_PARTIALS;
+		int frame = 0;
+		for (int j = 0; j < num_captures; j++)
+		{
+			const float *to = rendered.get() + j * num + i * NUM_PARTIALS;
+			int end = (j == num_captures - 1) ? num_frames : min(int(rendered_times[j] / total * num_frames + 0.5f), num_frames);
+			if (end > frame)
+				synthesize(live, i, from, to, end - frame, mono.get() + frame);
+			from = to;
+			frame = max(frame, end);
+		}
+
+		int fade = min(SEGMENT_FADE, num_frames / 2);
+		for (int j = 0; j < fade; j++)
+		{
+			float weight = float(j) / fade;
+			mono[j] *= weight;
+			mono[num_frames - 1 - j] *= weight;
+		}
+		for (int j = 0; j < num_frames; j++)
+			pcm[j] = to_pcm(mono[j]);
+		saveWav(String::format("%s%d_%d.wav", segment_path.get(), i, index), pcm.get(), num_frames, 1, sample_rate);
+	}
+	memcpy(last.get(), rendered.get() + (num_captures - 1) * num, sizeof(float) * num);
+
+	render_time = Time::microsecondsToMilliseconds(Time::get() - begin);
+	AtomicInc(&num_rendered);
+	AtomicSet(&rendering, 0);
+}
+
+bool FieldSonifier::render(const PendulumField &field, float duration, float ifps, Vector<short> &samples)
+{
+	if (!isInitialized() || ifps <= 0.0f)
+	{
+		Log::error("FieldSonifier::render(): the sonifier is not initialized\n");
+		return false;
+	}
+
+	UNIGINE_PROFILER_FUNCTION;
+
+	int num = getNumVoices() * NUM_PARTIALS;
+	int num_frames = max(int(duration * sample_rate), 1);
+	PendulumField copy = field;
+	Oscillators oscillators;
+	init_oscillators(oscillators);
+	Vector<float> from(num);
+	Vector<float> to(num);
+	Vector<float> mix(num_frames * 2);
+	Vector<Vec3> centers(getNumVoices());
+	memset(mix.get(), 0, sizeof(float) * mix.size());
+	capture(copy, from.get(), centers.get());
+
+	// equal power panning by the column of the bin, the voices of the mix sum as uncorrelated signals
+	Vector<float> left(getNumVoices());
+	Vector<float> right(getNumVoices());
+	float level = 1.0f / Math::sqrt(float(getNumVoices()));
+	for (int i = 0; i < getNumVoices(); i++)
+	{
+		float pan = (float(i % bins_x) + 0.5f) / bins_x * Consts::PI05;
+		left[i] = Math::cos(pan) * level;
+		right[i] = Math::sin(pan) * level;
+	}
+
+	double time = 0.0;
+	int frame = 0;
+	Vector<float> voice(num_frames);
+	while (frame < num_frames)
+	{
+		copy.step(ifps);
+		time += ifps;
+		capture(copy, to.get(), centers.get());
+		int end = min(int(time * sample_rate + 0.5), num_frames);
+		int count = end - frame;
+		if (count > 0)
+		{
+			for (int i = 0; i < getNumVoices(); i++)
+			{
+				memset(voice.get(), 0, sizeof(float) * count);
+				synthesize(oscillators, i, from.get() + i * NUM_PARTIALS, to.get() + i * NUM_PARTIALS, count, voice.get());
+				float *dest = mix.get() + frame * 2;
+				for (int j = 0; j < count; j++)
+				{
+					dest[j * 2 + 0] += voice[j] * left[i];
+					dest[j * 2 + 1] += voice[j] * right[i];
+				}
+			}
+		}
+		from.swap(to);
+		frame = max(frame, end);
+	}
+
+	samples.resize(mix.size());
+	for (int i = 0; i < mix.size(); i++)
+		samples[i] = to_pcm(mix[i]);
+	return true;
+}
+
+bool FieldSonifier::saveWav(const char *path, const short *samples, int num_frames, int num_channels, int sample_rate)
+{
+	unsigned int data_size = (unsigned int)(num_frames * num_channels * sizeof(short));
+	WavHeader header;
+	memcpy(header.riff, "RIFF", 4);
+	header.riff_size = data_size + sizeof(WavHeader) - 8;
+	memcpy(header.wave, "WAVE", 4);
+	memcpy(header.fmt, "fmt ", 4);
+	header.fmt_size = 16;
+	header.format = 1;
+	header.num_channels = (unsigned short)num_channels;
+	header.sample_rate = (unsigned int)sample_rate;
+	header.byte_rate = (unsigned int)(sample_rate * num_channels * sizeof(short));
+	header.block_align = (unsigned short)(num_channels * sizeof(short));
+	header.bits_per_sample = 16;
+	memcpy(header.data, "data", 4);
+	header.data_size = data_size;
+
+	FilePtr file = File::create(path, "wb", false);
+	if (!file || !file->isOpened() || file->write(&header, sizeof(header)) != sizeof(header) || file->write(samples, data_size) != data_size)
+	{
+		Log::error("FieldSonifier::saveWav(): can't write \"%s\" file\n", path);
+		return false;
+	}
+	file->close();
+	return true;
+}
+
+void FieldSonifier::init_oscillators(Oscillators &oscillators) const
+{
+	// unit phasors spread by the golden angle, so equal partials of different voices don't add up in phase
+	int num = getNumVoices() * NUM_PARTIALS;
+	oscillators.re.resize(num);
+	oscillators.im.resize(num);
+	for (int i = 0; i < num; i++)
+	{
+		double angle = i * 2.39996322972865332;
+		oscillators.re[i] = float(::cos(angle));
+		oscillators.im[i] = float(::sin(angle));
+	}
+}
+
+void FieldSonifier::capture(const PendulumField &field, float *amplitudes, Vec3 *centers)
+{
+	int num_voices = getNumVoices();
+	memset(amplitudes, 0, sizeof(float) * num_voices * NUM_PARTIALS);
+	for (int i = 0; i < num_voices; i++)
+	{
+		counts[i] = 0;
+		centers[i] = Vec3_zero;
+	}
+	int num = field.getNumPendulums();
+	if (num == 0)
+		return;
+
+	float min_x = field.pivot_x[0];
+	float max_x = min_x;
+	float min_y = field.pivot_y[0];
+	float max_y = min_y;
+	for (int i = 1; i < num; i++)
+	{
+		min_x = min(min_x, field.pivot_x[i]);
+		max_x = max(max_x, field.pivot_x[i]);
+		min_y = min(min_y, field.pivot_y[i]);
+		max_y = max(max_y, field.pivot_y[i]);
+	}
+	float scale_x = bins_x / max(max_x - min_x, 1e-3f) * 0.9999f;
+	float scale_y = bins_y / max(max_y - min_y, 1e-3f) * 0.9999f;
+
+	// the partial of a pendulum is its natural frequency scaled into the audible range, on a log scale
+	float log_base = Math::log2(Math::sqrt(field.getGravity()) * pitch_scale / (Consts::PI2 * min_frequency));
+	for (int i = 0; i < num; i++)
+	{
+		int voice = clamp(int((field.pivot_y[i] - min_y) * scale_y), 0, bins_y - 1) * bins_x +
+			clamp(int((field.pivot_x[i] - min_x) * scale_x), 0, bins_x - 1);
+		counts[voice]++;
+		centers[voice] += Vec3(field.pivot_x[i], field.pivot_y[i], field.pivot_z[i]);
+
+		float omega = field.omega[i];
+		if (omega == 0.0f)
+			continue;
+		float length = field.length[i];
+		float octave = log_base - 0.5f * Math::log2(length);
+		int partial = clamp(floorInt(octave * PARTIALS_PER_OCTAVE + 0.5f), 0, NUM_PARTIALS - 1);
+		amplitudes[voice * NUM_PARTIALS + partial] += Math::abs(omega) * length;
+	}
+
+	// speeds add up in phase, the partials carry the mean speed of the bin
+	Vec3 origin = field.getOrigin();
+	for (int i = 0; i < num_voices; i++)
+	{
+		if (counts[i] == 0)
+			continue;
+		centers[i] = origin + centers[i] / Scalar(counts[i]);
+		float scale = gain / counts[i];
+		float *dest = amplitudes + i * NUM_PARTIALS;
+		for (int j = 0; j < NUM_PARTIALS; j++)
+			dest[j] *= scale;
+	}
+}
+
+void FieldSonifier::synthesize(Oscillators &oscillators, int voice, const float *begin, const float *end, int num_frames, float *out) const
+{
+	float *re = oscillators.re.get() + voice * NUM_PARTIALS;
+	float *im = oscillators.im.get() + voice * NUM_PARTIALS;
+	const float *rotation_x = rotation_re.get();
+	const float *rotation_y = rotation_im.get();
+	float step = 1.0f / num_frames;
+
+	for (int offset = 0; offset < num_frames; offset += BLOCK_SIZE)
+	{
+		int num = min(BLOCK_SIZE, num_frames - offset);
+		#ifdef USE_SSE
+			// four partials per lane group, the lanes of a frame are summed once all groups are done
+			alignas(16) float lanes[BLOCK_SIZE * 4];
+			memset(lanes, 0, sizeof(float) * num * 4);
+			for (int k = 0; k < NUM_PARTIALS; k += 4)
+			{
+				__m128 x = _mm_loadu_ps(re + k);
+				__m128 y = _mm_loadu_ps(im + k);
+				__m128 cx = _mm_loadu_ps(rotation_x + k);
+				__m128 cy = _mm_loadu_ps(rotation_y + k);
+				__m128 a0 = _mm_loadu_ps(begin + k);
+				__m128 da = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(end + k), a0), _mm_set1_ps(step));
+				__m128 a = _mm_add_ps(a0, _mm_mul_ps(da, _mm_set1_ps(float(offset))));
+				for (int f = 0; f < num; f++)
+				{
+					__m128 sum = _mm_load_ps(lanes + f * 4);
+					_mm_store_ps(lanes + f * 4, _mm_add_ps(sum, _mm_mul_ps(a, y)));
+					__m128 nx = _mm_sub_ps(_mm_mul_ps(x, cx), _mm_mul_ps(y, cy));
+					y = _mm_add_ps(_mm_mul_ps(x, cy), _mm_mul_ps(y, cx));
+					x = nx;
+					a = _mm_add_ps(a, da);
+				}
+				_mm_storeu_ps(re + k, x);
+				_mm_storeu_ps(im + k, y);
+			}
+			for (int f = 0; f < num; f++)
+			{
+				const float *sum = lanes + f * 4;
+				out[offset + f] += (sum[0] + sum[1]) + (sum[2] + sum[3]);
+			}
+		#else
+			for (int k = 0; k < NUM_PARTIALS; k++)
+			{
+				float x = re[k];
+				float y = im[k];
+				float da = (end[k] - begin[k]) * step;
+				float a = begin[k] + da * offset;
+				for (int f = 0; f < num; f++)
+				{
+					out[offset + f] += a * y;
+					float nx = x * rotation_x[k] - y * rotation_y[k];
+					y = x * rotation_y[k] + y * rotation_x[k];
+					x = nx;
+					a += da;
+				}
+				re[k] = x;
+				im[k] = y;
+			}
+		#endif
+
+		// the rotations accumulate rounding, the phasors are pulled back to the unit circle
+		for (int k = 0; k < NUM_PARTIALS; k++)
+		{
+			float length = Math::rsqrt(re[k] * re[k] + im[k] * im[k]);
+			re[k] *= length;
+			im[k] *= length;
+		}
+	}
+}
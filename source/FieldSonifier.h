@@ -0,0 +1,105 @@
+#ifndef __FIELD_SONIFIER_H__
+#define __FIELD_SONIFIER_H__
+
+#include "PendulumField.h"
+
+#include <UnigineSounds.h>
+#include <UnigineString.h>
+#include <UnigineVector.h>
+
+// Sonification of a field through a few aggregated voices instead of a sound source per pendulum.
+// The pivots are binned into a grid of voices. Every pendulum adds the speed of its bob to one of the partials of
+// its voice, chosen by its natural frequency, so the cost of the synthesis depends on the number of voices and
+// partials only. Partials are rotating phasors summed four at a time with SIMD, their amplitudes ramp between
+// captures. Live output renders short segments in the background and plays them through one streamed sound source
+// per voice placed at the center of its bin; offline output steps a copy of the field and mixes all voices into a
+// stereo buffer that can be saved as a WAV file.
+class FieldSonifier
+{
+public:
+	enum
+	{
+		NUM_PARTIALS = 32,
+		PARTIALS_PER_OCTAVE = 8,
+	};
+
+	FieldSonifier();
+	~FieldSonifier();
+
+	// voices are the cells of a bins_x by bins_y grid over the bounds of the pivots
+	void init(int bins_x, int bins_y, int sample_rate);
+	// stops the live output and waits for its render
+	void shutdown();
+	bool isInitialized() const { return sample_rate > 0; }
+	int getNumVoices() const { return bins_x * bins_y; }
+	int getSampleRate() const { return sample_rate; }
+
+	// maps the natural frequency of a pendulum to the audible range, the lowest partial is min_frequency
+	void setPitchScale(float scale) { pitch_scale = scale; }
+	float getPitchScale() const { return pitch_scale; }
+	void setMinFrequency(float frequency);
+	float getMinFrequency() const { return min_frequency; }
+	void setGain(float g) { gain = g; }
+	float getGain() const { return gain; }
+
+	// live output, segments are written to files starting with path and played one segment behind the capture
+	void start(const char *path, float segment);
+	void stop();
+	bool isPlaying() const { return !segment_path.empty(); }
+	// captures the field and swaps finished segments in, called on the main thread
+	void update(const PendulumField &field, float ifps);
+	// duration of the last segment render in milliseconds and the number of segments that were late
+	float getRenderTime() const { return render_time; }
+	int getNumLate() const { return num_late; }
+
+	// steps a copy of the field and renders duration seconds of interleaved stereo, voices are panned by their column
+	bool render(const PendulumField &field, float duration, float ifps, Unigine::Vector<short> &samples);
+	static bool saveWav(const char *path, const short *samples, int num_frames, int num_channels, int sample_rate);
+
+private:
+	// phasors of the partials of every voice
+	struct Oscillators
+	{
+		Unigine::Vector<float> re;
+		Unigine::Vector<float> im;
+	};
+
+	void init_oscillators(Oscillators &oscillators) const;
+	void capture(const PendulumField &field, float *amplitudes, Unigine::Math::Vec3 *positions);
+	void synthesize(Oscillators &oscillators, int voice, const float *begin, const float *end, int num_frames, float *out) const;
+	void render_segment();
+
+	int bins_x;
+	int bins_y;
+	int sample_rate;
+	float pitch_scale;
+	float min_frequency;
+	float gain;
+
+	// rotation of the partial phasors per sample
+	Unigine::Vector<float> rotation_re;
+	Unigine::Vector<float> rotation_im;
+	Unigine::Vector<int> counts;
+
+	// live output: captures are collected for a segment and handed to the render as a whole
+	Unigine::String segment_path;
+	float segment;
+	float segment_time;
+	Unigine::Vector<float> pending;
+	Unigine::Vector<float> pending_times;
+	Unigine::Vector<float> rendered;
+	Unigine::Vector<float> rendered_times;
+	Unigine::Vector<float> last;
+	Unigine::Vector<Unigine::Math::Vec3> positions;
+	Unigine::Vector<float> mono;
+	Unigine::Vector<short> pcm;
+	Oscillators live;
+	Unigine::Vector<Unigine::SoundSourcePtr> sources;
+	volatile int rendering;
+	volatile int num_rendered;
+	int num_played;
+	float render_time;
+	int num_late;
+};
+
+#endif // __FIELD_SONIFIER_H__
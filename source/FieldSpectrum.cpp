@@ -0,0 +1,257 @@
+#include "FieldSpectrum.h"
+
+#include <UnigineAsyncQueue.h>
+#include <UnigineProfiler.h>
+#include <UnigineThread.h>
+#include <UnigineTimer.h>
+
+#include <string.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+constexpr int SNAPSHOT_NEW = 4;
+
+float get_power(const vec2 &v)
+{
+	return v.x * v.x + v.y * v.y;
+}
+}
+
+FieldSpectrum::FieldSpectrum()
+	: lattice_x(0)
+	, lattice_y(0)
+	, size_x(0)
+	, size_y(0)
+	, window(0)
+	, interval(15)
+	, time(0.0)
+	, ticks(0)
+	, num_samples(0)
+	, history_head(0)
+	, num_dropped(0)
+	, write_index(0)
+	, read_index(1)
+	, latest(2)
+	, analyzing(0)
+	, analysis_time(0.0f)
+	, num_spectra(0)
+{
+}
+
+FieldSpectrum::~FieldSpectrum()
+{
+	shutdown();
+}
+
+void FieldSpectrum::init(int lx, int ly, const Vector<int> &p, int w, int capacity)
+{
+	shutdown();
+
+	lattice_x = max(lx, 2);
+	lattice_y = max(ly, 1);
+	size_x = FieldFFT::getFloorPowerOfTwo(lattice_x);
+	size_y = FieldFFT::getFloorPowerOfTwo(lattice_y);
+	window = max(FieldFFT::getFloorPowerOfTwo(w), 2);
+	probes = p;
+
+	time = 0.0;
+	ticks = 0;
+	num_samples = 0;
+	history_head = 0;
+	history.resize(probes.size() * window);
+	memset(history.get(), 0, sizeof(float) * history.size());
+	num_dropped = 0;
+
+	for (Snapshot &snapshot : snapshots)
+	{
+		snapshot.angles.resize(size_x * size_y);
+		snapshot.history.resize(probes.size() * window);
+	}
+	write_index = 0;
+	read_index = 1;
+	latest = 2;
+
+	fft_x.init(size_x);
+	if (size_y > 1)
+		fft_y.init(size_y);
+	fft_t.init(window);
+	grid.resize(size_y * (size_x / 2 + 1));
+	column.resize(size_y);
+	frequencies.resize(window / 2 + 1);
+	windowed.resize(window);
+	hann.resize(window);
+	for (int i = 0; i < window; i++)
+		hann[i] = 0.5f - 0.5f * cos(Consts::PI2 * i / window);
+
+	// results are sized once, readers copy from them while the analysis writes other slots
+	results.resize(max(capacity, 1));
+	sequences.resize(results.size());
+	for (int i = 0; i < results.size(); i++)
+	{
+		Spectrum &spectrum = results[i];
+		spectrum.time = 0.0;
+		spectrum.sample_step = 0.0f;
+		spectrum.size_x = size_x;
+		spectrum.size_y = size_y;
+		spectrum.spatial.resize(grid.size());
+		spectrum.rows.resize(size_x / 2 + 1);
+		spectrum.window = window;
+		spectrum.num_probes = probes.size();
+		spectrum.temporal.resize(probes.size() * frequencies.size());
+		sequences[i] = 0;
+	}
+	num_spectra = 0;
+}
+
+void FieldSpectrum::shutdown()
+{
+	while (AtomicGet(&analyzing))
+		Thread::switchThread();
+	lattice_x = 0;
+}
+
+void FieldSpectrum::capture(const PendulumField &field, float ifps)
+{
+	if (!isInitialized())
+		return;
+
+	UNIGINE_PROFILER_FUNCTION;
+
+	// probes are sampled every tick, a removed pendulum reads as zero
+	for (int i = 0; i < probes.size(); i++)
+	{
+		int id = probes[i];
+		history[i * window + history_head] = field.isValidId(id) ? field.theta[field.getSlot(id)] : 0.0f;
+	}
+	history_head = (history_head + 1) % window;
+	num_samples = min(num_samples + 1, window);
+	time += ifps;
+
+	if (++ticks < interval)
+		return;
+	ticks = 0;
+
+	Snapshot &snapshot = snapshots[write_index];
+	snapshot.time = time;
+	snapshot.sample_step = ifps;
+	snapshot.num_samples = num_samples;
+	float *angles = snapshot.angles.get();
+	for (int y = 0; y < size_y; y++)
+	{
+		for (int x = 0; x < size_x; x++)
+		{
+			int id = y * lattice_x + x;
+			*angles++ = field.isValidId(id) ? field.theta[field.getSlot(id)] : 0.0f;
+		}
+	}
+	for (int i = 0; i < probes.size(); i++)
+	{
+		const float *src = history.get() + i * window;
+		float *dest = snapshot.history.get() + i * window;
+		for (int j = 0; j < window; j++)
+			dest[j] = src[(history_head + j) % window];
+	}
+
+	// the newest snapshot replaces one the analysis has not taken yet
+	int previous = AtomicSwap(&latest, write_index | SNAPSHOT_NEW);
+	if (previous & SNAPSHOT_NEW)
+		num_dropped++;
+	write_index = previous & ~SNAPSHOT_NEW;
+
+	if (AtomicCAS(&analyzing, 0, 1))
+		AsyncQueue::runAsync(AsyncQueue::ASYNC_THREAD_BACKGROUND, MakeCallback(this, &FieldSpectrum::analyze));
+}
+
+void FieldSpectrum::analyze()
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	// snapshots published during an analysis are taken by the same run
+	while (AtomicGet(&latest) & SNAPSHOT_NEW)
+	{
+		long long begin = Time::get();
+		read_index = AtomicSwap(&latest, read_index) & ~SNAPSHOT_NEW;
+
+		int count = AtomicGet(&num_spectra);
+		int slot = count % results.size();
+		AtomicInc(&sequences[slot]);
+		process(snapshots[read_index], results[slot]);
+		AtomicInc(&sequences[slot]);
+		AtomicSet(&num_spectra, count + 1);
+
+		analysis_time = Time::microsecondsToMilliseconds(Time::get() - begin);
+	}
+	AtomicSet(&analyzing, 0);
+}
+
+void FieldSpectrum::process(const Snapshot &snapshot, Spectrum &spectrum)
+{
+	spectrum.time = snapshot.time;
+	spectrum.sample_step = snapshot.sample_step;
+
+	// rows first as real transforms, then the columns of their non-negative frequencies
+	int num_x = size_x / 2 + 1;
+	float row_scale = 1.0f / (float(size_x) * size_x * size_y);
+	memset(spectrum.rows.get(), 0, sizeof(float) * spectrum.rows.size());
+	for (int y = 0; y < size_y; y++)
+	{
+		vec2 *row = grid.get() + y * num_x;
+		fft_x.transformReal(snapshot.angles.get() + y * size_x, row);
+		for (int k = 0; k < num_x; k++)
+			spectrum.rows[k] += get_power(row[k]) * row_scale;
+	}
+
+	float grid_scale = 1.0f / (float(size_x) * size_x * size_y * size_y);
+	for (int k = 0; k < num_x; k++)
+	{
+		for (int y = 0; y < size_y; y++)
+			column[y] = grid[y * num_x + k];
+		if (size_y > 1)
+			fft_y.transform(column.get());
+		for (int y = 0; y < size_y; y++)
+			spectrum.spatial[y * num_x + k] = get_power(column[y]) * grid_scale;
+	}
+
+	// the Hann window keeps the leakage of the sliding window low, the power is normalized by its sum
+	int num_f = window / 2 + 1;
+	float window_sum = window * 0.5f;
+	float time_scale = 1.0f / (window_sum * window_sum);
+	for (int i = 0; i < probes.size(); i++)
+	{
+		float *power = spectrum.temporal.get() + i * num_f;
+		if (snapshot.num_samples < window)
+		{
+			memset(power, 0, sizeof(float) * num_f);
+			continue;
+		}
+		const float *samples = snapshot.history.get() + i * window;
+		for (int j = 0; j < window; j++)
+			windowed[j] = samples[j] * hann[j];
+		fft_t.transformReal(windowed.get(), frequencies.get());
+		for (int k = 0; k < num_f; k++)
+			power[k] = get_power(frequencies[k]) * time_scale;
+	}
+}
+
+int FieldSpectrum::getNumSpectra() const
+{
+	return AtomicGet(&num_spectra);
+}
+
+bool FieldSpectrum::getSpectrum(int age, Spectrum &ret) const
+{
+	int count = AtomicGet(&num_spectra);
+	if (age < 0 || age >= min(count, results.size()))
+		return false;
+
+	// the analysis may lap the reader, the sequence tells whether the slot changed during the copy
+	int slot = (count - 1 - age) % results.size();
+	int sequence = AtomicGet(&sequences[slot]);
+	if (sequence & 1)
+		return false;
+	ret = results[slot];
+	return AtomicGet(&sequences[slot]) == sequence;
+}
@@ -0,0 +1,123 @@
+#ifndef __FIELD_SPECTRUM_H__
+#define __FIELD_SPECTRUM_H__
+
+#include "FieldFFT.h"
+#include "PendulumField.h"
+
+#include <UnigineVector.h>
+
+// Streaming spectral analysis of the angles of a lattice field.
+// The physics thread records the probe angles every tick and every few ticks copies them together with the angles
+// of a power-of-two region of the lattice into a triple-buffered snapshot, so it never waits for the analysis. A
+// background thread transforms the newest snapshot into the 2D power spectrum of the region, the mean 1D power
+// spectrum of its rows and the Hann-windowed power spectrum of the last window ticks of every probe. Results go
+// to a ring buffer that readers copy from without locks.
+class FieldSpectrum
+{
+public:
+	struct Spectrum
+	{
+		// field time of the snapshot in seconds and the tick between the probe samples
+		double time;
+		float sample_step;
+
+		// power of the wave vectors: size_y rows of ky in FFT order, each with size_x / 2 + 1 non-negative kx
+		int size_x;
+		int size_y;
+		Unigine::Vector<float> spatial;
+		// mean power of the rows, size_x / 2 + 1 values
+		Unigine::Vector<float> rows;
+
+		// power per probe, window / 2 + 1 frequencies in steps of 1 / (window * sample_step) Hz,
+		// zero until the probes have recorded a full window
+		int window;
+		int num_probes;
+		Unigine::Vector<float> temporal;
+	};
+
+	FieldSpectrum();
+	~FieldSpectrum();
+
+	// the lattice is the one of PendulumField::createLattice(), whose ids follow the lattice slots; the region is its
+	// largest power-of-two corner, the window is rounded down to a power of two
+	void init(int lattice_x, int lattice_y, const Unigine::Vector<int> &probes, int window, int capacity);
+	// waits for a running analysis
+	void shutdown();
+	bool isInitialized() const { return lattice_x > 0; }
+	int getNumProbes() const { return probes.size(); }
+	int getProbe(int num) const { return probes[num]; }
+
+	// ticks between snapshots, the hop of the sliding window
+	void setInterval(int ticks) { interval = Unigine::Math::max(ticks, 1); }
+	int getInterval() const { return interval; }
+
+	// records the tick on the physics thread and starts an analysis when a snapshot is due
+	void capture(const PendulumField &field, float ifps);
+
+	// spectra produced so far, the ring keeps the last capacity of them
+	int getNumSpectra() const;
+	int getCapacity() const { return results.size(); }
+	// copies the spectrum of the given age, 0 is the newest; fails if it is not in the ring or was overwritten
+	// during the copy
+	bool getSpectrum(int age, Spectrum &ret) const;
+
+	// duration of the last analysis in milliseconds and the number of snapshots replaced before they were analyzed
+	float getAnalysisTime() const { return analysis_time; }
+	int getNumDropped() const { return num_dropped; }
+
+private:
+	struct Snapshot
+	{
+		double time;
+		float sample_step;
+		int num_samples;
+		Unigine::Vector<float> angles;
+		// probe histories oldest first
+		Unigine::Vector<float> history;
+	};
+
+	void analyze();
+	void process(const Snapshot &snapshot, Spectrum &spectrum);
+
+	int lattice_x;
+	int lattice_y;
+	int size_x;
+	int size_y;
+	int window;
+	Unigine::Vector<int> probes;
+	int interval;
+
+	// physics thread state
+	double time;
+	int ticks;
+	int num_samples;
+	int history_head;
+	Unigine::Vector<float> history;
+	int num_dropped;
+
+	// triple buffer: the physics thread fills write_index, the analysis reads read_index and the newest one is
+	// exchanged through latest, which carries SNAPSHOT_NEW until the analysis takes it
+	Snapshot snapshots[3];
+	int write_index;
+	int read_index;
+	volatile int latest;
+	volatile int analyzing;
+
+	// analysis state
+	FieldFFT fft_x;
+	FieldFFT fft_y;
+	FieldFFT fft_t;
+	Unigine::Vector<Unigine::Math::vec2> grid;
+	Unigine::Vector<Unigine::Math::vec2> column;
+	Unigine::Vector<Unigine::Math::vec2> frequencies;
+	Unigine::Vector<float> windowed;
+	Unigine::Vector<float> hann;
+	float analysis_time;
+
+	// ring of results, a slot is being written while its sequence is odd
+	Unigine::Vector<Spectrum> results;
+	Unigine::Vector<int> sequences;
+	volatile int num_spectra;
+};
+
+#endif // __FIELD_SPECTRUM_H__
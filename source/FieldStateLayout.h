@@ -0,0 +1,58 @@
+#ifndef __FIELD_STATE_LAYOUT_H__
+#define __FIELD_STATE_LAYOUT_H__
+
+// Layout of the shared memory the live field state is published to, shared by FieldPublisher and the C reader in
+// utils/field_state. Plain C so external tools can include it as is.
+//
+// The memory starts with a FieldStateHeader of header_size bytes, followed by num_frames frames of frame_size bytes.
+// A frame is a FieldStateFrame padded to FIELD_STATE_ALIGNMENT, then num_columns columns of capacity floats, indexed
+// by the external pendulum id, each starting at a multiple of FIELD_STATE_ALIGNMENT. Frame n goes to slot
+// n % num_frames. Its sequence is odd while the frame is written; a reader copies a frame between two reads of an
+// even sequence and keeps the copy only if the sequence did not change. num_published is stored after the frame is
+// complete, the newest frame is num_published - 1.
+
+#include <stdint.h>
+
+#define FIELD_STATE_MAGIC 0x54534650u // "PFST"
+#define FIELD_STATE_VERSION 2
+#define FIELD_STATE_ALIGNMENT 64
+#define FIELD_STATE_MAX_COLUMNS 16
+
+typedef struct FieldStateHeader
+{
+	// the magic is stored last, a reader that maps the memory during its setup sees zero
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t frame_size;
+	uint32_t num_frames;
+	// ids per column, ids past it are not published
+	uint32_t capacity;
+	uint32_t num_columns;
+	// PendulumField::ARRAY of every column: 6 is the angle, 7 the angular velocity, 8 to 10 the bob position; pivots
+	// and bobs are relative to the origin of their frame
+	int32_t columns[FIELD_STATE_MAX_COLUMNS];
+	uint32_t writer_pid;
+	float tick_step;
+	uint32_t reserved;
+	volatile long long num_published;
+} FieldStateHeader;
+
+typedef struct FieldStateFrame
+{
+	volatile int32_t sequence;
+	// ids handed out by the field when the frame was taken, removed pendulums read as NaN
+	uint32_t num_pendulums;
+	// index of the frame since the publisher opened and the physics tick it was taken after
+	unsigned long long frame;
+	unsigned long long tick;
+	// field time in seconds
+	double time;
+	// monotonic clock of the publisher in nanoseconds when the frame was complete
+	long long publish_time;
+	// world position of the field origin, PendulumField::getOrigin(); the world position of a bob is this plus the
+	// published one
+	double origin[3];
+} FieldStateFrame;
+
+#endif // __FIELD_STATE_LAYOUT_H__
@@ -0,0 +1,472 @@
+#include "FieldStorage.h"
+#include "MappedFile.h"
+#include "PendulumField.h"
+
+#include <UnigineCompress.h>
+#include <UnigineFileSystem.h>
+#include <UnigineLog.h>
+#include <UnigineProfiler.h>
+#include <UnigineStreams.h>
+#include <UnigineThread.h>
+#include <UnigineTimer.h>
+#include <UnigineWorld.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#ifdef __SSE4_2__
+	#include <nmmintrin.h>
+#endif
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+constexpr unsigned int STORAGE_MAGIC = ('P' << 0) | ('F' << 8) | ('L' << 16) | ('D' << 24);
+constexpr unsigned int STORAGE_VERSION = 3;
+// world data entry holding the GUID of the file
+constexpr const char *WORLD_DATA_NAME = "pendulum_field";
+// arrays up to the derived bob positions are stored
+constexpr int NUM_STORED_ARRAYS = PendulumField::ARRAY_BOB_X;
+constexpr size_t MAX_RAW_SIZE = sizeof(float) * NUM_STORED_ARRAYS * PendulumField::CHUNK_SIZE;
+
+struct StorageHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	int num_pendulums;
+	int chunk_size;
+	float gravity;
+	float damping;
+	float bob_radius;
+	unsigned int table_checksum;
+	// bytes of the file neither a block nor the table uses
+	unsigned long long garbage;
+	unsigned long long table_offset;
+	unsigned int header_checksum;
+	// increased by every save, the valid slot of the newest generation is the current header
+	unsigned int generation;
+};
+
+// the header is written alternately into two slots, the blocks and tables follow them
+constexpr int NUM_HEADER_SLOTS = 2;
+constexpr size_t DATA_OFFSET = sizeof(StorageHeader) * NUM_HEADER_SLOTS;
+
+// CRC-32C, hardware accelerated when the build targets SSE 4.2
+unsigned int get_checksum(const void *data, size_t size)
+{
+	const unsigned char *src = static_cast<const unsigned char *>(data);
+	unsigned int crc = 0xffffffff;
+	#ifdef __SSE4_2__
+		unsigned long long crc64 = crc;
+		for (; size >= 8; size -= 8, src += 8)
+		{
+			unsigned long long value;
+			memcpy(&value, src, sizeof(value));
+			crc64 = _mm_crc32_u64(crc64, value);
+		}
+		crc = (unsigned int)crc64;
+		for (; size > 0; size--)
+			crc = _mm_crc32_u8(crc, *src++);
+	#else
+		static const struct Table
+		{
+			Table()
+			{
+				for (unsigned int i = 0; i < 256; i++)
+				{
+					unsigned int value = i;
+					for (int k = 0; k < 8; k++)
+						value = (value >> 1) ^ (0x82f63b78 & (0u - (value & 1)));
+					values[i] = value;
+				}
+			}
+			unsigned int values[256];
+		} table;
+		for (; size > 0; size--)
+			crc = table.values[(crc ^ *src++) & 0xff] ^ (crc >> 8);
+	#endif
+	return ~crc;
+}
+
+unsigned int get_header_checksum(const StorageHeader &header)
+{
+	StorageHeader copy = header;
+	copy.header_checksum = 0;
+	return get_checksum(&copy, sizeof(copy));
+}
+
+// slot of the valid header of the newest generation, -1 if neither slot is valid
+int get_current_slot(const StorageHeader *headers)
+{
+	int ret = -1;
+	for (int i = 0; i < NUM_HEADER_SLOTS; i++)
+	{
+		const StorageHeader &header = headers[i];
+		if (header.magic != STORAGE_MAGIC || header.version != STORAGE_VERSION || header.chunk_size != PendulumField::CHUNK_SIZE
+			|| header.num_pendulums < 0 || get_header_checksum(header) != header.header_checksum)
+			continue;
+		if (ret == -1 || int(header.generation - headers[ret].generation) > 0)
+			ret = i;
+	}
+	return ret;
+}
+
+// writes the file through to the disk, the engine files only flush into the system cache; a handle of its own
+// syncs the writes of every handle of the file
+bool sync_file(const char *path)
+{
+	#ifdef _WIN32
+		HANDLE handle = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+			return false;
+		bool ret = FlushFileBuffers(handle) != 0;
+		CloseHandle(handle);
+		return ret;
+	#else
+		int fd = open(path, O_RDONLY);
+		if (fd == -1)
+			return false;
+		bool ret = fsync(fd) == 0;
+		close(fd);
+		return ret;
+	#endif
+}
+
+// replaces the file at once, readers see either the old or the new one
+bool replace_file(const char *from, const char *to)
+{
+	#ifdef _WIN32
+		return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+	#else
+		return rename(from, to) == 0;
+	#endif
+}
+
+// stored arrays of a chunk one after another
+size_t gather_chunk(const PendulumField &field, int chunk, float *raw)
+{
+	int begin, end;
+	field.getChunkRange(chunk, begin, end);
+	int num = end - begin;
+	for (int i = 0; i < NUM_STORED_ARRAYS; i++)
+		memcpy(raw + i * num, field.getArray(PendulumField::ARRAY(i)).get() + begin, sizeof(float) * num);
+	return sizeof(float) * NUM_STORED_ARRAYS * num;
+}
+
+void scatter_chunk(PendulumField &field, int chunk, const float *raw)
+{
+	int begin, end;
+	field.getChunkRange(chunk, begin, end);
+	int num = end - begin;
+	for (int i = 0; i < NUM_STORED_ARRAYS; i++)
+		memcpy(field.getArray(PendulumField::ARRAY(i)).get() + begin, raw + i * num, sizeof(float) * num);
+}
+
+thread_local float raw_chunk[MAX_RAW_SIZE / sizeof(float)];
+}
+
+FieldStorage::FieldStorage()
+	: num_chunks(0)
+	, num_written(0)
+	, file_size(0)
+	, time(0.0f)
+{
+}
+
+FieldStorage::~FieldStorage()
+{
+}
+
+String FieldStorage::getWorldFile()
+{
+	if (!World::hasData(WORLD_DATA_NAME))
+		return String();
+	UGUID guid(World::getData(WORLD_DATA_NAME));
+	if (!guid.isValid() || !FileSystem::isFileExist(guid))
+		return String();
+	return FileSystem::getAbsolutePath(guid);
+}
+
+bool FieldStorage::setWorldFile(const char *path)
+{
+	UGUID guid = FileSystem::getGUID(path);
+	if (!guid.isValid())
+	{
+		guid = FileSystem::generateGUID();
+		if (!FileSystem::setGUID(path, guid))
+			return false;
+	}
+	World::setData(WORLD_DATA_NAME, guid.makeString());
+	return true;
+}
+
+bool FieldStorage::load(const char *path, PendulumField &field)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	Timer timer;
+	timer.begin();
+	num_written = 0;
+
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+
+	const unsigned char *data = file.getData();
+	size_t size = file.getSize();
+	if (size < DATA_OFFSET)
+		return false;
+
+	// a header torn by an interrupted save fails its checksum, the other slot still holds the previous save
+	const StorageHeader *headers = reinterpret_cast<const StorageHeader *>(data);
+	int slot = get_current_slot(headers);
+	if (slot == -1)
+	{
+		Log::warning("FieldStorage::load(): \"%s\" is not a field of this version\n", path);
+		return false;
+	}
+	const StorageHeader &header = headers[slot];
+
+	int num = header.num_pendulums;
+	num_chunks = (num + PendulumField::CHUNK_SIZE - 1) / PendulumField::CHUNK_SIZE;
+	size_t table_size = sizeof(Entry) * num_chunks;
+	if (header.table_offset < DATA_OFFSET || header.table_offset + table_size > size)
+	{
+		Log::warning("FieldStorage::load(): \"%s\" is truncated\n", path);
+		return false;
+	}
+	const Entry *table = reinterpret_cast<const Entry *>(data + header.table_offset);
+	if (get_checksum(table, table_size) != header.table_checksum)
+	{
+		Log::warning("FieldStorage::load(): chunk table of \"%s\" is corrupted\n", path);
+		return false;
+	}
+
+	field.clear();
+	field.resize(num);
+
+	// blocks are independent, the workers decompress them straight from the mapping
+	AtomicInt32 next_chunk(0);
+	AtomicInt32 num_failed(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		for (int chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++)
+		{
+			const Entry &entry = table[chunk];
+			int begin, end;
+			field.getChunkRange(chunk, begin, end);
+			size_t raw_size = sizeof(float) * NUM_STORED_ARRAYS * (end - begin);
+			if (entry.offset + entry.size > size
+				|| !Compress::lz4Decompress(raw_chunk, raw_size, data + entry.offset, entry.size)
+				|| get_checksum(raw_chunk, raw_size) != entry.checksum)
+			{
+				num_failed++;
+				continue;
+			}
+			scatter_chunk(field, chunk, raw_chunk);
+		}
+	});
+	if (num_failed > 0)
+	{
+		Log::warning("FieldStorage::load(): %d of %d chunks of \"%s\" are corrupted\n", int(num_failed), num_chunks, path);
+		field.clear();
+		return false;
+	}
+
+	field.setGravity(header.gravity);
+	field.setDamping(header.damping);
+	field.setBobRadius(header.bob_radius);
+	field.updateBobs();
+
+	file_size = size;
+	time = float(timer.endMilliseconds());
+	return true;
+}
+
+bool FieldStorage::read_table(const char *path, const PendulumField &field, Vector<Entry> &result, unsigned long long &garbage,
+	unsigned long long &table_offset, unsigned int &generation, int &slot) const
+{
+	FilePtr file = File::create(path, "rb", false);
+	if (!file || !file->isOpened())
+		return false;
+
+	StorageHeader headers[NUM_HEADER_SLOTS];
+	bool ret = file->read(headers, sizeof(headers)) == sizeof(headers);
+	slot = ret ? get_current_slot(headers) : -1;
+	ret = slot != -1 && headers[slot].num_pendulums == field.getNumPendulums();
+	if (ret)
+	{
+		const StorageHeader &header = headers[slot];
+		result.resize(field.getNumChunks());
+		size_t table_size = sizeof(Entry) * result.size();
+		ret = file->seekSet(header.table_offset) && file->read(result.get(), table_size) == table_size
+			&& get_checksum(result.get(), table_size) == header.table_checksum;
+		garbage = header.garbage;
+		table_offset = header.table_offset;
+		generation = header.generation;
+	}
+	file->close();
+	return ret;
+}
+
+void FieldStorage::pack_chunks(const PendulumField &field, bool compress)
+{
+	AtomicInt32 next_chunk(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		for (int chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++)
+		{
+			if (compress && !dirty[chunk])
+				continue;
+
+			size_t raw_size = gather_chunk(field, chunk, raw_chunk);
+			if (!compress)
+			{
+				checksums[chunk] = get_checksum(raw_chunk, raw_size);
+				continue;
+			}
+
+			Vector<unsigned char> &block = blocks[chunk];
+			block.resize(int(Compress::lz4Size(raw_size)));
+			size_t block_size = block.size();
+			if (!Compress::lz4Compress(block.get(), block_size, raw_chunk, raw_size, false))
+				block_size = 0;
+			block.resize(int(block_size));
+		}
+	});
+}
+
+bool FieldStorage::save(const char *path, const PendulumField &field)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	Timer timer;
+	timer.begin();
+
+	num_chunks = field.getNumChunks();
+	checksums.resize(num_chunks);
+	dirty.resize(num_chunks);
+	blocks.resize(num_chunks);
+	pack_chunks(field, false);
+
+	// an existing file of the same layout is updated without touching anything its current header references: the
+	// changed blocks and a new table are appended and synced, then the other header slot switches to them, so a save
+	// torn at any point leaves the old field
+	unsigned long long garbage = 0;
+	unsigned long long table_offset = 0;
+	unsigned int generation = 0;
+	int slot = -1;
+	size_t table_size = sizeof(Entry) * num_chunks;
+	bool incremental = read_table(path, field, entries, garbage, table_offset, generation, slot);
+	size_t end = DATA_OFFSET;
+	if (incremental)
+	{
+		end = max(end, size_t(table_offset + table_size));
+		for (int i = 0; i < num_chunks; i++)
+		{
+			end = max(end, size_t(entries[i].offset + entries[i].capacity));
+			dirty[i] = (entries[i].checksum != checksums[i]);
+		}
+		// the replaced blocks and table add to the holes of the earlier saves
+		garbage += table_size;
+		for (int i = 0; i < num_chunks; i++)
+			garbage += dirty[i] ? entries[i].capacity : 0;
+		// compacted once at least half of the file would be unused
+		incremental = garbage * 2 <= end;
+	}
+	if (!incremental)
+	{
+		entries.resize(num_chunks);
+		memset(entries.get(), 0, sizeof(Entry) * num_chunks);
+		memset(dirty.get(), 1, num_chunks);
+		end = DATA_OFFSET;
+		garbage = 0;
+		// the new file leaves the second slot zeroed and invalid
+		slot = 1;
+	}
+
+	pack_chunks(field, true);
+
+	// a full save goes to a temporary file that replaces the old one once it is complete
+	String temp_path = String::format("%s.tmp", path);
+	const char *write_path = incremental ? path : temp_path.get();
+	FilePtr file = File::create(write_path, incremental ? "r+b" : "wb", false);
+	if (!file || !file->isOpened())
+	{
+		Log::error("FieldStorage::save(): can't open \"%s\" file\n", write_path);
+		return false;
+	}
+
+	bool ret = file->seekSet(end) != 0;
+	num_written = 0;
+	for (int i = 0; i < num_chunks && ret; i++)
+	{
+		if (!dirty[i])
+			continue;
+
+		const Vector<unsigned char> &block = blocks[i];
+		ret = block.size() > 0;
+		if (!ret)
+			break;
+
+		Entry &entry = entries[i];
+		entry.offset = end;
+		entry.size = block.size();
+		entry.capacity = block.size();
+		entry.checksum = checksums[i];
+		end += block.size();
+
+		ret = file->write(block.get(), block.size()) == size_t(block.size());
+		num_written++;
+	}
+
+	StorageHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = STORAGE_MAGIC;
+	header.version = STORAGE_VERSION;
+	header.num_pendulums = field.getNumPendulums();
+	header.chunk_size = PendulumField::CHUNK_SIZE;
+	header.gravity = field.getGravity();
+	header.damping = field.getDamping();
+	header.bob_radius = field.getBobRadius();
+	header.table_checksum = get_checksum(entries.get(), table_size);
+	header.garbage = garbage;
+	header.table_offset = end;
+	header.generation = generation + 1;
+	header.header_checksum = get_header_checksum(header);
+	end += table_size;
+
+	// the blocks and the table are on the disk before the header that references them is written
+	ret = ret && file->write(entries.get(), table_size) == table_size && file->flush() && sync_file(write_path);
+	ret = ret && file->seekSet(sizeof(StorageHeader) * (1 - slot)) && file->write(&header, sizeof(header)) == sizeof(header) && file->flush();
+	file->close();
+	ret = ret && sync_file(write_path);
+
+	for (Vector<unsigned char> &block : blocks)
+		block.clear();
+
+	if (ret && !incremental)
+		ret = replace_file(temp_path.get(), path);
+	if (!ret)
+	{
+		if (!incremental)
+			remove(temp_path.get());
+		Log::error("FieldStorage::save(): can't write \"%s\" file\n", path);
+		return false;
+	}
+
+	file_size = end;
+	time = float(timer.endMilliseconds());
+	return true;
+}
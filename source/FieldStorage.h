@@ -0,0 +1,64 @@
+#ifndef __FIELD_STORAGE_H__
+#define __FIELD_STORAGE_H__
+
+#include <UnigineString.h>
+#include <UnigineVector.h>
+
+class PendulumField;
+
+// Binary sidecar file of an authored PendulumField, referenced from the world by its GUID.
+// The file is two header slots, one lz4 block per field chunk holding the stored arrays of its pendulums and a chunk
+// table, every block carries a checksum of its contents. Saving over an existing file of the same layout appends only
+// the chunks whose checksum changed and a new table, syncs them to the disk and then writes the header referencing
+// them into the slot of the older generation; loading uses the valid header of the newest generation, so an
+// interrupted save, even one tearing the header, leaves the previous field readable. The file is compacted through
+// a temporary file once half of it is unused.
+// Bob positions are derived and not stored.
+class FieldStorage
+{
+public:
+	FieldStorage();
+	~FieldStorage();
+
+	// paths are absolute
+	bool load(const char *path, PendulumField &field);
+	bool save(const char *path, const PendulumField &field);
+
+	// absolute path of the file referenced by the loaded world, empty if there is none
+	static Unigine::String getWorldFile();
+	// references the file from the loaded world, the reference is stored by the next world save
+	static bool setWorldFile(const char *path);
+
+	// statistics of the last load or save
+	int getNumChunks() const { return num_chunks; }
+	int getNumWrittenChunks() const { return num_written; }
+	size_t getFileSize() const { return file_size; }
+	float getTime() const { return time; }
+
+private:
+	struct Entry
+	{
+		unsigned long long offset;
+		// compressed size and the space the block takes in the file
+		unsigned int size;
+		unsigned int capacity;
+		unsigned int checksum;
+		unsigned int reserved;
+	};
+
+	bool read_table(const char *path, const PendulumField &field, Unigine::Vector<Entry> &result, unsigned long long &garbage,
+		unsigned long long &table_offset, unsigned int &generation, int &slot) const;
+	void pack_chunks(const PendulumField &field, bool compress);
+
+	Unigine::Vector<Entry> entries;
+	Unigine::Vector<unsigned int> checksums;
+	Unigine::Vector<unsigned char> dirty;
+	Unigine::Vector<Unigine::Vector<unsigned char>> blocks;
+
+	int num_chunks;
+	int num_written;
+	size_t file_size;
+	float time;
+};
+
+#endif // __FIELD_STORAGE_H__
@@ -0,0 +1,154 @@
+#include "FieldTaskGraph.h"
+
+#include <UnigineLog.h>
+
+#include <algorithm>
+#include <string.h>
+
+using namespace Unigine;
+using namespace Math;
+
+FieldTaskGraph::FieldTaskGraph()
+	: built(false)
+	, time(0.0f)
+	, busy_time(0.0f)
+	, num_workers(0)
+	, num_steals(0)
+{
+	stage_offsets.append(0);
+}
+
+FieldTaskGraph::~FieldTaskGraph()
+{
+}
+
+void FieldTaskGraph::clear()
+{
+	built = false;
+	stage_names.clear();
+	stage_offsets.clear();
+	stage_offsets.append(0);
+	task_stages.clear();
+	dependencies.clear();
+	num_dependencies.clear();
+	successor_offsets.clear();
+	successors.clear();
+	roots.clear();
+	pending.clear();
+	queue_tasks.clear();
+}
+
+int FieldTaskGraph::addStage(const char *name, int num_tasks)
+{
+	built = false;
+	int stage = stage_names.size();
+	stage_names.append(String(name));
+	for (int i = 0; i < num_tasks; i++)
+		task_stages.append(stage);
+	stage_offsets.append(task_stages.size());
+	return stage;
+}
+
+void FieldTaskGraph::addDependency(int stage, int task, int dependency_stage, int dependency_task)
+{
+	if (dependency_stage >= stage)
+	{
+		Log::error("FieldTaskGraph::addDependency(): stage \"%s\" can't wait for stage \"%s\"\n", getStageName(stage), getStageName(dependency_stage));
+		return;
+	}
+	built = false;
+	dependencies.append(stage_offsets[stage] + task);
+	dependencies.append(stage_offsets[dependency_stage] + dependency_task);
+}
+
+void FieldTaskGraph::build()
+{
+	int num_tasks = task_stages.size();
+	num_dependencies.resize(num_tasks);
+	memset(num_dependencies.get(), 0, sizeof(int) * num_tasks);
+	successor_offsets.resize(num_tasks + 1);
+	memset(successor_offsets.get(), 0, sizeof(int) * (num_tasks + 1));
+
+	// pairs sorted by the dependency give the successor lists, equal neighbours are duplicates
+	int num_pairs = dependencies.size() / 2;
+	Vector<long long> pairs(num_pairs);
+	for (int i = 0; i < num_pairs; i++)
+		pairs[i] = ((long long)dependencies[i * 2 + 1] << 32) | (unsigned int)dependencies[i * 2];
+	std::sort(pairs.begin(), pairs.end());
+	num_pairs = int(std::unique(pairs.begin(), pairs.end()) - pairs.begin());
+
+	successors.resize(num_pairs);
+	for (int i = 0; i < num_pairs; i++)
+	{
+		int task = int(pairs[i] & 0xffffffff);
+		int dependency = int(pairs[i] >> 32);
+		successors[i] = task;
+		num_dependencies[task]++;
+		successor_offsets[dependency + 1]++;
+	}
+	for (int i = 0; i < num_tasks; i++)
+		successor_offsets[i + 1] += successor_offsets[i];
+	dependencies.clear();
+
+	roots.clear();
+	for (int i = 0; i < num_tasks; i++)
+	{
+		if (num_dependencies[i] == 0)
+			roots.append(i);
+	}
+
+	pending.resize(num_tasks);
+	built = true;
+}
+
+void FieldTaskGraph::prepare_queues()
+{
+	// one queue per pool thread and one for the calling thread
+	int num_queues = PoolCPUShaders::getNumThreads() + 1;
+	int num_tasks = task_stages.size();
+	queues.resize(num_queues);
+	memset(queues.get(), 0, sizeof(Queue) * num_queues);
+	queue_tasks.resize(num_queues * num_tasks);
+
+	memcpy(pending.get(), num_dependencies.get(), sizeof(int) * num_tasks);
+
+	// every queue starts with a contiguous range of the roots, neighbouring chunks stay on the same worker
+	int num_roots = roots.size();
+	for (int i = 0; i < num_roots; i++)
+		push(int((long long)i * num_queues / num_roots), roots[i]);
+}
+
+void FieldTaskGraph::push(int queue, int task)
+{
+	Queue &q = queues[queue];
+	ScopedSpinLockInt lock(q.lock);
+	// every task is pushed once per run, so a queue never holds more than all of them
+	queue_tasks[queue * task_stages.size() + q.tail++] = task;
+}
+
+int FieldTaskGraph::pop(int queue)
+{
+	Queue &q = queues[queue];
+	if (AtomicGet(&q.tail) <= AtomicGet(&q.head))
+		return -1;
+	ScopedSpinLockInt lock(q.lock);
+	if (q.tail <= q.head)
+		return -1;
+	return queue_tasks[queue * task_stages.size() + --q.tail];
+}
+
+int FieldTaskGraph::steal(int queue)
+{
+	int num_queues = queues.size();
+	for (int i = 1; i < num_queues; i++)
+	{
+		int victim = (queue + i) % num_queues;
+		Queue &q = queues[victim];
+		if (AtomicGet(&q.tail) <= AtomicGet(&q.head))
+			continue;
+		ScopedSpinLockInt lock(q.lock);
+		if (q.tail > q.head)
+			return queue_tasks[victim * task_stages.size() + q.head++];
+	}
+	return -1;
+}
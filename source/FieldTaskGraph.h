@@ -0,0 +1,194 @@
+#ifndef __FIELD_TASK_GRAPH_H__
+#define __FIELD_TASK_GRAPH_H__
+
+#include <UnigineMathLib.h>
+#include <UnigineString.h>
+#include <UnigineThread.h>
+#include <UnigineTimer.h>
+#include <UnigineVector.h>
+
+// Dependency graph of the tasks of a tick, run on the CPU shader pool.
+// Tasks are grouped into stages and wait for tasks of earlier stages only. The graph is built once and reused
+// by every run: a task is released into the queue of the worker that finished its last dependency, workers take
+// their own tasks newest first and steal the oldest tasks of the others when they run out, so there is no barrier
+// between the stages. runStaged() runs the same tasks stage by stage with a barrier after each one.
+class FieldTaskGraph
+{
+public:
+	FieldTaskGraph();
+	~FieldTaskGraph();
+
+	void clear();
+	// returns the index of the stage, its tasks are numbered from 0
+	int addStage(const char *name, int num_tasks);
+	// the task waits for a task of an earlier stage, duplicates are merged by build()
+	void addDependency(int stage, int task, int dependency_stage, int dependency_task);
+	// must be called after the last stage and dependency are added
+	void build();
+	bool isBuilt() const { return built; }
+
+	int getNumStages() const { return stage_names.size(); }
+	const char *getStageName(int stage) const { return stage_names[stage].get(); }
+	int getNumStageTasks(int stage) const { return stage_offsets[stage + 1] - stage_offsets[stage]; }
+	int getNumTasks() const { return task_stages.size(); }
+	int getNumDependencies() const { return successors.size(); }
+
+	// func(stage, task) is called once for every task of the graph, from the worker threads
+	template <typename Func>
+	void run(Func func);
+	template <typename Func>
+	void runStaged(Func func);
+
+	// statistics of the last run in milliseconds, the idle time is what the workers spent waiting for tasks
+	float getTime() const { return time; }
+	float getBusyTime() const { return busy_time; }
+	float getIdleTime() const { return Unigine::Math::max(time * num_workers - busy_time, 0.0f); }
+	float getIdleRatio() const { return (time > 0.0f && num_workers > 0) ? getIdleTime() / (time * num_workers) : 0.0f; }
+	int getNumWorkers() const { return num_workers; }
+	int getNumSteals() const { return num_steals; }
+
+private:
+	// task queue of a worker, padded to a cache line
+	struct Queue
+	{
+		int lock;
+		int head;
+		int tail;
+		int padding[13];
+	};
+
+	void prepare_queues();
+	void push(int queue, int task);
+	int pop(int queue);
+	int steal(int queue);
+	template <typename Func>
+	long long run_task(Func &func, int task);
+
+	bool built;
+	Unigine::Vector<Unigine::String> stage_names;
+	Unigine::Vector<int> stage_offsets;
+	Unigine::Vector<int> task_stages;
+	// pairs of a task and its dependency until build()
+	Unigine::Vector<int> dependencies;
+
+	Unigine::Vector<int> num_dependencies;
+	Unigine::Vector<int> successor_offsets;
+	Unigine::Vector<int> successors;
+	Unigine::Vector<int> roots;
+
+	Unigine::Vector<int> pending;
+	Unigine::Vector<Queue> queues;
+	Unigine::Vector<int> queue_tasks;
+
+	float time;
+	float busy_time;
+	int num_workers;
+	int num_steals;
+};
+
+template <typename Func>
+long long FieldTaskGraph::run_task(Func &func, int task)
+{
+	int stage = task_stages[task];
+	long long begin = Unigine::Time::get();
+	func(stage, task - stage_offsets[stage]);
+	return Unigine::Time::get() - begin;
+}
+
+template <typename Func>
+void FieldTaskGraph::run(Func func)
+{
+	using namespace Unigine;
+
+	if (!built || task_stages.empty())
+		return;
+
+	prepare_queues();
+
+	AtomicInt32 remaining(task_stages.size());
+	AtomicInt64 busy(0);
+	AtomicInt32 workers(0);
+	AtomicInt32 steals(0);
+	long long begin = Time::get();
+
+	runSyncMultiThreadFunc([&](CPUShader *, int thread_num, int)
+	{
+		int queue = thread_num % queues.size();
+		long long worker_busy = 0;
+		int worker_steals = 0;
+		BackoffSpinner spinner;
+		while (true)
+		{
+			int task = pop(queue);
+			if (task == -1)
+			{
+				task = steal(queue);
+				worker_steals += (task != -1) ? 1 : 0;
+			}
+			if (task == -1)
+			{
+				if (remaining == 0)
+					break;
+				spinner.spin();
+				continue;
+			}
+			spinner = BackoffSpinner();
+
+			worker_busy += run_task(func, task);
+
+			// released successors stay on this worker, they read what the task has just written
+			for (int i = successor_offsets[task]; i < successor_offsets[task + 1]; i++)
+			{
+				int successor = successors[i];
+				if (AtomicAdd(&pending[successor], -1) == 1)
+					push(queue, successor);
+			}
+			--remaining;
+		}
+		busy += worker_busy;
+		steals += worker_steals;
+		++workers;
+	});
+
+	time = (Time::get() - begin) / 1000.0f;
+	busy_time = busy / 1000.0f;
+	num_workers = workers;
+	num_steals = steals;
+}
+
+template <typename Func>
+void FieldTaskGraph::runStaged(Func func)
+{
+	using namespace Unigine;
+
+	if (!built || task_stages.empty())
+		return;
+
+	AtomicInt64 busy(0);
+	int max_workers = 0;
+	long long begin = Time::get();
+
+	for (int stage = 0; stage < stage_names.size(); stage++)
+	{
+		int first = stage_offsets[stage];
+		int last = stage_offsets[stage + 1];
+		AtomicInt32 next_task(first);
+		AtomicInt32 workers(0);
+		runSyncMultiThreadFunc([&](CPUShader *, int, int)
+		{
+			long long worker_busy = 0;
+			for (int task = next_task++; task < last; task = next_task++)
+				worker_busy += run_task(func, task);
+			busy += worker_busy;
+			++workers;
+		});
+		max_workers = Unigine::Math::max(max_workers, int(workers));
+	}
+
+	time = (Time::get() - begin) / 1000.0f;
+	busy_time = busy / 1000.0f;
+	num_workers = max_workers;
+	num_steals = 0;
+}
+
+#endif // __FIELD_TASK_GRAPH_H__
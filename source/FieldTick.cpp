@@ -0,0 +1,176 @@
+#include "FieldTick.h"
+#include "BobBVH.h"
+#include "FieldEnergy.h"
+#include "FieldTrails.h"
+#include "PendulumField.h"
+
+#include <UnigineProfiler.h>
+
+using namespace Unigine;
+using namespace Math;
+
+FieldTick::FieldTick()
+	: field(nullptr)
+	, bvh(nullptr)
+	, trails(nullptr)
+	, energy(nullptr)
+	, num_builds(0)
+	, num_chunks(0)
+	, layout_version(0)
+	, num_rebuilds(0)
+	, energy_enabled(false)
+	, trails_enabled(false)
+	, ifps(0.0f)
+{
+}
+
+FieldTick::~FieldTick()
+{
+}
+
+void FieldTick::init(PendulumField &f, BobBVH &b, FieldTrails *t)
+{
+	clear();
+	field = &f;
+	bvh = &b;
+	trails = t;
+}
+
+void FieldTick::clear()
+{
+	field = nullptr;
+	bvh = nullptr;
+	trails = nullptr;
+	energy = nullptr;
+	graph.clear();
+	chunk_energy.clear();
+	chunk_kinetic_energy.clear();
+	chunk_subtrees.clear();
+}
+
+bool FieldTick::is_graph_valid() const
+{
+	return graph.isBuilt() && num_chunks == field->getNumChunks() && layout_version == field->getLayoutVersion()
+		&& num_rebuilds == bvh->getNumRebuilds() && energy_enabled == (energy != nullptr) && trails_enabled == (trails != nullptr);
+}
+
+void FieldTick::build_graph()
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	num_chunks = field->getNumChunks();
+	layout_version = field->getLayoutVersion();
+	num_rebuilds = bvh->getNumRebuilds();
+	energy_enabled = (energy != nullptr);
+	trails_enabled = (trails != nullptr);
+	num_builds++;
+
+	// stages are added in the order of STAGE, empty ones keep the indices
+	int num_subtrees = bvh->getNumSubtrees();
+	graph.clear();
+	graph.addStage("integrate", num_chunks);
+	graph.addStage("energy", energy_enabled ? num_chunks : 0);
+	graph.addStage("refit", num_subtrees);
+	graph.addStage("trails", trails_enabled ? num_chunks : 0);
+
+	for (int chunk = 0; chunk < num_chunks; chunk++)
+	{
+		if (energy_enabled)
+			graph.addDependency(STAGE_ENERGY, chunk, STAGE_INTEGRATE, chunk);
+		if (trails_enabled)
+			graph.addDependency(STAGE_TRAILS, chunk, STAGE_INTEGRATE, chunk);
+	}
+
+	// a subtree waits for every chunk holding one of its bobs, in curve order that is a few neighbouring chunks
+	chunk_subtrees.resize(num_chunks);
+	for (int &subtree : chunk_subtrees)
+		subtree = -1;
+	for (int subtree = 0; subtree < num_subtrees; subtree++)
+	{
+		int num = 0;
+		const int *bobs = bvh->getSubtreeBobs(subtree, num);
+		for (int i = 0; i < num; i++)
+		{
+			int chunk = bobs[i] / PendulumField::CHUNK_SIZE;
+			if (chunk_subtrees[chunk] == subtree)
+				continue;
+			chunk_subtrees[chunk] = subtree;
+			graph.addDependency(STAGE_REFIT, subtree, STAGE_INTEGRATE, chunk);
+		}
+	}
+
+	graph.build();
+	chunk_energy.resize(energy_enabled ? num_chunks : 0);
+	chunk_kinetic_energy.resize(energy_enabled ? num_chunks : 0);
+}
+
+void FieldTick::run_task(int stage, int task)
+{
+	switch (stage)
+	{
+		case STAGE_INTEGRATE:
+			substeps += field->stepChunk(task, ifps);
+			break;
+		case STAGE_ENERGY:
+		{
+			int begin, end;
+			field->getChunkRange(task, begin, end);
+			chunk_energy[task] = field->getEnergy(begin, end, &chunk_kinetic_energy[task]);
+			break;
+		}
+		case STAGE_REFIT:
+			bvh->refitSubtree(task);
+			break;
+		case STAGE_TRAILS:
+		{
+			int begin, end;
+			field->getChunkRange(task, begin, end);
+			trails->record(begin, end);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+void FieldTick::run(float step, bool staged)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	if (field == nullptr || field->getNumChunks() == 0 || step <= 0.0f)
+		return;
+
+	ifps = step;
+	// a rebuilt tree already fits the current bobs, it is refitted again after the integration anyway
+	bvh->updateLayout();
+	if (trails)
+		trails->beginRecord();
+	if (!is_graph_valid())
+		build_graph();
+
+	field->beginStep(ifps);
+	substeps = 0;
+	auto func = [this](int stage, int task) { run_task(stage, task); };
+	if (staged)
+		graph.runStaged(func);
+	else
+		graph.run(func);
+	field->endStep(substeps);
+
+	// per-chunk sums keep the result independent of the number of workers
+	if (energy)
+	{
+		double sum = 0.0;
+		double kinetic_sum = 0.0;
+		for (int i = 0; i < chunk_energy.size(); i++)
+		{
+			sum += chunk_energy[i];
+			kinetic_sum += chunk_kinetic_energy[i];
+		}
+		energy->update(sum, kinetic_sum, field->getDamping(), ifps);
+	}
+	// the nodes above the subtrees are few, a rebuild of a loose tree runs its own parallel jobs
+	bvh->refitTop();
+
+	Profiler::setValue("Tick idle", "%", graph.getIdleRatio() * 100.0f, 100.0f, nullptr);
+}
@@ -0,0 +1,72 @@
+#ifndef __FIELD_TICK_H__
+#define __FIELD_TICK_H__
+
+#include "FieldTaskGraph.h"
+
+class BobBVH;
+class FieldEnergy;
+class FieldTrails;
+class PendulumField;
+
+// Physics tick of a pendulum field as a graph of chunk tasks.
+// Every chunk is integrated by its own task; the energy sum and the trail history of a chunk wait only for that
+// chunk, and a subtree of the bob BVH is refitted as soon as the chunks holding its bobs are integrated, so the
+// stages overlap across the field instead of meeting at barriers. The graph is rebuilt only when the chunks, the
+// storage order or the BVH topology change.
+class FieldTick
+{
+public:
+	enum STAGE
+	{
+		STAGE_INTEGRATE = 0,
+		STAGE_ENERGY,
+		STAGE_REFIT,
+		STAGE_TRAILS,
+		NUM_STAGES,
+	};
+
+	FieldTick();
+	~FieldTick();
+
+	// trails and energy are optional
+	void init(PendulumField &field, BobBVH &bvh, FieldTrails *trails = nullptr);
+	void clear();
+
+	// the energy monitor is sampled after every tick, nullptr disables it
+	void setEnergy(FieldEnergy *e) { energy = e; }
+
+	// same work as PendulumField::step(), FieldEnergy::update(), BobBVH::update() and FieldTrails::record(),
+	// staged runs the stages one after another with a barrier between them
+	void run(float ifps, bool staged = false);
+
+	const FieldTaskGraph &getGraph() const { return graph; }
+	int getNumBuilds() const { return num_builds; }
+
+private:
+	bool is_graph_valid() const;
+	void build_graph();
+	void run_task(int stage, int task);
+
+	PendulumField *field;
+	BobBVH *bvh;
+	FieldTrails *trails;
+	FieldEnergy *energy;
+
+	FieldTaskGraph graph;
+	int num_builds;
+	// what the graph was built for
+	int num_chunks;
+	int layout_version;
+	int num_rebuilds;
+	bool energy_enabled;
+	bool trails_enabled;
+
+	float ifps;
+	Unigine::AtomicInt32 substeps;
+	Unigine::Vector<double> chunk_energy;
+	Unigine::Vector<double> chunk_kinetic_energy;
+	// last subtree that depends on a chunk, for merging dependencies
+	Unigine::Vector<int> chunk_subtrees;
+};
+
+#endif // __FIELD_TICK_H__
@@ -0,0 +1,337 @@
+#include "FieldTrails.h"
+#include "BobBVH.h"
+#include "PendulumField.h"
+
+#include <UnigineProfiler.h>
+#include <UnigineWindowManager.h>
+
+#include <algorithm>
+#include <string.h>
+
+using namespace Unigine;
+using namespace Math;
+
+FieldTrails::FieldTrails()
+	: field(nullptr)
+	, length(0)
+	, max_trails(0)
+	, width(0.05f)
+	, pixel_error(1.0f)
+	, head(0)
+	, num_visible(0)
+{
+}
+
+FieldTrails::~FieldTrails()
+{
+	shutdown();
+}
+
+void FieldTrails::init(const PendulumField &f, int l, int num)
+{
+	shutdown();
+
+	field = &f;
+	length = max(l, 2);
+	max_trails = max(num, 0);
+	reset();
+	create_mesh();
+}
+
+void FieldTrails::shutdown()
+{
+	if (mesh)
+		mesh.deleteLater();
+	field = nullptr;
+	trail_ids.destroy();
+	trail_samples.destroy();
+	history_x.destroy();
+	history_y.destroy();
+	history_z.destroy();
+	slot_trails.destroy();
+	ids.destroy();
+	tracked.destroy();
+	vertices.destroy();
+	nearest.destroy();
+	points.destroy();
+	ages.destroy();
+	head = 0;
+	num_visible = 0;
+}
+
+void FieldTrails::setMaterialPath(const char *path)
+{
+	material_path = path;
+	if (mesh && !material_path.empty())
+		mesh->setMaterialFilePath(material_path, 0);
+}
+
+size_t FieldTrails::getMemoryUsage() const
+{
+	return trail_ids.getMemoryUsage() + trail_samples.getMemoryUsage() + history_x.getMemoryUsage() + history_y.getMemoryUsage()
+		+ history_z.getMemoryUsage() + slot_trails.getMemoryUsage() + ids.getMemoryUsage() + tracked.getMemoryUsage()
+		+ vertices.getMemoryUsage() + nearest.getMemoryUsage() + points.getMemoryUsage() + ages.getMemoryUsage();
+}
+
+void FieldTrails::reset()
+{
+	head = 0;
+	trail_ids.resize(-1, max_trails);
+	trail_samples.resize(0, max_trails);
+	history_x.resize(max_trails * length);
+	history_y.resize(max_trails * length);
+	history_z.resize(max_trails * length);
+	slot_trails.clear();
+}
+
+void FieldTrails::create_mesh()
+{
+	if (max_trails == 0)
+		return;
+
+	// every slot is a strip of length point pairs, unused points of a slot are collapsed into degenerate triangles
+	mesh = ObjectMeshDynamic::create(ObjectMeshDynamic::USAGE_DYNAMIC_VERTEX);
+	mesh->setName("pendulum_trails");
+	mesh->addSurface("trails");
+	mesh->setCastShadow(false, 0);
+	mesh->setCastWorldShadow(false, 0);
+	mesh->setIntersection(false, 0);
+	if (!material_path.empty())
+		mesh->setMaterialFilePath(material_path, 0);
+
+	Vector<int> indices;
+	indices.allocate(max_trails * (length - 1) * 6);
+	for (int slot = 0; slot < max_trails; slot++)
+	{
+		int base = slot * length * 2;
+		for (int i = 0; i < length - 1; i++)
+		{
+			int v = base + i * 2;
+			indices.appendFast(v + 0);
+			indices.appendFast(v + 1);
+			indices.appendFast(v + 2);
+			indices.appendFast(v + 2);
+			indices.appendFast(v + 1);
+			indices.appendFast(v + 3);
+		}
+	}
+	mesh->setIndicesArray(indices.get(), indices.size());
+	mesh->flushIndices();
+
+	vertices.resize(max_trails * length * 2);
+	points.allocate(length);
+	ages.allocate(length);
+}
+
+void FieldTrails::record()
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	beginRecord();
+	if (field)
+		record(0, field->getNumPendulums());
+}
+
+void FieldTrails::beginRecord()
+{
+	if (field == nullptr || max_trails == 0)
+		return;
+
+	// trails follow their bob by id, a removed bob frees its trail
+	head = (head + 1) % length;
+	slot_trails.clear();
+	for (int trail = 0; trail < max_trails; trail++)
+	{
+		int id = trail_ids[trail];
+		if (id == -1)
+			continue;
+		if (!field->isValidId(id))
+		{
+			trail_ids[trail] = -1;
+			trail_samples[trail] = 0;
+			continue;
+		}
+		trail_samples[trail] = min(trail_samples[trail] + 1, length);
+		slot_trails.append(SlotTrail{field->getSlot(id), trail});
+	}
+	std::sort(slot_trails.begin(), slot_trails.end(), [](const SlotTrail &t0, const SlotTrail &t1) { return t0.slot < t1.slot; });
+}
+
+void FieldTrails::record(int begin, int end)
+{
+	if (field == nullptr || begin >= end)
+		return;
+
+	const SlotTrail *it = std::lower_bound(slot_trails.get(), slot_trails.get() + slot_trails.size(), begin,
+		[](const SlotTrail &t, int slot) { return t.slot < slot; });
+	const SlotTrail *last = slot_trails.get() + slot_trails.size();
+	for (; it != last && it->slot < end; ++it)
+	{
+		int index = it->trail * length + head;
+		history_x[index] = field->bob_x.get()[it->slot];
+		history_y[index] = field->bob_y.get()[it->slot];
+		history_z[index] = field->bob_z.get()[it->slot];
+	}
+}
+
+void FieldTrails::select(const Vector<int> &bobs)
+{
+	ids.clear();
+	for (int slot : bobs)
+		ids.append(field->getId(slot));
+	std::sort(ids.begin(), ids.end());
+
+	// trails of the bobs that left the set are freed, the others keep their history
+	tracked.clear();
+	for (int trail = 0; trail < max_trails; trail++)
+	{
+		int id = trail_ids[trail];
+		if (id == -1)
+			continue;
+		if (std::binary_search(ids.begin(), ids.end(), id))
+		{
+			tracked.append(id);
+			continue;
+		}
+		trail_ids[trail] = -1;
+		trail_samples[trail] = 0;
+	}
+	std::sort(tracked.begin(), tracked.end());
+
+	// there are never more bobs than trails, a new one always finds a free trail
+	int free_trail = 0;
+	for (int id : ids)
+	{
+		if (std::binary_search(tracked.begin(), tracked.end(), id))
+			continue;
+		while (trail_ids[free_trail] != -1)
+			free_trail++;
+		trail_ids[free_trail] = id;
+		trail_samples[free_trail] = 0;
+	}
+}
+
+int FieldTrails::decimate(int trail, const vec3 &camera, float pixel_size)
+{
+	auto get_sample = [this, trail](int age)
+	{
+		int index = trail * length + (head - age + length) % length;
+		return vec3(history_x[index], history_y[index], history_z[index]);
+	};
+	int num_samples = trail_samples[trail];
+
+	points.clear();
+	ages.clear();
+
+	float iage = 1.0f / (length - 1);
+	points.appendFast(get_sample(0));
+	ages.appendFast(0.0f);
+
+	// greedy decimation, a sample is dropped while it stays within the error from the segment that replaces it
+	vec3 next = get_sample(1);
+	for (int age = 1; age < num_samples - 1; age++)
+	{
+		vec3 current = next;
+		next = get_sample(age + 1);
+
+		const vec3 &last = points.last();
+		vec3 segment = next - last;
+		float k = saturate(dot(current - last, segment) / max(segment.length2(), Consts::EPS));
+		float error = length2(last + segment * k - current);
+		float tolerance = pixel_error * pixel_size * (current - camera).length();
+		if (error > tolerance * tolerance)
+		{
+			points.appendFast(current);
+			ages.appendFast(age * iage);
+		}
+	}
+	points.appendFast(next);
+	ages.appendFast((num_samples - 1) * iage);
+
+	return points.size();
+}
+
+void FieldTrails::write_ribbon(int slot, int num_points, const vec3 &camera, BoundBox &bound_box)
+{
+	ObjectMeshDynamic::Vertex *v = vertices.get() + slot * length * 2;
+	for (int i = 0; i < num_points; i++)
+	{
+		const vec3 &p = points[i];
+		vec3 tangent = points[max(i - 1, 0)] - points[min(i + 1, num_points - 1)];
+		vec3 side = cross(tangent, p - camera);
+		float side_length = side.length();
+		float age = ages[i];
+		side *= (side_length > Consts::EPS) ? width * 0.5f * (1.0f - age) / side_length : 0.0f;
+
+		v[0].xyz = p - side;
+		v[1].xyz = p + side;
+		v[0].texcoord = vec4(age, 0.0f, 0.0f, 0.0f);
+		v[1].texcoord = vec4(age, 1.0f, 0.0f, 0.0f);
+		v[0].tangent = v[1].tangent = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		v[0].color = v[1].color = vec4(1.0f, 1.0f, 1.0f, 1.0f - age);
+		v += 2;
+
+		bound_box.expand(p);
+	}
+
+	// collapse the unused tail of the slot onto the oldest point
+	const ObjectMeshDynamic::Vertex &last = v[-1];
+	for (int i = num_points; i < length; i++)
+	{
+		v[0] = last;
+		v[1] = last;
+		v += 2;
+	}
+}
+
+void FieldTrails::translate(const vec3 &offset)
+{
+	for (int i = 0; i < history_x.size(); i++)
+	{
+		history_x[i] += offset.x;
+		history_y[i] += offset.y;
+		history_z[i] += offset.z;
+	}
+}
+
+void FieldTrails::update(const PlayerPtr &player, const BobBVH &bvh)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	num_visible = 0;
+	if (!mesh || !player)
+	{
+		if (mesh)
+			mesh->setEnabled(false);
+		return;
+	}
+
+	ivec2 size = WindowManager::getMainWindow() ? WindowManager::getMainWindow()->getClientSize() : ivec2(1, 1);
+	// bobs are relative to the field origin, the mesh is placed at it
+	const Vec3 &origin = field->getOrigin();
+	vec3 camera = vec3(player->getWorldPosition() - origin);
+	BoundFrustum frustum(player->getAspectCorrectedProjection(size.x, size.y), mat4(player->getCamera()->getModelview() * Math::translate(origin)));
+	// world-space size of one pixel at unit distance
+	float pixel_size = 2.0f * tan(player->getFov() * 0.5f * Consts::DEG2RAD) / max(size.y, 1);
+
+	// the visible bobs nearest to the camera within the budget get the trails
+	bvh.getNearestBobs(camera, max_trails, frustum, nearest);
+	select(nearest);
+
+	BoundBox bound_box;
+	for (int trail = 0; trail < max_trails; trail++)
+		if (trail_ids[trail] != -1 && trail_samples[trail] >= 2)
+			write_ribbon(num_visible++, decimate(trail, camera, pixel_size), camera, bound_box);
+
+	// only the slots in use are uploaded and drawn
+	mesh->setEnabled(num_visible > 0);
+	if (num_visible == 0)
+		return;
+	mesh->setWorldPosition(origin);
+	mesh->setVertexArray(vertices.get(), num_visible * length * 2);
+	mesh->setSurfaceBegin(0, 0);
+	mesh->setSurfaceEnd(num_visible * (length - 1) * 6, 0);
+	mesh->setBoundBox(bound_box, 0);
+	mesh->setBoundBox(bound_box);
+	mesh->flushVertex();
+}
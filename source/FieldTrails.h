@@ -0,0 +1,92 @@
+#ifndef __FIELD_TRAILS_H__
+#define __FIELD_TRAILS_H__
+
+#include <UnigineObjects.h>
+#include <UniginePlayers.h>
+#include <UnigineVector.h>
+
+class BobBVH;
+class PendulumField;
+
+// Motion trails of the pendulum bobs.
+// Only the visible bobs nearest to the camera have a trail: the set is found by a nearest-k query of the BVH and
+// every trail keeps a ring of its own positions, following its bob by id. A bob entering the set starts an empty
+// trail. Ribbons are written into fixed-size slots of a single ObjectMeshDynamic whose index buffer never changes;
+// history points closer than the allowed screen-space error are collapsed. History memory is the trail budget
+// times the length, and recording and selection work follows the budget, not the field size or the number of bobs
+// on screen.
+class FieldTrails
+{
+public:
+	FieldTrails();
+	~FieldTrails();
+
+	void init(const PendulumField &field, int length, int max_trails);
+	void shutdown();
+
+	void setWidth(float w) { width = w; }
+	float getWidth() const { return width; }
+	// allowed deviation of the decimated trail in pixels
+	void setPixelError(float error) { pixel_error = error; }
+	float getPixelError() const { return pixel_error; }
+	void setMaterialPath(const char *path);
+
+	int getLength() const { return length; }
+	int getMaxTrails() const { return max_trails; }
+	int getNumVisibleTrails() const { return num_visible; }
+	size_t getMemoryUsage() const;
+
+	// appends the current positions of the bobs with a trail to their history
+	void record();
+	// record() split for task schedulers: beginRecord() advances the history, then every range of slots
+	// is copied once its bobs are final, possibly concurrently
+	void beginRecord();
+	void record(int begin, int end);
+	// moves the recorded history with the bobs after PendulumField::rebase()
+	void translate(const Unigine::Math::vec3 &offset);
+	// picks the bobs with a trail and rebuilds their ribbons
+	void update(const Unigine::PlayerPtr &player, const BobBVH &bvh);
+
+private:
+	void reset();
+	void select(const Unigine::Vector<int> &bobs);
+	void create_mesh();
+	int decimate(int trail, const Unigine::Math::vec3 &camera, float pixel_size);
+	void write_ribbon(int slot, int num_points, const Unigine::Math::vec3 &camera, Unigine::Math::BoundBox &bound_box);
+
+	const PendulumField *field;
+
+	int length;
+	int max_trails;
+	float width;
+	float pixel_error;
+	Unigine::String material_path;
+
+	// pendulum id of every trail, -1 for a free one, and its number of samples; sample rows are shared, the sample
+	// of a trail is at [trail * length + row]
+	Unigine::Vector<int> trail_ids;
+	Unigine::Vector<int> trail_samples;
+	int head;
+	Unigine::Vector<float> history_x;
+	Unigine::Vector<float> history_y;
+	Unigine::Vector<float> history_z;
+	// trails by the slot of their bob for record(begin, end), sorted by beginRecord()
+	struct SlotTrail
+	{
+		int slot;
+		int trail;
+	};
+	Unigine::Vector<SlotTrail> slot_trails;
+	// sorted ids of the nearest bobs and of the bobs followed so far, scratch of select()
+	Unigine::Vector<int> ids;
+	Unigine::Vector<int> tracked;
+
+	Unigine::ObjectMeshDynamicPtr mesh;
+	Unigine::Vector<Unigine::ObjectMeshDynamic::Vertex> vertices;
+	Unigine::Vector<int> nearest;
+	Unigine::Vector<Unigine::Math::vec3> points;
+	Unigine::Vector<float> ages;
+	int num_visible;
+};
+
+#endif // __FIELD_TRAILS_H__
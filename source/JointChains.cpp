@@ -0,0 +1,180 @@
+#include "JointChains.h"
+#include "PendulumChains.h"
+
+#include <UnigineProfiler.h>
+#include <UnigineThread.h>
+
+using namespace Unigine;
+using namespace Math;
+
+JointChains::JointChains()
+	: num_chains(0)
+	, num_links(0)
+	, num_iterations(8)
+	, gravity(9.81f)
+{
+}
+
+void JointChains::create(const PendulumChains &chains)
+{
+	clear();
+	num_chains = chains.getNumChains();
+	num_links = chains.getNumLinks();
+	gravity = chains.getGravity();
+
+	int num = num_chains * num_links;
+	position_x.resize(num);
+	position_y.resize(num);
+	velocity_x.resize(num);
+	velocity_y.resize(num);
+	length.resize(num);
+	mass.resize(num);
+
+	// the same forward kinematics as the reduced chains, bob velocities add up link by link
+	for (int chain = 0; chain < num_chains; chain++)
+	{
+		double angle = 0.0;
+		double rate = 0.0;
+		double x = 0.0;
+		double y = 0.0;
+		double vx = 0.0;
+		double vy = 0.0;
+		for (int i = 0; i < num_links; i++)
+		{
+			int index = chains.getIndex(chain, i);
+			angle += chains.theta[index];
+			rate += chains.omega[index];
+			double l = chains.length[index];
+			x += l * ::sin(angle);
+			y -= l * ::cos(angle);
+			vx += l * rate * ::cos(angle);
+			vy += l * rate * ::sin(angle);
+
+			int num = chain * num_links + i;
+			position_x[num] = float(x);
+			position_y[num] = float(y);
+			velocity_x[num] = float(vx);
+			velocity_y[num] = float(vy);
+			length[num] = chains.length[index];
+			mass[num] = chains.mass[index];
+		}
+	}
+}
+
+void JointChains::clear()
+{
+	num_chains = 0;
+	num_links = 0;
+	position_x.clear();
+	position_y.clear();
+	velocity_x.clear();
+	velocity_y.clear();
+	length.clear();
+	mass.clear();
+}
+
+void JointChains::step(float ifps)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	if (num_chains == 0 || ifps <= 0.0f)
+		return;
+
+	AtomicInt32 next_chain(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		for (int chain = next_chain++; chain < num_chains; chain = next_chain++)
+			step_chain(chain, ifps);
+	});
+}
+
+void JointChains::step_chain(int chain, float ifps)
+{
+	int begin = chain * num_links;
+	float *x = position_x.get() + begin;
+	float *y = position_y.get() + begin;
+	float *vx = velocity_x.get() + begin;
+	float *vy = velocity_y.get() + begin;
+	const float *l = length.get() + begin;
+	const float *m = mass.get() + begin;
+
+	// predicted positions, the old ones are kept in the velocities until the joints are relaxed
+	for (int i = 0; i < num_links; i++)
+	{
+		vy[i] -= gravity * ifps;
+		float old_x = x[i];
+		float old_y = y[i];
+		x[i] += vx[i] * ifps;
+		y[i] += vy[i] * ifps;
+		vx[i] = old_x;
+		vy[i] = old_y;
+	}
+
+	// the first rod is jointed to the fixed anchor, which takes no correction
+	for (int iteration = 0; iteration < num_iterations; iteration++)
+	{
+		for (int i = 0; i < num_links; i++)
+		{
+			float parent_x = (i > 0) ? x[i - 1] : 0.0f;
+			float parent_y = (i > 0) ? y[i - 1] : 0.0f;
+			float dx = x[i] - parent_x;
+			float dy = y[i] - parent_y;
+			float distance = Math::sqrt(dx * dx + dy * dy);
+			if (distance < Consts::EPS)
+				continue;
+			float parent_weight = (i > 0) ? 1.0f / m[i - 1] : 0.0f;
+			float weight = 1.0f / m[i];
+			float correction = (distance - l[i]) / (distance * (parent_weight + weight));
+			x[i] -= dx * correction * weight;
+			y[i] -= dy * correction * weight;
+			if (i > 0)
+			{
+				x[i - 1] += dx * correction * parent_weight;
+				y[i - 1] += dy * correction * parent_weight;
+			}
+		}
+	}
+
+	float ifps_inv = 1.0f / ifps;
+	for (int i = 0; i < num_links; i++)
+	{
+		vx[i] = (x[i] - vx[i]) * ifps_inv;
+		vy[i] = (y[i] - vy[i]) * ifps_inv;
+	}
+}
+
+vec2 JointChains::getBob(int chain, int link) const
+{
+	int num = chain * num_links + link;
+	return vec2(position_x[num], position_y[num]);
+}
+
+float JointChains::getStretch() const
+{
+	float ret = 0.0f;
+	for (int chain = 0; chain < num_chains; chain++)
+	{
+		vec2 parent = vec2_zero;
+		for (int i = 0; i < num_links; i++)
+		{
+			vec2 bob = getBob(chain, i);
+			float l = length[chain * num_links + i];
+			ret = max(ret, Math::abs(Math::length(bob - parent) - l) / l);
+			parent = bob;
+		}
+	}
+	return ret;
+}
+
+double JointChains::getEnergy(int chain) const
+{
+	double energy = 0.0;
+	for (int i = 0; i < num_links; i++)
+	{
+		int num = chain * num_links + i;
+		double vx = velocity_x[num];
+		double vy = velocity_y[num];
+		energy += mass[num] * (0.5 * (vx * vx + vy * vy) + gravity * position_y[num]);
+	}
+	return energy;
+}
@@ -0,0 +1,53 @@
+#ifndef __JOINT_CHAINS_H__
+#define __JOINT_CHAINS_H__
+
+#include <UnigineMathLib.h>
+#include <UnigineVector.h>
+
+class PendulumChains;
+
+// Multi-link pendulums in maximal coordinates, the way body and joint chains are simulated.
+// Every bob is a free particle and every rod a distance joint. A step moves the bobs under gravity and relaxes the
+// joints with a fixed number of Gauss-Seidel iterations, then takes the velocities from the corrected positions,
+// like the iterative joint solver of the engine. Long or fast chains stretch when the iterations fall short. Used as
+// the reference the reduced-coordinate chains are compared with.
+class JointChains
+{
+public:
+	JointChains();
+
+	// copies the chains in their current state, positions are in the swing planes relative to the anchors
+	void create(const PendulumChains &chains);
+	void clear();
+	int getNumChains() const { return num_chains; }
+	int getNumLinks() const { return num_links; }
+
+	void setNumIterations(int num) { num_iterations = Unigine::Math::max(num, 1); }
+	int getNumIterations() const { return num_iterations; }
+
+	void step(float ifps);
+
+	// bob of a link in the swing plane of its chain, y is up
+	Unigine::Math::vec2 getBob(int chain, int link) const;
+	// largest relative deviation of a rod from its length
+	float getStretch() const;
+	double getEnergy(int chain) const;
+
+private:
+	void step_chain(int chain, float ifps);
+
+	int num_chains;
+	int num_links;
+	int num_iterations;
+	float gravity;
+
+	// link by link per chain, index chain * num_links + link
+	Unigine::Vector<float> position_x;
+	Unigine::Vector<float> position_y;
+	Unigine::Vector<float> velocity_x;
+	Unigine::Vector<float> velocity_y;
+	Unigine::Vector<float> length;
+	Unigine::Vector<float> mass;
+};
+
+#endif // __JOINT_CHAINS_H__
@@ -0,0 +1,103 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+	: data(nullptr)
+	, size(0)
+	#ifdef _WIN32
+		, file(INVALID_HANDLE_VALUE)
+		, mapping(nullptr)
+	#else
+		, fd(-1)
+	#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char *path)
+{
+	close();
+
+	#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+		{
+			close();
+			return false;
+		}
+		data = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (data == nullptr)
+		{
+			close();
+			return false;
+		}
+		size = static_cast<size_t>(file_size.QuadPart);
+	#else
+		fd = ::open(path, O_RDONLY);
+		if (fd == -1)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			close();
+			return false;
+		}
+		void *ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr == MAP_FAILED)
+		{
+			close();
+			return false;
+		}
+		data = static_cast<const unsigned char *>(ptr);
+		size = static_cast<size_t>(st.st_size);
+		madvise(ptr, size, MADV_SEQUENTIAL);
+	#endif
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+	#else
+		if (data)
+			munmap(const_cast<unsigned char *>(data), size);
+		if (fd != -1)
+			::close(fd);
+		fd = -1;
+	#endif
+
+	data = nullptr;
+	size = 0;
+}
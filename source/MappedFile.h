@@ -0,0 +1,35 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <stddef.h>
+
+// Read-only memory mapping of a file given by its absolute path.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	bool open(const char *path);
+	void close();
+
+	bool isOpened() const { return data != nullptr; }
+	const unsigned char *getData() const { return data; }
+	size_t getSize() const { return size; }
+
+private:
+	const unsigned char *data;
+	size_t size;
+
+	#ifdef _WIN32
+		void *file;
+		void *mapping;
+	#else
+		int fd;
+	#endif
+};
+
+#endif // __MAPPED_FILE_H__
@@ -0,0 +1,366 @@
+#include "PendulumChains.h"
+#include "FieldLanes.h"
+
+#include <UnigineProfiler.h>
+#include <UnigineThread.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+// per link scratch of a lane group: the bob position, the velocity product term, the articulated inertia and bias
+// force, and the projections onto the joint axis
+enum SCRATCH
+{
+	SCRATCH_BOB_X = 0,
+	SCRATCH_BOB_Y,
+	SCRATCH_BIAS_1,
+	SCRATCH_BIAS_2,
+	SCRATCH_I00,
+	SCRATCH_I01,
+	SCRATCH_I02,
+	SCRATCH_I11,
+	SCRATCH_I12,
+	SCRATCH_I22,
+	SCRATCH_P0,
+	SCRATCH_P1,
+	SCRATCH_P2,
+	SCRATCH_U0,
+	SCRATCH_U1,
+	SCRATCH_U2,
+	SCRATCH_D,
+	SCRATCH_TORQUE,
+	SCRATCH_QDD,
+	// Runge-Kutta stage state and the weighted sums of its derivatives
+	SCRATCH_THETA,
+	SCRATCH_OMEGA,
+	SCRATCH_SUM_THETA,
+	SCRATCH_SUM_OMEGA,
+	NUM_SCRATCH,
+};
+
+constexpr int GROUP_SCRATCH_SIZE = PendulumChains::MAX_LINKS * NUM_SCRATCH * PendulumChains::LANES;
+}
+
+PendulumChains::PendulumChains()
+	: num_chains(0)
+	, num_links(0)
+	, stride(0)
+	, gravity(9.81f)
+	, damping(0.0f)
+	, num_substeps(2)
+{
+}
+
+void PendulumChains::create(int chains, int links, float l, float m)
+{
+	clear();
+	num_chains = max(chains, 0);
+	num_links = clamp(links, 1, int(MAX_LINKS));
+	stride = (num_chains + LANES - 1) / LANES * LANES;
+
+	// padding lanes hold resting chains, so the passes never divide by zero
+	int num = num_links * stride;
+	theta.resize(num);
+	omega.resize(num);
+	length.resize(num);
+	mass.resize(num);
+	for (int i = 0; i < num; i++)
+	{
+		theta[i] = 0.0f;
+		omega[i] = 0.0f;
+		length[i] = max(l, 1e-3f);
+		mass[i] = max(m, 1e-3f);
+	}
+
+	anchors.resize(num_chains);
+	directions.resize(num_chains);
+	for (int i = 0; i < num_chains; i++)
+	{
+		anchors[i] = vec3(0.0f, 0.0f, length[0] * num_links);
+		directions[i] = vec2(1.0f, 0.0f);
+	}
+}
+
+void PendulumChains::clear()
+{
+	num_chains = 0;
+	num_links = 0;
+	stride = 0;
+	theta.clear();
+	omega.clear();
+	length.clear();
+	mass.clear();
+	anchors.clear();
+	directions.clear();
+}
+
+void PendulumChains::setAnchor(int chain, const vec3 &anchor, const vec2 &direction)
+{
+	anchors[chain] = anchor;
+	directions[chain] = normalize(direction);
+}
+
+void PendulumChains::translate(const vec3 &offset)
+{
+	for (vec3 &anchor : anchors)
+		anchor += offset;
+}
+
+void PendulumChains::step(float ifps)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	int num_groups = getNumGroups();
+	if (num_groups == 0 || ifps <= 0.0f)
+		return;
+
+	int num_slots = PoolCPUShaders::getNumThreads() + 1;
+	scratch.resize(num_slots * GROUP_SCRATCH_SIZE);
+
+	AtomicInt32 next_group(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int thread_num, int)
+	{
+		float *thread_scratch = scratch.get() + (thread_num % num_slots) * GROUP_SCRATCH_SIZE;
+		for (int group = next_group++; group < num_groups; group = next_group++)
+			step_group(group, ifps, thread_scratch);
+	});
+}
+
+void PendulumChains::stepGroups(int begin, int end, float ifps)
+{
+	if (ifps <= 0.0f)
+		return;
+	scratch.resize(max(scratch.size(), GROUP_SCRATCH_SIZE));
+	for (int group = max(begin, 0); group < min(end, getNumGroups()); group++)
+		step_group(group, ifps, scratch.get());
+}
+
+void PendulumChains::step_group(int group, float ifps, float *s)
+{
+	// classic Runge-Kutta over the joint state, the articulated-body pass gives the accelerations of every stage
+	auto at = [s](int link, int value) { return s + (link * NUM_SCRATCH + value) * LANES; };
+
+	int base = group * LANES;
+	float h = ifps / num_substeps;
+	const float offsets[3] = { 0.5f, 0.5f, 1.0f };
+	const float weights[4] = { 1.0f / 6.0f, 2.0f / 6.0f, 2.0f / 6.0f, 1.0f / 6.0f };
+	FieldLanes zero(0.0f);
+
+	for (int substep = 0; substep < num_substeps; substep++)
+	{
+		for (int i = 0; i < num_links; i++)
+		{
+			int index = i * stride + base;
+			FieldLanes::load(theta.get() + index).store(at(i, SCRATCH_THETA));
+			FieldLanes::load(omega.get() + index).store(at(i, SCRATCH_OMEGA));
+			zero.store(at(i, SCRATCH_SUM_THETA));
+			zero.store(at(i, SCRATCH_SUM_OMEGA));
+		}
+		for (int stage = 0; stage < 4; stage++)
+		{
+			evaluate(base, s);
+			FieldLanes weight(weights[stage]);
+			FieldLanes offset((stage < 3) ? offsets[stage] * h : 0.0f);
+			for (int i = 0; i < num_links; i++)
+			{
+				int index = i * stride + base;
+				FieldLanes rate = FieldLanes::load(at(i, SCRATCH_OMEGA));
+				FieldLanes acceleration = FieldLanes::load(at(i, SCRATCH_QDD));
+				(FieldLanes::load(at(i, SCRATCH_SUM_THETA)) + weight * rate).store(at(i, SCRATCH_SUM_THETA));
+				(FieldLanes::load(at(i, SCRATCH_SUM_OMEGA)) + weight * acceleration).store(at(i, SCRATCH_SUM_OMEGA));
+				(FieldLanes::load(theta.get() + index) + offset * rate).store(at(i, SCRATCH_THETA));
+				(FieldLanes::load(omega.get() + index) + offset * acceleration).store(at(i, SCRATCH_OMEGA));
+			}
+		}
+		FieldLanes dt(h);
+		for (int i = 0; i < num_links; i++)
+		{
+			int index = i * stride + base;
+			(FieldLanes::load(theta.get() + index) + dt * FieldLanes::load(at(i, SCRATCH_SUM_THETA))).store(theta.get() + index);
+			(FieldLanes::load(omega.get() + index) + dt * FieldLanes::load(at(i, SCRATCH_SUM_OMEGA))).store(omega.get() + index);
+		}
+	}
+}
+
+void PendulumChains::evaluate(int base, float *s) const
+{
+	// spatial vectors are planar (angular, x, y) about the anchor, the joint of link i turns about the bob of link
+	// i - 1, so its axis is (1, y, -x) of that bob and the bob of the link carries the whole mass
+	auto at = [s](int link, int value) { return s + (link * NUM_SCRATCH + value) * LANES; };
+
+	FieldLanes zero(0.0f);
+	FieldLanes g(gravity);
+	FieldLanes d(damping);
+
+	// outward: bob positions, link velocities, velocity product terms, rigid inertias and bias forces with gravity
+	FieldLanes angle = zero;
+	FieldLanes w = zero;
+	FieldLanes vx = zero;
+	FieldLanes vy = zero;
+	FieldLanes px = zero;
+	FieldLanes py = zero;
+	for (int i = 0; i < num_links; i++)
+	{
+		int index = i * stride + base;
+		FieldLanes qd = FieldLanes::load(at(i, SCRATCH_OMEGA));
+		FieldLanes m = FieldLanes::load(mass.get() + index);
+		FieldLanes l = FieldLanes::load(length.get() + index);
+		angle = angle + FieldLanes::load(at(i, SCRATCH_THETA));
+		FieldLanes sin_angle, cos_angle;
+		sincos_lanes(angle, sin_angle, cos_angle);
+		FieldLanes bx = px + l * sin_angle;
+		FieldLanes by = py - l * cos_angle;
+		bx.store(at(i, SCRATCH_BOB_X));
+		by.store(at(i, SCRATCH_BOB_Y));
+
+		FieldLanes jx = py * qd;
+		FieldLanes jy = zero - px * qd;
+		(qd * vy - w * jy).store(at(i, SCRATCH_BIAS_1));
+		(w * jx - qd * vx).store(at(i, SCRATCH_BIAS_2));
+		w = w + qd;
+		vx = vx + jx;
+		vy = vy + jy;
+
+		FieldLanes i00 = m * (bx * bx + by * by);
+		FieldLanes i01 = zero - m * by;
+		FieldLanes i02 = m * bx;
+		i00.store(at(i, SCRATCH_I00));
+		i01.store(at(i, SCRATCH_I01));
+		i02.store(at(i, SCRATCH_I02));
+		m.store(at(i, SCRATCH_I11));
+		zero.store(at(i, SCRATCH_I12));
+		m.store(at(i, SCRATCH_I22));
+
+		// only the linear momentum enters the cross product with the velocity
+		FieldLanes h1 = i01 * w + m * vx;
+		FieldLanes h2 = i02 * w + m * vy;
+		FieldLanes mg = m * g;
+		(vx * h2 - vy * h1 + mg * bx).store(at(i, SCRATCH_P0));
+		(zero - w * h2).store(at(i, SCRATCH_P1));
+		(w * h1 + mg).store(at(i, SCRATCH_P2));
+
+		px = bx;
+		py = by;
+	}
+
+	// inward: articulated inertias and bias forces, every link hands its remainder to the parent
+	for (int i = num_links - 1; i >= 0; i--)
+	{
+		FieldLanes qd = FieldLanes::load(at(i, SCRATCH_OMEGA));
+		FieldLanes s1 = (i > 0) ? FieldLanes::load(at(i - 1, SCRATCH_BOB_Y)) : zero;
+		FieldLanes s2 = (i > 0) ? zero - FieldLanes::load(at(i - 1, SCRATCH_BOB_X)) : zero;
+		FieldLanes a00 = FieldLanes::load(at(i, SCRATCH_I00));
+		FieldLanes a01 = FieldLanes::load(at(i, SCRATCH_I01));
+		FieldLanes a02 = FieldLanes::load(at(i, SCRATCH_I02));
+		FieldLanes a11 = FieldLanes::load(at(i, SCRATCH_I11));
+		FieldLanes a12 = FieldLanes::load(at(i, SCRATCH_I12));
+		FieldLanes a22 = FieldLanes::load(at(i, SCRATCH_I22));
+		FieldLanes p0 = FieldLanes::load(at(i, SCRATCH_P0));
+		FieldLanes p1 = FieldLanes::load(at(i, SCRATCH_P1));
+		FieldLanes p2 = FieldLanes::load(at(i, SCRATCH_P2));
+
+		FieldLanes u0 = a00 + a01 * s1 + a02 * s2;
+		FieldLanes u1 = a01 + a11 * s1 + a12 * s2;
+		FieldLanes u2 = a02 + a12 * s1 + a22 * s2;
+		FieldLanes dd = u0 + s1 * u1 + s2 * u2;
+		FieldLanes torque = zero - d * qd - (p0 + s1 * p1 + s2 * p2);
+		u0.store(at(i, SCRATCH_U0));
+		u1.store(at(i, SCRATCH_U1));
+		u2.store(at(i, SCRATCH_U2));
+		dd.store(at(i, SCRATCH_D));
+		torque.store(at(i, SCRATCH_TORQUE));
+		if (i == 0)
+			break;
+
+		FieldLanes inv_d = FieldLanes(1.0f) / dd;
+		FieldLanes k0 = u0 * inv_d;
+		FieldLanes k1 = u1 * inv_d;
+		FieldLanes k2 = u2 * inv_d;
+		a00 = a00 - u0 * k0;
+		a01 = a01 - u0 * k1;
+		a02 = a02 - u0 * k2;
+		a11 = a11 - u1 * k1;
+		a12 = a12 - u1 * k2;
+		a22 = a22 - u2 * k2;
+		FieldLanes bias_1 = FieldLanes::load(at(i, SCRATCH_BIAS_1));
+		FieldLanes bias_2 = FieldLanes::load(at(i, SCRATCH_BIAS_2));
+		FieldLanes scale = torque * inv_d;
+		p0 = p0 + a01 * bias_1 + a02 * bias_2 + u0 * scale;
+		p1 = p1 + a11 * bias_1 + a12 * bias_2 + u1 * scale;
+		p2 = p2 + a12 * bias_1 + a22 * bias_2 + u2 * scale;
+
+		auto add = [&](int value, const FieldLanes &v) { (FieldLanes::load(at(i - 1, value)) + v).store(at(i - 1, value)); };
+		add(SCRATCH_I00, a00);
+		add(SCRATCH_I01, a01);
+		add(SCRATCH_I02, a02);
+		add(SCRATCH_I11, a11);
+		add(SCRATCH_I12, a12);
+		add(SCRATCH_I22, a22);
+		add(SCRATCH_P0, p0);
+		add(SCRATCH_P1, p1);
+		add(SCRATCH_P2, p2);
+	}
+
+	// outward: joint accelerations from the acceleration of the parent
+	FieldLanes acc_0 = zero;
+	FieldLanes acc_1 = zero;
+	FieldLanes acc_2 = zero;
+	for (int i = 0; i < num_links; i++)
+	{
+		FieldLanes s1 = (i > 0) ? FieldLanes::load(at(i - 1, SCRATCH_BOB_Y)) : zero;
+		FieldLanes s2 = (i > 0) ? zero - FieldLanes::load(at(i - 1, SCRATCH_BOB_X)) : zero;
+		acc_1 = acc_1 + FieldLanes::load(at(i, SCRATCH_BIAS_1));
+		acc_2 = acc_2 + FieldLanes::load(at(i, SCRATCH_BIAS_2));
+		FieldLanes u0 = FieldLanes::load(at(i, SCRATCH_U0));
+		FieldLanes u1 = FieldLanes::load(at(i, SCRATCH_U1));
+		FieldLanes u2 = FieldLanes::load(at(i, SCRATCH_U2));
+		FieldLanes qdd = (FieldLanes::load(at(i, SCRATCH_TORQUE)) - (u0 * acc_0 + u1 * acc_1 + u2 * acc_2)) / FieldLanes::load(at(i, SCRATCH_D));
+		qdd.store(at(i, SCRATCH_QDD));
+		acc_0 = acc_0 + qdd;
+		acc_1 = acc_1 + s1 * qdd;
+		acc_2 = acc_2 + s2 * qdd;
+	}
+}
+
+void PendulumChains::getBobs(int chain, vec3 *bobs) const
+{
+	const vec3 &anchor = anchors[chain];
+	const vec2 &direction = directions[chain];
+	float angle = 0.0f;
+	float x = 0.0f;
+	float z = 0.0f;
+	for (int i = 0; i < num_links; i++)
+	{
+		int index = getIndex(chain, i);
+		angle += theta[index];
+		float sin_angle, cos_angle;
+		sincos(angle, sin_angle, cos_angle);
+		x += length[index] * sin_angle;
+		z -= length[index] * cos_angle;
+		bobs[i] = anchor + vec3(direction.x * x, direction.y * x, z);
+	}
+}
+
+double PendulumChains::getEnergy(int chain) const
+{
+	double angle = 0.0;
+	double rate = 0.0;
+	double vx = 0.0;
+	double vy = 0.0;
+	double y = 0.0;
+	double energy = 0.0;
+	for (int i = 0; i < num_links; i++)
+	{
+		int index = getIndex(chain, i);
+		angle += theta[index];
+		rate += omega[index];
+		double l = length[index];
+		vx += l * rate * ::cos(angle);
+		vy += l * rate * ::sin(angle);
+		y -= l * ::cos(angle);
+		energy += mass[index] * (0.5 * (vx * vx + vy * vy) + gravity * y);
+	}
+	return energy;
+}
@@ -0,0 +1,83 @@
+#ifndef __PENDULUM_CHAINS_H__
+#define __PENDULUM_CHAINS_H__
+
+#include <UnigineMathLib.h>
+#include <UnigineVector.h>
+
+// Multi-link pendulums in reduced coordinates.
+// Every chain hangs from a fixed anchor and swings in the vertical plane of its direction. The state is the angle
+// and the angular velocity of every joint relative to its parent link, so the rods keep their lengths exactly and
+// no constraint is solved. Every Runge-Kutta stage runs the articulated-body algorithm, linear in the number of
+// links, on four chains at a time: joint arrays are stored link by link with the chains of a link contiguous, so
+// each SIMD lane is a chain.
+class PendulumChains
+{
+public:
+	enum
+	{
+		MAX_LINKS = 128,
+		LANES = 4,
+	};
+
+	PendulumChains();
+
+	// all chains have the same number of links, a link of the given length ends in a bob of the given mass
+	void create(int num_chains, int num_links, float length, float mass);
+	void clear();
+	int getNumChains() const { return num_chains; }
+	int getNumLinks() const { return num_links; }
+	// chains padded to a multiple of LANES, the distance between two links of a chain in the joint arrays
+	int getStride() const { return stride; }
+	int getIndex(int chain, int link) const { return link * stride + chain; }
+
+	void setGravity(float g) { gravity = g; }
+	float getGravity() const { return gravity; }
+	// joint torque per unit of relative angular velocity
+	void setDamping(float d) { damping = d; }
+	float getDamping() const { return damping; }
+	// Runge-Kutta steps per tick, stiff long chains need more of them
+	void setNumSubsteps(int num) { num_substeps = Unigine::Math::max(num, 1); }
+	int getNumSubsteps() const { return num_substeps; }
+
+	// anchors are relative to the field origin, the direction is the horizontal axis of the swing plane
+	void setAnchor(int chain, const Unigine::Math::vec3 &anchor, const Unigine::Math::vec2 &direction);
+	const Unigine::Math::vec3 &getAnchor(int chain) const { return anchors[chain]; }
+	const Unigine::Math::vec2 &getDirection(int chain) const { return directions[chain]; }
+	void translate(const Unigine::Math::vec3 &offset);
+
+	// steps all chains on the worker threads
+	void step(float ifps);
+	// steps the chains of lane groups [begin, end) on the calling thread
+	void stepGroups(int begin, int end, float ifps);
+	int getNumGroups() const { return stride / LANES; }
+
+	// bob positions of a chain, num_links points relative to the field origin
+	void getBobs(int chain, Unigine::Math::vec3 *bobs) const;
+	// kinetic and potential energy of a chain, the anchor is the zero of the potential
+	double getEnergy(int chain) const;
+
+	// joint arrays, index with getIndex()
+	Unigine::Vector<float> theta;
+	Unigine::Vector<float> omega;
+	Unigine::Vector<float> length;
+	Unigine::Vector<float> mass;
+
+private:
+	void step_group(int group, float ifps, float *scratch);
+	// joint accelerations of the stage state of a lane group in the scratch
+	void evaluate(int base, float *scratch) const;
+
+	int num_chains;
+	int num_links;
+	int stride;
+	float gravity;
+	float damping;
+	int num_substeps;
+
+	Unigine::Vector<Unigine::Math::vec3> anchors;
+	Unigine::Vector<Unigine::Math::vec2> directions;
+	// per-thread articulated-body scratch of one lane group
+	Unigine::Vector<float> scratch;
+};
+
+#endif // __PENDULUM_CHAINS_H__
@@ -0,0 +1,1360 @@
+#include "PendulumField.h"
+
+#include <UnigineProfiler.h>
+#include <UnigineThread.h>
+#include <UnigineTimer.h>
+
+#include <algorithm>
+#include <string.h>
+
+using namespace Unigine;
+using namespace Math;
+
+namespace
+{
+// composition weights of the symmetric leapfrog step
+constexpr int NUM_FOREST_RUTH_STAGES = 3;
+const float FOREST_RUTH_WEIGHTS[NUM_FOREST_RUTH_STAGES] =
+{
+	1.35120719195966f, -1.70241438391932f, 1.35120719195966f,
+};
+
+constexpr int NUM_YOSHIDA6_STAGES = 7;
+const float YOSHIDA6_WEIGHTS[NUM_YOSHIDA6_STAGES] =
+{
+	0.784513610477560f, 0.235573213359357f, -1.17767998417887f, 1.31518632068391f,
+	-1.17767998417887f, 0.235573213359357f, 0.784513610477560f,
+};
+
+// elements between clock checks of a sliced reorder
+constexpr int REORDER_SLICE_SIZE = 16384;
+// 30-bit curve codes are sorted in three passes of 10 bits
+constexpr int RADIX_BITS = 10;
+constexpr int RADIX_SIZE = 1 << RADIX_BITS;
+constexpr unsigned int RADIX_MASK = RADIX_SIZE - 1;
+constexpr int RADIX_PASSES = 3;
+}
+
+Vector<float> PendulumField::*const PendulumField::arrays[PendulumField::NUM_ARRAYS] =
+{
+	&PendulumField::pivot_x,
+	&PendulumField::pivot_y,
+	&PendulumField::pivot_z,
+	&PendulumField::direction_x,
+	&PendulumField::direction_y,
+	&PendulumField::length,
+	&PendulumField::theta,
+	&PendulumField::omega,
+	&PendulumField::bob_x,
+	&PendulumField::bob_y,
+	&PendulumField::bob_z,
+};
+
+Vector<double> PendulumField::*const PendulumField::anchors[3] =
+{
+	&PendulumField::anchor_x,
+	&PendulumField::anchor_y,
+	&PendulumField::anchor_z,
+};
+
+PendulumField::PendulumField()
+	: origin(Vec3_zero)
+	, gravity(9.81f)
+	, damping(0.0f)
+	, bob_radius(0.1f)
+	, integrator(INTEGRATOR_EULER)
+	, tolerance(1e-4f)
+	, num_substeps(0)
+	, sleep_energy(1e-4f)
+	, sleep_ticks(30)
+	, num_active(0)
+	, ordered(false)
+	, layout_version(0)
+	, numa_aware(true)
+	, num_partitions(1)
+	, placed_data(nullptr)
+	, placed_chunks(0)
+{
+	sliced.stage = REORDER_DONE;
+	partition_chunks[0] = 0;
+	partition_chunks[1] = 0;
+}
+
+PendulumField::~PendulumField()
+{
+}
+
+void PendulumField::clear()
+{
+	for (int i = 0; i < NUM_ARRAYS; i++)
+		(this->*arrays[i]).clear();
+	for (int i = 0; i < 3; i++)
+		(this->*anchors[i]).clear();
+	slot_ids.clear();
+	id_slots.clear();
+	rest_ticks.clear();
+	origin = Vec3_zero;
+	clear_order();
+}
+
+void PendulumField::resize(int num)
+{
+	for (int i = 0; i < NUM_ARRAYS; i++)
+		(this->*arrays[i]).resize(num);
+	// the zero anchors match no pivots written afterwards, the next rebase takes those pivots as they are
+	for (int i = 0; i < 3; i++)
+	{
+		(this->*anchors[i]).resize(num);
+		if (num > 0)
+			memset((this->*anchors[i]).get(), 0, sizeof(double) * num);
+	}
+
+	// ids restart in slot order
+	slot_ids.resize(num);
+	id_slots.resize(num);
+	for (int i = 0; i < num; i++)
+		slot_ids[i] = id_slots[i] = i;
+	rest_ticks.clear();
+	clear_order();
+}
+
+int PendulumField::addPendulum(const vec3 &pivot, const vec2 &direction, float l, float angle, float velocity)
+{
+	vec2 dir = direction;
+	if (dir.length2() < Consts::EPS)
+		dir = vec2(1.0f, 0.0f);
+	dir.normalize();
+
+	int num = theta.size();
+	pivot_x.append(pivot.x);
+	pivot_y.append(pivot.y);
+	pivot_z.append(pivot.z);
+	direction_x.append(dir.x);
+	direction_y.append(dir.y);
+	length.append(max(l, Consts::EPS));
+	theta.append(angle);
+	omega.append(velocity);
+	bob_x.append(0.0f);
+	bob_y.append(0.0f);
+	bob_z.append(0.0f);
+	anchor_x.append(0.0);
+	anchor_y.append(0.0);
+	anchor_z.append(0.0);
+	set_anchor(num);
+	updateBobs(num, num + 1);
+
+	// new pendulums are appended to the storage and sorted in by the next reorder
+	int id = id_slots.size();
+	slot_ids.append(id);
+	id_slots.append(num);
+	if (ordered)
+		mark_moved(num);
+	return id;
+}
+
+template <typename Func>
+void PendulumField::run_chunks(Func func)
+{
+	AtomicInt32 next_chunk[FieldMemory::MAX_NODES];
+	for (int p = 0; p < num_partitions; p++)
+		next_chunk[p] = partition_chunks[p];
+
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		// the own partition first, then the others in turn
+		int first = (num_partitions > 1) ? FieldMemory::getCurrentNode() % num_partitions : 0;
+		for (int k = 0; k < num_partitions; k++)
+		{
+			int p = (first + k) % num_partitions;
+			int end = partition_chunks[p + 1];
+			for (int i = next_chunk[p]++; i < end; i = next_chunk[p]++)
+				func(chunk_order[i]);
+		}
+	});
+}
+
+void PendulumField::createLattice(int size_x, int size_y, float spacing, float l)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	clear();
+	resize(size_x * size_y);
+
+	l = max(l, Consts::EPS);
+
+	// the chunks are filled by the workers of their partitions
+	place();
+	run_chunks([&](int chunk)
+	{
+		int begin, end;
+		getChunkRange(chunk, begin, end);
+		for (int i = begin; i < end; i++)
+		{
+			vec3 pivot;
+			getLatticePendulum(i, size_x, size_y, spacing, l, pivot, theta[i]);
+			pivot_x[i] = pivot.x;
+			pivot_y[i] = pivot.y;
+			pivot_z[i] = pivot.z;
+			direction_x[i] = 1.0f;
+			direction_y[i] = 0.0f;
+			length[i] = l;
+			omega[i] = 0.0f;
+			set_anchor(i);
+		}
+		updateBobs(begin, end);
+	});
+}
+
+void PendulumField::getLatticePendulum(int slot, int size_x, int size_y, float spacing, float l, vec3 &pivot, float &angle)
+{
+	int x = slot % size_x;
+	int y = slot / size_x;
+	pivot.x = x * spacing - (size_x - 1) * spacing * 0.5f;
+	pivot.y = y * spacing - (size_y - 1) * spacing * 0.5f;
+	pivot.z = l;
+	angle = getLatticeAngle(x, y);
+}
+
+float PendulumField::getLatticeAngle(int x, int y)
+{
+	return sin(x * 0.1f + y * 0.07f) * 0.5f;
+}
+
+void PendulumField::reserve(int num)
+{
+	for (int i = 0; i < NUM_ARRAYS; i++)
+		(this->*arrays[i]).allocate(num);
+	for (int i = 0; i < 3; i++)
+		(this->*anchors[i]).allocate(num);
+	slot_ids.allocate(num);
+	id_slots.allocate(num);
+}
+
+void PendulumField::swap(PendulumField &other)
+{
+	using std::swap;
+
+	for (int i = 0; i < NUM_ARRAYS; i++)
+		(this->*arrays[i]).swap(other.*arrays[i]);
+	for (int i = 0; i < 3; i++)
+		(this->*anchors[i]).swap(other.*anchors[i]);
+	slot_ids.swap(other.slot_ids);
+	id_slots.swap(other.id_slots);
+	swap(origin, other.origin);
+
+	swap(num_substeps, other.num_substeps);
+	chunk_step.swap(other.chunk_step);
+	chunk_cost.swap(other.chunk_cost);
+	chunk_order.swap(other.chunk_order);
+
+	swap(num_active, other.num_active);
+	rest_ticks.swap(other.rest_ticks);
+	active_indices.swap(other.active_indices);
+	chunk_active.swap(other.chunk_active);
+	chunk_dirty.swap(other.chunk_dirty);
+
+	swap(ordered, other.ordered);
+	swap(order_min, other.order_min);
+	swap(order_scale, other.order_scale);
+	codes.swap(other.codes);
+	moved.swap(other.moved);
+	slot_moved.swap(other.slot_moved);
+
+	// placements follow the arrays unless the fields disagree on NUMA awareness
+	swap(num_partitions, other.num_partitions);
+	swap(partition_chunks, other.partition_chunks);
+	swap(placed_data, other.placed_data);
+	swap(placed_chunks, other.placed_chunks);
+	if (numa_aware != other.numa_aware)
+		placed_data = other.placed_data = nullptr;
+
+	// slots of both fields are new, there is no permutation from the old ones
+	last_order.clear();
+	other.last_order.clear();
+	layout_version = other.layout_version = max(layout_version, other.layout_version) + 1;
+	sliced.stage = other.sliced.stage = REORDER_DONE;
+}
+
+void PendulumField::removePendulum(int id)
+{
+	if (id < 0 || id >= id_slots.size() || id_slots[id] == -1)
+		return;
+	int slot = id_slots[id];
+
+	// the last slot fills the hole
+	int last = theta.size() - 1;
+	for (int i = 0; i < NUM_ARRAYS; i++)
+	{
+		Vector<float> &array = this->*arrays[i];
+		array[slot] = array[last];
+		array.removeLast();
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		Vector<double> &anchor = this->*anchors[i];
+		anchor[slot] = anchor[last];
+		anchor.removeLast();
+	}
+	int last_id = slot_ids[last];
+	slot_ids[slot] = last_id;
+	slot_ids.removeLast();
+	id_slots[last_id] = slot;
+	id_slots[id] = -1;
+
+	if (rest_ticks.size() == last + 1)
+	{
+		rest_ticks[slot] = rest_ticks[last];
+		rest_ticks.removeLast();
+		active_indices.removeLast();
+		chunk_dirty[slot / CHUNK_SIZE] = 1;
+		chunk_dirty[last / CHUNK_SIZE] = 1;
+		int num_chunks = getNumChunks();
+		chunk_active.resize(num_chunks);
+		chunk_dirty.resize(num_chunks);
+	}
+
+	if (ordered)
+	{
+		// the pendulum moved into the hole is sorted in again by the next updateOrder()
+		for (int m : { slot, last })
+		{
+			if (m < slot_moved.size() && slot_moved[m])
+			{
+				moved.removeOne(m);
+				slot_moved[m] = 0;
+			}
+		}
+		if (codes.size() == last + 1)
+		{
+			codes[slot] = codes[last];
+			codes.removeLast();
+		}
+		slot_moved.resize(min(slot_moved.size(), last));
+		if (slot != last)
+			mark_moved(slot);
+	}
+	last_order.clear();
+	layout_version++;
+}
+
+void PendulumField::setPivot(int id, const vec3 &pivot)
+{
+	int slot = id_slots[id];
+	pivot_x[slot] = pivot.x;
+	pivot_y[slot] = pivot.y;
+	pivot_z[slot] = pivot.z;
+	set_anchor(slot);
+	updateBobs(slot, slot + 1);
+	if (ordered)
+		mark_moved(slot);
+}
+
+void PendulumField::set_anchor(int slot)
+{
+	anchor_x[slot] = double(origin.x) + pivot_x[slot];
+	anchor_y[slot] = double(origin.y) + pivot_y[slot];
+	anchor_z[slot] = double(origin.z) + pivot_z[slot];
+}
+
+bool PendulumField::rebase(const Vec3 &position, float distance, vec3 &offset)
+{
+	Vec3 delta = position - origin;
+	if (max(max(abs(delta.x), abs(delta.y)), abs(delta.z)) < distance)
+		return false;
+
+	Scalar step = Scalar(REBASE_STEP);
+	Vec3 new_origin = Vec3(Scalar(floorInt(position.x / step + Scalar(0.5))), Scalar(floorInt(position.y / step + Scalar(0.5))),
+		Scalar(floorInt(position.z / step + Scalar(0.5)))) * step;
+	offset = vec3(origin - new_origin);
+	if (new_origin == origin)
+		return false;
+	Vec3 old_origin = origin;
+	origin = new_origin;
+
+	UNIGINE_PROFILER_FUNCTION;
+
+	// every pivot is recomputed from its anchor, the chunks are shifted in parallel
+	int num_chunks = getNumChunks();
+	AtomicInt32 next_chunk(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		for (int chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++)
+		{
+			int begin, end;
+			getChunkRange(chunk, begin, end);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float *pivot = (this->*arrays[ARRAY_PIVOT_X + axis]).get();
+				double *anchor = (this->*anchors[axis]).get();
+				double from = double(old_origin[axis]);
+				double to = double(new_origin[axis]);
+				for (int i = begin; i < end; i++)
+				{
+					if (float(anchor[i] - from) != pivot[i])
+						anchor[i] = from + pivot[i];
+					pivot[i] = float(anchor[i] - to);
+				}
+			}
+			updateBobs(begin, end);
+		}
+	});
+
+	// codes of moved pendulums are computed against the curve bounds, they move with the pivots
+	order_min += offset;
+	return true;
+}
+
+void PendulumField::getChunkRange(int chunk, int &begin, int &end) const
+{
+	begin = chunk * CHUNK_SIZE;
+	end = min(begin + CHUNK_SIZE, theta.size());
+}
+
+const char *PendulumField::getIntegratorName(INTEGRATOR integrator)
+{
+	switch (integrator)
+	{
+		case INTEGRATOR_EULER: return "euler";
+		case INTEGRATOR_DOPRI5: return "dopri5";
+		case INTEGRATOR_FOREST_RUTH: return "forest_ruth";
+		case INTEGRATOR_YOSHIDA6: return "yoshida6";
+		default: return "unknown";
+	}
+}
+
+void PendulumField::step(float ifps)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	int num_chunks = getNumChunks();
+	if (num_chunks == 0 || ifps <= 0.0f)
+		return;
+
+	prepare_chunks(ifps);
+
+	AtomicInt32 substeps(0);
+	run_chunks([&](int chunk)
+	{
+		substeps += step_chunk(chunk, ifps);
+	});
+	endStep(substeps);
+}
+
+void PendulumField::endStep(int substeps)
+{
+	num_substeps = substeps;
+	num_active = 0;
+	for (int active : chunk_active)
+		num_active += active;
+
+	Profiler::setValue("Pendulums active", "%", getActiveRatio() * 100.0f, 100.0f, nullptr);
+}
+
+void PendulumField::step(float ifps, const int *chunks, int num_chunks)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	if (num_chunks == 0 || ifps <= 0.0f)
+		return;
+
+	prepare_chunks(ifps);
+
+	if (num_chunks == 1)
+	{
+		endStep(step_chunk(chunks[0], ifps));
+		return;
+	}
+
+	AtomicInt32 next_chunk(0);
+	AtomicInt32 substeps(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		for (int i = next_chunk++; i < num_chunks; i = next_chunk++)
+			substeps += step_chunk(chunks[i], ifps);
+	});
+	endStep(substeps);
+}
+
+int PendulumField::step_chunk(int chunk, float ifps)
+{
+	int begin, end;
+	getChunkRange(chunk, begin, end);
+
+	int *indices = active_indices.get() + begin;
+	if (chunk_dirty[chunk])
+	{
+		// woken chunks rebuild their active list from the rest counters
+		int num = 0;
+		for (int i = begin; i < end; i++)
+		{
+			indices[num] = i;
+			num += (rest_ticks[i] < sleep_ticks) ? 1 : 0;
+		}
+		chunk_active[chunk] = num;
+		chunk_dirty[chunk] = 0;
+	}
+
+	int num = chunk_active[chunk];
+	if (num == 0)
+	{
+		chunk_cost[chunk] = 0;
+		return 0;
+	}
+
+	// fully active chunks are integrated in place, partially active ones through a gathered copy of their state
+	bool gather = (num != end - begin);
+	float *t = theta.get() + begin;
+	float *w = omega.get() + begin;
+	const float *l = length.get() + begin;
+	static thread_local Vector<float> state;
+	if (gather)
+	{
+		state.resize(CHUNK_SIZE * 3);
+		float *gathered_t = state.get();
+		float *gathered_w = state.get() + CHUNK_SIZE;
+		float *gathered_l = state.get() + CHUNK_SIZE * 2;
+		for (int i = 0; i < num; i++)
+		{
+			int index = indices[i];
+			gathered_t[i] = theta[index];
+			gathered_w[i] = omega[index];
+			gathered_l[i] = length[index];
+		}
+		t = gathered_t;
+		w = gathered_w;
+		l = gathered_l;
+	}
+
+	switch (integrator)
+	{
+		case INTEGRATOR_DOPRI5: chunk_cost[chunk] = step_dopri5(chunk, t, w, l, num, ifps); break;
+		case INTEGRATOR_FOREST_RUTH: step_symplectic(t, w, l, num, ifps, FOREST_RUTH_WEIGHTS, NUM_FOREST_RUTH_STAGES); break;
+		case INTEGRATOR_YOSHIDA6: step_symplectic(t, w, l, num, ifps, YOSHIDA6_WEIGHTS, NUM_YOSHIDA6_STAGES); break;
+		default: step_euler(t, w, l, num, ifps); break;
+	}
+
+	if (gather)
+	{
+		for (int i = 0; i < num; i++)
+		{
+			int index = indices[i];
+			theta[index] = t[i];
+			omega[index] = w[i];
+		}
+		updateBobs(indices, num);
+	}
+	else
+		updateBobs(begin, end);
+
+	if (sleep_energy > 0.0f)
+		chunk_active[chunk] = update_sleeping(indices, num);
+	return chunk_cost[chunk];
+}
+
+int PendulumField::update_sleeping(int *indices, int num)
+{
+	// pendulums below the energy threshold for sleep_ticks ticks in a row are stopped
+	int *rest = rest_ticks.get();
+	for (int i = 0; i < num; i++)
+	{
+		int index = indices[i];
+		float l = length[index];
+		float v = omega[index] * l;
+		float energy = 0.5f * v * v + gravity * l * (1.0f - cos(theta[index]));
+		int ticks = (energy < sleep_energy) ? rest[index] + 1 : 0;
+		rest[index] = ticks;
+		if (ticks >= sleep_ticks)
+			omega[index] = 0.0f;
+	}
+
+	// in-place stream compaction of the indices that stay awake
+	int count = 0;
+	int i = 0;
+	#ifdef USE_SSE
+		// shuffle masks packing the kept lanes of 4 indices to the front
+		static const struct ShuffleTable
+		{
+			ShuffleTable()
+			{
+				for (int mask = 0; mask < 16; mask++)
+				{
+					unsigned char *bytes = reinterpret_cast<unsigned char *>(&masks[mask]);
+					int num_kept = 0;
+					for (int lane = 0; lane < 4; lane++)
+					{
+						if ((mask & (1 << lane)) == 0)
+							continue;
+						for (int b = 0; b < 4; b++)
+							bytes[num_kept * 4 + b] = (unsigned char)(lane * 4 + b);
+						num_kept++;
+					}
+					for (int b = num_kept * 4; b < 16; b++)
+						bytes[b] = 0x80;
+				}
+			}
+			__m128i masks[16];
+		} table;
+
+		__m128i limit = _mm_set1_epi32(sleep_ticks);
+		for (; i + 4 <= num; i += 4)
+		{
+			__m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + i));
+			__m128i ticks = _mm_set_epi32(rest[indices[i + 3]], rest[indices[i + 2]], rest[indices[i + 1]], rest[indices[i + 0]]);
+			int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(ticks, limit)));
+			// the store never passes the lanes already loaded, the write position is behind the read position
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(indices + count), _mm_shuffle_epi8(index, table.masks[mask]));
+			count += _mm_popcnt_u32(mask);
+		}
+	#endif
+	for (; i < num; i++)
+	{
+		int index = indices[i];
+		indices[count] = index;
+		count += (rest[index] < sleep_ticks) ? 1 : 0;
+	}
+	return count;
+}
+
+void PendulumField::wake(int num)
+{
+	if (rest_ticks.size() != theta.size())
+		return;
+	if (rest_ticks[num] >= sleep_ticks)
+		chunk_dirty[num / CHUNK_SIZE] = 1;
+	rest_ticks[num] = 0;
+}
+
+void PendulumField::applyImpulse(int num, float velocity)
+{
+	omega[num] += velocity / length[num];
+	wake(num);
+}
+
+void PendulumField::wakeAll()
+{
+	rest_ticks.clear();
+}
+
+float PendulumField::getActiveRatio() const
+{
+	return theta.size() ? float(num_active) / theta.size() : 1.0f;
+}
+
+void PendulumField::prepare_chunks(float ifps)
+{
+	int num_chunks = getNumChunks();
+	if (placed_data != theta.get() || placed_chunks != num_chunks)
+		place();
+	if (rest_ticks.size() != theta.size() || chunk_dirty.size() != num_chunks)
+	{
+		// a resized or reloaded field starts fully awake, added pendulums start awake in their chunks
+		int num_kept = min(rest_ticks.size(), theta.size());
+		rest_ticks.resize(theta.size());
+		active_indices.resize(theta.size());
+		memset(rest_ticks.get() + num_kept, 0, sizeof(int) * (rest_ticks.size() - num_kept));
+		bind_partitions(rest_ticks.get(), sizeof(int));
+		bind_partitions(active_indices.get(), sizeof(int));
+		chunk_active.resize(num_chunks);
+		chunk_dirty.resize(num_chunks);
+		int first_dirty = min(num_kept / CHUNK_SIZE, num_chunks);
+		memset(chunk_dirty.get() + first_dirty, 1, num_chunks - first_dirty);
+	}
+	if (sleep_energy <= 0.0f && num_active != theta.size())
+	{
+		// chunks skipped by a partial step count as awake too, so this runs once and not every tick
+		memset(rest_ticks.get(), 0, sizeof(int) * rest_ticks.size());
+		memset(chunk_dirty.get(), 1, chunk_dirty.size());
+		for (int i = 0; i < num_chunks; i++)
+			chunk_active[i] = min(CHUNK_SIZE, theta.size() - i * CHUNK_SIZE);
+		num_active = theta.size();
+	}
+
+	if (chunk_step.size() != num_chunks)
+	{
+		chunk_step.resize(num_chunks);
+		chunk_cost.resize(num_chunks);
+		for (int i = 0; i < num_chunks; i++)
+		{
+			chunk_step[i] = ifps;
+			chunk_cost[i] = 1;
+		}
+	}
+
+	if (integrator != INTEGRATOR_DOPRI5)
+	{
+		int cost = 1;
+		if (integrator == INTEGRATOR_FOREST_RUTH)
+			cost = NUM_FOREST_RUTH_STAGES;
+		else if (integrator == INTEGRATOR_YOSHIDA6)
+			cost = NUM_YOSHIDA6_STAGES;
+		for (int i = 0; i < num_chunks; i++)
+			chunk_cost[i] = cost;
+		return;
+	}
+
+	// the slowest chunks of the previous tick start first so they don't end up last on a single worker
+	for (int p = 0; p < num_partitions; p++)
+	{
+		std::stable_sort(chunk_order.begin() + partition_chunks[p], chunk_order.begin() + partition_chunks[p + 1],
+			[this](int c0, int c1) { return chunk_cost[c0] > chunk_cost[c1]; });
+	}
+}
+
+void PendulumField::setNumaAware(bool enabled)
+{
+	if (numa_aware == enabled)
+		return;
+	numa_aware = enabled;
+	placed_data = nullptr;
+}
+
+void PendulumField::place()
+{
+	int num_chunks = getNumChunks();
+	chunk_order.resize(num_chunks);
+	for (int i = 0; i < num_chunks; i++)
+		chunk_order[i] = i;
+
+	// partitions cover whole pages, huge pages hold many chunks
+	num_partitions = numa_aware ? clamp(FieldMemory::getNumNodes(), 1, max(num_chunks, 1)) : 1;
+	int granularity = max(int(FieldMemory::getPageSize() / (CHUNK_SIZE * sizeof(float))), 1);
+	int partition_size = (num_chunks + num_partitions - 1) / num_partitions;
+	partition_size = (partition_size + granularity - 1) / granularity * granularity;
+	for (int p = 0; p <= num_partitions; p++)
+		partition_chunks[p] = min(p * partition_size, num_chunks);
+	partition_chunks[num_partitions] = num_chunks;
+
+	for (int i = 0; i < NUM_ARRAYS; i++)
+		bind_partitions((this->*arrays[i]).get(), sizeof(float));
+	for (int i = 0; i < 3; i++)
+		bind_partitions((this->*anchors[i]).get(), sizeof(double));
+	if (rest_ticks.size() == theta.size())
+	{
+		bind_partitions(rest_ticks.get(), sizeof(int));
+		bind_partitions(active_indices.get(), sizeof(int));
+	}
+
+	placed_data = theta.get();
+	placed_chunks = num_chunks;
+}
+
+void PendulumField::bind_partitions(void *data, size_t element_size)
+{
+	if (data == nullptr)
+		return;
+	FieldMemory::advise(data, theta.size() * element_size);
+	if (num_partitions == 1)
+		return;
+	for (int p = 0; p < num_partitions; p++)
+	{
+		size_t begin = size_t(partition_chunks[p]) * CHUNK_SIZE;
+		size_t end = min(size_t(partition_chunks[p + 1]) * CHUNK_SIZE, size_t(theta.size()));
+		if (begin < end)
+			FieldMemory::bind(static_cast<char *>(data) + begin * element_size, (end - begin) * element_size, p);
+	}
+}
+
+void PendulumField::step_euler(float *t, float *w, const float *l, int n, float ifps)
+{
+	// semi-implicit Euler
+	for (int i = 0; i < n; i++)
+	{
+		w[i] += (-gravity / l[i] * sin(t[i]) - damping * w[i]) * ifps;
+		t[i] += w[i] * ifps;
+	}
+}
+
+void PendulumField::step_symplectic(float *t, float *w, const float *l, int n, float ifps, const float *weights, int num_weights)
+{
+	// kick-drift-kick leapfrog stages, every stage sweeps the whole chunk so the loops stay branch-free
+	for (int s = 0; s < num_weights; s++)
+	{
+		float h = weights[s] * ifps;
+		float half = h * 0.5f;
+		// damping is applied as an exact decay around each stage to keep the splitting symmetric
+		float decay = exp(-damping * half);
+		for (int i = 0; i < n; i++)
+		{
+			float v = w[i] * decay;
+			v -= gravity / l[i] * sin(t[i]) * half;
+			float angle = t[i] + v * h;
+			v -= gravity / l[i] * sin(angle) * half;
+			t[i] = angle;
+			w[i] = v * decay;
+		}
+	}
+}
+
+double PendulumField::getEnergy(int begin, int end, double *kinetic) const
+{
+	double kinetic_energy = 0.0;
+	double potential_energy = 0.0;
+	for (int i = begin; i < end; i++)
+	{
+		float l = length[i];
+		float v = omega[i] * l;
+		kinetic_energy += 0.5 * v * v;
+		potential_energy += gravity * l * (1.0 - cos(theta[i]));
+	}
+	if (kinetic)
+		*kinetic = kinetic_energy;
+	return kinetic_energy + potential_energy;
+}
+
+double PendulumField::getEnergy(double *kinetic) const
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	// per-chunk sums keep the reduction order and the result independent of the number of workers
+	int num_chunks = getNumChunks();
+	Vector<double> energies(num_chunks);
+	Vector<double> kinetic_energies(num_chunks);
+	AtomicInt32 next_chunk(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		for (int chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++)
+		{
+			int begin, end;
+			getChunkRange(chunk, begin, end);
+			energies[chunk] = getEnergy(begin, end, &kinetic_energies[chunk]);
+		}
+	});
+
+	double energy = 0.0;
+	double kinetic_energy = 0.0;
+	for (int i = 0; i < num_chunks; i++)
+	{
+		energy += energies[i];
+		kinetic_energy += kinetic_energies[i];
+	}
+	if (kinetic)
+		*kinetic = kinetic_energy;
+	return energy;
+}
+
+int PendulumField::step_dopri5(int chunk, float *t, float *w, const float *l, int n, float ifps)
+{
+	// Dormand-Prince tableau, the last row is also the 5th order solution
+	static const float a[7][6] =
+	{
+		{ 0.0f },
+		{ 1.0f / 5.0f },
+		{ 3.0f / 40.0f, 9.0f / 40.0f },
+		{ 44.0f / 45.0f, -56.0f / 15.0f, 32.0f / 9.0f },
+		{ 19372.0f / 6561.0f, -25360.0f / 2187.0f, 64448.0f / 6561.0f, -212.0f / 729.0f },
+		{ 9017.0f / 3168.0f, -355.0f / 33.0f, 46732.0f / 5247.0f, 49.0f / 176.0f, -5103.0f / 18656.0f },
+		{ 35.0f / 384.0f, 0.0f, 500.0f / 1113.0f, 125.0f / 192.0f, -2187.0f / 6784.0f, 11.0f / 84.0f },
+	};
+	// difference between the 5th and the embedded 4th order solutions
+	static const float e[7] =
+	{
+		71.0f / 57600.0f, 0.0f, -71.0f / 16695.0f, 71.0f / 1920.0f, -17253.0f / 339200.0f, 22.0f / 525.0f, -1.0f / 40.0f,
+	};
+
+	// stage derivatives and the stage state, CHUNK_SIZE floats each
+	static thread_local Vector<float> scratch;
+	scratch.resize(CHUNK_SIZE * 16);
+	float *k_theta[7];
+	float *k_omega[7];
+	for (int i = 0; i < 7; i++)
+	{
+		k_theta[i] = scratch.get() + CHUNK_SIZE * i;
+		k_omega[i] = scratch.get() + CHUNK_SIZE * (i + 7);
+	}
+	float *y_theta = scratch.get() + CHUNK_SIZE * 14;
+	float *y_omega = scratch.get() + CHUNK_SIZE * 15;
+
+	auto derivative = [&](const float *yt, const float *yw, float *kt, float *kw)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			kt[i] = yw[i];
+			kw[i] = -gravity / l[i] * sin(yt[i]) - damping * yw[i];
+		}
+	};
+
+	float time = 0.0f;
+	float h = clamp(chunk_step[chunk], ifps * 1e-3f, ifps);
+	int num_steps = 0;
+	bool first_same_as_last = false;
+	while (time < ifps && num_steps < 1000)
+	{
+		float step = min(h, ifps - time);
+		bool last = (step == ifps - time);
+		num_steps++;
+
+		if (!first_same_as_last)
+			derivative(t, w, k_theta[0], k_omega[0]);
+		for (int s = 1; s < 7; s++)
+		{
+			for (int i = 0; i < n; i++)
+			{
+				float dt = 0.0f;
+				float dw = 0.0f;
+				for (int j = 0; j < s; j++)
+				{
+					dt += a[s][j] * k_theta[j][i];
+					dw += a[s][j] * k_omega[j][i];
+				}
+				y_theta[i] = t[i] + step * dt;
+				y_omega[i] = w[i] + step * dw;
+			}
+			derivative(y_theta, y_omega, k_theta[s], k_omega[s]);
+		}
+
+		// the largest scaled error of the chunk decides the step
+		float error = 0.0f;
+		for (int i = 0; i < n; i++)
+		{
+			float et = 0.0f;
+			float ew = 0.0f;
+			for (int j = 0; j < 7; j++)
+			{
+				et += e[j] * k_theta[j][i];
+				ew += e[j] * k_omega[j][i];
+			}
+			float scale_theta = tolerance * (1.0f + max(abs(t[i]), abs(y_theta[i])));
+			float scale_omega = tolerance * (1.0f + max(abs(w[i]), abs(y_omega[i])));
+			error = max(error, max(abs(et * step) / scale_theta, abs(ew * step) / scale_omega));
+		}
+
+		float factor = (error > 0.0f) ? clamp(0.9f * pow(error, -0.2f), 0.2f, 5.0f) : 5.0f;
+		if (error <= 1.0f || step <= ifps * 1e-3f)
+		{
+			// the last stage is evaluated at the new state and becomes the first stage of the next step
+			memcpy(t, y_theta, sizeof(float) * n);
+			memcpy(w, y_omega, sizeof(float) * n);
+			std::swap(k_theta[0], k_theta[6]);
+			std::swap(k_omega[0], k_omega[6]);
+			first_same_as_last = true;
+			time = last ? ifps : time + step;
+			// a step clipped by the end of the tick doesn't limit the next one
+			if (!last || factor < 1.0f)
+				h = step * factor;
+		}
+		else
+		{
+			first_same_as_last = true;
+			h = step * factor;
+		}
+	}
+
+	chunk_step[chunk] = h;
+	return num_steps;
+}
+
+void PendulumField::updateBobs(int begin, int end)
+{
+	const float *t = theta.get();
+	const float *l = length.get();
+	for (int i = begin; i < end; i++)
+	{
+		float s, c;
+		sincos(t[i], s, c);
+		bob_x[i] = pivot_x[i] + direction_x[i] * s * l[i];
+		bob_y[i] = pivot_y[i] + direction_y[i] * s * l[i];
+		bob_z[i] = pivot_z[i] - c * l[i];
+	}
+}
+
+void PendulumField::updateBobs(const int *indices, int num)
+{
+	const float *t = theta.get();
+	const float *l = length.get();
+	for (int i = 0; i < num; i++)
+	{
+		int index = indices[i];
+		float s, c;
+		sincos(t[index], s, c);
+		bob_x[index] = pivot_x[index] + direction_x[index] * s * l[index];
+		bob_y[index] = pivot_y[index] + direction_y[index] * s * l[index];
+		bob_z[index] = pivot_z[index] - c * l[index];
+	}
+}
+
+void PendulumField::updateBobs()
+{
+	updateBobs(0, theta.size());
+}
+
+namespace
+{
+// spreads the low 10 bits of a value to every third bit
+unsigned int spread_bits(unsigned int v)
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+}
+
+unsigned int PendulumField::get_code(int slot) const
+{
+	vec3 p = (getPivot(slot) - order_min) * order_scale;
+	unsigned int x = (unsigned int)clamp(p.x, 0.0f, 1023.0f);
+	unsigned int y = (unsigned int)clamp(p.y, 0.0f, 1023.0f);
+	unsigned int z = (unsigned int)clamp(p.z, 0.0f, 1023.0f);
+	return spread_bits(x) | (spread_bits(y) << 1) | (spread_bits(z) << 2);
+}
+
+void PendulumField::mark_moved(int slot)
+{
+	if (slot_moved.size() <= slot)
+	{
+		int size = slot_moved.size();
+		slot_moved.resize(slot + 1);
+		memset(slot_moved.get() + size, 0, slot + 1 - size);
+	}
+	if (slot_moved[slot])
+		return;
+	slot_moved[slot] = 1;
+	moved.append(slot);
+}
+
+void PendulumField::clear_order()
+{
+	ordered = false;
+	codes.clear();
+	moved.clear();
+	slot_moved.clear();
+	last_order.clear();
+	layout_version++;
+}
+
+void PendulumField::reorder()
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	int num = theta.size();
+	if (num == 0)
+		return;
+
+	BoundBox bound_box;
+	for (int i = 0; i < num; i++)
+		bound_box.expand(getPivot(i));
+	begin_curve(bound_box);
+
+	codes.resize(num);
+	for (int i = 0; i < num; i++)
+		codes[i] = get_code(i);
+
+	Vector<int> order(num);
+	for (int i = 0; i < num; i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [this](int s0, int s1)
+	{
+		return codes[s0] != codes[s1] ? codes[s0] < codes[s1] : slot_ids[s0] < slot_ids[s1];
+	});
+
+	moved.clear();
+	slot_moved.resize(num);
+	memset(slot_moved.get(), 0, num);
+	apply_order(order);
+	ordered = true;
+}
+
+void PendulumField::begin_curve(const BoundBox &bound_box)
+{
+	// the curve covers the bounds of the pivots at the time of the full reorder
+	order_min = bound_box.minimum;
+	vec3 size = bound_box.maximum - bound_box.minimum;
+	order_scale = vec3(1023.0f) / max(size, vec3(Consts::EPS));
+}
+
+void PendulumField::beginReorder()
+{
+	sliced.stage = REORDER_BOUNDS;
+	sliced.position = 0;
+	sliced.pass = 0;
+	sliced.array = 0;
+	sliced.bound_box.clear();
+}
+
+bool PendulumField::updateReorder(long long end_time)
+{
+	UNIGINE_PROFILER_FUNCTION;
+
+	// a stable radix sort of the slots in id order by their codes, the same order as the comparison in reorder()
+	int num = theta.size();
+	if (num == 0)
+		sliced.stage = REORDER_DONE;
+
+	while (sliced.stage != REORDER_DONE)
+	{
+		if (Time::get() >= end_time)
+			return false;
+
+		int size = (sliced.stage == REORDER_IDS) ? id_slots.size() : num;
+		int begin = sliced.position;
+		int end = min(begin + REORDER_SLICE_SIZE, size);
+		int shift = sliced.pass * RADIX_BITS;
+		int *order = sliced.order.get();
+
+		switch (sliced.stage)
+		{
+			case REORDER_BOUNDS:
+				for (int i = begin; i < end; i++)
+					sliced.bound_box.expand(getPivot(i));
+				break;
+			case REORDER_CODES:
+				for (int i = begin; i < end; i++)
+					codes[i] = get_code(i);
+				break;
+			case REORDER_IDS:
+				for (int id = begin; id < end; id++)
+				{
+					if (id_slots[id] != -1)
+						sliced.order.appendFast(id_slots[id]);
+				}
+				break;
+			case REORDER_HISTOGRAM:
+				for (int i = begin; i < end; i++)
+					sliced.histogram[(codes[order[i]] >> shift) & RADIX_MASK]++;
+				break;
+			case REORDER_SCATTER:
+				for (int i = begin; i < end; i++)
+				{
+					int slot = order[i];
+					sliced.temp[sliced.histogram[(codes[slot] >> shift) & RADIX_MASK]++] = slot;
+				}
+				break;
+			case REORDER_PERMUTE:
+				// one array at a time into a spare buffer that takes its place, the replaced buffer is the next spare
+				if (sliced.array < NUM_ARRAYS)
+				{
+					const float *data = (this->*arrays[sliced.array]).get();
+					float *temp = sliced.float_temp.get();
+					for (int i = begin; i < end; i++)
+						temp[i] = data[order[i]];
+				}
+				else if (sliced.array == NUM_ARRAYS)
+				{
+					unsigned int *temp = sliced.code_temp.get();
+					for (int i = begin; i < end; i++)
+						temp[i] = codes[order[i]];
+				}
+				else if (sliced.array <= NUM_ARRAYS + 2)
+				{
+					const int *data = (sliced.array == NUM_ARRAYS + 1) ? slot_ids.get() : rest_ticks.get();
+					int *temp = sliced.temp.get();
+					for (int i = begin; i < end; i++)
+						temp[i] = data[order[i]];
+				}
+				else
+				{
+					const double *data = (this->*anchors[sliced.array - NUM_ARRAYS - 3]).get();
+					double *temp = sliced.double_temp.get();
+					for (int i = begin; i < end; i++)
+						temp[i] = data[order[i]];
+				}
+				break;
+			case REORDER_SLOTS:
+				for (int i = begin; i < end; i++)
+					id_slots[slot_ids[i]] = i;
+				break;
+			default:
+				break;
+		}
+
+		sliced.position = end;
+		if (end < size)
+			continue;
+
+		// the stage is over
+		sliced.position = 0;
+		switch (sliced.stage)
+		{
+			case REORDER_BOUNDS:
+				begin_curve(sliced.bound_box);
+				codes.resize(num);
+				sliced.stage = REORDER_CODES;
+				break;
+			case REORDER_CODES:
+				sliced.order.clear();
+				sliced.order.allocate(num);
+				sliced.temp.resize(num);
+				sliced.histogram.resize(RADIX_SIZE);
+				sliced.stage = REORDER_IDS;
+				break;
+			case REORDER_IDS:
+				memset(sliced.histogram.get(), 0, sizeof(int) * RADIX_SIZE);
+				sliced.stage = REORDER_HISTOGRAM;
+				break;
+			case REORDER_HISTOGRAM:
+			{
+				int offset = 0;
+				for (int &count : sliced.histogram)
+				{
+					int next = offset + count;
+					count = offset;
+					offset = next;
+				}
+				sliced.stage = REORDER_SCATTER;
+				break;
+			}
+			case REORDER_SCATTER:
+				sliced.order.swap(sliced.temp);
+				if (++sliced.pass < RADIX_PASSES)
+				{
+					memset(sliced.histogram.get(), 0, sizeof(int) * RADIX_SIZE);
+					sliced.stage = REORDER_HISTOGRAM;
+					break;
+				}
+				sliced.array = 0;
+				sliced.float_temp.resize(num);
+				sliced.double_temp.resize(num);
+				sliced.code_temp.resize(num);
+				sliced.stage = REORDER_PERMUTE;
+				break;
+			case REORDER_PERMUTE:
+				if (sliced.array < NUM_ARRAYS)
+					(this->*arrays[sliced.array]).swap(sliced.float_temp);
+				else if (sliced.array == NUM_ARRAYS)
+					codes.swap(sliced.code_temp);
+				else if (sliced.array == NUM_ARRAYS + 1)
+					slot_ids.swap(sliced.temp);
+				else if (sliced.array == NUM_ARRAYS + 2)
+					rest_ticks.swap(sliced.temp);
+				else
+					(this->*anchors[sliced.array - NUM_ARRAYS - 3]).swap(sliced.double_temp);
+				sliced.array++;
+				// rest counters are permuted only if the field has stepped since it was resized
+				if (sliced.array == NUM_ARRAYS + 2 && rest_ticks.size() != num)
+					sliced.array++;
+				if (sliced.array == NUM_ARRAYS + 6)
+					sliced.stage = REORDER_SLOTS;
+				break;
+			case REORDER_SLOTS:
+			{
+				if (chunk_dirty.size())
+					memset(chunk_dirty.get(), 1, chunk_dirty.size());
+				moved.clear();
+				slot_moved.resize(num);
+				memset(slot_moved.get(), 0, num);
+				ordered = true;
+				last_order.swap(sliced.order);
+				layout_version++;
+				sliced.temp.destroy();
+				sliced.float_temp.destroy();
+				sliced.double_temp.destroy();
+				sliced.code_temp.destroy();
+				sliced.order.destroy();
+				sliced.stage = REORDER_DONE;
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	return true;
+}
+
+bool PendulumField::updateOrder()
+{
+	if (!ordered)
+	{
+		reorder();
+		return true;
+	}
+	if (moved.empty())
+		return false;
+
+	// many moved pivots are likely out of the curve bounds, the whole field is sorted again
+	int num = theta.size();
+	if (moved.size() * 8 > num)
+	{
+		reorder();
+		return true;
+	}
+
+	UNIGINE_PROFILER_FUNCTION;
+
+	// the slots that didn't move are still sorted, the moved ones are sorted alone and merged in
+	codes.resize(num);
+	for (int slot : moved)
+		codes[slot] = get_code(slot);
+	auto less = [this](int s0, int s1)
+	{
+		return codes[s0] != codes[s1] ? codes[s0] < codes[s1] : slot_ids[s0] < slot_ids[s1];
+	};
+	std::sort(moved.begin(), moved.end(), less);
+
+	Vector<int> order;
+	order.allocate(num);
+	int next = 0;
+	for (int slot = 0; slot < num; slot++)
+	{
+		if (slot < slot_moved.size() && slot_moved[slot])
+			continue;
+		while (next < moved.size() && less(moved[next], slot))
+			order.appendFast(moved[next++]);
+		order.appendFast(slot);
+	}
+	while (next < moved.size())
+		order.appendFast(moved[next++]);
+
+	for (int slot : moved)
+		slot_moved[slot] = 0;
+	moved.clear();
+	apply_order(order);
+	return true;
+}
+
+void PendulumField::apply_order(const Vector<int> &order)
+{
+	int num = order.size();
+
+	// every job permutes one array
+	enum
+	{
+		JOB_CODES = NUM_ARRAYS,
+		JOB_IDS,
+		JOB_REST,
+		JOB_ANCHORS,
+		NUM_JOBS = JOB_ANCHORS + 3,
+	};
+	AtomicInt32 next_job(0);
+	runSyncMultiThreadFunc([&](CPUShader *, int, int)
+	{
+		static thread_local Vector<float> float_temp;
+		static thread_local Vector<int> int_temp;
+		static thread_local Vector<double> double_temp;
+		auto permute = [&](auto *data, auto &temp)
+		{
+			temp.resize(num);
+			for (int i = 0; i < num; i++)
+				temp[i] = data[order[i]];
+			memcpy(data, temp.get(), sizeof(data[0]) * num);
+		};
+
+		for (int job = next_job++; job < NUM_JOBS; job = next_job++)
+		{
+			if (job < NUM_ARRAYS)
+				permute((this->*arrays[job]).get(), float_temp);
+			else if (job == JOB_CODES)
+				permute(reinterpret_cast<int *>(codes.get()), int_temp);
+			else if (job == JOB_IDS)
+				permute(slot_ids.get(), int_temp);
+			else if (job == JOB_REST)
+			{
+				if (rest_ticks.size() == num)
+					permute(rest_ticks.get(), int_temp);
+			}
+			else
+				permute((this->*anchors[job - JOB_ANCHORS]).get(), double_temp);
+		}
+	});
+
+	for (int i = 0; i < num; i++)
+		id_slots[slot_ids[i]] = i;
+
+	// active lists are rebuilt from the permuted rest counters
+	if (chunk_dirty.size())
+		memset(chunk_dirty.get(), 1, chunk_dirty.size());
+
+	last_order = order;
+	layout_version++;
+}
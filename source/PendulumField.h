@@ -0,0 +1,291 @@
+#ifndef __PENDULUM_FIELD_H__
+#define __PENDULUM_FIELD_H__
+
+#include <UnigineMathLib.h>
+#include <UnigineMathLibBounds.h>
+#include <UnigineVector.h>
+
+#include "FieldMemory.h"
+
+// Field of planar pendulums stored as a structure of arrays.
+// Every pendulum swings around its pivot in the vertical plane spanned by its horizontal direction and the Z axis.
+// Pendulums are grouped into fixed-size chunks of consecutive indices, which are the unit of work for worker threads.
+class PendulumField
+{
+public:
+	enum
+	{
+		CHUNK_SIZE = 1024,
+		// the origin moves in steps of this size, rebasing doesn't happen for smaller camera moves
+		REBASE_STEP = 1024,
+	};
+
+	// per-pendulum arrays in storage order
+	enum ARRAY
+	{
+		ARRAY_PIVOT_X = 0,
+		ARRAY_PIVOT_Y,
+		ARRAY_PIVOT_Z,
+		ARRAY_DIRECTION_X,
+		ARRAY_DIRECTION_Y,
+		ARRAY_LENGTH,
+		ARRAY_THETA,
+		ARRAY_OMEGA,
+		ARRAY_BOB_X,
+		ARRAY_BOB_Y,
+		ARRAY_BOB_Z,
+		NUM_ARRAYS,
+	};
+
+	enum INTEGRATOR
+	{
+		// semi-implicit Euler with the tick step
+		INTEGRATOR_EULER = 0,
+		// embedded Dormand-Prince 5(4) with a step size controlled per chunk
+		INTEGRATOR_DOPRI5,
+		// 4th order symplectic composition of leapfrog steps (Forest-Ruth / Yoshida triple jump)
+		INTEGRATOR_FOREST_RUTH,
+		// 6th order symplectic composition of leapfrog steps (Yoshida solution A)
+		INTEGRATOR_YOSHIDA6,
+		NUM_INTEGRATORS,
+	};
+
+	PendulumField();
+	~PendulumField();
+
+	void clear();
+	void resize(int num);
+	// returns the external id of the pendulum
+	int addPendulum(const Unigine::Math::vec3 &pivot, const Unigine::Math::vec2 &direction, float length, float angle, float velocity = 0.0f);
+	// the last pendulum takes the slot of the removed one, the id is not reused
+	void removePendulum(int id);
+	bool isValidId(int id) const { return id >= 0 && id < id_slots.size() && id_slots[id] != -1; }
+	// every id handed out so far is below this, removed ones included
+	int getNumIds() const { return id_slots.size(); }
+	// creates a regular size_x * size_y lattice of pivots centered at the origin
+	void createLattice(int size_x, int size_y, float spacing, float length);
+	// pivot and initial angle of the pendulum in the slot of a lattice made by createLattice()
+	static void getLatticePendulum(int slot, int size_x, int size_y, float spacing, float length, Unigine::Math::vec3 &pivot, float &angle);
+	// initial angle of the pendulum at column x and row y of a lattice, a slow wave so the field is not at rest
+	static float getLatticeAngle(int x, int y);
+	// allocates the arrays for num pendulums, addPendulum() doesn't reallocate until then
+	void reserve(int num);
+	// exchanges the pendulums and their state with another field, the parameters stay; both layouts change
+	void swap(PendulumField &other);
+
+	int getNumPendulums() const { return theta.size(); }
+	int getNumChunks() const { return (theta.size() + CHUNK_SIZE - 1) / CHUNK_SIZE; }
+	void getChunkRange(int chunk, int &begin, int &end) const;
+
+	// Storage slots are sorted along a Morton curve of the pivots by reorder(), external ids stay stable.
+	// Slot indices are what every per-pendulum array and query uses, they are valid until the layout version changes.
+	int getSlot(int id) const { return id_slots[id]; }
+	int getId(int slot) const { return slot_ids[slot]; }
+	void setPivot(int id, const Unigine::Math::vec3 &pivot);
+	// sorts the whole storage
+	void reorder();
+	// reorder() in resumable slices for frame-budgeted jobs, updateReorder() returns true once the storage is sorted;
+	// the field must not be edited or stepped in between
+	void beginReorder();
+	bool updateReorder(long long end_time);
+	// merges pendulums whose pivots moved since the last reorder back into the curve order, returns true if the layout changed
+	bool updateOrder();
+	int getLayoutVersion() const { return layout_version; }
+	// permutation of the last reorder, new slot to old slot, empty if the layout was reset instead
+	const Unigine::Vector<int> &getLastOrder() const { return last_order; }
+
+	Unigine::Vector<float> &getArray(ARRAY array) { return this->*arrays[array]; }
+	const Unigine::Vector<float> &getArray(ARRAY array) const { return this->*arrays[array]; }
+
+	// Chunks are split into one contiguous partition per NUMA node and the pages of every array are moved to the
+	// node of their partition. Workers take chunks of the partition of their own node first and steal from the
+	// others once it is done. Single-node machines get a single partition.
+	void setNumaAware(bool enabled);
+	bool isNumaAware() const { return numa_aware; }
+	int getNumPartitions() const { return num_partitions; }
+
+	void setGravity(float g) { gravity = g; }
+	float getGravity() const { return gravity; }
+	void setDamping(float d) { damping = d; }
+	float getDamping() const { return damping; }
+	void setBobRadius(float r) { bob_radius = r; }
+	float getBobRadius() const { return bob_radius; }
+
+	void setIntegrator(INTEGRATOR i) { integrator = i; }
+	INTEGRATOR getIntegrator() const { return integrator; }
+	// relative and absolute error allowed per adaptive step
+	void setTolerance(float t) { tolerance = t; }
+	float getTolerance() const { return tolerance; }
+	// number of integration steps taken by the last tick over all chunks, rejected ones included
+	int getNumSubsteps() const { return num_substeps; }
+	float getChunkStep(int chunk) const { return chunk_step[chunk]; }
+	int getChunkCost(int chunk) const { return chunk_cost[chunk]; }
+
+	static const char *getIntegratorName(INTEGRATOR integrator);
+
+	// pendulums whose energy per unit mass stays below the threshold for the given number of ticks are put
+	// to sleep and skipped by step(), 0 disables sleeping
+	void setSleepEnergy(float e) { sleep_energy = e; }
+	float getSleepEnergy() const { return sleep_energy; }
+	void setSleepTicks(int t) { sleep_ticks = Unigine::Math::max(t, 1); }
+	int getSleepTicks() const { return sleep_ticks; }
+	bool isSleeping(int num) const { return num < rest_ticks.size() && rest_ticks[num] >= sleep_ticks; }
+	// wakes a pendulum, must not be called while the field is stepping
+	void wake(int num);
+	void wakeAll();
+	// adds a tangential bob velocity and wakes the pendulum
+	void applyImpulse(int num, float velocity);
+	// active pendulums of the last tick
+	int getNumActive() const { return num_active; }
+	float getActiveRatio() const;
+
+	// advances the field by ifps seconds on all worker threads
+	void step(float ifps);
+	// advances only the listed chunks, the others keep their state
+	void step(float ifps, const int *chunks, int num_chunks);
+	// step() split for task schedulers: beginStep() once, then stepChunk() for every chunk from any thread,
+	// then endStep() with the sum of the returned substeps
+	void beginStep(float ifps) { prepare_chunks(ifps); }
+	int stepChunk(int chunk, float ifps) { return step_chunk(chunk, ifps); }
+	void endStep(int substeps);
+	// recomputes world-space bob positions from the angles
+	void updateBobs(int begin, int end);
+	void updateBobs(const int *indices, int num);
+	void updateBobs();
+
+	// total kinetic and potential energy per unit bob mass, zero at rest; the kinetic part is returned on request,
+	// the damping dissipates twice the kinetic energy times the damping per second
+	double getEnergy(double *kinetic = nullptr) const;
+	double getEnergy(int begin, int end, double *kinetic = nullptr) const;
+
+	Unigine::Math::vec3 getPivot(int num) const { return Unigine::Math::vec3(pivot_x[num], pivot_y[num], pivot_z[num]); }
+	Unigine::Math::vec3 getBob(int num) const { return Unigine::Math::vec3(bob_x[num], bob_y[num], bob_z[num]); }
+
+	// pivots and bobs are stored relative to the origin, the world position of a bob is getOrigin() + getBob()
+	const Unigine::Math::Vec3 &getOrigin() const { return origin; }
+	// once the position is farther than the distance from the origin along an axis, moves the origin to the multiple
+	// of REBASE_STEP nearest to the position; the pivots are recomputed from their double precision world positions,
+	// so they round once against the new origin instead of accumulating an error per rebase, and the bobs follow them.
+	// The returned offset is the shift of the origin for everything else kept relative to it.
+	bool rebase(const Unigine::Math::Vec3 &position, float distance, Unigine::Math::vec3 &offset);
+
+	// pivots
+	Unigine::Vector<float> pivot_x;
+	Unigine::Vector<float> pivot_y;
+	Unigine::Vector<float> pivot_z;
+	// normalized horizontal swing direction
+	Unigine::Vector<float> direction_x;
+	Unigine::Vector<float> direction_y;
+	// parameters and state
+	Unigine::Vector<float> length;
+	Unigine::Vector<float> theta;
+	Unigine::Vector<float> omega;
+	// world-space bob positions, derived from the state
+	Unigine::Vector<float> bob_x;
+	Unigine::Vector<float> bob_y;
+	Unigine::Vector<float> bob_z;
+
+private:
+	static Unigine::Vector<float> PendulumField::*const arrays[NUM_ARRAYS];
+	static Unigine::Vector<double> PendulumField::*const anchors[3];
+
+	template <typename Func>
+	void run_chunks(Func func);
+	void place();
+	void bind_partitions(void *data, size_t element_size);
+
+	void prepare_chunks(float ifps);
+	int step_chunk(int chunk, float ifps);
+	int update_sleeping(int *indices, int num);
+	unsigned int get_code(int slot) const;
+	void mark_moved(int slot);
+	void set_anchor(int slot);
+	void clear_order();
+	void apply_order(const Unigine::Vector<int> &order);
+	void begin_curve(const Unigine::Math::BoundBox &bound_box);
+	void step_euler(float *t, float *w, const float *l, int n, float ifps);
+	int step_dopri5(int chunk, float *t, float *w, const float *l, int n, float ifps);
+	void step_symplectic(float *t, float *w, const float *l, int n, float ifps, const float *weights, int num_weights);
+
+	Unigine::Math::Vec3 origin;
+	// world positions of the pivots in double precision, the source of the pivots after a rebase; a pivot written
+	// straight into the arrays no longer matches its anchor and is taken as exact by the next rebase
+	Unigine::Vector<double> anchor_x;
+	Unigine::Vector<double> anchor_y;
+	Unigine::Vector<double> anchor_z;
+
+	float gravity;
+	float damping;
+	float bob_radius;
+
+	INTEGRATOR integrator;
+	float tolerance;
+	int num_substeps;
+
+	// per-chunk step size carried between ticks and the number of steps of the last tick
+	Unigine::Vector<float> chunk_step;
+	Unigine::Vector<int> chunk_cost;
+	// chunks sorted by decreasing cost, expensive chunks are taken by the workers first
+	Unigine::Vector<int> chunk_order;
+
+	float sleep_energy;
+	int sleep_ticks;
+	int num_active;
+	// consecutive ticks at rest per pendulum
+	Unigine::Vector<int> rest_ticks;
+	// awake pendulums of every chunk compacted to the front of the chunk range
+	Unigine::Vector<int> active_indices;
+	Unigine::Vector<int> chunk_active;
+	// chunks with woken pendulums, their active list is rebuilt on the next tick
+	Unigine::Vector<unsigned char> chunk_dirty;
+
+	Unigine::Vector<int> slot_ids;
+	Unigine::Vector<int> id_slots;
+	// curve codes of the slots and the slots whose pivots moved since they were coded
+	bool ordered;
+	Unigine::Math::vec3 order_min;
+	Unigine::Math::vec3 order_scale;
+	Unigine::Vector<unsigned int> codes;
+	Unigine::Vector<int> moved;
+	Unigine::Vector<unsigned char> slot_moved;
+	Unigine::Vector<int> last_order;
+	int layout_version;
+
+	// position of a sliced reorder
+	enum REORDER_STAGE
+	{
+		REORDER_BOUNDS = 0,
+		REORDER_CODES,
+		REORDER_IDS,
+		REORDER_HISTOGRAM,
+		REORDER_SCATTER,
+		REORDER_PERMUTE,
+		REORDER_SLOTS,
+		REORDER_DONE,
+	};
+	struct SlicedReorder
+	{
+		REORDER_STAGE stage;
+		int position;
+		int pass;
+		int array;
+		Unigine::Math::BoundBox bound_box;
+		Unigine::Vector<int> order;
+		Unigine::Vector<int> temp;
+		Unigine::Vector<float> float_temp;
+		Unigine::Vector<double> double_temp;
+		Unigine::Vector<unsigned int> code_temp;
+		Unigine::Vector<int> histogram;
+	};
+	SlicedReorder sliced;
+
+	bool numa_aware;
+	int num_partitions;
+	// partition ranges in chunk_order, the last entry is the number of chunks
+	int partition_chunks[FieldMemory::MAX_NODES + 1];
+	// arrays reallocated after the placement are placed again
+	const float *placed_data;
+	int placed_chunks;
+};
+
+#endif // __PENDULUM_FIELD_H__
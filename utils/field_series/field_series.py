@@ -0,0 +1,144 @@
+"""Reference reader of the columnar series files written by FieldSeries (source/FieldSeries.h).
+
+The file is memory-mapped. A slice touches only the blocks it overlaps: raw blocks are numpy views of the mapping,
+lz4 blocks are decompressed with the lz4 package (raw LZ4 block format). A slice that lies inside one raw block is
+returned without a copy.
+
+    series = FieldSeries("world.fieldseries")
+    theta = series.read("theta", ticks=slice(600, 1200), pendulums=slice(0, 4096))
+    stats = series.stats("theta")  # min, max and mean per time and pendulum chunk
+    bob_x = series.read("bob_x") + series.origins()[:, 0:1]  # world positions
+
+Run as a script to print the layout of a file and the throughput of reading it whole.
+"""
+
+import mmap
+import sys
+import time
+
+import numpy as np
+
+MAGIC = ord("P") | (ord("S") << 8) | (ord("E") << 16) | (ord("R") << 24)
+VERSION = 2
+CODEC_RAW = 0
+CODEC_LZ4 = 1
+
+HEADER = np.dtype([
+	("magic", "<u4"), ("version", "<u4"), ("num_pendulums", "<i4"), ("pendulums_per_chunk", "<i4"),
+	("ticks_per_chunk", "<i4"), ("num_columns", "<i4"), ("num_time_chunks", "<i4"), ("tick_step", "<f4"),
+	("num_ticks", "<u8"), ("index_offset", "<u8"), ("start_time", "<f8"), ("reserved", "<u4", 2),
+])
+COLUMN = np.dtype([("array", "<i4"), ("name", "S28")])
+TIME_CHUNK = np.dtype([
+	("first_tick", "<u8"), ("num_ticks", "<i4"), ("reserved", "<i4"), ("start_time", "<f8"), ("origin", "<f8", 3),
+])
+BLOCK = np.dtype([
+	("offset", "<u8"), ("size", "<u4"), ("raw_size", "<u4"), ("codec", "<u4"),
+	("min", "<f4"), ("max", "<f4"), ("mean", "<f4"),
+])
+
+
+class FieldSeries:
+	def __init__(self, path):
+		with open(path, "rb") as file:
+			self.data = mmap.mmap(file.fileno(), 0, access=mmap.ACCESS_READ)
+		header = np.frombuffer(self.data, HEADER, 1, 0)[0]
+		if header["magic"] != MAGIC or header["version"] != VERSION:
+			raise ValueError("%s is not a series file of version %d" % (path, VERSION))
+		if header["index_offset"] == 0:
+			raise ValueError("the recording of %s was not closed" % path)
+
+		self.num_pendulums = int(header["num_pendulums"])
+		self.num_ticks = int(header["num_ticks"])
+		self.ticks_per_chunk = int(header["ticks_per_chunk"])
+		self.pendulums_per_chunk = int(header["pendulums_per_chunk"])
+		self.tick_step = float(header["tick_step"])
+		self.start_time = float(header["start_time"])
+		num_columns = int(header["num_columns"])
+		num_time_chunks = int(header["num_time_chunks"])
+		self.num_pendulum_chunks = -(-self.num_pendulums // self.pendulums_per_chunk)
+
+		columns = np.frombuffer(self.data, COLUMN, num_columns, HEADER.itemsize)
+		self.columns = [name.rstrip(b"\0").decode() for name in columns["name"]]
+		offset = int(header["index_offset"])
+		self.time_chunks = np.frombuffer(self.data, TIME_CHUNK, num_time_chunks, offset)
+		offset += TIME_CHUNK.itemsize * num_time_chunks
+		self.blocks = np.frombuffer(self.data, BLOCK, num_time_chunks * self.num_pendulum_chunks * num_columns, offset)
+		self.blocks = self.blocks.reshape(num_time_chunks, self.num_pendulum_chunks, num_columns)
+
+	def column(self, name):
+		return self.columns.index(name) if isinstance(name, str) else int(name)
+
+	def times(self, ticks=slice(None)):
+		"""Field times of the samples in seconds."""
+		begin, end, _ = ticks.indices(self.num_ticks)
+		return self.start_time + self.tick_step * np.arange(begin, end)
+
+	def origins(self, ticks=slice(None)):
+		"""Field origin of every sample, ticks by 3 doubles; pivots and bobs are relative to it."""
+		begin, end, _ = ticks.indices(self.num_ticks)
+		return self.time_chunks["origin"][np.arange(begin, end) // self.ticks_per_chunk]
+
+	def stats(self, name):
+		"""Structured array of min, max and mean per time chunk and pendulum chunk, NaN for empty blocks."""
+		return self.blocks[:, :, self.column(name)][["min", "max", "mean"]]
+
+	def block(self, time_chunk, pendulum_chunk, name):
+		"""Ticks by pendulums array of a block, a view of the mapping when it is stored raw."""
+		entry = self.blocks[time_chunk, pendulum_chunk, self.column(name)]
+		num_ticks = int(self.time_chunks[time_chunk]["num_ticks"])
+		width = min(self.num_pendulums - pendulum_chunk * self.pendulums_per_chunk, self.pendulums_per_chunk)
+		offset = int(entry["offset"])
+		if entry["codec"] == CODEC_RAW:
+			values = np.frombuffer(self.data, np.float32, num_ticks * width, offset)
+		elif entry["codec"] == CODEC_LZ4:
+			import lz4.block
+			raw = lz4.block.decompress(self.data[offset:offset + int(entry["size"])], uncompressed_size=int(entry["raw_size"]))
+			values = np.frombuffer(raw, np.float32)
+		else:
+			raise ValueError("unknown codec %d" % entry["codec"])
+		return values.reshape(num_ticks, width)
+
+	def read(self, name, ticks=slice(None), pendulums=slice(None)):
+		"""Ticks by pendulums array of a slice, removed pendulums are NaN."""
+		tick_begin, tick_end, _ = ticks.indices(self.num_ticks)
+		begin, end, _ = pendulums.indices(self.num_pendulums)
+		first_time = tick_begin // self.ticks_per_chunk
+		last_time = (tick_end - 1) // self.ticks_per_chunk if tick_end > tick_begin else first_time
+		first_chunk = begin // self.pendulums_per_chunk
+		last_chunk = (end - 1) // self.pendulums_per_chunk if end > begin else first_chunk
+
+		def part(time_chunk, pendulum_chunk):
+			first_tick = int(self.time_chunks[time_chunk]["first_tick"])
+			chunk_begin = pendulum_chunk * self.pendulums_per_chunk
+			values = self.block(time_chunk, pendulum_chunk, name)
+			return values[max(tick_begin - first_tick, 0):tick_end - first_tick, max(begin - chunk_begin, 0):end - chunk_begin]
+
+		# a slice inside one block is a view of it
+		if first_time == last_time and first_chunk == last_chunk:
+			return part(first_time, first_chunk)
+		rows = [np.hstack([part(t, p) for p in range(first_chunk, last_chunk + 1)]) for t in range(first_time, last_time + 1)]
+		return np.vstack(rows)
+
+
+def main(argv):
+	if len(argv) < 2:
+		print("usage: field_series.py <file>")
+		return 1
+	series = FieldSeries(argv[1])
+	print("%d ticks of %d pendulums, %.4f s per tick, columns %s" % (series.num_ticks, series.num_pendulums, series.tick_step,
+		", ".join(series.columns)))
+	codecs = series.blocks["codec"]
+	print("%d time chunks of %d ticks, %d pendulum chunks, %d raw and %d lz4 blocks" % (series.blocks.shape[0],
+		series.ticks_per_chunk, series.num_pendulum_chunks, np.count_nonzero(codecs == CODEC_RAW), np.count_nonzero(codecs == CODEC_LZ4)))
+	for name in series.columns:
+		begin = time.perf_counter()
+		values = series.read(name)
+		elapsed = time.perf_counter() - begin
+		print("  %s: read %.1f MB in %.3f s (%.0f MB/s), range [%g, %g]" % (name, values.nbytes / 1048576.0, elapsed,
+			values.nbytes / 1048576.0 / max(elapsed, 1e-9), np.nanmin(values), np.nanmax(values)))
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main(sys.argv))
@@ -0,0 +1,160 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "field_state_reader.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static size_t align(size_t size)
+{
+	return (size + FIELD_STATE_ALIGNMENT - 1) & ~(size_t)(FIELD_STATE_ALIGNMENT - 1);
+}
+
+static int is_live(const FieldStateHeader *header)
+{
+	return __atomic_load_n((const volatile uint32_t *)&header->magic, __ATOMIC_ACQUIRE) == FIELD_STATE_MAGIC;
+}
+
+int field_state_open(FieldStateReader *reader, const char *name)
+{
+	memset(reader, 0, sizeof(*reader));
+	reader->fd = shm_open(name, O_RDONLY, 0);
+	if (reader->fd == -1)
+		return -1;
+
+	struct stat st;
+	void *ptr = MAP_FAILED;
+	if (fstat(reader->fd, &st) == 0 && (size_t)st.st_size >= sizeof(FieldStateHeader))
+		ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+	if (ptr == MAP_FAILED)
+	{
+		field_state_close(reader);
+		return -1;
+	}
+	reader->header = (const FieldStateHeader *)ptr;
+	reader->size = (size_t)st.st_size;
+
+	// the layout is checked once, the publisher never changes it while the magic is set
+	const FieldStateHeader *header = reader->header;
+	if (!is_live(header) || header->version != FIELD_STATE_VERSION || header->num_frames == 0 || header->num_columns == 0
+		|| header->num_columns > FIELD_STATE_MAX_COLUMNS
+		|| header->frame_size < align(sizeof(FieldStateFrame)) + align(sizeof(float) * header->capacity) * header->num_columns
+		|| (size_t)header->header_size + (size_t)header->frame_size * header->num_frames > reader->size)
+	{
+		field_state_close(reader);
+		return -1;
+	}
+	reader->frames = (const unsigned char *)ptr + header->header_size;
+	return 0;
+}
+
+void field_state_close(FieldStateReader *reader)
+{
+	if (reader->header)
+		munmap((void *)reader->header, reader->size);
+	if (reader->fd != -1)
+		close(reader->fd);
+	memset(reader, 0, sizeof(*reader));
+	reader->fd = -1;
+}
+
+long long field_state_num_published(const FieldStateReader *reader)
+{
+	return __atomic_load_n(&reader->header->num_published, __ATOMIC_ACQUIRE);
+}
+
+int field_state_find_column(const FieldStateReader *reader, int array)
+{
+	for (uint32_t i = 0; i < reader->header->num_columns; i++)
+		if (reader->header->columns[i] == array)
+			return (int)i;
+	return -1;
+}
+
+int field_state_read(FieldStateReader *reader, long long frame, const int *columns, int num_columns, int begin, int end, float *dest,
+	FieldStateInfo *info)
+{
+	const FieldStateHeader *header = reader->header;
+	if (begin < 0 || end > (int)header->capacity || begin > end)
+		return FIELD_STATE_BAD_ARGUMENT;
+	for (int i = 0; i < num_columns; i++)
+		if (columns[i] < 0 || columns[i] >= (int)header->num_columns)
+			return FIELD_STATE_BAD_ARGUMENT;
+	if (!is_live(header))
+		return FIELD_STATE_CLOSED;
+	long long num_published = field_state_num_published(reader);
+	if (frame < 0 || frame >= num_published)
+		return FIELD_STATE_BAD_ARGUMENT;
+	if (frame < num_published - header->num_frames)
+		return FIELD_STATE_OVERWRITTEN;
+
+	const unsigned char *slot = reader->frames + (size_t)(frame % header->num_frames) * header->frame_size;
+	const FieldStateFrame *f = (const FieldStateFrame *)slot;
+	const float *data = (const float *)(slot + align(sizeof(FieldStateFrame)));
+	size_t column_size = align(sizeof(float) * header->capacity) / sizeof(float);
+
+	int sequence = __atomic_load_n(&f->sequence, __ATOMIC_ACQUIRE);
+	if (sequence & 1)
+	{
+		reader->num_retries++;
+		return FIELD_STATE_BUSY;
+	}
+
+	FieldStateInfo copy;
+	copy.frame = f->frame;
+	copy.tick = f->tick;
+	copy.time = f->time;
+	copy.publish_time = f->publish_time;
+	copy.num_pendulums = (int)f->num_pendulums;
+	for (int i = 0; i < 3; i++)
+		copy.origin[i] = f->origin[i];
+	size_t width = (size_t)(end - begin);
+	for (int i = 0; i < num_columns; i++)
+		memcpy(dest + width * i, data + column_size * columns[i] + begin, sizeof(float) * width);
+
+	// the copy is kept only if no write started while it was taken
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&f->sequence, __ATOMIC_RELAXED) != sequence)
+	{
+		reader->num_retries++;
+		return FIELD_STATE_BUSY;
+	}
+	if (copy.frame != (unsigned long long)frame)
+	{
+		reader->num_retries++;
+		return FIELD_STATE_OVERWRITTEN;
+	}
+	if (info)
+		*info = copy;
+	return FIELD_STATE_OK;
+}
+
+long long field_state_read_latest(FieldStateReader *reader, const int *columns, int num_columns, int begin, int end, float *dest,
+	FieldStateInfo *info)
+{
+	for (;;)
+	{
+		if (!is_live(reader->header))
+			return FIELD_STATE_CLOSED;
+		long long frame = field_state_num_published(reader) - 1;
+		if (frame < 0)
+			return FIELD_STATE_EMPTY;
+		// a frame that went away while it was copied has a newer one behind it
+		int ret = field_state_read(reader, frame, columns, num_columns, begin, end, dest, info);
+		if (ret == FIELD_STATE_OK)
+			return frame;
+		if (ret < 0)
+			return ret;
+	}
+}
+
+long long field_state_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,82 @@
+#ifndef __FIELD_STATE_READER_H__
+#define __FIELD_STATE_READER_H__
+
+// Reader of the live field state that FieldPublisher (source/FieldPublisher.h) publishes to POSIX shared memory.
+// The memory is mapped read-only and the reader never holds anything the simulation waits on: a frame is copied
+// between two loads of its sequence and the copy is thrown away when the publisher touched the frame meanwhile.
+//
+//     FieldStateReader reader;
+//     if (field_state_open(&reader, "/pendulum_field") == 0)
+//     {
+//         int columns[1] = { field_state_find_column(&reader, 6) }; // the angle
+//         FieldStateInfo info;
+//         long long frame = field_state_read_latest(&reader, columns, 1, 0, reader.header->capacity, theta, &info);
+//         field_state_close(&reader);
+//     }
+
+#include "FieldStateLayout.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+	FIELD_STATE_OK = 0,
+	// the publisher was writing the frame, or it has been replaced by a newer one
+	FIELD_STATE_BUSY = 1,
+	FIELD_STATE_OVERWRITTEN = 2,
+	// nothing has been published yet
+	FIELD_STATE_EMPTY = -1,
+	// the publisher closed the memory, open the name again to follow a new one
+	FIELD_STATE_CLOSED = -2,
+	FIELD_STATE_BAD_ARGUMENT = -3,
+};
+
+typedef struct FieldStateReader
+{
+	const FieldStateHeader *header;
+	const unsigned char *frames;
+	size_t size;
+	int fd;
+	// copies thrown away because the publisher raced them
+	unsigned long long num_retries;
+} FieldStateReader;
+
+typedef struct FieldStateInfo
+{
+	unsigned long long frame;
+	unsigned long long tick;
+	double time;
+	long long publish_time;
+	int num_pendulums;
+	// field origin the published pivots and bobs are relative to
+	double origin[3];
+} FieldStateInfo;
+
+// maps the memory of the name, 0 on success and -1 when there is no valid publisher behind it
+int field_state_open(FieldStateReader *reader, const char *name);
+void field_state_close(FieldStateReader *reader);
+
+// number of frames published so far, the newest one is that minus one
+long long field_state_num_published(const FieldStateReader *reader);
+// index of the column publishing a PendulumField::ARRAY, -1 if it is not published
+int field_state_find_column(const FieldStateReader *reader, int array);
+
+// copies pendulums [begin, end) of the columns of a frame into consecutive runs of end - begin floats
+int field_state_read(FieldStateReader *reader, long long frame, const int *columns, int num_columns, int begin, int end, float *dest,
+	FieldStateInfo *info);
+// copies the newest frame that could be read consistently, returns its index or one of the negative codes
+long long field_state_read_latest(FieldStateReader *reader, const int *columns, int num_columns, int begin, int end, float *dest,
+	FieldStateInfo *info);
+
+// monotonic clock in nanoseconds the publish times are taken with
+long long field_state_clock(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __FIELD_STATE_READER_H__
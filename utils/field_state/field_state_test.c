@@ -0,0 +1,300 @@
+// Latency and throughput test of the shared-memory field state, run as a process apart from the publisher.
+//
+//     field_state_test [--name /pendulum_field] [--seconds 10]
+//         follows a running simulation started with pendulum_publish 1
+//     field_state_test --self [--pendulums 65536] [--frames 8] [--rate 1000] [--seconds 10]
+//         forks a synthetic publisher that writes frames the way FieldPublisher does, every value and the origin of
+//         a frame derived from its index, so a torn copy is caught
+//
+// The reader polls for new frames and copies every column of the newest one. The latency of a frame is the time
+// from the end of its publish to the end of its copy.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "field_state_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_SAMPLES (1 << 22)
+
+typedef struct Options
+{
+	const char *name;
+	double seconds;
+	int self;
+	int pendulums;
+	int frames;
+	double rate;
+} Options;
+
+static size_t align(size_t size)
+{
+	return (size + FIELD_STATE_ALIGNMENT - 1) & ~(size_t)(FIELD_STATE_ALIGNMENT - 1);
+}
+
+static float frame_value(unsigned long long frame, int column)
+{
+	return (float)(frame % 65536) + 0.5f * (float)column;
+}
+
+// the synthetic field rebases by 1024 every 16 frames
+static double frame_origin(unsigned long long frame, int axis)
+{
+	return (axis == 0) ? (double)(frame / 16) * 1024.0 : -4096.0 * axis;
+}
+
+// synthetic publisher of the child process, the sequence protocol of FieldPublisher::publish()
+static int run_writer(const Options *options)
+{
+	int num_columns = 2;
+	size_t column_size = align(sizeof(float) * options->pendulums);
+	size_t header_size = align(sizeof(FieldStateHeader));
+	size_t frame_size = align(sizeof(FieldStateFrame)) + column_size * num_columns;
+	size_t size = header_size + frame_size * options->frames;
+
+	shm_unlink(options->name);
+	int fd = shm_open(options->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd == -1 || ftruncate(fd, (off_t)size) != 0)
+	{
+		fprintf(stderr, "writer: can't create \"%s\": %s\n", options->name, strerror(errno));
+		return 1;
+	}
+	unsigned char *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (memory == MAP_FAILED)
+	{
+		fprintf(stderr, "writer: can't map \"%s\": %s\n", options->name, strerror(errno));
+		return 1;
+	}
+
+	FieldStateHeader *header = (FieldStateHeader *)memory;
+	header->version = FIELD_STATE_VERSION;
+	header->header_size = (uint32_t)header_size;
+	header->frame_size = (uint32_t)frame_size;
+	header->num_frames = (uint32_t)options->frames;
+	header->capacity = (uint32_t)options->pendulums;
+	header->num_columns = (uint32_t)num_columns;
+	header->columns[0] = 6;
+	header->columns[1] = 7;
+	header->writer_pid = (uint32_t)getpid();
+	header->tick_step = (options->rate > 0.0) ? (float)(1.0 / options->rate) : 0.0f;
+	__atomic_store_n(&header->magic, FIELD_STATE_MAGIC, __ATOMIC_RELEASE);
+
+	long long period = (options->rate > 0.0) ? (long long)(1e9 / options->rate) : 0;
+	long long start = field_state_clock();
+	long long end = start + (long long)((options->seconds + 0.5) * 1e9);
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	for (unsigned long long index = 0; field_state_clock() < end; index++)
+	{
+		FieldStateFrame *frame = (FieldStateFrame *)(memory + header_size + (index % options->frames) * frame_size);
+		float *data = (float *)((unsigned char *)frame + align(sizeof(FieldStateFrame)));
+
+		__atomic_fetch_add(&frame->sequence, 1, __ATOMIC_SEQ_CST);
+		for (int column = 0; column < num_columns; column++)
+		{
+			float value = frame_value(index, column);
+			float *dest = data + column_size / sizeof(float) * column;
+			for (int i = 0; i < options->pendulums; i++)
+				dest[i] = value;
+		}
+		frame->num_pendulums = (uint32_t)options->pendulums;
+		frame->frame = index;
+		frame->tick = index;
+		frame->time = (double)(field_state_clock() - start) * 1e-9;
+		frame->publish_time = field_state_clock();
+		for (int axis = 0; axis < 3; axis++)
+			frame->origin[axis] = frame_origin(index, axis);
+		__atomic_store_n(&frame->sequence, frame->sequence + 1, __ATOMIC_RELEASE);
+		__atomic_store_n(&header->num_published, (long long)index + 1, __ATOMIC_RELEASE);
+
+		if (period > 0)
+		{
+			deadline.tv_nsec += period;
+			while (deadline.tv_nsec >= 1000000000L)
+			{
+				deadline.tv_nsec -= 1000000000L;
+				deadline.tv_sec++;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+		}
+	}
+
+	__atomic_store_n(&header->magic, 0, __ATOMIC_RELEASE);
+	munmap(memory, size);
+	close(fd);
+	shm_unlink(options->name);
+	return 0;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	long long x = *(const long long *)a;
+	long long y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+static int run_reader(const Options *options)
+{
+	// the publisher may still be setting the memory up
+	FieldStateReader reader;
+	long long wait_end = field_state_clock() + 5000000000LL;
+	while (field_state_open(&reader, options->name) != 0)
+	{
+		if (field_state_clock() > wait_end)
+		{
+			fprintf(stderr, "reader: no field state published to \"%s\"\n", options->name);
+			return 1;
+		}
+		struct timespec ts = { 0, 1000000 };
+		nanosleep(&ts, NULL);
+	}
+
+	const FieldStateHeader *header = reader.header;
+	int num_columns = (int)header->num_columns;
+	int capacity = (int)header->capacity;
+	int columns[FIELD_STATE_MAX_COLUMNS];
+	for (int i = 0; i < num_columns; i++)
+		columns[i] = i;
+	float *values = malloc(sizeof(float) * (size_t)capacity * num_columns);
+	long long *latencies = malloc(sizeof(long long) * MAX_SAMPLES);
+	if (!values || !latencies)
+	{
+		fprintf(stderr, "reader: out of memory\n");
+		return 1;
+	}
+	printf("reading \"%s\" of publisher %u: %d pendulums, %d columns, %u frames of %.1f KB\n", options->name, header->writer_pid,
+		capacity, num_columns, header->num_frames, header->frame_size / 1024.0);
+
+	long long num_samples = 0;
+	long long num_skipped = 0;
+	long long num_torn = 0;
+	long long last = -1;
+	int closed = 0;
+	long long start = field_state_clock();
+	long long end = start + (long long)(options->seconds * 1e9);
+	while (field_state_clock() < end)
+	{
+		long long published = field_state_num_published(&reader);
+		if (published - 1 == last || published == 0)
+		{
+			if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != FIELD_STATE_MAGIC)
+			{
+				closed = 1;
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+
+		FieldStateInfo info;
+		long long frame = field_state_read_latest(&reader, columns, num_columns, 0, capacity, values, &info);
+		long long now = field_state_clock();
+		if (frame == FIELD_STATE_CLOSED)
+		{
+			closed = 1;
+			break;
+		}
+		if (frame < 0)
+			continue;
+
+		if (num_samples < MAX_SAMPLES)
+			latencies[num_samples] = now - info.publish_time;
+		num_samples++;
+		if (last >= 0)
+			num_skipped += frame - last - 1;
+		last = frame;
+
+		if (options->self)
+		{
+			int torn = 0;
+			for (int axis = 0; axis < 3; axis++)
+				torn |= info.origin[axis] != frame_origin(info.frame, axis);
+			for (int column = 0; column < num_columns && !torn; column++)
+			{
+				float expected = frame_value(info.frame, column);
+				const float *src = values + (size_t)capacity * column;
+				int i = 0;
+				while (i < capacity && src[i] == expected)
+					i++;
+				torn = i < capacity;
+			}
+			num_torn += torn;
+		}
+	}
+	double elapsed = (double)(field_state_clock() - start) * 1e-9;
+
+	long long count = (num_samples < MAX_SAMPLES) ? num_samples : MAX_SAMPLES;
+	qsort(latencies, (size_t)count, sizeof(long long), compare_latency);
+	double bytes = (double)num_samples * sizeof(float) * capacity * num_columns;
+	printf("%lld frames read in %.2f s (%.0f frames/s, %.1f MB/s), %lld skipped, %llu retries, %lld torn%s\n", num_samples, elapsed,
+		num_samples / elapsed, bytes / elapsed / 1048576.0, num_skipped, reader.num_retries, num_torn,
+		closed ? ", the publisher closed" : "");
+	if (count > 0)
+		printf("latency us: min %.1f, p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n", latencies[0] * 1e-3, latencies[count / 2] * 1e-3,
+			latencies[count * 99 / 100] * 1e-3, latencies[count * 999 / 1000] * 1e-3, latencies[count - 1] * 1e-3);
+
+	free(values);
+	free(latencies);
+	field_state_close(&reader);
+	return (num_torn > 0) ? 2 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	Options options = { "/pendulum_field", 10.0, 0, 65536, 8, 1000.0 };
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--self") == 0)
+			options.self = 1;
+		else if (strcmp(argv[i], "--name") == 0 && i + 1 < argc)
+			options.name = argv[++i];
+		else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+			options.seconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "--pendulums") == 0 && i + 1 < argc)
+			options.pendulums = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			options.frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+			options.rate = atof(argv[++i]);
+		else
+		{
+			fprintf(stderr, "usage: %s [--self] [--name name] [--seconds s] [--pendulums n] [--frames n] [--rate hz]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (options.pendulums < 1 || options.frames < 2 || options.seconds <= 0.0)
+	{
+		fprintf(stderr, "bad options\n");
+		return 1;
+	}
+	if (!options.self)
+		return run_reader(&options);
+
+	// the synthetic publisher gets a name of its own unless one was given
+	if (strcmp(options.name, "/pendulum_field") == 0)
+		options.name = "/field_state_test";
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		fprintf(stderr, "can't fork the publisher: %s\n", strerror(errno));
+		return 1;
+	}
+	if (pid == 0)
+		return run_writer(&options);
+
+	int ret = run_reader(&options);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		ret = (ret != 0) ? ret : 1;
+	return ret;
+}